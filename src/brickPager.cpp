@@ -0,0 +1,608 @@
+/*********************************************************************************************************************
+ *
+ * brickPager.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+
+#include "brickPager.h"
+#include "utils.h"
+
+
+namespace
+{
+
+    // OpenGL formats of the atlas, same as the 3D texture of a volume of the same type (see TexFormat)
+    void atlasFormat(VVolFile::DataType _dataType, GLint* _internalFormat, GLenum* _type)
+    {
+        switch (_dataType)
+        {
+            case VVolFile::TYPE_UINT16: *_internalFormat = TexFormat<std::uint16_t>::internalFormat; *_type = TexFormat<std::uint16_t>::type; break;
+            case VVolFile::TYPE_INT16:  *_internalFormat = TexFormat<std::int16_t>::internalFormat;  *_type = TexFormat<std::int16_t>::type; break;
+            case VVolFile::TYPE_FLOAT32:*_internalFormat = TexFormat<float>::internalFormat;         *_type = TexFormat<float>::type; break;
+            default:                    *_internalFormat = TexFormat<std::uint8_t>::internalFormat;  *_type = TexFormat<std::uint8_t>::type; break;
+        }
+    }
+
+    // Write a value (native units) as a voxel of a given type
+    void storeValue(float _value, VVolFile::DataType _dataType, std::uint8_t* _dst)
+    {
+        switch (_dataType)
+        {
+            case VVolFile::TYPE_UINT16: { std::uint16_t v = std::uint16_t(_value); std::memcpy(_dst, &v, sizeof(v)); break; }
+            case VVolFile::TYPE_INT16:  { std::int16_t v = std::int16_t(_value);   std::memcpy(_dst, &v, sizeof(v)); break; }
+            case VVolFile::TYPE_FLOAT32:{ std::memcpy(_dst, &_value, sizeof(_value)); break; }
+            default:                    { *_dst = std::uint8_t(_value); break; }
+        }
+    }
+
+    // Name of the .vvol file a volume file (or DICOM folder) is converted into
+    std::string convertedFileName(std::string _fileName)
+    {
+        while (!_fileName.empty() && (_fileName.back() == '/' || _fileName.back() == '\\'))
+            _fileName.pop_back();
+        if (_fileName.size() > 7 && _fileName.compare(_fileName.size() - 7, 7, ".nii.gz") == 0)
+            _fileName.resize(_fileName.size() - 3);
+        size_t dot = _fileName.find_last_of('.');
+        size_t separator = _fileName.find_last_of("/\\");
+        if (dot != std::string::npos && (separator == std::string::npos || dot > separator + 1))
+            _fileName.resize(dot);
+        return _fileName + ".vvol";
+    }
+
+} // anonymous namespace
+
+
+
+void BrickPager::open(const std::string& _fileName, size_t _hostBudget, size_t _atlasBudget)
+{
+    close();
+
+    m_fileName = _fileName;
+    m_hostBudget = _hostBudget;
+    m_atlasBudget = _atlasBudget;
+    m_stop = false;
+    m_state = PAGER_OPENING;
+    m_thread = std::thread(&BrickPager::run, this);
+}
+
+
+void BrickPager::close()
+{
+    stopPaging();
+
+    if (m_atlasTex != 0)
+        glDeleteTextures(1, &m_atlasTex);
+    if (m_pageTableTex != 0)
+        glDeleteTextures(1, &m_pageTableTex);
+    m_atlasTex = 0;
+    m_pageTableTex = 0;
+
+    m_vvol = VVolFile();
+    m_brickStates.clear();
+    m_requests.clear();
+    m_nextRequest = 0;
+    m_ready.clear();
+    m_hostPool.clear();
+    m_hostLRU.clear();
+    m_hostMemory = 0;
+    m_volume.reset();
+    m_slots.clear();
+    m_brickSlots.clear();
+    m_brickNeeded.clear();
+    m_needed.clear();
+    m_nbResident = 0;
+    m_frame = 0;
+    m_state = PAGER_IDLE;
+}
+
+
+bool BrickPager::update(glm::vec2 _window, glm::ivec3 _slices, bool _volumeRendering, glm::vec3 _eye, double _uploadBudget)
+{
+    PagerState state = m_state;
+    if (state == PAGER_FAILED)
+    {
+        close();
+        return false;
+    }
+    if (state != PAGER_READY)
+        return false;
+
+    bool created = false;
+    if (m_atlasTex == 0)
+    {
+        if (!createTextures())
+        {
+            close();
+            return false;
+        }
+        created = true;
+    }
+    m_frame++;
+
+    // list needed bricks again when the view changed (the camera moved by a significant part of a brick)
+    glm::ivec3 dims = m_vvol.getDimensions();
+    float eyeTolerance = 0.5f * float(m_vvol.getBrickSize()) / float(std::max(dims.x, std::max(dims.y, dims.z)));
+    bool changed = created || _window != m_lastWindow || _slices != m_lastSlices || _volumeRendering != m_lastVolumeRendering
+                   || (_volumeRendering && glm::length(_eye - m_lastEye) > eyeTolerance);
+    if (changed)
+    {
+        listNeededBricks(_window, _slices, _volumeRendering, _eye);
+        m_lastWindow = _window;
+        m_lastSlices = _slices;
+        m_lastVolumeRendering = _volumeRendering;
+        m_lastEye = _eye;
+    }
+
+    // needed bricks are kept in the atlas, the others can be evicted
+    std::vector<int> requests;
+    m_nbResident = 0;
+    for (int id : m_needed)
+    {
+        m_brickNeeded[id] = m_frame;
+        if (m_brickSlots[id] >= 0)
+        {
+            m_slots[m_brickSlots[id]].lastUsed = m_frame;
+            m_nbResident++;
+        }
+        else if (changed)
+            requests.push_back(id);
+    }
+    if (changed)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_requests.swap(requests);
+            m_nextRequest = 0;
+        }
+        m_wakeUp.notify_one();
+    }
+
+    // upload bricks decoded by the paging thread, within the budget
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double, std::milli>(_uploadBudget));
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        ReadyBrick brick;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_ready.empty())
+                break;
+            brick = std::move(m_ready.front());
+            m_ready.pop_front();
+        }
+        m_wakeUp.notify_one();
+
+        // brick no longer needed (the view changed meanwhile): dropped, it is still in the host pool
+        bool uploaded = (m_brickNeeded[brick.id] == m_frame) && uploadBrick(brick);
+        if (uploaded)
+            m_nbResident++;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_brickStates[brick.id] = uploaded ? BRICK_RESIDENT : BRICK_ABSENT;
+    }
+
+    return created;
+}
+
+
+void BrickPager::setNearest(bool _useNearest)
+{
+    m_useNearest = _useNearest;
+    if (m_atlasTex == 0)
+        return;
+
+    GLint param = _useNearest ? GL_NEAREST : GL_LINEAR;
+    glBindTexture(GL_TEXTURE_3D, m_atlasTex);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, param);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, param);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+
+bool BrickPager::createTextures()
+{
+    glm::ivec3 nbBricks = m_vvol.getNbBricks();
+    size_t nbBricksTotal = size_t(nbBricks.x) * size_t(nbBricks.y) * size_t(nbBricks.z);
+
+    m_volume = std::make_shared<VolumeImg>();
+    if (!m_volume->volumeInitHeader(m_vvol.getDatatype(), m_vvol.getDimensions(), m_vvol.getOrigin(), m_vvol.getSpacing(), m_vvol.getValueRange()))
+        return false;
+
+    // atlas: as many slots as the budget allows (at most one per brick), within the max size of a 3D texture
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+    int maxSlotsPerAxis = std::max(1, int(maxSize) / m_slotSize);
+    size_t slotBytes = size_t(m_slotSize) * size_t(m_slotSize) * size_t(m_slotSize) * m_voxelSize;
+    size_t nbSlots = std::max(size_t(1), std::min(m_atlasBudget / slotBytes, nbBricksTotal));
+    int side = std::max(1, std::min(maxSlotsPerAxis, int(std::cbrt(double(nbSlots)))));
+    m_nbSlots = glm::ivec3(side, side, std::max(1, std::min(maxSlotsPerAxis, int(nbSlots / (size_t(side) * size_t(side))))));
+    m_slots.assign(size_t(m_nbSlots.x) * size_t(m_nbSlots.y) * size_t(m_nbSlots.z), Slot());
+
+    GLint internalFormat;
+    GLenum type;
+    atlasFormat(m_vvol.getDataType(), &internalFormat, &type);
+    GLint param = m_useNearest ? GL_NEAREST : GL_LINEAR;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenTextures(1, &m_atlasTex);
+    glBindTexture(GL_TEXTURE_3D, m_atlasTex);
+    glTexImage3D(GL_TEXTURE_3D, 0, internalFormat, m_nbSlots.x * m_slotSize, m_nbSlots.y * m_slotSize, m_nbSlots.z * m_slotSize, 0, GL_RED, type, nullptr);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, param);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, param);
+
+    // page table: no brick resident (integer texture, fetched without filtering)
+    std::vector<std::uint16_t> entries(nbBricksTotal * 4, 0);
+    glGenTextures(1, &m_pageTableTex);
+    glBindTexture(GL_TEXTURE_3D, m_pageTableTex);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16UI, nbBricks.x, nbBricks.y, nbBricks.z, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, entries.data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    // e.g. atlas too large for GPU memory
+    GLenum glError = glGetError();
+    if (glError != GL_NO_ERROR)
+    {
+        errorLog() << "BrickPager::createTextures(): could not create textures (GL error " << glError << ")";
+        return false;
+    }
+
+    m_brickSlots.assign(nbBricksTotal, -1);
+    m_brickNeeded.assign(nbBricksTotal, 0);
+    m_needed.clear();
+
+    std::cout << "[INFO] BrickPager::createTextures(): " << nbBricksTotal << " bricks, atlas of " << m_slots.size() << " slots ("
+              << m_slots.size() * slotBytes / (1024 * 1024) << " MB)" << std::endl;
+    return true;
+}
+
+
+void BrickPager::listNeededBricks(glm::vec2 _window, glm::ivec3 _slices, bool _volumeRendering, glm::vec3 _eye)
+{
+    const std::vector<VVolFile::BrickInfo>& infos = m_vvol.getBrickInfos();
+    glm::ivec3 nbBricks = m_vvol.getNbBricks();
+    glm::ivec3 dims = m_vvol.getDimensions();
+    int brickSize = m_vvol.getBrickSize();
+
+    m_needed.clear();
+    std::vector<bool> listed(infos.size(), false);
+    auto add = [&](int _id)
+    {
+        // bricks below the window render as empty, like bricks not resident
+        if (!listed[_id] && infos[_id].maxVal >= _window.x)
+        {
+            listed[_id] = true;
+            m_needed.push_back(_id);
+        }
+    };
+
+    // bricks crossed by the displayed slices
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (_slices[axis] < 0 || _slices[axis] >= dims[axis])
+            continue;
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        glm::ivec3 brick;
+        brick[axis] = _slices[axis] / brickSize;
+        for (brick[v] = 0; brick[v] < nbBricks[v]; brick[v]++)
+            for (brick[u] = 0; brick[u] < nbBricks[u]; brick[u]++)
+                add(brick.x + nbBricks.x * (brick.y + nbBricks.y * brick.z));
+    }
+
+    // volume rendering: other bricks from the nearest to the camera, as long as there are slots for them
+    size_t room = (m_slots.size() > m_needed.size()) ? m_slots.size() - m_needed.size() : 0;
+    if (_volumeRendering && room > 0)
+    {
+        std::vector<std::pair<float, int>> candidates;
+        glm::vec3 halfBrick = glm::vec3(0.5f * float(brickSize));
+        for (int id = 0; id < int(infos.size()); id++)
+        {
+            if (listed[id] || infos[id].maxVal < _window.x)
+                continue;
+            glm::ivec3 brick(id % nbBricks.x, (id / nbBricks.x) % nbBricks.y, id / (nbBricks.x * nbBricks.y));
+            glm::vec3 center = (glm::vec3(brick * brickSize) + halfBrick) / glm::vec3(dims);
+            glm::vec3 d = center - _eye;
+            candidates.emplace_back(glm::dot(d, d), id);
+        }
+        if (candidates.size() > room)
+        {
+            std::nth_element(candidates.begin(), candidates.begin() + room, candidates.end());
+            candidates.resize(room);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        for (const auto& candidate : candidates)
+            add(candidate.second);
+    }
+
+    if (m_needed.size() > m_slots.size())
+        m_needed.resize(m_slots.size());
+}
+
+
+bool BrickPager::uploadBrick(const ReadyBrick& _brick)
+{
+    // free slot, or slot of the least recently used brick not needed by the current view
+    int slot = -1;
+    for (int s = 0; s < int(m_slots.size()); s++)
+    {
+        if (m_slots[s].brick < 0)
+        {
+            slot = s;
+            break;
+        }
+        if (m_slots[s].lastUsed < m_frame && (slot < 0 || m_slots[s].lastUsed < m_slots[slot].lastUsed))
+            slot = s;
+    }
+    if (slot < 0)
+        return false;
+
+    int evicted = m_slots[slot].brick;
+    if (evicted >= 0)
+    {
+        m_brickSlots[evicted] = -1;
+        setPageEntry(evicted, -1);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_brickStates[evicted] = BRICK_ABSENT;
+    }
+
+    GLint internalFormat;
+    GLenum type;
+    atlasFormat(m_vvol.getDataType(), &internalFormat, &type);
+    glm::ivec3 slotCoords(slot % m_nbSlots.x, (slot / m_nbSlots.x) % m_nbSlots.y, slot / (m_nbSlots.x * m_nbSlots.y));
+    glm::ivec3 offset = slotCoords * m_slotSize;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_3D, m_atlasTex);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, offset.x, offset.y, offset.z, m_slotSize, m_slotSize, m_slotSize, GL_RED, type, _brick.voxels.data());
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    m_slots[slot].brick = _brick.id;
+    m_slots[slot].lastUsed = m_frame;
+    m_brickSlots[_brick.id] = slot;
+    setPageEntry(_brick.id, slot);
+    return true;
+}
+
+
+void BrickPager::setPageEntry(int _id, int _slot)
+{
+    glm::ivec3 nbBricks = m_vvol.getNbBricks();
+    glm::ivec3 brick(_id % nbBricks.x, (_id / nbBricks.x) % nbBricks.y, _id / (nbBricks.x * nbBricks.y));
+
+    std::uint16_t entry[4] = { 0, 0, 0, 0 };
+    if (_slot >= 0)
+    {
+        entry[0] = std::uint16_t(_slot % m_nbSlots.x);
+        entry[1] = std::uint16_t((_slot / m_nbSlots.x) % m_nbSlots.y);
+        entry[2] = std::uint16_t(_slot / (m_nbSlots.x * m_nbSlots.y));
+        entry[3] = 1;
+    }
+
+    glBindTexture(GL_TEXTURE_3D, m_pageTableTex);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, brick.x, brick.y, brick.z, 1, 1, 1, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, entry);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+
+void BrickPager::stopPaging()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeUp.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+
+void BrickPager::run()
+{
+    if (!openFile())
+    {
+        m_state = PAGER_FAILED;
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_brickStates.assign(m_vvol.getBrickInfos().size(), BRICK_ABSENT);
+    m_state = PAGER_READY;
+
+    while (!m_stop)
+    {
+        // first needed brick neither resident nor queued, if there is room for it
+        int id = -1;
+        if (m_ready.size() < MAX_READY_BRICKS)
+        {
+            while (m_nextRequest < m_requests.size() && id < 0)
+            {
+                int candidate = m_requests[m_nextRequest++];
+                if (m_brickStates[candidate] == BRICK_ABSENT)
+                    id = candidate;
+            }
+        }
+        if (id < 0)
+        {
+            m_wakeUp.wait(lock);
+            continue;
+        }
+        m_brickStates[id] = BRICK_QUEUED;
+
+        // decode without holding the lock (the render thread keeps going)
+        lock.unlock();
+        ReadyBrick brick;
+        brick.id = id;
+        bool built = buildSlot(id, &brick.voxels);
+        lock.lock();
+
+        if (built)
+            m_ready.push_back(std::move(brick));
+        else
+            m_brickStates[id] = BRICK_FAILED;
+    }
+}
+
+
+bool BrickPager::openFile()
+{
+    std::string fileName = m_fileName;
+    std::string extension = std::filesystem::path(fileName).extension().string();
+    if (extension != ".vvol")
+    {
+        // convert the volume, unless it was already converted
+        std::string converted = convertedFileName(fileName);
+        std::error_code error;
+        bool upToDate = std::filesystem::exists(converted, error)
+                        && std::filesystem::last_write_time(converted, error) >= std::filesystem::last_write_time(fileName, error);
+        if (!upToDate)
+        {
+            std::cout << "[INFO] BrickPager::openFile(): convert " << fileName << " into " << converted << std::endl;
+
+            // data are mapped, not read: conversion goes through them one layer of bricks at a time, byte swapped
+            // (if needed) brick by brick, and stops as soon as paging is stopped
+            auto stopped = [this]()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_stop;
+            };
+            VolumeImg volume;
+            if (!volume.volumeLoad(fileName, true, stopped))
+                return false;
+            if (!volume.volumeSaveVVol(converted, stopped))
+                return false;
+        }
+        fileName = converted;
+    }
+
+    if (!m_vvol.open(fileName))
+    {
+        errorLog() << "BrickPager::openFile(): could not open " << fileName;
+        return false;
+    }
+
+    switch (m_vvol.getDataType())
+    {
+        case VVolFile::TYPE_UINT8:   m_voxelSize = 1; break;
+        case VVolFile::TYPE_FLOAT32: m_voxelSize = 4; break;
+        default:                     m_voxelSize = 2; break;
+    }
+    m_slotSize = m_vvol.getBrickSize() + 2;
+
+    glm::ivec3 dims = m_vvol.getDimensions();
+    std::cout << "[INFO] BrickPager::openFile(): " << fileName << ": " << dims.x << " x " << dims.y << " x " << dims.z << " voxels ("
+              << size_t(dims.x) * size_t(dims.y) * size_t(dims.z) * m_voxelSize / (1024 * 1024) << " MB), "
+              << m_vvol.getBrickInfos().size() << " bricks" << std::endl;
+    return true;
+}
+
+
+const std::uint8_t* BrickPager::hostBrick(int _id)
+{
+    auto it = m_hostPool.find(_id);
+    if (it != m_hostPool.end())
+    {
+        m_hostLRU.splice(m_hostLRU.begin(), m_hostLRU, it->second.lru);
+        return it->second.voxels.data();
+    }
+
+    glm::ivec3 bMin, bSize;
+    m_vvol.brickBox(_id, &bMin, &bSize);
+    std::vector<std::uint8_t> voxels(size_t(bSize.x) * size_t(bSize.y) * size_t(bSize.z) * m_voxelSize);
+    if (!m_vvol.readBrick(_id, voxels.data()))
+        return nullptr;
+
+    // evict least recently used bricks beyond the budget (keeping at least the new one)
+    size_t size = voxels.size();
+    while (!m_hostLRU.empty() && m_hostMemory + size > m_hostBudget)
+    {
+        auto evicted = m_hostPool.find(m_hostLRU.back());
+        m_hostMemory -= evicted->second.voxels.size();
+        m_hostPool.erase(evicted);
+        m_hostLRU.pop_back();
+    }
+
+    m_hostLRU.push_front(_id);
+    HostBrick& brick = m_hostPool[_id];
+    brick.voxels = std::move(voxels);
+    brick.lru = m_hostLRU.begin();
+    m_hostMemory += size;
+    return brick.voxels.data();
+}
+
+
+bool BrickPager::buildSlot(int _id, std::vector<std::uint8_t>* _voxels)
+{
+    const std::vector<VVolFile::BrickInfo>& infos = m_vvol.getBrickInfos();
+    glm::ivec3 nbBricks = m_vvol.getNbBricks();
+    size_t slotSize = size_t(m_slotSize);
+    _voxels->assign(slotSize * slotSize * slotSize * m_voxelSize, 0);
+
+    // slot covers the brick and its apron
+    glm::ivec3 bMin, bSize;
+    m_vvol.brickBox(_id, &bMin, &bSize);
+    glm::ivec3 slotMin = bMin - glm::ivec3(1);
+    glm::ivec3 slotMax = slotMin + glm::ivec3(m_slotSize);
+    glm::ivec3 brick(_id % nbBricks.x, (_id / nbBricks.x) % nbBricks.y, _id / (nbBricks.x * nbBricks.y));
+
+    // copy the part of the brick and of its 26 neighbors inside the slot
+    for (int dz = -1; dz <= 1; dz++)
+    for (int dy = -1; dy <= 1; dy++)
+    for (int dx = -1; dx <= 1; dx++)
+    {
+        glm::ivec3 neighbor = brick + glm::ivec3(dx, dy, dz);
+        if (glm::any(glm::lessThan(neighbor, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(neighbor, nbBricks)))
+            continue; // outside the volume: 0
+
+        int id = neighbor.x + nbBricks.x * (neighbor.y + nbBricks.y * neighbor.z);
+        glm::ivec3 nMin, nSize;
+        m_vvol.brickBox(id, &nMin, &nSize);
+        glm::ivec3 lo = glm::max(slotMin, nMin);
+        glm::ivec3 hi = glm::min(slotMax, nMin + nSize);
+        if (glm::any(glm::greaterThanEqual(lo, hi)))
+            continue;
+
+        // uniform brick: filled without decoding
+        const std::uint8_t* src = nullptr;
+        std::uint8_t value[4] = { 0, 0, 0, 0 };
+        if (infos[id].minVal == infos[id].maxVal)
+            storeValue(infos[id].minVal, m_vvol.getDataType(), value);
+        else if ((src = hostBrick(id)) == nullptr)
+            return false;
+
+        size_t rowSize = size_t(hi.x - lo.x) * m_voxelSize;
+        for (int z = lo.z; z < hi.z; z++)
+        {
+            for (int y = lo.y; y < hi.y; y++)
+            {
+                std::uint8_t* dst = _voxels->data() + ((size_t(z - slotMin.z) * slotSize + size_t(y - slotMin.y)) * slotSize + size_t(lo.x - slotMin.x)) * m_voxelSize;
+                if (src != nullptr)
+                    std::memcpy(dst, src + ((size_t(z - nMin.z) * size_t(nSize.y) + size_t(y - nMin.y)) * size_t(nSize.x) + size_t(lo.x - nMin.x)) * m_voxelSize, rowSize);
+                else
+                {
+                    for (size_t x = 0; x < rowSize; x += m_voxelSize)
+                        std::memcpy(dst + x, value, m_voxelSize);
+                }
+            }
+        }
+    }
+
+    return true;
+}
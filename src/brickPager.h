@@ -0,0 +1,292 @@
+/*********************************************************************************************************************
+ *
+ * brickPager.h
+ *
+ * Out-of-core volume: bricks of a .vvol file paged on demand into host memory and into a GPU brick atlas
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef BRICKPAGER_H
+#define BRICKPAGER_H
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+#include "volumeImg.h"
+#include "vvolFile.h"
+
+
+/*!
+* \class BrickPager
+* \brief Renders a volume larger than RAM (and than a single 3D texture) from the bricks of a .vvol file
+* The volume is never held as a whole: the .vvol file is mapped, and bricks are decoded on demand.
+*   - host pool: decoded bricks, kept in a LRU cache bounded by a memory budget (paging thread only)
+*   - brick atlas: 3D texture of fixed-size slots, each holding a brick with a 1-voxel apron copied from its
+*     neighbors, so that trilinear filtering is seamless across bricks
+*   - page table: 3D texture with a texel per brick (RGBA16UI): slot of the brick in the atlas (rgb) and
+*     residency (a), through which shaders resolve samples (see samplePaged() in fragment shaders)
+* Every frame, the render thread lists the bricks needed by the current view (see update()): bricks crossed by
+* the displayed slices first, then, for volume rendering, all bricks of the volume from the nearest to the camera.
+* Bricks whose values are all below the window are skipped (they would render as empty anyway), and the list is
+* cut to the number of atlas slots. The paging thread decodes the needed bricks that are not resident, and the
+* render thread uploads them into free or least recently used slots, within a time budget. Bricks not resident yet
+* are rendered as the low bound of the window (i.e. empty) until they are uploaded.
+* Volumes in other formats are first converted into a .vvol file (on the paging thread), from their mapped data.
+* Only the render thread calls the public functions (with the GL context current for update() and close()).
+*/
+class BrickPager
+{
+    public:
+
+        /*! State of the pager */
+        enum PagerState { PAGER_IDLE, PAGER_OPENING, PAGER_READY, PAGER_FAILED };
+
+        static const size_t DEFAULT_HOST_BUDGET = size_t(1024) << 20;   /*!< default memory budget of the host pool (bytes) */
+        static const size_t DEFAULT_ATLAS_BUDGET = size_t(512) << 20;   /*!< default memory budget of the brick atlas (bytes) */
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                        CONSTRUCTORS / DESTRUCTORS                                           |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        BrickPager() {}
+
+        /*! textures must be released with close() while the GL context exists */
+        virtual ~BrickPager() { stopPaging(); }
+
+        BrickPager(const BrickPager&) = delete;
+        BrickPager& operator=(const BrickPager&) = delete;
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                GETTERS                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*! \fn isOpen : a volume is open (or being opened) */
+        inline bool isOpen() const { return m_state != PAGER_IDLE; }
+        /*! \fn isReady : the volume is open and its textures are created */
+        inline bool isReady() const { return m_atlasTex != 0; }
+        /*! \fn getVolume : attributes of the paged volume, without data (nullptr until ready) */
+        inline std::shared_ptr<VolumeImg> getVolume() const { return m_volume; }
+        /*! \fn getAtlasTexture : 3D texture of the brick atlas (used as volume texture in shaders) */
+        inline GLuint getAtlasTexture() const { return m_atlasTex; }
+        /*! \fn getPageTableTexture : 3D texture of the page table */
+        inline GLuint getPageTableTexture() const { return m_pageTableTex; }
+        inline int getBrickSize() const { return m_vvol.getBrickSize(); }
+        inline int getNbBricks() const { return int(m_brickSlots.size()); }
+        inline int getNbSlots() const { return int(m_slots.size()); }
+        /*! \fn getNbNeededBricks : number of bricks needed by the current view (at most the number of slots) */
+        inline int getNbNeededBricks() const { return int(m_needed.size()); }
+        /*! \fn getNbResidentBricks : number of bricks needed by the current view and resident in the atlas */
+        inline int getNbResidentBricks() const { return m_nbResident; }
+        /*! \fn getHostMemory : memory used by the host pool (bytes) */
+        inline size_t getHostMemory() const { return m_hostMemory; }
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                   MISC                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*!
+        * \fn open
+        * \brief Start opening a volume for paging (on the paging thread): a .vvol file is used as is, other files are
+        * converted first into a .vvol file next to them (unless it already exists and is more recent)
+        * Conversion maps the data of the file, so that it stays out-of-core for uncompressed formats only, and cannot be
+        * interrupted (close() waits for its end).
+        * \param _fileName : name of file to open
+        * \param _hostBudget : memory budget of the host pool (bytes)
+        * \param _atlasBudget : memory budget of the brick atlas (bytes)
+        */
+        void open(const std::string& _fileName, size_t _hostBudget = DEFAULT_HOST_BUDGET, size_t _atlasBudget = DEFAULT_ATLAS_BUDGET);
+
+        /*!
+        * \fn close
+        * \brief Stop paging and release bricks and textures
+        */
+        void close();
+
+        /*!
+        * \fn update
+        * \brief List the bricks needed by the current view, and upload decoded bricks into the atlas within a time budget
+        * \param _window : window [low ; high] (native units): bricks below it are not needed
+        * \param _slices : displayed slices along X, Y and Z (voxel indices, -1 if not displayed)
+        * \param _volumeRendering : the whole volume is rendered (ray casting)
+        * \param _eye : camera position in volume texture coordinates (i.e. [0 ; 1]^3 box), for volume rendering
+        * \param _uploadBudget : time budget (in ms) for atlas uploads
+        * \return true if the volume just became ready (textures created, see getVolume())
+        */
+        bool update(glm::vec2 _window, glm::ivec3 _slices, bool _volumeRendering, glm::vec3 _eye, double _uploadBudget);
+
+        /*!
+        * \fn setNearest
+        * \brief Set the filtering of the atlas (GL_NEAREST if true, GL_LINEAR otherwise)
+        */
+        void setNearest(bool _useNearest);
+
+
+    protected:
+
+        /*! State of a brick */
+        enum BrickState : std::uint8_t { BRICK_ABSENT, BRICK_QUEUED, BRICK_RESIDENT, BRICK_FAILED };
+
+        /*! Brick decoded by the paging thread, with its apron, waiting for upload */
+        struct ReadyBrick
+        {
+            int id;                                 /*!< brick index */
+            std::vector<std::uint8_t> voxels;       /*!< slotSize^3 voxels */
+        };
+
+        /*! Slot of the atlas (render thread only) */
+        struct Slot
+        {
+            int brick = -1;                         /*!< brick held by the slot (-1: none) */
+            std::uint64_t lastUsed = 0;             /*!< last update() the brick was needed */
+        };
+
+        /*! Decoded brick of the host pool (paging thread only) */
+        struct HostBrick
+        {
+            std::vector<std::uint8_t> voxels;       /*!< voxels of the brick, dense */
+            std::list<int>::iterator lru;           /*!< position in m_hostLRU */
+        };
+
+        static const size_t MAX_READY_BRICKS = 64;  /*!< max number of decoded bricks waiting for upload */
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                ATTRIBUTES                                                   |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        // shared between threads
+        std::thread m_thread;                               /*!< paging thread */
+        std::mutex m_mutex;                                 /*!< protects brick states, requests, ready bricks and m_stop */
+        std::condition_variable m_wakeUp;                   /*!< wakes up the paging thread (new requests, room in m_ready) */
+        std::atomic<PagerState> m_state = PAGER_IDLE;       /*!< state (written by paging thread while opening) */
+        std::vector<BrickState> m_brickStates;              /*!< state of each brick */
+        std::vector<int> m_requests;                        /*!< needed bricks, by priority */
+        size_t m_nextRequest = 0;                           /*!< first request not examined by the paging thread */
+        std::deque<ReadyBrick> m_ready;                     /*!< decoded bricks waiting for upload */
+        bool m_stop = false;                                /*!< stop request for the paging thread */
+
+        // set by open(), then by the paging thread while opening
+        std::string m_fileName;                             /*!< name of file to open */
+        size_t m_hostBudget = DEFAULT_HOST_BUDGET;          /*!< memory budget of the host pool (bytes) */
+        size_t m_atlasBudget = DEFAULT_ATLAS_BUDGET;        /*!< memory budget of the brick atlas (bytes) */
+        VVolFile m_vvol;                                    /*!< bricked file */
+        size_t m_voxelSize = 1;                             /*!< size of a voxel (bytes) */
+        int m_slotSize = 0;                                 /*!< size of an atlas slot (brick size + apron, voxels) */
+
+        // paging thread only
+        std::unordered_map<int, HostBrick> m_hostPool;      /*!< decoded bricks */
+        std::list<int> m_hostLRU;                           /*!< bricks of the host pool, most recently used first */
+        std::atomic<size_t> m_hostMemory = 0;               /*!< memory used by the host pool (bytes) */
+
+        // render thread only
+        std::shared_ptr<VolumeImg> m_volume;                /*!< attributes of the volume, without data */
+        GLuint m_atlasTex = 0;                              /*!< brick atlas */
+        GLuint m_pageTableTex = 0;                          /*!< page table */
+        glm::ivec3 m_nbSlots = glm::ivec3(0);               /*!< number of atlas slots along each axis */
+        std::vector<Slot> m_slots;                          /*!< atlas slots */
+        std::vector<int> m_brickSlots;                      /*!< slot of each resident brick (-1: none) */
+        std::vector<std::uint64_t> m_brickNeeded;           /*!< last update() each brick was needed */
+        std::vector<int> m_needed;                          /*!< bricks needed by the current view, by priority */
+        std::uint64_t m_frame = 0;                          /*!< number of calls to update() */
+        int m_nbResident = 0;                               /*!< number of needed bricks resident in the atlas */
+        bool m_useNearest = false;                          /*!< atlas filtering */
+
+        // view of the last listing of needed bricks
+        glm::vec2 m_lastWindow = glm::vec2(0.0f);
+        glm::ivec3 m_lastSlices = glm::ivec3(-1);
+        bool m_lastVolumeRendering = false;
+        glm::vec3 m_lastEye = glm::vec3(0.0f);
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                   MISC                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*!
+        * \fn createTextures
+        * \brief Create the volume attributes, the atlas (as many slots as the budget allows) and the page table
+        * \return true if succeeded, false otherwise
+        */
+        bool createTextures();
+
+        /*!
+        * \fn listNeededBricks
+        * \brief List the bricks needed by a view into m_needed, by priority (see update())
+        */
+        void listNeededBricks(glm::vec2 _window, glm::ivec3 _slices, bool _volumeRendering, glm::vec3 _eye);
+
+        /*!
+        * \fn uploadBrick
+        * \brief Upload a decoded brick into a free or least recently used slot, and update the page table
+        * \return true if a slot was available, false otherwise
+        */
+        bool uploadBrick(const ReadyBrick& _brick);
+
+        /*!
+        * \fn setPageEntry
+        * \brief Write the page table entry of a brick
+        * \param _id : brick index
+        * \param _slot : slot of the brick (-1: not resident)
+        */
+        void setPageEntry(int _id, int _slot);
+
+        /*!
+        * \fn stopPaging
+        * \brief Stop the paging thread (waits for the brick being decoded, if any)
+        */
+        void stopPaging();
+
+        /*!
+        * \fn run
+        * \brief Body of the paging thread
+        */
+        void run();
+
+        /*!
+        * \fn openFile
+        * \brief Open (converting it first if needed) the file to page (paging thread)
+        * \return true if succeeded, false otherwise
+        */
+        bool openFile();
+
+        /*!
+        * \fn hostBrick
+        * \brief Get a decoded brick from the host pool, decoding it on miss (and evicting least recently used bricks
+        * beyond the budget). The pointer is valid until the next call.
+        * \return voxels of the brick, nullptr if decoding failed
+        */
+        const std::uint8_t* hostBrick(int _id);
+
+        /*!
+        * \fn buildSlot
+        * \brief Assemble the content of an atlas slot: a brick and its 1-voxel apron (voxels of neighbor bricks, 0
+        * outside the volume)
+        * \param _id : brick index
+        * \param _voxels : slotSize^3 voxels
+        * \return true if succeeded, false otherwise
+        */
+        bool buildSlot(int _id, std::vector<std::uint8_t>* _voxels);
+
+};
+
+#endif // BRICKPAGER_H
@@ -0,0 +1,271 @@
+/*********************************************************************************************************************
+ *
+ * derivedCache.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "derivedCache.h"
+#include "parallel.h"
+#include "GLtools.h"
+
+
+namespace
+{
+    const char CACHE_MAGIC[8] = { 'V', 'V', 'C', 'A', 'C', 'H', 'E', '1' };
+
+    // header of a cache entry, followed by the elements
+    struct EntryHeader
+    {
+        char magic[8];
+        std::uint64_t key;
+        std::uint64_t nbElem;
+        std::uint32_t elemSize;
+        std::uint32_t reserved;
+    };
+    static_assert(sizeof(EntryHeader) == 32, "unexpected padding in EntryHeader");
+
+    std::string s_directory;                                /*!< cache directory (empty: cache disabled) */
+    size_t s_maxSize = DerivedCache::DEFAULT_MAX_SIZE;      /*!< max total size of the entries (bytes) */
+
+    const size_t HASH_CHUNK = 1 << 20;                      /*!< size of the blocks hashed independently */
+    const std::uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    const std::uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    const std::uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+
+    inline std::uint64_t rotl(std::uint64_t _x, int _r)
+    {
+        return (_x << _r) | (_x >> (64 - _r));
+    }
+
+    inline std::uint64_t hashRound(std::uint64_t _acc, std::uint64_t _val)
+    {
+        return rotl(_acc + _val * PRIME2, 31) * PRIME1;
+    }
+
+    inline std::uint64_t avalanche(std::uint64_t _h)
+    {
+        _h ^= _h >> 33;
+        _h *= PRIME2;
+        _h ^= _h >> 29;
+        _h *= PRIME3;
+        _h ^= _h >> 32;
+        return _h;
+    }
+
+    // Hash of a block, 4 independent lanes of 8-byte words (xxHash64-like)
+    std::uint64_t hashBlock(const std::uint8_t* _data, size_t _size, std::uint64_t _seed)
+    {
+        std::uint64_t lanes[4] = { _seed + PRIME1 + PRIME2, _seed + PRIME2, _seed, _seed - PRIME1 };
+        size_t i = 0;
+        for (; i + 32 <= _size; i += 32)
+        {
+            for (int l = 0; l < 4; l++)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, _data + i + 8 * l, sizeof(word));
+                lanes[l] = hashRound(lanes[l], word);
+            }
+        }
+
+        std::uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+        for (; i < _size; i++)
+            h = rotl(h ^ (_data[i] * PRIME3), 11) * PRIME1;
+
+        return avalanche(h ^ std::uint64_t(_size));
+    }
+
+    std::string entryPath(const std::string& _name, std::uint64_t _key)
+    {
+        char keyString[17];
+        std::snprintf(keyString, sizeof(keyString), "%016llx", (unsigned long long)_key);
+        return (std::filesystem::path(s_directory) / (_name + "_" + keyString + ".cache")).string();
+    }
+
+    /*!
+    * \fn trim
+    * \brief Remove the least recently used entries (i.e. the oldest modification times, see load()) until the total
+    * size of the cache is within its max size
+    * Entries still mapped may not be removable (e.g. on Windows): they are skipped.
+    * \param _keep : entry just written, never removed
+    */
+    void trim(const std::filesystem::path& _keep)
+    {
+        struct Entry
+        {
+            std::filesystem::path path;
+            std::filesystem::file_time_type time;
+            std::uintmax_t size;
+        };
+        std::vector<Entry> entries;
+        std::uintmax_t totalSize = 0;
+
+        std::error_code error;
+        for (std::filesystem::directory_iterator it(s_directory, error), end; !error && it != end; it.increment(error))
+        {
+            if (it->path().extension() != ".cache")
+                continue;
+            std::error_code entryError;
+            Entry entry{ it->path(), it->last_write_time(entryError), 0 };
+            if (!entryError)
+                entry.size = it->file_size(entryError);
+            if (entryError)
+                continue;
+            totalSize += entry.size;
+            entries.push_back(entry);
+        }
+        if (totalSize <= s_maxSize)
+            return;
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& _a, const Entry& _b) { return _a.time < _b.time; });
+        for (const Entry& entry : entries)
+        {
+            if (totalSize <= s_maxSize)
+                break;
+            if (entry.path == _keep || !std::filesystem::remove(entry.path, error))
+                continue;
+            totalSize -= entry.size;
+            std::cout << "[INFO] DerivedCache::trim(): " << entry.path.string() << " removed (cache over "
+                      << (s_maxSize >> 20) << " MB)" << std::endl;
+        }
+    }
+
+} // anonymous namespace
+
+
+
+namespace DerivedCache
+{
+
+    void setDirectory(const std::string& _directory, size_t _maxSize)
+    {
+        s_directory = _directory;
+        s_maxSize = _maxSize;
+    }
+
+
+    const std::string& getDirectory()
+    {
+        return s_directory;
+    }
+
+
+    std::uint64_t contentHash(const void* _data, size_t _size)
+    {
+        // blocks of fixed size are hashed in parallel, then combined in order
+        const std::uint8_t* data = static_cast<const std::uint8_t*>(_data);
+        size_t nbChunks = (_size + HASH_CHUNK - 1) / HASH_CHUNK;
+        std::vector<std::uint64_t> chunkHashes(nbChunks);
+        Parallel::parallelFor(0, nbChunks, [&](size_t _first, size_t _last)
+        {
+            for (size_t c = _first; c < _last; c++)
+                chunkHashes[c] = hashBlock(data + c * HASH_CHUNK, std::min(HASH_CHUNK, _size - c * HASH_CHUNK), c);
+        });
+
+        std::uint64_t h = PRIME3 ^ std::uint64_t(_size);
+        for (std::uint64_t chunkHash : chunkHashes)
+            h = hashRound(h, chunkHash);
+        return avalanche(h);
+    }
+
+
+    std::uint64_t combineHash(std::uint64_t _hash, const std::string& _str)
+    {
+        return avalanche(hashRound(_hash, hashBlock(reinterpret_cast<const std::uint8_t*>(_str.data()), _str.size(), PRIME1)));
+    }
+
+
+    bool load(const std::string& _name, std::uint64_t _key, size_t _elemSize,
+              std::shared_ptr<MappedFile>* _file, size_t* _offset, size_t* _nbElem)
+    {
+        if (s_directory.empty())
+            return false;
+
+        std::string path = entryPath(_name, _key);
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(path, error))
+            return false;
+
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(path))
+            return false;
+
+        EntryHeader header;
+        if (file->size() < sizeof(EntryHeader))
+            return false;
+        std::memcpy(&header, file->data(), sizeof(EntryHeader));
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.key != _key || header.elemSize != _elemSize
+            || sizeof(EntryHeader) + header.nbElem * _elemSize != file->size())
+        {
+            warningLog() << "DerivedCache::load(): invalid cache entry " << path;
+            return false;
+        }
+
+        *_file = file;
+        *_offset = sizeof(EntryHeader);
+        *_nbElem = size_t(header.nbElem);
+
+        // most recently used entry (see trim())
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+        std::cout << "[INFO] DerivedCache::load(): " << _name << " read from " << path << std::endl;
+        return true;
+    }
+
+
+    bool store(const std::string& _name, std::uint64_t _key, const void* _data, size_t _elemSize, size_t _nbElem)
+    {
+        if (s_directory.empty())
+            return false;
+
+        std::error_code error;
+        std::filesystem::create_directories(s_directory, error);
+
+        EntryHeader header;
+        std::memset(&header, 0, sizeof(EntryHeader));
+        std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.key = _key;
+        header.nbElem = _nbElem;
+        header.elemSize = std::uint32_t(_elemSize);
+
+        // write to a temporary file, then rename it: an entry is never read while incomplete
+        std::string path = entryPath(_name, _key);
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(EntryHeader));
+            file.write(static_cast<const char*>(_data), _nbElem * _elemSize);
+            if (!file)
+            {
+                warningLog() << "DerivedCache::store(): could not write " << tmpPath;
+                file.close();
+                std::filesystem::remove(tmpPath, error);
+                return false;
+            }
+        }
+
+        std::filesystem::rename(tmpPath, path, error);
+        if (error)
+        {
+            warningLog() << "DerivedCache::store(): could not write " << path;
+            std::filesystem::remove(tmpPath, error);
+            return false;
+        }
+
+        trim(path);
+        return true;
+    }
+
+} // end namespace DerivedCache
@@ -0,0 +1,123 @@
+/*********************************************************************************************************************
+ *
+ * derivedCache.h
+ *
+ * Persistent disk cache of data derived from volumes (gradients, histograms, min-max grids, mip levels, etc.)
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef DERIVEDCACHE_H
+#define DERIVEDCACHE_H
+
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "mappedFile.h"
+#include "voxelStorage.h"
+
+
+/*!
+* \namespace DerivedCache
+* \brief Derived data are stored in one file per entry in the cache directory, named after the kind of data and a
+* 64-bit key. The key combines a content hash of the source voxels with the processing parameters, so that an entry
+* is found again whatever the file the volume comes from, and is never reused for other data or parameters.
+* Entries are mapped back (copy-on-write) when read, without any copy.
+* The total size of the entries is capped: the least recently used ones are removed when a new entry exceeds it.
+*/
+namespace DerivedCache
+{
+
+    /*! Default max total size of the cache entries (bytes) */
+    const size_t DEFAULT_MAX_SIZE = size_t(4) << 30;
+
+
+    /*!
+    * \fn setDirectory
+    * \brief Set the cache directory (created when the first entry is stored), an empty name disables the cache
+    * To be called once, before any loading thread is started.
+    * \param _directory : cache directory
+    * \param _maxSize : max total size of the entries (bytes)
+    */
+    void setDirectory(const std::string& _directory, size_t _maxSize = DEFAULT_MAX_SIZE);
+
+    /*! \fn getDirectory */
+    const std::string& getDirectory();
+
+
+    /*!
+    * \fn contentHash
+    * \brief Fast 64-bit hash of a memory block (multithreaded, result independent of the number of threads)
+    * \param _data : first byte
+    * \param _size : size in bytes
+    */
+    std::uint64_t contentHash(const void* _data, size_t _size);
+
+    /*!
+    * \fn combineHash
+    * \brief Combine a hash with a string (e.g. kind of data and processing parameters)
+    */
+    std::uint64_t combineHash(std::uint64_t _hash, const std::string& _str);
+
+
+    /*!
+    * \fn load
+    * \brief Map a cache entry (which becomes the most recently used one)
+    * \param _name : kind of data (e.g. "gradient")
+    * \param _key : key of the entry (see combineHash())
+    * \param _elemSize : size of an element in bytes
+    * \param _file : mapped entry
+    * \param _offset : offset of the first element in the mapping
+    * \param _nbElem : number of elements
+    * \return true if the entry exists and is valid, false otherwise
+    */
+    bool load(const std::string& _name, std::uint64_t _key, size_t _elemSize,
+              std::shared_ptr<MappedFile>* _file, size_t* _offset, size_t* _nbElem);
+
+    /*!
+    * \fn store
+    * \brief Write a cache entry (written to a temporary file first, so that entries are always complete),
+    * then remove the least recently used entries beyond the max size of the cache
+    * \param _name : kind of data (e.g. "gradient")
+    * \param _key : key of the entry (see combineHash())
+    * \param _data : first element
+    * \param _elemSize : size of an element in bytes
+    * \param _nbElem : number of elements
+    * \return true if the entry was written, false otherwise
+    */
+    bool store(const std::string& _name, std::uint64_t _key, const void* _data, size_t _elemSize, size_t _nbElem);
+
+
+    /*!
+    * \fn load
+    * \brief Map a cache entry into a voxel storage
+    */
+    template <typename T>
+    bool load(const std::string& _name, std::uint64_t _key, VoxelStorage<T>* _out)
+    {
+        std::shared_ptr<MappedFile> file;
+        size_t offset, nbElem;
+        if (!load(_name, _key, sizeof(T), &file, &offset, &nbElem))
+            return false;
+        return _out->adoptMapping(file, offset, nbElem);
+    }
+
+    /*!
+    * \fn store
+    * \brief Write the content of a voxel storage as a cache entry
+    */
+    template <typename T>
+    bool store(const std::string& _name, std::uint64_t _key, const VoxelStorage<T>& _data)
+    {
+        return store(_name, _key, _data.data(), sizeof(T), _data.size());
+    }
+
+}
+
+#endif // DERIVEDCACHE_H
@@ -14,6 +14,18 @@
 
 DrawableMesh::DrawableMesh()
 {
+    // no GL object yet (names of 0 are ignored on deletion)
+    m_meshVAO = 0;
+    m_defaultVAO = 0;
+    m_vertexVBO = 0;
+    m_normalVBO = 0;
+    m_colorVBO = 0;
+    m_uvVBO = 0;
+    m_tex3dVBO = 0;
+    m_indexVBO = 0;
+    m_numVertices = 0;
+    m_numIndices = 0;
+
     setUseGammaCorrecFlag(false);
     setModeVR(1);
 
@@ -28,8 +40,12 @@ DrawableMesh::DrawableMesh()
     m_useShadow = false;
     m_useJitter = false;
     m_useTF = 0;
+    m_lod = 0;
 
     setAmbientCol(glm::vec3(0.1f, 0.1f, 0.1f));
+    setWindow(glm::vec2(0.0f, 1.0f));
+    setPageTable(0);
+    setSlab(0, 1, glm::vec3(0.0f));
 }
 
 
@@ -260,6 +276,50 @@ void DrawableMesh::createSliceVAO(unsigned int _orientation)
 }
 
 
+void DrawableMesh::createMeshVAO(const std::vector<glm::vec3>& _vertices, const std::vector<glm::vec3>& _normals, const std::vector<uint32_t>& _indices)
+{
+    // Generates and populates a VBO for vertex coords
+    glGenBuffers(1, &(m_vertexVBO));
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexVBO);
+    size_t verticesNBytes = _vertices.size() * sizeof(_vertices[0]);
+    glBufferData(GL_ARRAY_BUFFER, verticesNBytes, _vertices.data(), GL_STATIC_DRAW);
+
+    // Generates and populates a VBO for vertex normals
+    glGenBuffers(1, &(m_normalVBO));
+    glBindBuffer(GL_ARRAY_BUFFER, m_normalVBO);
+    size_t normalsNBytes = _normals.size() * sizeof(_normals[0]);
+    glBufferData(GL_ARRAY_BUFFER, normalsNBytes, _normals.data(), GL_STATIC_DRAW);
+
+    // Generates and populates a VBO for the element indices
+    glGenBuffers(1, &(m_indexVBO));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBO);
+    size_t indicesNBytes = _indices.size() * sizeof(_indices[0]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesNBytes, _indices.data(), GL_STATIC_DRAW);
+
+
+    // Creates a vertex array object (VAO) for drawing the mesh
+    glGenVertexArrays(1, &(m_meshVAO));
+    glBindVertexArray(m_meshVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexVBO);
+    glEnableVertexAttribArray(POSITION);
+    glVertexAttribPointer(POSITION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_normalVBO);
+    glEnableVertexAttribArray(NORMAL);
+    glVertexAttribPointer(NORMAL, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBO);
+    glBindVertexArray(m_defaultVAO); // unbinds the VAO
+
+    // Additional information required by draw calls
+    m_numVertices = (unsigned int)_vertices.size();
+    m_numIndices = (unsigned int)_indices.size();
+
+    errorLog().lastGLerror();
+}
+
+
 void DrawableMesh::drawBoundingGeom(GLuint _program, MVPmatrices& _mvpMatrices)
 {
     // Activate program
@@ -383,11 +443,16 @@ void DrawableMesh::drawRayCast(GLuint _program, RayCasting& _rayCastTex, GLuint
     glUniform1i(glGetUniformLocation(_program, "u_useTF"), m_useTF);
     glUniform1i(glGetUniformLocation(_program, "u_useGammaCorrec"), m_useGammaCorrec);
     glUniform1i(glGetUniformLocation(_program, "u_modeVR"), m_modeVR);
-    glUniform1i(glGetUniformLocation(_program, "u_maxSteps"), m_maxSteps);
+    glUniform1i(glGetUniformLocation(_program, "u_maxSteps"), std::max(m_maxSteps >> m_lod, 1));
+    glUniform1f(glGetUniformLocation(_program, "u_lod"), float(m_lod));
     glUniformMatrix4fv(glGetUniformLocation(_program, "u_matMVP"), 1, GL_FALSE, &_mvpMat[0][0]);
     glUniform1f(glGetUniformLocation(_program, "u_transparency"), _transparency);
+    glUniform2fv(glGetUniformLocation(_program, "u_window"), 1, &m_window[0]);
 
 
+    bindPageTable(_program);
+    bindMacrocells(_program, _rayCastTex.macrocellTex, _rayCastTex.distanceFieldTex);
+
     // Draw!
     glBindVertexArray(m_meshVAO);                       // bind the VAO
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBO);  // do not forget to bind the index buffer AFTER !
@@ -417,6 +482,8 @@ void DrawableMesh::drawIsoSurf(GLuint _program, RayCasting& _rayCastTex, GLuint
     glBindTexture(GL_TEXTURE_2D, m_perlinTex);
     glActiveTexture(GL_TEXTURE4);
     glBindTexture(GL_TEXTURE_1D, _1dTex);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_3D, _rayCastTex.gradTex);
 
     // set uniforms
     glUniform1i(glGetUniformLocation(_program, "u_volumeTexture"), 0);
@@ -424,8 +491,11 @@ void DrawableMesh::drawIsoSurf(GLuint _program, RayCasting& _rayCastTex, GLuint
     glUniform1i(glGetUniformLocation(_program, "u_backFaceTexture"), 2);
     glUniform1i(glGetUniformLocation(_program, "u_perlinTex"), 3);
     glUniform1i(glGetUniformLocation(_program, "u_lookupTexture"), 4);
+    glUniform1i(glGetUniformLocation(_program, "u_gradientTexture"), 7);
+    glUniform1i(glGetUniformLocation(_program, "u_useGradientTex"), _rayCastTex.gradTex != 0);
     glUniform1i(glGetUniformLocation(_program, "u_useGammaCorrec"), m_useGammaCorrec);
-    glUniform1i(glGetUniformLocation(_program, "u_maxSteps"), m_maxSteps);
+    glUniform1i(glGetUniformLocation(_program, "u_maxSteps"), std::max(m_maxSteps >> m_lod, 1));
+    glUniform1f(glGetUniformLocation(_program, "u_lod"), float(m_lod));
     glUniform1f(glGetUniformLocation(_program, "u_isoValue"), (float)_isoValue / 255.0f);
     glUniform1f(glGetUniformLocation(_program, "u_isoValue2"), (float)_isoValue2 / 255.0f);
     glUniformMatrix4fv(glGetUniformLocation(_program, "u_matM"), 1, GL_FALSE, &_mvpMatrices.modelMat[0][0]);
@@ -438,6 +508,10 @@ void DrawableMesh::drawIsoSurf(GLuint _program, RayCasting& _rayCastTex, GLuint
     glUniform2fv(glGetUniformLocation(_program, "u_screenDims"), 1, &_screenDims[0]);
     glUniform3fv(glGetUniformLocation(_program, "u_ambientColor"), 1, &m_ambientCol[0]);
     glUniform1f(glGetUniformLocation(_program, "u_transparency"), _transparency);
+    glUniform2fv(glGetUniformLocation(_program, "u_window"), 1, &m_window[0]);
+
+    bindPageTable(_program);
+    bindMacrocells(_program, _rayCastTex.macrocellTex, _rayCastTex.distanceFieldTex);
 
     // Draw!
     glBindVertexArray(m_meshVAO);                       // bind the VAO
@@ -471,6 +545,12 @@ void DrawableMesh::drawSlice(GLuint _program, MVPmatrices& _mvpMatrices, glm::ma
     glUniform1i(glGetUniformLocation(_program, "u_volumeTexture"), 0);
     glUniform1i(glGetUniformLocation(_program, "u_lookupTexture"), 1);
     glUniform1i(glGetUniformLocation(_program, "u_useGammaCorrec"), m_useGammaCorrec);
+    glUniform2fv(glGetUniformLocation(_program, "u_window"), 1, &m_window[0]);
+    glUniform1i(glGetUniformLocation(_program, "u_slabMode"), m_slabMode);
+    glUniform1i(glGetUniformLocation(_program, "u_slabSamples"), m_slabSamples);
+    glUniform3fv(glGetUniformLocation(_program, "u_slabStep"), 1, &m_slabStep[0]);
+
+    bindPageTable(_program);
 
     // Draw!
     glBindVertexArray(m_meshVAO);                       // bind the VAO
@@ -484,3 +564,62 @@ void DrawableMesh::drawSlice(GLuint _program, MVPmatrices& _mvpMatrices, glm::ma
     glUseProgram(0);
 }
 
+
+void DrawableMesh::drawMesh(GLuint _program, MVPmatrices& _mvpMatrices, glm::mat4 _tex3dMat, glm::mat4 _rotationMat, glm::vec3 _lightDir)
+{
+    // Activate program
+    glUseProgram(_program);
+
+    // normals are transformed by the inverse transpose (3D tex coords are scaled by the inverse of the volume extent)
+    glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(_tex3dMat)));
+
+    // Pass uniforms
+    glUniformMatrix4fv(glGetUniformLocation(_program, "u_matM"), 1, GL_FALSE, &_mvpMatrices.modelMat[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(_program, "u_matV"), 1, GL_FALSE, &_mvpMatrices.viewMat[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(_program, "u_matP"), 1, GL_FALSE, &_mvpMatrices.projMat[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(_program, "u_matTex"), 1, GL_FALSE, &_tex3dMat[0][0]);
+    glUniformMatrix3fv(glGetUniformLocation(_program, "u_matNormal"), 1, GL_FALSE, &normalMat[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(_program, "u_matRot"), 1, GL_FALSE, &_rotationMat[0][0]);
+    glUniform3fv(glGetUniformLocation(_program, "u_lightDir"), 1, &_lightDir[0]);
+    glUniform1i(glGetUniformLocation(_program, "u_useGammaCorrec"), m_useGammaCorrec);
+    glUniform3fv(glGetUniformLocation(_program, "u_ambientColor"), 1, &m_ambientCol[0]);
+
+    // Draw!
+    glBindVertexArray(m_meshVAO);                       // bind the VAO
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBO);  // do not forget to bind the index buffer AFTER !
+
+    glDrawElements(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, 0);
+
+    glBindVertexArray(m_defaultVAO);
+
+    glUseProgram(0);
+}
+
+
+void DrawableMesh::bindPageTable(GLuint _program)
+{
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_3D, m_pageTableTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(_program, "u_pageTable"), 6);
+    glUniform1i(glGetUniformLocation(_program, "u_paged"), m_pageTableTex != 0);
+    glUniform3fv(glGetUniformLocation(_program, "u_volumeDims"), 1, &m_pagedDims[0]);
+    glUniform1f(glGetUniformLocation(_program, "u_brickSize"), m_brickSize);
+}
+
+
+void DrawableMesh::bindMacrocells(GLuint _program, GLuint _cellTex, GLuint _distTex)
+{
+    glActiveTexture(GL_TEXTURE8);
+    glBindTexture(GL_TEXTURE_3D, _cellTex);
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_3D, _distTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(_program, "u_macrocells"), 8);
+    glUniform1i(glGetUniformLocation(_program, "u_useMacrocells"), _cellTex != 0);
+    glUniform1i(glGetUniformLocation(_program, "u_distanceField"), 9);
+    glUniform1i(glGetUniformLocation(_program, "u_useDistanceField"), _cellTex != 0 && _distTex != 0);
+    glUniform1f(glGetUniformLocation(_program, "u_cellSize"), float(Macrocells::CELL_SIZE));
+}
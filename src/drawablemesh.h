@@ -62,6 +62,8 @@ class DrawableMesh
         inline void setModeVR(int _modeVR) { m_modeVR = _modeVR; }
         /*! \fn setMaxSteps */
         inline void setMaxSteps(int _maxSteps) { m_maxSteps = _maxSteps; }
+        /*! \fn setLod : mip level of the volume sampled by ray casting, whose steps are scaled accordingly (0 = full resolution) */
+        inline void setLod(int _lod) { m_lod = _lod; }
         /*! \fn setUseAOFlag */
         inline void setUseAOFlag(bool _useAO) { m_useAO = _useAO; }
         /*! \fn setUseShadowFlag */
@@ -78,6 +80,12 @@ class DrawableMesh
         inline void setPerlinTex(GLuint _perlinTex) { m_perlinTex = _perlinTex; }
         /*! \fn setAmbientCol */
         inline void setAmbientCol(glm::vec3 _ambientCol) { m_ambientCol = _ambientCol; }
+        /*! \fn setWindow : window [low ; high] in 3D texture units (see VolumeImg::windowToTexture()) */
+        inline void setWindow(glm::vec2 _window) { m_window = _window; }
+        /*! \fn setPageTable : page table of an out-of-core volume, whose brick atlas is then the volume 3D texture (see BrickPager), 0 for an in-core volume */
+        inline void setPageTable(GLuint _pageTableTex, glm::vec3 _volumeDims = glm::vec3(0.0f), float _brickSize = 0.0f) { m_pageTableTex = _pageTableTex; m_pagedDims = _volumeDims; m_brickSize = _brickSize; }
+        /*! \fn setSlab : projection of slices over a slab (see Reformat::SlabMode), sampled _nbSamples times centered on the slice, _step apart (3D texture units) */
+        inline void setSlab(int _slabMode, int _nbSamples, glm::vec3 _step) { m_slabMode = _slabMode; m_slabSamples = _nbSamples; m_slabStep = _step; }
 
         /*! \fn getUseGammaCorrecFlag */
         inline bool getUseGammaCorrecFlag() { return m_useGammaCorrec; }
@@ -85,6 +93,8 @@ class DrawableMesh
         inline bool getModeVR() { return m_modeVR; }
         /*! \fn getMaxSteps */
         inline bool getMaxSteps() { return m_maxSteps; }
+        /*! \fn getLod */
+        inline int getLod() { return m_lod; }
         /*! \fn getUseAOFlag */
         inline bool getUseAOFlag() { return m_useAO; }
         /*! \fn getUseShadowFlag */
@@ -93,6 +103,8 @@ class DrawableMesh
         inline bool getUseJitterFlag() { return m_useJitter; }
         /*! \fn getUseTFFlag */
         inline int getUseTFFlag() { return m_useTF; }
+        /*! \fn getWindow */
+        inline glm::vec2 getWindow() { return m_window; }
 
 
         /*------------------------------------------------------------------------------------------------------------+
@@ -121,6 +133,15 @@ class DrawableMesh
         */
         void createSliceVAO(unsigned int _orientation);
 
+        /*!
+        * \fn createMeshVAO
+        * \brief Create VAO and VBOs of an indexed triangle mesh (e.g. an isosurface, see MarchingCubes)
+        * \param _vertices : vertex coords
+        * \param _normals : vertex normals
+        * \param _indices : 3 vertex indices per triangle
+        */
+        void createMeshVAO(const std::vector<glm::vec3>& _vertices, const std::vector<glm::vec3>& _normals, const std::vector<uint32_t>& _indices);
+
         /*!
         * \fn drawBoundingGeom
         * \brief Draw the content of the mesh VAO
@@ -188,6 +209,17 @@ class DrawableMesh
         */
         void drawSlice(GLuint _program, MVPmatrices& _mvpMatrices, glm::mat4 _tex3dMat, GLuint& _3dTex, GLuint _1dTex);
 
+        /*!
+        * \fn drawMesh
+        * \brief Draw a triangle mesh of the volume into the G-buffer, shaded as the ray-cast isosurface
+        * \param _program : shader program
+        * \param _mvpMatrices : Model, View, and Projection matrices of the bounding geometry
+        * \param _tex3dMat : transformation of vertex coords to 3D tex coords
+        * \param _rotationMat : rotation of the volume in 3D tex coords (model matrix of drawIsoSurf())
+        * \param _lightDir : light direction
+        */
+        void drawMesh(GLuint _program, MVPmatrices& _mvpMatrices, glm::mat4 _tex3dMat, glm::mat4 _rotationMat, glm::vec3 _lightDir);
+
 
     protected:
 
@@ -212,6 +244,7 @@ class DrawableMesh
         bool m_useGammaCorrec;      /*!< flag to apply gamma correction or not */
         int m_modeVR;               /*!< VR mode (1 = MIP, 2 = alpha blending, 3 = isusurface, 4 = hybrid)*/
         int m_maxSteps;             /*!< max nb of steps for ray-casting (= diagonal length of volume box)*/
+        int m_lod;                  /*!< mip level of the volume sampled by ray-casting (steps are 2^m_lod times larger) */
 
         bool m_vertexProvided;      /*!< flag to indicate if vertex coords are available or not */
         bool m_normalProvided;      /*!< flag to indicate if normals are available or not */
@@ -228,6 +261,13 @@ class DrawableMesh
         GLuint m_perlinTex;         /*!< index of perlin noise texture */
         std::vector<glm::vec3> m_randKernel;
         glm::vec3 m_ambientCol;     /*!< color used for ambient lighting and shadows */
+        glm::vec2 m_window;         /*!< window [low ; high] applied to volume values (3D texture units) */
+        GLuint m_pageTableTex;      /*!< page table of an out-of-core volume (0 for an in-core volume) */
+        glm::vec3 m_pagedDims;      /*!< dimensions of the out-of-core volume (voxels) */
+        float m_brickSize;          /*!< brick size of the out-of-core volume (voxels) */
+        int m_slabMode;             /*!< projection of slices over a slab (0 = thin slice, 1 = MIP, 2 = MinIP, 3 = average) */
+        int m_slabSamples;          /*!< number of samples across the slab */
+        glm::vec3 m_slabStep;       /*!< distance between samples across the slab (3D texture units) */
 
         /*------------------------------------------------------------------------------------------------------------+
         |                                                   MISC                                                      |
@@ -241,5 +281,23 @@ class DrawableMesh
         */
         //GLuint load2DTexture(const std::string& _filename, bool _repeat = false);
 
+        /*!
+        * \fn bindPageTable
+        * \brief Bind the page table (texture unit 6) and pass paging uniforms, for shaders sampling the volume
+        * (always done: the page table sampler must not share the unit of the volume sampler, even when unused)
+        * \param _program : shader program (in use)
+        */
+        void bindPageTable(GLuint _program);
+
+        /*!
+        * \fn bindMacrocells
+        * \brief Bind the min-max macrocell grid (texture unit 8) and its distance field (texture unit 9), and pass their uniforms,
+        * for ray casting shaders skipping empty space
+        * \param _program : shader program (in use)
+        * \param _cellTex : macrocell grid texture (see Macrocells), 0 to march through the whole volume
+        * \param _distTex : distance field texture (see Macrocells::distanceField()), 0 to skip cells one by one
+        */
+        void bindMacrocells(GLuint _program, GLuint _cellTex, GLuint _distTex);
+
 };
 #endif // DRAWABLEMESH_H
\ No newline at end of file
@@ -0,0 +1,267 @@
+/*********************************************************************************************************************
+ *
+ * gradientVolume.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include "gradientVolume.h"
+
+#include <vector>
+#include <utility>
+
+#include "volumeImg.h"
+#include "parallel.h"
+#include "simd.h"
+
+
+namespace GradientVolume
+{
+
+namespace
+{
+    // minimal number of rows of a band processed by a thread
+    const size_t minRowsPerBand = 16;
+
+    // Sobel sums are 32 times the derivative per voxel
+    const float sobelNorm = 1.0f / 32.0f;
+
+    // version of the cached gradients (see VolumeImg::derivedData()), to increment on any change of the result
+    // 1: octahedral directions, 2: signed normalized xyz directions
+    const int cacheVersion = 2;
+
+
+    /*!
+    * \struct BandPlanes
+    * \brief Partial sums of one slice, over a band of rows
+    * a: derivative along x, smoothed along y
+    * b: smoothed along x, derivative along y
+    * c: smoothed along x and y
+    */
+    struct BandPlanes
+    {
+        std::vector<float> a, b, c;
+    };
+
+
+    /*!
+    * \fn rowPass
+    * \brief Derivative [-1 0 1] and smoothing [1 2 1] of a row along x (border voxels repeated)
+    */
+    template <typename VoxelType>
+    void rowPass(const VoxelType* _row, size_t _nx, float* _dx, float* _sx)
+    {
+        size_t last = _nx - 1;
+        for (size_t x = 1; x < last; x++)
+        {
+            float prev = float(_row[x - 1]), next = float(_row[x + 1]);
+            _dx[x] = next - prev;
+            _sx[x] = prev + 2.0f * float(_row[x]) + next;
+        }
+
+        // borders (and single voxel rows)
+        float v0 = float(_row[0]), v1 = float(_row[std::min<size_t>(1, last)]);
+        _dx[0] = v1 - v0;
+        _sx[0] = 3.0f * v0 + v1;
+        if (last > 0)
+        {
+            float vl = float(_row[last]), vp = float(_row[last - 1]);
+            _dx[last] = vl - vp;
+            _sx[last] = vp + 3.0f * vl;
+        }
+    }
+
+
+#if defined(SIMD_X86)
+    /*!
+    * \fn packRowAVX2
+    * \brief AVX2 version of packRow(), 8 voxels at a time
+    * \return number of voxels processed (the remaining ones are left to the scalar loop)
+    */
+    SIMD_TARGET_AVX2 size_t packRowAVX2(const float* _a[3], const float* _b[3], const float* _c[3], size_t _nx, float _scale, std::uint32_t* _out)
+    {
+        size_t x = 0;
+        const __m256 two = _mm256_set1_ps(2.0f);
+        const __m256 norm = _mm256_set1_ps(sobelNorm);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 snormMax = _mm256_set1_ps(127.0f);
+        const __m256 scale = _mm256_set1_ps(_scale);
+
+        for (; x + 8 <= _nx; x += 8)
+        {
+            __m256 gx = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(_a[0] + x), _mm256_loadu_ps(_a[2] + x)), _mm256_mul_ps(two, _mm256_loadu_ps(_a[1] + x)));
+            __m256 gy = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(_b[0] + x), _mm256_loadu_ps(_b[2] + x)), _mm256_mul_ps(two, _mm256_loadu_ps(_b[1] + x)));
+            __m256 gz = _mm256_sub_ps(_mm256_loadu_ps(_c[2] + x), _mm256_loadu_ps(_c[0] + x));
+            gx = _mm256_mul_ps(gx, norm);
+            gy = _mm256_mul_ps(gy, norm);
+            gz = _mm256_mul_ps(gz, norm);
+
+            // magnitude (same operation order as encode(), NaN clamped to 1 as std::min())
+            __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy)), _mm256_mul_ps(gz, gz)));
+            __m256 mag = _mm256_min_ps(_mm256_mul_ps(len, scale), one);
+
+            // unit direction (0 for null gradients)
+            __m256 nonNull = _mm256_cmp_ps(len, zero, _CMP_GT_OQ);
+            __m256 safeLen = _mm256_blendv_ps(one, len, nonNull);
+            __m256 dx = _mm256_and_ps(_mm256_div_ps(gx, safeLen), nonNull);
+            __m256 dy = _mm256_and_ps(_mm256_div_ps(gy, safeLen), nonNull);
+            __m256 dz = _mm256_and_ps(_mm256_div_ps(gz, safeLen), nonNull);
+
+            // quantize to signed bytes, and pack (little endian: r in the low byte)
+            const __m256i byteMask = _mm256_set1_epi32(0xff);
+            __m256i r = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(dx, snormMax), half))), byteMask);
+            __m256i g = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(dy, snormMax), half))), byteMask);
+            __m256i b = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(dz, snormMax), half))), byteMask);
+            __m256i m = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(mag, snormMax), half)));
+            __m256i packed = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+                                             _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_slli_epi32(m, 24)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + x), packed);
+        }
+        return x;
+    }
+#endif
+
+
+    /*!
+    * \fn packRow
+    * \brief Combine the partial sums of 3 consecutive slices into the gradients of a row, and pack them
+    * \param _a, _b, _c : partial sums of slices z-1, z, z+1 (see BandPlanes), offset to the row
+    */
+    void packRow(const float* _a[3], const float* _b[3], const float* _c[3], size_t _nx, float _scale, std::uint32_t* _out)
+    {
+        size_t x = 0;
+#if defined(SIMD_X86)
+        if (Simd::hasAVX2())
+            x = packRowAVX2(_a, _b, _c, _nx, _scale, _out);
+#endif
+
+        for (; x < _nx; x++)
+        {
+            glm::vec3 grad((_a[0][x] + _a[2][x] + 2.0f * _a[1][x]) * sobelNorm,
+                           (_b[0][x] + _b[2][x] + 2.0f * _b[1][x]) * sobelNorm,
+                           (_c[2][x] - _c[0][x]) * sobelNorm);
+            _out[x] = encode(grad, _scale);
+        }
+    }
+
+} // namespace
+
+
+template <typename VoxelType>
+void compute(VolumeView<const VoxelType> _vol, float _scale, std::uint32_t* _out)
+{
+    if (_vol.empty() || _out == nullptr)
+        return;
+
+    const size_t nx = _vol.extent(0), ny = _vol.extent(1), nz = _vol.extent(2);
+
+    Parallel::parallelFor(0, ny, [&](size_t _yFirst, size_t _yLast)
+    {
+        const size_t bandSize = (_yLast - _yFirst) * nx;
+
+        // partial sums of slices z-1, z and z+1, slice k in planes[k % 3]
+        BandPlanes planes[3];
+        for (BandPlanes& p : planes)
+        {
+            p.a.resize(bandSize);
+            p.b.resize(bandSize);
+            p.c.resize(bandSize);
+        }
+
+        // row passes of rows y-1, y and y+1 of current slice, row j in slot j % 3
+        std::vector<float> dx(3 * nx), sx(3 * nx);
+        size_t slotRow[3];
+
+        auto computePlanes = [&](size_t _k)
+        {
+            BandPlanes& p = planes[_k % 3];
+            slotRow[0] = slotRow[1] = slotRow[2] = size_t(-1);
+            auto rowSums = [&](size_t _j) -> size_t
+            {
+                size_t slot = _j % 3;
+                if (slotRow[slot] != _j)
+                {
+                    rowPass(_vol.row(_j, _k), nx, dx.data() + slot * nx, sx.data() + slot * nx);
+                    slotRow[slot] = _j;
+                }
+                return slot * nx;
+            };
+
+            for (size_t y = _yFirst; y < _yLast; y++)
+            {
+                // rows out of the grid are the border rows
+                size_t prev = rowSums(y > 0 ? y - 1 : 0);
+                size_t next = rowSums(std::min(y + 1, ny - 1));
+                size_t cur = rowSums(y);
+
+                float* a = p.a.data() + (y - _yFirst) * nx;
+                float* b = p.b.data() + (y - _yFirst) * nx;
+                float* c = p.c.data() + (y - _yFirst) * nx;
+                for (size_t x = 0; x < nx; x++)
+                {
+                    a[x] = dx[prev + x] + 2.0f * dx[cur + x] + dx[next + x];
+                    b[x] = sx[next + x] - sx[prev + x];
+                    c[x] = sx[prev + x] + 2.0f * sx[cur + x] + sx[next + x];
+                }
+            }
+        };
+
+        computePlanes(0);
+        for (size_t z = 0; z < nz; z++)
+        {
+            // slices out of the grid are the border slices
+            if (z + 1 < nz)
+                computePlanes(z + 1);
+            const BandPlanes& p0 = planes[(z > 0 ? z - 1 : 0) % 3];
+            const BandPlanes& p1 = planes[z % 3];
+            const BandPlanes& p2 = planes[std::min(z + 1, nz - 1) % 3];
+
+            for (size_t y = _yFirst; y < _yLast; y++)
+            {
+                size_t offset = (y - _yFirst) * nx;
+                const float* a[3] = { p0.a.data() + offset, p1.a.data() + offset, p2.a.data() + offset };
+                const float* b[3] = { p0.b.data() + offset, p1.b.data() + offset, p2.b.data() + offset };
+                const float* c[3] = { p0.c.data() + offset, p1.c.data() + offset, p2.c.data() + offset };
+                packRow(a, b, c, nx, _scale, _out + _vol.index(0, y, z));
+            }
+        }
+    }, minRowsPerBand);
+}
+
+template void compute<std::uint8_t>(VolumeView<const std::uint8_t>, float, std::uint32_t*);
+template void compute<std::uint16_t>(VolumeView<const std::uint16_t>, float, std::uint32_t*);
+template void compute<std::int16_t>(VolumeView<const std::int16_t>, float, std::uint32_t*);
+template void compute<float>(VolumeView<const float>, float, std::uint32_t*);
+
+
+bool compute(VolumeImg* _vol, VoxelStorage<std::uint32_t>* _out)
+{
+    // a step of the whole value range between two voxels is stored as 1
+    glm::vec2 range = _vol->getValueRange();
+    float scale = range.y > range.x ? 2.0f / (range.y - range.x) : 0.0f;
+    size_t nbVoxels = _vol->getNbVoxels();
+
+    return _vol->derivedData("gradient", cacheVersion, "sobel", _out, [&](VoxelStorage<std::uint32_t>* _storage)
+    {
+        bool computed = false;
+        _vol->visit([&](auto& _typedVol)
+        {
+            // no data (e.g. out-of-core volume)
+            if (nbVoxels == 0 || _typedVol.getStorage().size() != nbVoxels)
+                return;
+
+            _storage->resize(nbVoxels);
+            compute(std::as_const(_typedVol).view(), scale, _storage->data());
+            computed = true;
+        });
+        return computed;
+    });
+}
+
+} // namespace GradientVolume
@@ -0,0 +1,124 @@
+/*********************************************************************************************************************
+ *
+ * gradientVolume.h
+ *
+ * Precomputed gradient volume, with normals packed in 32 bits per voxel
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef GRADIENTVOLUME_H
+#define GRADIENTVOLUME_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "volumeView.h"
+#include "voxelStorage.h"
+
+
+class VolumeImg;
+
+
+/*!
+* \namespace GradientVolume
+* \brief Gradient of every voxel, computed once after loading so that shading reads a normal with a single fetch
+* (instead of 6 neighbor fetches per shaded sample).
+* The gradient is the 3x3x3 Sobel operator in its separable form (derivative [-1 0 1] along the axis, smoothing
+* [1 2 1] along the two others), divided by 32 so that it is a derivative per voxel. Voxels out of the grid take the
+* value of the nearest border voxel.
+* Each voxel is packed in 32 bits, read as a GL_RGBA8_SNORM texture (bytes in memory order, whatever the host):
+* r, g, b : unit direction of the gradient, signed normalized (8 bits each, null for a null gradient)
+* a : gradient magnitude, scaled (see compute()) and clamped to 1 (7 bits)
+* Directions are stored as plain xyz so that they can be filtered by the texture units (unlike octahedral codes,
+* which cannot be interpolated across the fold); the filtered direction is normalized after fetching.
+*/
+namespace GradientVolume
+{
+
+    /*!
+    * \fn compute
+    * \brief Compute the packed gradients of a volume (multithreaded, vectorized on AVX2)
+    * Threads process bands of rows, each walking along z with the partial sums of 3 slices only.
+    * \param _vol : voxels
+    * \param _scale : factor from gradient magnitude (native units per voxel) to stored magnitude (1 is stored as 255)
+    * \param _out : packed gradients (one per voxel, same layout as _vol)
+    */
+    template <typename VoxelType>
+    void compute(VolumeView<const VoxelType> _vol, float _scale, std::uint32_t* _out);
+
+    /*!
+    * \fn compute
+    * \brief Get the packed gradients of a volume from the derived data cache, or compute them
+    * (magnitude is relative to the value range of the volume, which must be loaded: a step of the whole range
+    * between two voxels is stored as 1)
+    * \param _vol : volume
+    * \param _out : packed gradients
+    * \return true if gradients are available
+    */
+    bool compute(VolumeImg* _vol, VoxelStorage<std::uint32_t>* _out);
+
+
+    /*!
+    * \fn encode
+    * \brief Pack a gradient (see GradientVolume)
+    * \param _grad : gradient
+    * \param _scale : factor from gradient magnitude to stored magnitude
+    */
+    inline std::uint32_t encode(glm::vec3 _grad, float _scale)
+    {
+        float len = std::sqrt(_grad.x * _grad.x + _grad.y * _grad.y + _grad.z * _grad.z);
+        float mag = std::min(1.0f, len * _scale);
+
+        // unit direction (null for a null gradient)
+        glm::vec3 dir(0.0f);
+        if (len > 0.0f)
+            dir = glm::vec3(_grad.x / len, _grad.y / len, _grad.z / len);
+
+        // rounded as floor(x + 0.5), as the vectorized version
+        std::int8_t bytes[4] = { std::int8_t(std::floor(dir.x * 127.0f + 0.5f)),
+                                 std::int8_t(std::floor(dir.y * 127.0f + 0.5f)),
+                                 std::int8_t(std::floor(dir.z * 127.0f + 0.5f)),
+                                 std::int8_t(std::floor(mag * 127.0f + 0.5f)) };
+        std::uint32_t packed;
+        std::memcpy(&packed, bytes, sizeof(packed));
+        return packed;
+    }
+
+    /*!
+    * \fn decodeDirection
+    * \brief Unit direction of a packed gradient (null for a null gradient)
+    */
+    inline glm::vec3 decodeDirection(std::uint32_t _packed)
+    {
+        std::int8_t bytes[4];
+        std::memcpy(bytes, &_packed, sizeof(bytes));
+        glm::vec3 n(float(bytes[0]) / 127.0f, float(bytes[1]) / 127.0f, float(bytes[2]) / 127.0f);
+        float len = glm::length(n);
+        return len > 0.0f ? n / len : n;
+    }
+
+    /*!
+    * \fn decodeMagnitude
+    * \brief Stored magnitude of a packed gradient, in [0 ; 1]
+    */
+    inline float decodeMagnitude(std::uint32_t _packed)
+    {
+        std::int8_t bytes[4];
+        std::memcpy(bytes, &_packed, sizeof(bytes));
+        return float(bytes[3]) / 127.0f;
+    }
+
+}
+
+#endif // GRADIENTVOLUME_H
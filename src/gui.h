@@ -20,13 +20,24 @@
 #include "imgui_impl_opengl3.h"
 
 #include "volumeImg.h"
+#include "volumeLoader.h"
+#include "timeSeries.h"
+#include "brickPager.h"
+#include "volumeStats.h"
+#include "mipPyramid.h"
+#include "volumeFilter.h"
+#include "volumeResampler.h"
+#include "reformat.h"
+#include "marchingCubes.h"
 #include "drawablemesh.h"
 
 
 std::string dataDir = "../../data/";         /*!< relative path to img files folder  */
+std::string cacheDir = dataDir + "cache/";   /*!< folder of the disk cache of derived data (empty to disable it) */
+const size_t maxResampledVoxels = size_t(1024) * 1024 * 1024; /*!< largest volume created by resampling */
 
 struct UI {
-    int mainViewOrient = 1;            /*! Defines which type of view is in main view (1=3D, 2=A, 3=C, 4=S) */
+    int mainViewOrient = 1;            /*! Defines which type of view is in main view (1=3D, 2=A, 3=C, 4=S, 5=oblique) */
     glm::vec3 backColor = glm::vec3(0.5f, 0.5f, 0.5f); /*!< background color */
     bool isBackgroundWhite = false;   /*!< background color flag */
     bool isGammaCorrecOn = false;     /*!< Gamma correction flag */
@@ -40,27 +51,116 @@ struct UI {
     bool VR = false;                  /*! Show VolumeRendering view or not (3D slices)*/
     int VRmode = 1;                   /*! Use MIP (1), alpha blending (2), isosurface (3), or hybrid (4) mode for VR*/
     bool useTexNearest = false;       /*! flag to indicate if texture uses GL_NEAREST param (if not, uses GL_LINEAR by default)*/
+    int interactionLod = 1;           /*! mip level of the volume rendered while rotating the view (0 = always full resolution) */
     int sliceIdA;                     /*! ID of the Axial slice to visualize*/
     int sliceIdC;                     /*! ID of the Coronal slice to visualize*/
     int sliceIdS;                     /*! ID of the Sagittal slice to visualize*/
     char fileName[256] = {};          /*! name of file to load */
-    int isoValue = 38;                /*! threshold isosurface rendering */
+    int isoValue = 38;                /*! threshold isosurface rendering (windowed values, in [0 ; 255]) */
     int isoValue2 = 255;              /*! threshold second isosurface rendering (hybrid mode only) */
+    bool autoSettings = true;         /*! set window, transfer function and iso values from volume statistics after loading */
     float transparency = 0.02f;       /*! opacity factor for alpha blending */
+    glm::vec2 window = glm::vec2(0.0f, 255.0f); /*! window [low ; high] applied to volume values (native units) */
+    int ringSize = TimeSeries::DEFAULT_RING_SIZE; /*! number of frames prefetched for cine playback */
+    float cineFps = 10.0f;            /*! cine playback rate (frames per second) */
+    int filterType = VolumeFilter::FILTER_GAUSSIAN; /*! filter applied to the volume (see VolumeFilter::FilterType) */
+    float filterSigma = 1.0f;         /*! standard deviation of the Gaussian and bilateral filters (voxels) */
+    int medianRadius = 1;             /*! radius of the window of the median filter (1: 3x3x3, 2: 5x5x5) */
+    float filterRangeSigma = 0.1f;    /*! range standard deviation of the bilateral filter, relative to the window width */
+    bool applyFilter = false;         /*! filter requested (applied by the main loop, which re-uploads the volume) */
+    int resampleKernel = VolumeResampler::KERNEL_TRILINEAR; /*! interpolation kernel of resampling (see VolumeResampler::Kernel) */
+    bool resampleToBudget = false;    /*! resample to a voxel budget (isotropic), instead of a given spacing */
+    float resampleSpacing = 0.0f;     /*! isotropic spacing of resampling (world units, 0: finest spacing of the volume) */
+    int resampleBudget = 64;          /*! voxel budget of resampling (millions of voxels) */
+    bool resampleReorient = false;    /*! also permute and flip the voxel axes along the world axes */
+    bool applyResample = false;       /*! resampling requested (applied by the main loop, which replaces the volume) */
+    int slabMode = Reformat::SLAB_THIN; /*! projection of the slice views over a slab (see Reformat::SlabMode) */
+    float slabThickness = 10.0f;      /*! thickness of the slab (world units) */
+    float planeYaw = 0.0f;            /*! rotation of the oblique plane around Y (degrees, see Reformat::planeFromAngles()) */
+    float planePitch = 0.0f;          /*! rotation of the oblique plane around its rotated x axis (degrees) */
+    float planeOffset = 0.0f;         /*! translation of the oblique plane along its normal, from the volume center (world units) */
+    bool saveReformat = false;        /*! reformat of the oblique plane requested (computed and saved by the main loop) */
+    bool extractSurface = false;      /*! isosurface mesh extraction requested (extracted by the main loop, see MarchingCubes) */
+    bool showSurface = true;          /*! rasterize the extracted mesh instead of ray casting the isosurface */
+    int surfaceIsoValue = -1;         /*! iso value of the extracted mesh (-1: no mesh, set by the main loop) */
+    int exportSurface = 0;            /*! export of the extracted mesh requested (1: PLY, 2: STL, saved by the main loop) */
 };
 
-void loadFile(std::string _fileName, VolumeImg& _volume, GLuint& _volTex)
+/*!
+* \fn applyStatsSettings
+* \brief Set window, transfer function and iso values from the statistics of the volume
+* (window discards outliers, isosurface separates background from object, second isosurface is the bone class of the TF)
+* \param _ui : GUI settings to update
+* \param _stats : statistics of the volume (fixed TF if empty, window unchanged)
+* \param _lookupTex : TF texture, rebuilt
+* \param _setWindow : also set the window (otherwise the current one is kept)
+*/
+void applyStatsSettings(UI& _ui, const VolumeStats::Stats& _stats, GLuint& _lookupTex, bool _setWindow = true)
 {
-    _volume.volumeLoad(_fileName);
-    //initScene();
-    build3DTex(_volTex, &_volume);
+    if (_stats.empty())
+    {
+        build1DTex(_lookupTex);
+        return;
+    }
+
+    if (_setWindow)
+        _ui.window = VolumeStats::autoWindow(_stats);
+    build1DTex(_lookupTex, &_stats, _ui.window);
+
+    auto toIndex = [&](float _value)
+    {
+        return std::clamp(int(std::lround(255.0f * (_value - _ui.window.x) / (_ui.window.y - _ui.window.x))), 0, 255);
+    };
+    float background = VolumeStats::otsuThreshold(_stats);
+    float objectBegin = _stats.fractionBelow(background);
+    _ui.isoValue = toIndex(background);
+    _ui.isoValue2 = toIndex(_stats.percentile(100.0f * (objectBegin + 0.85f * (1.0f - objectBegin))));
+}
+
+
+/*!
+* \fn baseFileName
+* \brief Name of a file without its extension (or a DICOM folder without its trailing separator), to name derived files
+*/
+std::string baseFileName(const std::string& _fileName)
+{
+    std::string fileName(_fileName);
+    while (!fileName.empty() && (fileName.back() == '/' || fileName.back() == '\\'))
+        fileName.pop_back();
+    if (fileName.size() > 7 && fileName.compare(fileName.size() - 7, 7, ".nii.gz") == 0)
+        fileName.resize(fileName.size() - 3);
+    size_t dot = fileName.find_last_of('.');
+    if (dot != std::string::npos && dot > fileName.find_last_of("/\\") + 1)
+        fileName = fileName.substr(0, dot);
+    return fileName;
 }
 
 
+/*!
+* \fn resampledSizeError
+* \brief Reason why a resampled volume of some dimensions is refused (empty if it is not)
+* \param _dims : dimensions of the resampled volume
+*/
+std::string resampledSizeError(glm::ivec3 _dims)
+{
+    GLint maxTexSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxTexSize);
+    if (maxTexSize > 0 && std::max(_dims.x, std::max(_dims.y, _dims.z)) > maxTexSize)
+        return "larger than the 3D texture limit (" + std::to_string(maxTexSize) + ")";
+    if (size_t(_dims.x) * size_t(_dims.y) * size_t(_dims.z) > maxResampledVoxels)
+        return "more than " + std::to_string(maxResampledVoxels / (1024 * 1024)) + " M voxels";
+    return "";
+}
+
 
 void GUI( UI& _ui,
           VolumeImg& _volume,
+          VolumeLoader& _loader,
+          TimeSeries& _timeSeries,
+          BrickPager& _brickPager,
+          const VolumeStats::Stats& _stats,
           GLuint& _volTex,
+          GLuint& _lookupTex,
           DrawableMesh& _drawScreenQuad,
           DrawableMesh& _drawSliceA,
           DrawableMesh& _drawSliceC,
@@ -81,25 +181,92 @@ void GUI( UI& _ui,
 
         ImGui::Separator();
 
-        ImGui::Text("Format supported: .vtk, .raw");
+        ImGui::Text("Format supported: .vtk, .raw, .mhd/.mha, .nhdr/.nrrd, .nii/.nii.gz, .vvol, DICOM folder");
 
         // filename
         ImGui::Text("File Name: ");
         ImGui::InputText(" ", _ui.fileName, sizeof(_ui.fileName));
 
         // import
+        // (loading runs in background, and cancels the current one if any)
         if (ImGui::Button("Load"))
         {
-            loadFile(dataDir + std::string(_ui.fileName), _volume, _volTex);
+            _timeSeries.close();
+            _brickPager.close();
+            _loader.start(dataDir + std::string(_ui.fileName));
+        }
+
+        // time series: numbered sequence of files the file name belongs to (e.g. heart_00.vtk, heart_01.vtk, ...)
+        ImGui::SameLine();
+        if (ImGui::Button("Load series"))
+        {
+            _loader.cancel();
+            _brickPager.close();
+            _timeSeries.open(dataDir + std::string(_ui.fileName), _ui.ringSize);
+            _timeSeries.setFps(_ui.cineFps);
+        }
+
+        // out-of-core volume: bricks are paged from disk (other formats than .vvol are converted first)
+        ImGui::SameLine();
+        if (ImGui::Button("Load paged"))
+        {
+            _loader.cancel();
+            _timeSeries.close();
+            _brickPager.open(dataDir + std::string(_ui.fileName));
+        }
+
+        // save current volume in native format (compressed bricks), next to the loaded file
+        if (!_loader.isLoading() && !_brickPager.isOpen() && _ui.fileName[0] != '\0')
+        {
+            ImGui::SameLine();
+            if (ImGui::Button("Save .vvol"))
+                _volume.volumeSaveVVol(dataDir + baseFileName(_ui.fileName) + ".vvol");
+        }
+
+        if (_loader.isLoading())
+        {
+            ImGui::ProgressBar(_loader.getProgress());
+            // (the volume displayed before the load is then restored, see restorePreviousVolume())
+            if (ImGui::Button("Cancel"))
+                _loader.cancel();
+        }
 
-            _drawScreenQuad.setMaxSteps(glm::length(glm::vec3((float)_volume.getDimensions().x,
-                                                              (float)_volume.getDimensions().y,
-                                                              (float)_volume.getDimensions().z)));
+        // paging
+        if (_brickPager.isOpen())
+        {
+            ImGui::Separator();
+            if (_brickPager.isReady())
+                ImGui::Text("Paged volume: %d bricks, %d / %d needed resident (atlas of %d), host pool %d MB",
+                            _brickPager.getNbBricks(), _brickPager.getNbResidentBricks(), _brickPager.getNbNeededBricks(),
+                            _brickPager.getNbSlots(), int(_brickPager.getHostMemory() >> 20));
+            else
+                ImGui::Text("Opening paged volume...");
+            if (ImGui::Button("Close paged"))
+                _brickPager.close();
+        }
 
-            _ui.sliceIdA = _volume.getDimensions()[2] / 2;
-            _ui.sliceIdC = _volume.getDimensions()[1] / 2;
-            _ui.sliceIdS = _volume.getDimensions()[0] / 2;
+        // cine playback
+        if (_timeSeries.isOpen())
+        {
+            ImGui::Separator();
+            ImGui::Text("Time series: %d frames, ring of %d (%d ready), %d late",
+                        _timeSeries.getNbFrames(), _timeSeries.getRingSize(), _timeSeries.getNbReadyFrames(), _timeSeries.getNbLateFrames());
+            if (ImGui::Button(_timeSeries.isPlaying() ? "Pause" : "Play"))
+                _timeSeries.setPlaying(!_timeSeries.isPlaying());
+            ImGui::SameLine();
+            if (ImGui::Button("Close series"))
+                _timeSeries.close();
+        }
+        if (_timeSeries.isOpen())
+        {
+            int frame = _timeSeries.getFrame();
+            if (ImGui::SliderInt("Frame", &frame, 0, _timeSeries.getNbFrames() - 1))
+                _timeSeries.setFrame(frame);
+            if (ImGui::SliderFloat("FPS", &_ui.cineFps, 1.0f, 60.0f))
+                _timeSeries.setFps(_ui.cineFps);
         }
+        else
+            ImGui::SliderInt("Ring size", &_ui.ringSize, 2, 64);
 
         // Tab bar
         if (ImGui::BeginTabBar("tab bar"))
@@ -108,10 +275,46 @@ void GUI( UI& _ui,
             // Second tab: Visualization
             if (ImGui::BeginTabItem("Visu"))
             {
-                if (ImGui::Checkbox("Show nearest voxel", &_ui.useTexNearest))
+                // window/level, in native units of the volume (applied in shaders, no reload)
+                glm::vec2 range = _volume.getValueRange();
+                range = glm::vec2(std::min(range.x, _volume.getDefaultWindow().x), std::max(range.y, _volume.getDefaultWindow().y));
+                float level = 0.5f * (_ui.window.x + _ui.window.y);
+                float width = _ui.window.y - _ui.window.x;
+                bool windowChanged = ImGui::SliderFloat("Level", &level, range.x, range.y);
+                windowChanged |= ImGui::SliderFloat("Width", &width, (range.y - range.x) * 0.001f, range.y - range.x);
+                if (windowChanged)
+                    _ui.window = glm::vec2(level - 0.5f * width, level + 0.5f * width);
+                if (ImGui::Button("Reset window"))
+                    _ui.window = _volume.getDefaultWindow();
+
+                // statistics of the volume (computed after loading)
+                if (!_stats.empty())
+                {
+                    ImGui::SameLine();
+                    if (ImGui::Button("Auto window"))
+                        _ui.window = VolumeStats::autoWindow(_stats);
+                    ImGui::SameLine();
+                    if (ImGui::Button("Auto TF"))
+                        applyStatsSettings(_ui, _stats, _lookupTex, false);
+                    ImGui::Text("Values: [%g ; %g], mean %.4g, std. dev. %.4g, median %.4g", _stats.range.x, _stats.range.y,
+                                _stats.mean, std::sqrt(_stats.variance), _stats.percentile(50.0f));
+                    // log scale, so that the background peak does not flatten the rest
+                    std::vector<float> bins(_stats.histogram.size());
+                    std::transform(_stats.histogram.begin(), _stats.histogram.end(), bins.begin(), [](std::uint64_t _c) { return std::log1p(float(_c)); });
+                    ImGui::PlotHistogram("Histogram", bins.data(), int(bins.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+                }
+                ImGui::Checkbox("Auto settings on load", &_ui.autoSettings);
+
+                ImGui::Separator();
+
+                if (ImGui::Checkbox("Show nearest voxel", &_ui.useTexNearest) && !_loader.isLoading() && !_timeSeries.isOpen())
                 {
                     // build 3D texture from volume and FBO for raycasting
-                    build3DTex(_volTex, &_volume, _ui.useTexNearest);
+                    // (paged volume: only the filtering of the atlas changes)
+                    if (_brickPager.isOpen())
+                        _brickPager.setNearest(_ui.useTexNearest);
+                    else
+                        build3DTex(_volTex, &_volume, _ui.useTexNearest);
                 }
 
                 if (ImGui::Checkbox("Gamma correction ", &_ui.isGammaCorrecOn))
@@ -137,6 +340,8 @@ void GUI( UI& _ui,
                         if (ImGui::RadioButton("hybrid", &_ui.VRmode, 4))
                             _drawScreenQuad.setModeVR(4);
 
+                        ImGui::SliderInt("LOD while rotating", &_ui.interactionLod, 0, MipPyramid::MAX_LEVELS - 1);
+
                         if (_ui.VRmode == 2 || _ui.VRmode == 4)
                         {
                             ImGui::SliderFloat("transparency", &_ui.transparency, 0.005f, 0.2f);
@@ -160,6 +365,33 @@ void GUI( UI& _ui,
                             }
                         }
 
+                        // isosurface mesh (volumes in memory only), saved next to the loaded file
+                        if (_ui.VRmode == 3)
+                        {
+                            bool inCore = !_loader.isLoading() && !_timeSeries.isOpen() && !_brickPager.isOpen();
+                            if (inCore)
+                            {
+                                if (ImGui::Button("Extract surface"))
+                                    _ui.extractSurface = true;
+                            }
+                            if (_ui.surfaceIsoValue >= 0)
+                            {
+                                if (inCore)
+                                    ImGui::SameLine();
+                                ImGui::Checkbox("Show surface mesh", &_ui.showSurface);
+                                if (_ui.surfaceIsoValue != _ui.isoValue)
+                                    ImGui::Text("Mesh of iso value %d (extract again to update)", _ui.surfaceIsoValue);
+                                if (_ui.fileName[0] != '\0')
+                                {
+                                    if (ImGui::Button("Save .ply"))
+                                        _ui.exportSurface = 1;
+                                    ImGui::SameLine();
+                                    if (ImGui::Button("Save .stl"))
+                                        _ui.exportSurface = 2;
+                                }
+                            }
+                        }
+
                         if (_ui.VRmode == 3 || _ui.VRmode == 4)
                         {
                             if (ImGui::Checkbox("Jitter", &_ui.isJitterOn))
@@ -208,6 +440,7 @@ void GUI( UI& _ui,
                     ImGui::RadioButton("Axial (Z-axis)", &_ui.mainViewOrient, 2);
                     ImGui::RadioButton("Axial (Y-axis)", &_ui.mainViewOrient, 3);
                     ImGui::RadioButton("Axial (X-axis)", &_ui.mainViewOrient, 4);
+                    ImGui::RadioButton("Oblique (MPR)", &_ui.mainViewOrient, 5);
                 }
 
                 if (!_ui.singleView || _ui.mainViewOrient == 2 || (_ui.mainViewOrient == 1 && !_ui.VR))
@@ -217,8 +450,108 @@ void GUI( UI& _ui,
                 if (!_ui.singleView || _ui.mainViewOrient == 4 || (_ui.mainViewOrient == 1 && !_ui.VR))
                     ImGui::SliderInt("Sagittal (X) slice", &_ui.sliceIdS, 1, _volume.getDimensions()[0]);
 
+                // oblique plane (also rotated by dragging with the left button)
+                if (_ui.singleView && _ui.mainViewOrient == 5)
+                {
+                    float halfDiagonal = 0.5f * glm::length(glm::vec3(_volume.getDimensions()) * _volume.getSpacing());
+                    ImGui::SliderFloat("Plane yaw (deg)", &_ui.planeYaw, -180.0f, 180.0f);
+                    ImGui::SliderFloat("Plane pitch (deg)", &_ui.planePitch, -90.0f, 90.0f);
+                    ImGui::SliderFloat("Plane offset", &_ui.planeOffset, -halfDiagonal, halfDiagonal);
+                    if (ImGui::Button("Reset plane"))
+                        _ui.planeYaw = _ui.planePitch = _ui.planeOffset = 0.0f;
+                }
+
+                // thick-slab projection of the slice views
+                ImGui::Separator();
+                ImGui::RadioButton("Thin", &_ui.slabMode, Reformat::SLAB_THIN);
+                ImGui::SameLine();
+                ImGui::RadioButton("MIP", &_ui.slabMode, Reformat::SLAB_MIP);
+                ImGui::SameLine();
+                ImGui::RadioButton("MinIP", &_ui.slabMode, Reformat::SLAB_MINIP);
+                ImGui::SameLine();
+                ImGui::RadioButton("Average", &_ui.slabMode, Reformat::SLAB_AVERAGE);
+                if (_ui.slabMode != Reformat::SLAB_THIN)
+                    ImGui::SliderFloat("Slab thickness", &_ui.slabThickness, 0.0f, 50.0f);
+
+                // reformat of the oblique plane, saved next to the loaded file (volumes in memory only)
+                bool inCoreVolume = !_loader.isLoading() && !_timeSeries.isOpen() && !_brickPager.isOpen();
+                if (_ui.singleView && _ui.mainViewOrient == 5 && inCoreVolume && _ui.fileName[0] != '\0')
+                {
+                    if (ImGui::Button("Save reformat"))
+                        _ui.saveReformat = true;
+                }
+
                 ImGui::EndTabItem();
             } // end tab Window views
+
+            // -----------------------------------------------------------------------------------
+            // Fourth tab: Filtering (voxels are replaced, reload the file to undo)
+            if (ImGui::BeginTabItem("Filter"))
+            {
+                ImGui::RadioButton("Gaussian", &_ui.filterType, VolumeFilter::FILTER_GAUSSIAN);
+                ImGui::SameLine();
+                ImGui::RadioButton("Median", &_ui.filterType, VolumeFilter::FILTER_MEDIAN);
+                ImGui::SameLine();
+                ImGui::RadioButton("Bilateral", &_ui.filterType, VolumeFilter::FILTER_BILATERAL);
+
+                if (_ui.filterType == VolumeFilter::FILTER_MEDIAN)
+                {
+                    ImGui::RadioButton("3x3x3", &_ui.medianRadius, 1);
+                    ImGui::SameLine();
+                    ImGui::RadioButton("5x5x5", &_ui.medianRadius, 2);
+                }
+                else
+                    ImGui::SliderFloat("Sigma (voxels)", &_ui.filterSigma, 0.5f, 4.0f);
+                if (_ui.filterType == VolumeFilter::FILTER_BILATERAL)
+                    ImGui::SliderFloat("Range sigma (window)", &_ui.filterRangeSigma, 0.01f, 1.0f);
+
+                // volumes in memory only
+                bool inCore = !_loader.isLoading() && !_timeSeries.isOpen() && !_brickPager.isOpen();
+                if (inCore)
+                {
+                    if (ImGui::Button("Apply filter"))
+                        _ui.applyFilter = true;
+                }
+
+                // resampling (a new volume replaces the current one)
+                ImGui::Separator();
+                glm::vec3 spacing = glm::abs(_volume.getSpacing());
+                glm::ivec3 dims = _volume.getDimensions();
+                ImGui::Text("Dimensions: %d x %d x %d, spacing: %g x %g x %g", dims.x, dims.y, dims.z, spacing.x, spacing.y, spacing.z);
+                ImGui::RadioButton("Nearest", &_ui.resampleKernel, VolumeResampler::KERNEL_NEAREST);
+                ImGui::SameLine();
+                ImGui::RadioButton("Trilinear", &_ui.resampleKernel, VolumeResampler::KERNEL_TRILINEAR);
+                ImGui::SameLine();
+                ImGui::RadioButton("Lanczos", &_ui.resampleKernel, VolumeResampler::KERNEL_LANCZOS);
+                ImGui::Checkbox("Voxel budget", &_ui.resampleToBudget);
+                if (_ui.resampleToBudget)
+                    ImGui::SliderInt("Budget (M voxels)", &_ui.resampleBudget, 1, 1024);
+                else
+                {
+                    if (_ui.resampleSpacing <= 0.0f)
+                        _ui.resampleSpacing = std::min(spacing.x, std::min(spacing.y, spacing.z));
+                    float maxSpacing = std::max(spacing.x, std::max(spacing.y, spacing.z));
+                    ImGui::SliderFloat("Isotropic spacing", &_ui.resampleSpacing, 0.25f * maxSpacing, 4.0f * maxSpacing);
+                }
+                ImGui::Checkbox("Reorient along world axes", &_ui.resampleReorient);
+
+                // refused before any allocation when too large
+                float newSpacing = _ui.resampleToBudget
+                                 ? VolumeResampler::spacingForBudget(dims, spacing, size_t(_ui.resampleBudget) * 1000000)
+                                 : _ui.resampleSpacing;
+                glm::ivec3 newDims = VolumeResampler::resampledDimensions(_volume, glm::vec3(newSpacing), _ui.resampleReorient);
+                std::string sizeError = resampledSizeError(newDims);
+                ImGui::Text("Result: %d x %d x %d", newDims.x, newDims.y, newDims.z);
+                if (!sizeError.empty())
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Too large: %s", sizeError.c_str());
+                else if (inCore)
+                {
+                    if (ImGui::Button("Resample"))
+                        _ui.applyResample = true;
+                }
+
+                ImGui::EndTabItem();
+            } // end tab Filtering
             ImGui::EndTabBar();
         } // end tab bar
 
@@ -226,6 +559,13 @@ void GUI( UI& _ui,
 
     ImGui::End();
 
+    // window in texture units
+    glm::vec2 texWindow = _volume.windowToTexture(_ui.window);
+    _drawScreenQuad.setWindow(texWindow);
+    _drawSliceA.setWindow(texWindow);
+    _drawSliceC.setWindow(texWindow);
+    _drawSliceS.setWindow(texWindow);
+
     // render
     ImGui::Render();
 }
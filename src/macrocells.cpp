@@ -0,0 +1,217 @@
+/*********************************************************************************************************************
+ *
+ * macrocells.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include "macrocells.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+
+#include "volumeImg.h"
+#include "parallel.h"
+
+
+namespace Macrocells
+{
+
+template <typename VoxelType>
+void compute(VolumeView<const VoxelType> _vol, int _layerBegin, int _layerEnd, glm::vec2* _out)
+{
+    glm::ivec3 grid = gridDimensions(_vol.getDimensions());
+    _layerBegin = std::max(_layerBegin, 0);
+    _layerEnd = std::min(_layerEnd, grid.z);
+    if (_vol.empty() || _layerEnd <= _layerBegin)
+        return;
+
+    const std::int64_t nx = std::int64_t(_vol.extent(0)), ny = std::int64_t(_vol.extent(1)), nz = std::int64_t(_vol.extent(2));
+    const std::int64_t s = CELL_SIZE;
+
+    // one task per row of cells (along x)
+    Parallel::parallelFor(0, size_t(grid.y) * size_t(_layerEnd - _layerBegin), [&](size_t _first, size_t _last)
+    {
+        std::vector<VoxelType> cellMin(grid.x), cellMax(grid.x);
+        for (size_t r = _first; r < _last; r++)
+        {
+            std::int64_t cy = std::int64_t(r % size_t(grid.y));
+            std::int64_t cz = std::int64_t(r / size_t(grid.y)) + _layerBegin;
+            std::fill(cellMin.begin(), cellMin.end(), std::numeric_limits<VoxelType>::max());
+            std::fill(cellMax.begin(), cellMax.end(), std::numeric_limits<VoxelType>::lowest());
+
+            // voxels of the cells and their 1-voxel apron
+            std::int64_t k0 = std::max<std::int64_t>(cz * s - 1, 0), k1 = std::min((cz + 1) * s + 1, nz);
+            std::int64_t j0 = std::max<std::int64_t>(cy * s - 1, 0), j1 = std::min((cy + 1) * s + 1, ny);
+            for (std::int64_t k = k0; k < k1; k++)
+            {
+                for (std::int64_t j = j0; j < j1; j++)
+                {
+                    const VoxelType* row = _vol.row(size_t(j), size_t(k));
+                    for (std::int64_t cx = 0; cx < grid.x; cx++)
+                    {
+                        std::int64_t i0 = std::max<std::int64_t>(cx * s - 1, 0), i1 = std::min((cx + 1) * s + 1, nx);
+                        VoxelType mn = cellMin[cx], mx = cellMax[cx];
+                        for (std::int64_t i = i0; i < i1; i++)
+                        {
+                            mn = row[i] < mn ? row[i] : mn;
+                            mx = row[i] > mx ? row[i] : mx;
+                        }
+                        cellMin[cx] = mn;
+                        cellMax[cx] = mx;
+                    }
+                }
+            }
+
+            glm::vec2* out = _out + r * size_t(grid.x);
+            for (std::int64_t cx = 0; cx < grid.x; cx++)
+                out[cx] = glm::vec2(float(cellMin[cx]), float(cellMax[cx]));
+        }
+    });
+}
+
+template void compute<std::uint8_t>(VolumeView<const std::uint8_t>, int, int, glm::vec2*);
+template void compute<std::uint16_t>(VolumeView<const std::uint16_t>, int, int, glm::vec2*);
+template void compute<std::int16_t>(VolumeView<const std::int16_t>, int, int, glm::vec2*);
+template void compute<float>(VolumeView<const float>, int, int, glm::vec2*);
+
+
+bool compute(VolumeImg* _vol, int _layerBegin, int _layerEnd, std::vector<glm::vec2>* _out)
+{
+    glm::ivec3 grid = gridDimensions(_vol->getDimensions());
+    _layerBegin = std::max(_layerBegin, 0);
+    _layerEnd = std::min(_layerEnd, grid.z);
+    size_t nbVoxels = _vol->getNbVoxels();
+
+    bool computed = false;
+    _vol->visit([&](auto& _typedVol)
+    {
+        // no data (e.g. out-of-core volume)
+        if (nbVoxels == 0 || _typedVol.getStorage().size() != nbVoxels)
+            return;
+
+        _out->resize(size_t(grid.x) * size_t(grid.y) * size_t(std::max(_layerEnd - _layerBegin, 0)));
+        compute(std::as_const(_typedVol).view(), _layerBegin, _layerEnd, _out->data());
+        computed = true;
+    });
+    if (!computed)
+        return false;
+
+    // native units to texture units (monotonic)
+    for (glm::vec2& cell : *_out)
+        cell = _vol->windowToTexture(cell);
+    return true;
+}
+
+
+/*!
+* \fn distancePass
+* \brief Distances along an axis, from the distances in the plane of the other axes (in place):
+* d'(c) = min over c' of the line of max(|c - c'|, d(c')), which composes into the Chebyshev distance.
+* Linear time per line, from the lower envelope of the functions of the cells (Meijster et al., chessboard metric).
+* \param _dist : distances (x fastest)
+* \param _grid : grid dimensions
+* \param _axis : axis of the lines (1 or 2, the distances along x come first, see distanceField())
+*/
+static void distancePass(std::uint8_t* _dist, glm::ivec3 _grid, int _axis)
+{
+    const int n = _grid[_axis];
+    const size_t stride = _axis == 1 ? size_t(_grid.x) : size_t(_grid.x) * size_t(_grid.y);
+    const size_t nbLines = size_t(_grid.x) * size_t(_grid.y) * size_t(_grid.z) / size_t(n);
+
+    Parallel::parallelFor(0, nbLines, [&](size_t _first, size_t _last)
+    {
+        std::vector<int> g(n), s(n), t(n);
+        for (size_t l = _first; l < _last; l++)
+        {
+            // first cell of the line: lines along y are (x, z) pairs, along z (x, y) pairs, x fastest
+            std::uint8_t* first = _axis == 1 ? _dist + (l / size_t(_grid.x)) * stride * size_t(n) + l % size_t(_grid.x) : _dist + l;
+            for (int i = 0; i < n; i++)
+                g[i] = first[size_t(i) * stride];
+
+            // f(x, i): distance of x through cell i, sep(i, u): last x where cell i is closer than cell u (i < u)
+            auto f = [&](int _x, int _i) { return std::max(std::abs(_x - _i), g[_i]); };
+            auto sep = [&](int _i, int _u) { return g[_i] <= g[_u] ? std::max(_i + g[_u], (_i + _u) / 2)
+                                                                   : std::min(_u - g[_i], (_i + _u) / 2); };
+
+            // cells of the lower envelope (s) and first position where each one is the closest (t)
+            int q = 0;
+            s[0] = 0;
+            t[0] = 0;
+            for (int u = 1; u < n; u++)
+            {
+                while (q >= 0 && f(t[q], s[q]) > f(t[q], u))
+                    q--;
+                if (q < 0)
+                {
+                    q = 0;
+                    s[0] = u;
+                }
+                else
+                {
+                    int w = 1 + sep(s[q], u);
+                    if (w < n)
+                    {
+                        q++;
+                        s[q] = u;
+                        t[q] = w;
+                    }
+                }
+            }
+
+            for (int u = n - 1; u >= 0; u--)
+            {
+                first[size_t(u) * stride] = std::uint8_t(std::min(f(u, s[q]), MAX_DISTANCE));
+                if (u == t[q])
+                    q--;
+            }
+        }
+    }, 64);
+}
+
+
+void distanceField(const std::vector<glm::vec2>& _cells, glm::ivec3 _grid, float _threshold, std::vector<std::uint8_t>* _out)
+{
+    const size_t nbCells = size_t(std::max(_grid.x, 0)) * size_t(std::max(_grid.y, 0)) * size_t(std::max(_grid.z, 0));
+    _out->resize(nbCells);
+    if (nbCells == 0 || _cells.size() != nbCells)
+    {
+        _out->clear();
+        return;
+    }
+
+    // distances along x: forward and backward sweeps of each row
+    std::uint8_t* dist = _out->data();
+    const size_t nx = size_t(_grid.x);
+    Parallel::parallelFor(0, nbCells / nx, [&](size_t _first, size_t _last)
+    {
+        for (size_t r = _first; r < _last; r++)
+        {
+            const glm::vec2* cells = _cells.data() + r * nx;
+            std::uint8_t* row = dist + r * nx;
+            int d = MAX_DISTANCE;
+            for (size_t i = 0; i < nx; i++)
+            {
+                d = cells[i].y > _threshold ? 0 : std::min(d + 1, MAX_DISTANCE);
+                row[i] = std::uint8_t(d);
+            }
+            d = MAX_DISTANCE;
+            for (size_t i = nx; i-- > 0; )
+            {
+                d = std::min(int(row[i]), std::min(d + 1, MAX_DISTANCE));
+                row[i] = std::uint8_t(d);
+            }
+        }
+    }, 64);
+
+    distancePass(dist, _grid, 1);
+    distancePass(dist, _grid, 2);
+}
+
+} // namespace Macrocells
@@ -0,0 +1,114 @@
+/*********************************************************************************************************************
+ *
+ * macrocells.h
+ *
+ * Min-max macrocell grid of a volume, for empty space skipping in ray casting
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef MACROCELLS_H
+#define MACROCELLS_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "volumeView.h"
+
+
+class VolumeImg;
+
+
+/*!
+* \namespace Macrocells
+* \brief Coarse grid of the volume, each cell of CELL_SIZE^3 voxels storing the min and max values that samples
+* taken in it can read. Ray casters jump over the cells that cannot contribute (e.g. whose max is below the iso value),
+* whatever the window, iso value or TF, which are applied on these bounds in shaders.
+* Cells cover the voxels interpolated by samples in them, i.e. their voxels plus a 1-voxel apron.
+* Cells are computed by layers (range of cells along Z), so that the grid is updated along with the slabs of a volume
+* being loaded.
+* For sparse volumes, a distance field over the occupancy of the cells lets rays cross whole blocks of empty cells.
+*/
+namespace Macrocells
+{
+
+    /*! number of voxels of a cell along each axis */
+    const int CELL_SIZE = 8;
+
+
+    /*!
+    * \fn gridDimensions
+    * \brief Number of cells along each axis of a volume
+    */
+    inline glm::ivec3 gridDimensions(glm::ivec3 _volDims) { return (glm::max(_volDims, glm::ivec3(0)) + CELL_SIZE - 1) / CELL_SIZE; }
+
+    /*!
+    * \fn layersOfSlab
+    * \brief Layers of cells completed by a slab of slices, when the slices before it are available: layers whose voxels
+    * and apron all lie before _zEnd, but not before _zBegin (the last layer, whose apron is cut by the end of the volume,
+    * is never completed by a slab)
+    * \param _zBegin : first slice of the slab
+    * \param _zEnd : slice after the last one of the slab
+    * \param _layerBegin : first layer
+    * \param _layerEnd : layer after the last one
+    */
+    inline void layersOfSlab(int _zBegin, int _zEnd, int* _layerBegin, int* _layerEnd)
+    {
+        // layer l reads slices up to (l + 1) * CELL_SIZE included
+        *_layerBegin = std::max(0, (_zBegin - 1) / CELL_SIZE);
+        *_layerEnd = std::max(*_layerBegin, (_zEnd - 1) / CELL_SIZE);
+    }
+
+
+    /*!
+    * \fn compute
+    * \brief Compute min and max values (native units) of the cells of a range of layers (multithreaded)
+    * \param _vol : voxels
+    * \param _layerBegin : first layer
+    * \param _layerEnd : layer after the last one (clamped to the grid)
+    * \param _out : [min ; max] per cell, x fastest, starting with cell (0, 0, _layerBegin)
+    */
+    template <typename VoxelType>
+    void compute(VolumeView<const VoxelType> _vol, int _layerBegin, int _layerEnd, glm::vec2* _out);
+
+    /*!
+    * \fn compute
+    * \brief Compute min and max values of the cells of a range of layers of a volume, in 3D texture units
+    * (i.e. in the units of sampled values, see VolumeImg::windowToTexture())
+    * \param _vol : volume
+    * \param _layerBegin : first layer
+    * \param _layerEnd : layer after the last one (clamped to the grid)
+    * \param _out : [min ; max] per cell (see above), resized
+    * \return false if the volume has no data in memory (e.g. out-of-core volume)
+    */
+    bool compute(VolumeImg* _vol, int _layerBegin, int _layerEnd, std::vector<glm::vec2>* _out);
+
+
+    /*! largest distance of a distance field (cells farther from any occupied cell get this distance) */
+    const int MAX_DISTANCE = 255;
+
+    /*!
+    * \fn distanceField
+    * \brief Chebyshev distance (in cells) from each cell to the nearest occupied cell, i.e. whose max is above a threshold
+    * (multithreaded, separable: distances along x, then y, then z)
+    * A sample in a cell at distance d > 0 lies in a block of (2d - 1)^3 empty cells centered on it, which rays can cross at once.
+    * Cells out of the grid are empty.
+    * \param _cells : [min ; max] per cell (see compute())
+    * \param _grid : grid dimensions (see gridDimensions())
+    * \param _threshold : cells whose max is above it are occupied (distance 0)
+    * \param _out : distance per cell, x fastest, capped to MAX_DISTANCE, resized
+    */
+    void distanceField(const std::vector<glm::vec2>& _cells, glm::ivec3 _grid, float _threshold, std::vector<std::uint8_t>* _out);
+
+}
+
+#endif // MACROCELLS_H
@@ -15,6 +15,8 @@
 //#define _USE_MATH_DEFINES
 //#include <math.h>
 #include <cstdlib>
+#include <chrono>
+#include <limits>
 
 #include "gui.h"
 
@@ -49,12 +51,23 @@ DrawableMesh* m_drawScreenQuad; /*!<  drawable object: screen quad */
 DrawableMesh* m_drawSliceA;     /*!<  drawable object: Axial slice */
 DrawableMesh* m_drawSliceC;     /*!<  drawable object: Coronal slice */
 DrawableMesh* m_drawSliceS;     /*!<  drawable object: Sagittal slice */
+DrawableMesh* m_drawSurface = nullptr;  /*!<  drawable object: extracted isosurface mesh (nullptr if none) */
+MarchingCubes::Mesh m_surface;          /*!<  extracted isosurface mesh (see MarchingCubes) */
+glm::mat4 m_surfaceTexMat;              /*!<  transformation of the vertex coords of the isosurface mesh to 3D tex coords */
 
 glm::mat4 m_modelMatrix;        /*!<  model matrix of the mesh */
     
 GLuint m_defaultVAO;            /*!<  default VAO */
 
 std::shared_ptr<VolumeImg> m_volume;
+VolumeLoader m_loader;                  /*!< background loader of volume files */
+bool m_restorePending = false;          /*!< m_previousVolume is to be displayed again if the current load does not complete */
+std::shared_ptr<VolumeImg> m_previousVolume;    /*!< in-core volume displayed before the load, restored if it is cancelled or fails */
+double m_uploadBudget = 4.0;            /*!< time budget (in ms) per frame to upload loaded slabs into 3D texture */
+TimeSeries m_timeSeries;                /*!< time series of volumes (cine playback) */
+bool m_timeSeriesShown = false;         /*!< a frame of the time series is displayed instead of the static volume */
+BrickPager m_brickPager;                /*!< out-of-core volume, paged from disk */
+bool m_pagedShown = false;              /*!< the out-of-core volume is displayed (through its brick atlas) */
 
 // FBOs
 GLuint m_frontFaceFBO;          /*!< FBO for front face rendering of bounding geometry: renders fragment position coords as rgb colors m_frontPos */
@@ -64,6 +77,9 @@ GLuint m_gBufferFBO;            /*!< FBO for G-buffer: renders fragment position
 // Textures
 RayCasting m_rayCasting;        /*!< Textures for ray-casting  */
 GLuint m_lookupTex;             /*!< TF 1D texture */
+VolumeStats::Stats m_volumeStats;   /*!< statistics of the displayed volume (histogram, range, etc.) */
+std::vector<glm::vec2> m_macrocells;    /*!< min-max macrocell grid of the volume (cells of m_rayCasting.macrocellTex) */
+float m_occupancyThreshold = std::numeric_limits<float>::quiet_NaN();   /*!< threshold of occupied macrocells of the distance field (NaN: to compute) */
 Gbuffer m_gBuf;                 /*!< screen-space textures for G-buffer  */
 
 // shader programs
@@ -74,6 +90,7 @@ GLuint m_programHybrid;         /*!< handle of the program object (i.e. shaders)
 GLuint m_programSlice;          /*!< handle of the program object (i.e. shaders) for slice rendering */
 GLuint m_programQuad;           /*!< handle of the program object (i.e. shaders) for screen quad rendering */
 GLuint m_programDeferred;       /*!< handle of the program object (i.e. shaders) for deferred screen space rendering of isosurface */
+GLuint m_programMesh;           /*!< handle of the program object (i.e. shaders) for isosurface mesh rendering (G-buffer) */
 
 
 // Slice orientation
@@ -93,6 +110,7 @@ bool m_startPanning3D = false;          /*! flag to indicate if panning is activ
 bool m_startPanningA = false;           /*! flag to indicate if panning is activated in axial view */
 bool m_startPanningC = false;           /*! flag to indicate if panning is activated in coronal view */
 bool m_startPanningS = false;           /*! flag to indicate if panning is activated in sagittal view */
+bool m_startRotatingPlane = false;      /*! flag to indicate if the oblique plane is rotated (dragged in the oblique view) */
 glm::vec2 m_prevMousePos(0.0f);
 std::vector<glm::vec3> m_randKernel;    /*! random kernel for SSAO  */
 GLuint m_noiseTex;                      /*! noise texture for SSAO  */
@@ -112,6 +130,21 @@ void calcViewportsCoords();
 void initScene();
 void setupImgui(GLFWwindow *window);
 void update();
+void updateLoading();
+void restorePreviousVolume();
+void updateTimeSeries();
+void updatePaging();
+void resetVolumeView();
+void updateVolumeStats(bool _applySettings = true);
+void updateFilter();
+void updateResample();
+void updateReformat();
+void updateSurface();
+void clearSurface();
+void updateDistanceField();
+void rebuildMacrocells(bool _withData = true);
+Reformat::Plane obliquePlane();
+void setSlab(DrawableMesh& _drawSlice, glm::vec3 _normal);
 void renderBoundingGeom();
 void renderRayCast();
 void renderSlice();
@@ -151,6 +184,9 @@ void initialize()
     // init model matrix
     m_modelMatrix = glm::mat4(1.0f);
 
+    // disk cache of data derived from volumes
+    DerivedCache::setDirectory(cacheDir);
+
     // new 3D image
     m_volume = std::make_shared<VolumeImg>();
 
@@ -186,10 +222,13 @@ void initialize()
     m_programSlice = loadShaderProgram(shaderDir + "slice.vert", shaderDir + "slice.frag");                     // Render textured slices 
     m_programQuad = loadShaderProgram(shaderDir + "screenQuad.vert", shaderDir + "screenQuad.frag");            // Renders screenQuad with texture one
     m_programDeferred = loadShaderProgram(shaderDir + "deferred.vert", shaderDir + "deferred.frag");
+    m_programMesh = loadShaderProgram(shaderDir + "mesh.vert", shaderDir + "mesh.frag");                        // Renders isosurface mesh into G-buffer
     
 
     // build 3D texture from volume and FBO for raycasting
      build3DTex(m_rayCasting.volTex, m_volume.get());
+     buildGradientTex(m_rayCasting.gradTex, m_volume.get());
+     rebuildMacrocells();
     // build FBO and texture output for front and back face rendering of bounding geometry
     buildScreenFBOandTex(m_frontFaceFBO, m_rayCasting.frontPosTex, TEX_WIDTH, TEX_HEIGHT);
     buildScreenFBOandTex(m_backFaceFBO, m_rayCasting.backPosTex, TEX_WIDTH, TEX_HEIGHT);
@@ -199,7 +238,7 @@ void initialize()
     
 
     // build transfer function
-    build1DTex(m_lookupTex);
+    updateVolumeStats();
 
     buildRandKernel(m_randKernel);
     buildKernelRot(m_noiseTex);
@@ -293,6 +332,454 @@ void update()
 }
 
 
+void updateLoading()
+{
+    VolumeLoader::LoadState state = m_loader.getState();
+    if (state == VolumeLoader::LOAD_FAILED)
+    {
+        // keep (or restore) the volume displayed before the load
+        m_loader.cancel();
+        restorePreviousVolume();
+        return;
+    }
+    if (!m_loader.isLoading())
+    {
+        // load cancelled: previous volume displayed again if needed
+        restorePreviousVolume();
+        return;
+    }
+    if (state != VolumeLoader::LOAD_DATA && state != VolumeLoader::LOAD_DONE)
+        return;
+
+    // header is read: switch to the new volume, with an empty texture
+    // (the previous in-core volume is kept until the load ends, to be restored if it does not complete)
+    if (m_loader.getVolume() != m_volume)
+    {
+        if (!m_restorePending)
+            m_previousVolume = m_pagedShown ? nullptr : m_volume;
+        m_restorePending = true;
+        m_volume = m_loader.getVolume();
+        build3DTex(m_rayCasting.volTex, m_volume.get(), m_ui.useTexNearest, false);
+        buildGradientTex(m_rayCasting.gradTex, nullptr);
+        rebuildMacrocells(false);
+        resetVolumeView();
+    }
+
+    // upload slabs finished by the loader, within the frame budget
+    // (cells only read the slices before the end of the slab: the next ones may still be processed by the loader thread)
+    auto tStart = std::chrono::steady_clock::now();
+    int zBegin, zEnd;
+    while (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count() < m_uploadBudget
+           && m_loader.nextSlab(&zBegin, &zEnd))
+    {
+        update3DTex(&m_rayCasting.volTex, m_volume.get(), zBegin, zEnd);
+        int layerBegin, layerEnd;
+        Macrocells::layersOfSlab(zBegin, zEnd, &layerBegin, &layerEnd);
+        updateMacrocellTex(m_rayCasting.macrocellTex, m_macrocells, m_volume.get(), layerBegin, layerEnd);
+    }
+
+    if (m_loader.finish())
+    {
+        // last layer of cells, completed by the end of the volume
+        int nbLayers = Macrocells::gridDimensions(m_volume->getDimensions()).z;
+        updateMacrocellTex(m_rayCasting.macrocellTex, m_macrocells, m_volume.get(), nbLayers - 1, nbLayers);
+
+        m_restorePending = false;
+        m_previousVolume.reset();
+        m_ui.window = m_volume->getDefaultWindow();
+        updateVolumeStats();
+
+        // gradients need the whole volume (and its value range)
+        buildGradientTex(m_rayCasting.gradTex, m_volume.get());
+
+        // mip levels need the whole volume too (also applies filtering possibly changed during loading)
+        build3DTexMipmaps(m_rayCasting.volTex, m_volume.get(), m_ui.useTexNearest);
+    }
+}
+
+
+void restorePreviousVolume()
+{
+    if (!m_restorePending)
+        return;
+    m_restorePending = false;
+    std::shared_ptr<VolumeImg> previous = std::move(m_previousVolume);
+    m_previousVolume.reset();
+
+    // a time series or paged volume replaces the load: it takes over the display
+    if (m_timeSeries.isOpen() || m_brickPager.isOpen())
+        return;
+
+    // the previous volume was out-of-core (its pager is closed): empty volume instead
+    if (!previous)
+    {
+        previous = std::make_shared<VolumeImg>();
+        previous->volumeInit();
+    }
+
+    m_volume = previous;
+    build3DTex(m_rayCasting.volTex, m_volume.get(), m_ui.useTexNearest);
+    buildGradientTex(m_rayCasting.gradTex, m_volume.get());
+    rebuildMacrocells();
+    resetVolumeView();
+    updateVolumeStats();
+    std::cout << "[INFO] restorePreviousVolume(): load of " << m_loader.getFileName() << " not completed, previous volume restored" << std::endl;
+}
+
+
+
+void updateTimeSeries()
+{
+    if (!m_timeSeries.isOpen())
+    {
+        // series closed: its last frame becomes the static volume, unless a volume being loaded or paged replaces it
+        // (its textures and statistics are then built by updateLoading() or updatePaging(), and the last frame is
+        // restored if the load does not complete)
+        if (m_timeSeriesShown)
+        {
+            m_timeSeriesShown = false;
+            if (m_loader.isLoading() && !m_restorePending)
+            {
+                m_previousVolume = m_volume;
+                m_restorePending = true;
+            }
+            else if (!m_loader.isLoading() && !m_brickPager.isOpen())
+            {
+                build3DTex(m_rayCasting.volTex, m_volume.get(), m_ui.useTexNearest);
+                buildGradientTex(m_rayCasting.gradTex, m_volume.get());
+                rebuildMacrocells();
+                updateVolumeStats();
+            }
+        }
+        return;
+    }
+
+    // upload prefetched frames, and move to the next one when due
+    if (!m_timeSeries.update(m_uploadBudget, m_ui.useTexNearest))
+        return;
+
+    m_volume = m_timeSeries.getVolume();
+    if (!m_timeSeriesShown)
+    {
+        // first frame: all frames share its dimensions, window and statistics
+        resetVolumeView();
+        updateVolumeStats();
+        m_timeSeriesShown = true;
+    }
+}
+
+
+void updatePaging()
+{
+    if (!m_brickPager.isOpen())
+    {
+        if (m_pagedShown)
+        {
+            // paging closed: back to an in-core volume (the one being loaded, if any)
+            m_drawScreenQuad->setPageTable(0);
+            m_drawSliceA->setPageTable(0);
+            m_drawSliceC->setPageTable(0);
+            m_drawSliceS->setPageTable(0);
+            m_pagedShown = false;
+            if (!m_loader.isLoading())
+            {
+                m_volume = std::make_shared<VolumeImg>();
+                m_volume->volumeInit();
+                build3DTex(m_rayCasting.volTex, m_volume.get(), m_ui.useTexNearest);
+                buildGradientTex(m_rayCasting.gradTex, m_volume.get());
+                rebuildMacrocells();
+                resetVolumeView();
+                updateVolumeStats();
+            }
+        }
+        return;
+    }
+
+    // view to list the needed bricks of
+    glm::ivec3 slices(-1);
+    bool volumeRendering = false;
+    glm::vec3 eye(0.5f);
+    if (m_pagedShown)
+    {
+        bool show3D = !m_ui.singleView || m_ui.mainViewOrient == 1;
+        bool showSlices3D = show3D && !m_ui.VR;
+        // (the oblique plane may cross any brick: all of them are listed, as for ray casting)
+        volumeRendering = (show3D && m_ui.VR) || (m_ui.singleView && m_ui.mainViewOrient == 5);
+
+        // slice views sample voxel (dimension - slice ID) along their axis (see renderSlice())
+        glm::ivec3 dims = m_volume->getDimensions();
+        if (!m_ui.singleView || m_ui.mainViewOrient == 4 || showSlices3D)
+            slices.x = std::max(0, std::min(dims.x - m_ui.sliceIdS, dims.x - 1));
+        if (!m_ui.singleView || m_ui.mainViewOrient == 3 || showSlices3D)
+            slices.y = std::max(0, std::min(dims.y - m_ui.sliceIdC, dims.y - 1));
+        if (!m_ui.singleView || m_ui.mainViewOrient == 2 || showSlices3D)
+            slices.z = std::max(0, std::min(dims.z - m_ui.sliceIdA, dims.z - 1));
+
+        // camera position in volume texture coordinates (i.e. 1 - position on the bounding geometry)
+        glm::mat4 modelView = m_camera3D.getViewMatrix() * m_modelMatrix * m_volume->volumeComputeModelMatrix();
+        eye = glm::vec3(1.0f) - glm::vec3(glm::inverse(modelView) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+
+    // upload paged bricks
+    if (!m_brickPager.update(m_ui.window, slices, volumeRendering, eye, m_uploadBudget))
+        return;
+
+    // volume ready: rendered through its brick atlas and page table
+    m_volume = m_brickPager.getVolume();
+    resetVolumeView();
+    updateVolumeStats();
+    glm::vec3 dims = glm::vec3(m_volume->getDimensions());
+    float brickSize = float(m_brickPager.getBrickSize());
+    m_drawScreenQuad->setPageTable(m_brickPager.getPageTableTexture(), dims, brickSize);
+    m_drawSliceA->setPageTable(m_brickPager.getPageTableTexture(), dims, brickSize);
+    m_drawSliceC->setPageTable(m_brickPager.getPageTableTexture(), dims, brickSize);
+    m_drawSliceS->setPageTable(m_brickPager.getPageTableTexture(), dims, brickSize);
+    m_brickPager.setNearest(m_ui.useTexNearest);
+    m_pagedShown = true;
+}
+
+
+void resetVolumeView()
+{
+    m_ui.window = m_volume->getDefaultWindow();
+    m_drawScreenQuad->setMaxSteps(static_cast<int>(glm::length(glm::vec3((float)m_volume->getDimensions().x,
+                                                                         (float)m_volume->getDimensions().y,
+                                                                         (float)m_volume->getDimensions().z))));
+    m_ui.sliceIdA = m_volume->getDimensions()[2] / 2;
+    m_ui.sliceIdC = m_volume->getDimensions()[1] / 2;
+    m_ui.sliceIdS = m_volume->getDimensions()[0] / 2;
+    clearSurface();
+}
+
+
+void updateVolumeStats(bool _applySettings)
+{
+    // out-of-core volumes have no data in memory: empty statistics, fixed TF
+    auto tStart = std::chrono::steady_clock::now();
+    m_volumeStats = VolumeStats::compute(*m_volume, VolumeStats::BINS_256);
+    if (!m_volumeStats.empty())
+        std::cout << "[INFO] updateVolumeStats(): mean " << m_volumeStats.mean << ", std. dev. " << std::sqrt(m_volumeStats.variance)
+                  << ", computed in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count()
+                  << " ms" << std::endl;
+
+    if (m_ui.autoSettings && _applySettings)
+        applyStatsSettings(m_ui, m_volumeStats, m_lookupTex);
+    else if (m_lookupTex == 0)
+        build1DTex(m_lookupTex);
+}
+
+
+void updateFilter()
+{
+    if (!m_ui.applyFilter)
+        return;
+    m_ui.applyFilter = false;
+
+    // filtered voxels replace the volume ones (range sigma of the bilateral filter is relative to the window)
+    auto tStart = std::chrono::steady_clock::now();
+    float sigmaRange = m_ui.filterRangeSigma * (m_ui.window.y - m_ui.window.x);
+    if (!VolumeFilter::apply(m_volume.get(), VolumeFilter::FilterType(m_ui.filterType), m_ui.filterSigma, m_ui.medianRadius, sigmaRange))
+    {
+        errorLog() << "[ERROR] updateFilter(): volume has no data in memory";
+        return;
+    }
+    std::cout << "[INFO] updateFilter(): filtered in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count() << " ms" << std::endl;
+
+    // re-upload, and rebuild what derives from the voxels (the window, TF and iso values set by the user are kept)
+    build3DTex(m_rayCasting.volTex, m_volume.get(), m_ui.useTexNearest);
+    buildGradientTex(m_rayCasting.gradTex, m_volume.get());
+    rebuildMacrocells();
+    clearSurface();
+    updateVolumeStats(false);
+}
+
+
+void updateResample()
+{
+    if (!m_ui.applyResample)
+        return;
+    m_ui.applyResample = false;
+
+    float spacing = m_ui.resampleToBudget
+                  ? VolumeResampler::spacingForBudget(m_volume->getDimensions(), m_volume->getSpacing(), size_t(m_ui.resampleBudget) * 1000000)
+                  : m_ui.resampleSpacing;
+
+    // dimensions first, so that oversized volumes are refused before allocating them
+    glm::ivec3 newDims = VolumeResampler::resampledDimensions(*m_volume, glm::vec3(spacing), m_ui.resampleReorient);
+    std::string sizeError = resampledSizeError(newDims);
+    if (!sizeError.empty())
+    {
+        errorLog() << "[ERROR] updateResample(): " << newDims.x << " x " << newDims.y << " x " << newDims.z << " volume is " << sizeError;
+        return;
+    }
+
+    auto tStart = std::chrono::steady_clock::now();
+    std::shared_ptr<VolumeImg> resampled = std::make_shared<VolumeImg>();
+    if (!VolumeResampler::resample(*m_volume, resampled.get(), glm::vec3(spacing), VolumeResampler::Kernel(m_ui.resampleKernel), m_ui.resampleReorient))
+    {
+        errorLog() << "[ERROR] updateResample(): volume has no data in memory";
+        return;
+    }
+    glm::ivec3 dims = resampled->getDimensions();
+    std::cout << "[INFO] updateResample(): resampled to " << dims.x << " x " << dims.y << " x " << dims.z << " in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count() << " ms" << std::endl;
+
+    // new volume, with the same window
+    glm::vec2 window = m_ui.window;
+    m_volume = resampled;
+    build3DTex(m_rayCasting.volTex, m_volume.get(), m_ui.useTexNearest);
+    buildGradientTex(m_rayCasting.gradTex, m_volume.get());
+    rebuildMacrocells();
+    resetVolumeView();
+    m_ui.window = window;
+    updateVolumeStats(false);
+}
+
+
+void updateReformat()
+{
+    if (!m_ui.saveReformat)
+        return;
+    m_ui.saveReformat = false;
+
+    // oblique plane as displayed, sampled at the finest spacing over a square of the volume diagonal
+    glm::vec3 spacing = m_volume->getSpacing();
+    float pixelSize = Reformat::slabStep(spacing);
+    float side = glm::length(glm::vec3(m_volume->getDimensions()) * spacing);
+    int size = std::max(1, int(std::ceil(side / pixelSize)));
+
+    auto tStart = std::chrono::steady_clock::now();
+    VolumeImg reformatted;
+    if (!Reformat::reformat(*m_volume, &reformatted, obliquePlane(), glm::ivec2(size), pixelSize,
+                            Reformat::SlabMode(m_ui.slabMode), m_ui.slabThickness, VolumeSampler::FILTER_TRILINEAR))
+    {
+        errorLog() << "[ERROR] updateReformat(): volume has no data in memory";
+        return;
+    }
+    std::cout << "[INFO] updateReformat(): " << size << " x " << size << " reformat computed in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count() << " ms" << std::endl;
+
+    reformatted.volumeSaveVVol(dataDir + baseFileName(m_ui.fileName) + "_mpr.vvol");
+}
+
+
+void updateSurface()
+{
+    if (m_ui.extractSurface)
+    {
+        m_ui.extractSurface = false;
+
+        // isovalue of the ray-cast isosurface, in native units
+        float isoValue = m_ui.window.x + (m_ui.window.y - m_ui.window.x) * float(m_ui.isoValue) / 255.0f;
+
+        auto tStart = std::chrono::steady_clock::now();
+        MarchingCubes::Mesh surface;
+        if (!MarchingCubes::extract(*m_volume, isoValue, &surface))
+        {
+            errorLog() << "[ERROR] updateSurface(): volume has no data in memory, or surface too large";
+            return;
+        }
+        std::cout << "[INFO] updateSurface(): " << surface.vertices.size() << " vertices, " << surface.nbTriangles() << " triangles extracted in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count() << " ms" << std::endl;
+
+        clearSurface();
+        m_surface = std::move(surface);
+        m_drawSurface = new DrawableMesh;
+        m_drawSurface->createMeshVAO(m_surface.vertices, m_surface.normals, m_surface.indices);
+        m_ui.surfaceIsoValue = m_ui.isoValue;
+
+        // vertex coords (voxel centers at origin + ijk * spacing) to 3D tex coords (voxel centers half a voxel inside)
+        glm::vec3 spacing = m_volume->getSpacing();
+        glm::vec3 extent = glm::vec3(m_volume->getDimensions()) * spacing;
+        m_surfaceTexMat = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f) / extent)
+                        * glm::translate(glm::mat4(1.0f), 0.5f * spacing - m_volume->getOrigin());
+    }
+
+    if (m_ui.exportSurface != 0)
+    {
+        // saved next to the loaded file
+        std::string fileName = dataDir + baseFileName(m_ui.fileName);
+        if (m_ui.exportSurface == 1)
+            MarchingCubes::savePLY(m_surface, fileName + ".ply");
+        else
+            MarchingCubes::saveSTL(m_surface, fileName + ".stl");
+        m_ui.exportSurface = 0;
+    }
+}
+
+
+void clearSurface()
+{
+    delete m_drawSurface;
+    m_drawSurface = nullptr;
+    m_surface = MarchingCubes::Mesh();
+    m_ui.surfaceIsoValue = -1;
+}
+
+
+Reformat::Plane obliquePlane()
+{
+    // rotated around the center of the volume
+    glm::vec3 spacing = m_volume->getSpacing();
+    glm::vec3 center = m_volume->getOrigin() + 0.5f * glm::vec3(m_volume->getDimensions() - glm::ivec3(1)) * spacing;
+    return Reformat::planeFromAngles(center, glm::radians(m_ui.planeYaw), glm::radians(m_ui.planePitch), m_ui.planeOffset);
+}
+
+
+void setSlab(DrawableMesh& _drawSlice, glm::vec3 _normal)
+{
+    // samples across the slab as the CPU reformat (see Reformat::nbSlabSamples()), along the normal in texture units
+    glm::vec3 spacing = m_volume->getSpacing();
+    glm::vec3 extent = glm::vec3(m_volume->getDimensions()) * spacing;
+    int nbSamples = 1;
+    if (m_ui.slabMode != Reformat::SLAB_THIN)
+        nbSamples = Reformat::nbSlabSamples(m_ui.slabThickness, Reformat::slabStep(spacing));
+    float step = nbSamples > 1 ? m_ui.slabThickness / float(nbSamples - 1) : 0.0f;
+    _drawSlice.setSlab(nbSamples > 1 ? m_ui.slabMode : Reformat::SLAB_THIN, nbSamples, step * _normal / extent);
+}
+
+
+void updateDistanceField()
+{
+    // not while loading: cells change with every slab
+    if (m_loader.isLoading() || m_macrocells.empty())
+    {
+        if (m_rayCasting.distanceFieldTex != 0)
+            buildDistanceFieldTex(m_rayCasting.distanceFieldTex, {}, glm::ivec3(0), 0.0f);
+        m_occupancyThreshold = std::numeric_limits<float>::quiet_NaN();
+        return;
+    }
+
+    // occupied macrocells (3D texture units): above the isovalue (isosurface and hybrid modes),
+    // above the low bound of the window otherwise (i.e. not transparent)
+    glm::vec2 window = m_drawScreenQuad->getWindow();
+    float threshold = window.x;
+    if (m_ui.VRmode == 3 || m_ui.VRmode == 4)
+        threshold = m_ui.isoValue > 0 ? window.x + (window.y - window.x) * float(m_ui.isoValue) / 255.0f
+                                      : -std::numeric_limits<float>::infinity();
+    // cells about the threshold are occupied, whatever the rounding in shaders
+    threshold -= 1.0e-4f * std::abs(window.y - window.x);
+    if (threshold == m_occupancyThreshold)
+        return;
+
+    auto tStart = std::chrono::steady_clock::now();
+    buildDistanceFieldTex(m_rayCasting.distanceFieldTex, m_macrocells, Macrocells::gridDimensions(m_volume->getDimensions()), threshold);
+    m_occupancyThreshold = threshold;
+    std::cout << "[INFO] updateDistanceField(): computed in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count() << " ms" << std::endl;
+}
+
+
+void rebuildMacrocells(bool _withData)
+{
+    buildMacrocellTex(m_rayCasting.macrocellTex, m_macrocells, m_volume.get(), _withData);
+
+    // the distance field was computed from the previous cells, whatever the threshold
+    m_occupancyThreshold = std::numeric_limits<float>::quiet_NaN();
+}
+
+
 
     /*------------------------------------------------------------------------------------------------------------+
     |                                                     DISPLAY                                                 |
@@ -374,6 +861,13 @@ void renderRayCast()
         viewID = 1;
     }
 
+    // coarser mip level (and larger steps) while the view is rotated or panned, full resolution when idle
+    // (only the static in-core volume has mip levels, see MipPyramid)
+    int lod = 0;
+    if ((m_trackball.isTracking() || m_lightTrackball.isTracking() || m_startPanning3D) && !m_timeSeriesShown && !m_pagedShown)
+        lod = std::min(m_ui.interactionLod, get3DTexMaxLevel(m_rayCasting.volTex));
+    m_drawScreenQuad->setLod(lod);
+
     if (m_ui.VRmode == 3 || m_ui.VRmode == 4)
     {
         // G-buffer for isosurface rendering
@@ -397,10 +891,23 @@ void renderRayCast()
                                     viewMat, 
                                     projMat };
  
-        GLuint program;
-        m_ui.VRmode == 4 ? program = m_programHybrid : program = m_programIsoSurf;
-        m_drawScreenQuad->drawIsoSurf(program, m_rayCasting, m_lookupTex, m_ui.isoValue, m_ui.isoValue2, mvpMatrices,
-                                      m_lightDir, glm::vec2(m_viewportDim[viewID].x, m_viewportDim[viewID].y), m_ui.transparency);
+        if (m_ui.VRmode == 3 && m_ui.showSurface && m_drawSurface != nullptr)
+        {
+            // rasterize the extracted isosurface mesh (depth tested) instead of ray casting it,
+            // placed as the bounding geometry and shaded as the ray-cast isosurface
+            glEnable(GL_DEPTH_TEST);
+            glDisable(GL_CULL_FACE);
+            m_drawSurface->setUseGammaCorrecFlag(m_drawScreenQuad->getUseGammaCorrecFlag());
+            MVPmatrices meshMatrices = { modelMat, viewMat, projMat };
+            m_drawSurface->drawMesh(m_programMesh, meshMatrices, m_surfaceTexMat, mvpMatrices.modelMat, m_lightDir);
+        }
+        else
+        {
+            GLuint program;
+            m_ui.VRmode == 4 ? program = m_programHybrid : program = m_programIsoSurf;
+            m_drawScreenQuad->drawIsoSurf(program, m_rayCasting, m_lookupTex, m_ui.isoValue, m_ui.isoValue2, mvpMatrices,
+                                          m_lightDir, glm::vec2(m_viewportDim[viewID].x, m_viewportDim[viewID].y), m_ui.transparency);
+        }
     
         if (m_ui.isBackgroundWhite)
             glClearColor(1.0f, 1.0f, 1.0f, 0.0);
@@ -493,6 +1000,10 @@ void renderSlices3D()
     translS -= 0.5f;
 
 
+    setSlab(*m_drawSliceA, glm::vec3(0.0f, 0.0f, 1.0f));
+    setSlab(*m_drawSliceC, glm::vec3(0.0f, 1.0f, 0.0f));
+    setSlab(*m_drawSliceS, glm::vec3(1.0f, 0.0f, 0.0f));
+
     MVPmatrices mvpMatrices = { modelMat * glm::translate(glm::mat4(1.0), glm::vec3(0.0f, 0.0f, translA)), viewMat, projMat };
     m_drawSliceA->drawSlice(m_programSlice, mvpMatrices, translMatA, m_rayCasting.volTex, m_lookupTex);
     mvpMatrices.modelMat = modelMat * glm::translate(glm::mat4(1.0), glm::vec3(0.0f, translC, 0.0f));
@@ -540,6 +1051,7 @@ void renderSlice()
             glm::mat4 texMat = glm::translate(glm::mat4(1.0), glm::vec3(0.0f, 0.0f, 1.0f - translA));
             glm::mat4 panMat = glm::translate(glm::mat4(1.0), m_translatA);
             MVPmatrices mvpMatrices = { panMat * modelMat, viewMat, projMat };
+            setSlab(*m_drawSliceA, glm::vec3(0.0f, 0.0f, 1.0f));
             m_drawSliceA->drawSlice(m_programSlice, mvpMatrices, texMat, m_rayCasting.volTex, m_lookupTex);
         }
         else if (i == 3 || (i == 0 && m_ui.mainViewOrient == 3))
@@ -550,6 +1062,7 @@ void renderSlice()
             glm::mat4 texMat = glm::translate(glm::mat4(1.0), glm::vec3(0.0f, 1.0f - translC, 0.0f));
             glm::mat4 panMat = glm::translate(glm::mat4(1.0), m_translatC);
             MVPmatrices mvpMatrices = { panMat * modelMat, viewMat, projMat };
+            setSlab(*m_drawSliceC, glm::vec3(0.0f, 1.0f, 0.0f));
             m_drawSliceC->drawSlice(m_programSlice, mvpMatrices, texMat, m_rayCasting.volTex, m_lookupTex);
         }
         else if (i == 4 || (i == 0 && m_ui.mainViewOrient == 4))
@@ -560,8 +1073,23 @@ void renderSlice()
             glm::mat4 texMat = glm::translate(glm::mat4(1.0), glm::vec3(1.0f - translS, 0.0f, 0.0f));
             glm::mat4 panMat = glm::translate(glm::mat4(1.0), m_translatS);
             MVPmatrices mvpMatrices = { panMat * modelMat, viewMat, projMat };
+            setSlab(*m_drawSliceS, glm::vec3(1.0f, 0.0f, 0.0f));
             m_drawSliceS->drawSlice(m_programSlice, mvpMatrices, texMat, m_rayCasting.volTex, m_lookupTex);
         }
+        else if (i == 0 && m_ui.mainViewOrient == 5)
+        {
+            // oblique plane, seen as the axial slice (same camera, zoom and panning)
+            // the quad spans the volume diagonal, i.e. a unit square in the normalized scene, so that it covers any section
+            Reformat::Plane plane = obliquePlane();
+            float side = glm::length(glm::vec3(m_volume->getDimensions()) * m_volume->getSpacing());
+            glm::mat4 viewMat = m_cameraA.getViewMatrix();
+            glm::mat4 projMat = m_cameraA.getProjectionMatrix();
+            glm::mat4 texMat = Reformat::textureMatrix(plane, side, m_volume->getOrigin(), m_volume->getSpacing(), m_volume->getDimensions());
+            glm::mat4 panMat = glm::translate(glm::mat4(1.0), m_translatA);
+            MVPmatrices mvpMatrices = { panMat, viewMat, projMat };
+            setSlab(*m_drawSliceA, plane.normal());
+            m_drawSliceA->drawSlice(m_programSlice, mvpMatrices, texMat, m_rayCasting.volTex, m_lookupTex);
+        }
         
     }
 }
@@ -569,6 +1097,25 @@ void renderSlice()
 
 void display()
 {
+    // during cine playback, render the current frame of the time series instead of the static volume
+    // (or the brick atlas of an out-of-core volume)
+    // (the precomputed gradients, macrocells and distance field are those of the static volume: shaders then fall back to
+    // finite differences and march through the whole volume)
+    GLuint staticVolTex = m_rayCasting.volTex;
+    GLuint staticGradTex = m_rayCasting.gradTex;
+    GLuint staticMacrocellTex = m_rayCasting.macrocellTex;
+    GLuint staticDistanceFieldTex = m_rayCasting.distanceFieldTex;
+    if (m_timeSeriesShown)
+        m_rayCasting.volTex = m_timeSeries.getTexture();
+    else if (m_pagedShown)
+        m_rayCasting.volTex = m_brickPager.getAtlasTexture();
+    if (m_timeSeriesShown || m_pagedShown)
+    {
+        m_rayCasting.gradTex = 0;
+        m_rayCasting.macrocellTex = 0;
+        m_rayCasting.distanceFieldTex = 0;
+    }
+
     if (!m_ui.singleView || (m_ui.singleView && m_ui.mainViewOrient == 1) )
     {
         if (m_ui.VR)
@@ -583,10 +1130,15 @@ void display()
         }
     }
     
-    if (!m_ui.singleView || (m_ui.singleView && (m_ui.mainViewOrient == 2 || m_ui.mainViewOrient == 3 || m_ui.mainViewOrient == 4)) )
+    if (!m_ui.singleView || (m_ui.singleView && (m_ui.mainViewOrient == 2 || m_ui.mainViewOrient == 3 || m_ui.mainViewOrient == 4 || m_ui.mainViewOrient == 5)) )
     {
         renderSlice();
     }
+
+    m_rayCasting.volTex = staticVolTex;
+    m_rayCasting.gradTex = staticGradTex;
+    m_rayCasting.macrocellTex = staticMacrocellTex;
+    m_rayCasting.distanceFieldTex = staticDistanceFieldTex;
 }
 
 
@@ -650,6 +1202,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
         m_programSlice = loadShaderProgram(shaderDir + "slice.vert", shaderDir + "slice.frag");                     // Render textured slices 
         m_programQuad = loadShaderProgram(shaderDir + "screenQuad.vert", shaderDir + "screenQuad.frag");
         m_programDeferred = loadShaderProgram(shaderDir + "deferred.vert", shaderDir + "deferred.frag");
+        m_programMesh = loadShaderProgram(shaderDir + "mesh.vert", shaderDir + "mesh.frag");
 
     }
 }
@@ -696,7 +1249,7 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 
                 m_prevMousePos = glm::vec2(x, y);
                 if ((!m_ui.singleView && x > m_viewportDim[1].x && y < m_viewportDim[1].y)
-                    || (m_ui.singleView && m_ui.mainViewOrient == 2))
+                    || (m_ui.singleView && (m_ui.mainViewOrient == 2 || m_ui.mainViewOrient == 5)))
                     m_startPanningA = true;
                 else if ((!m_ui.singleView && x < m_viewportDim[1].x && y > m_viewportDim[1].y)
                     || (m_ui.singleView && m_ui.mainViewOrient == 3))
@@ -705,6 +1258,12 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
                     || (m_ui.singleView && m_ui.mainViewOrient == 4))
                     m_startPanningS = true;
             }
+            else if (button == GLFW_MOUSE_BUTTON_LEFT && m_ui.singleView && m_ui.mainViewOrient == 5)
+            {
+                // rotate the oblique plane
+                m_prevMousePos = glm::vec2(x, y);
+                m_startRotatingPlane = true;
+            }
             else if (button == GLFW_MOUSE_BUTTON_RIGHT)
             {
                 std::cout << "pointer (X,Y) =  ( " << x << " , " << y << " ) --- " ;
@@ -723,7 +1282,10 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
             m_prevMousePos = glm::vec2(0.0f, 0.0f);
         }
         else if (button == GLFW_MOUSE_BUTTON_LEFT)
+        {
             m_trackball.stopTracking();
+            m_startRotatingPlane = false;
+        }
         else if (button == GLFW_MOUSE_BUTTON_RIGHT)
             m_lightTrackball.stopTracking();
     }
@@ -753,7 +1315,7 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 
     }
     else if ((!m_ui.singleView && x > m_viewportDim[1].x && y < m_viewportDim[1].y)
-        || (m_ui.singleView && m_ui.mainViewOrient == 2))
+        || (m_ui.singleView && (m_ui.mainViewOrient == 2 || m_ui.mainViewOrient == 5)))
     {
         // update zoom factor
         double newZoom = m_zoomFactA - yoffset / 30.0f;
@@ -803,6 +1365,17 @@ void cursorPosCallback(GLFWwindow* window, double x, double y)
     {
         m_lightTrackball.move(glm::vec2(x, y));
     }
+    else if (m_startRotatingPlane)
+    {
+        // half a degree per pixel: horizontal moves turn the oblique plane around Y, vertical ones tilt it
+        m_ui.planeYaw += 0.5f * float(x - m_prevMousePos.x);
+        if (m_ui.planeYaw > 180.0f)
+            m_ui.planeYaw -= 360.0f;
+        else if (m_ui.planeYaw < -180.0f)
+            m_ui.planeYaw += 360.0f;
+        m_ui.planePitch = std::clamp(m_ui.planePitch + 0.5f * float(y - m_prevMousePos.y), -90.0f, 90.0f);
+        m_prevMousePos = glm::vec2(x, y);
+    }
     else if (m_startPanningA || m_startPanningC || m_startPanningS || m_startPanning3D)
     {
         float width = (float)m_winWidth;
@@ -815,7 +1388,7 @@ void cursorPosCallback(GLFWwindow* window, double x, double y)
 
 
         if (((!m_ui.singleView && x > m_viewportDim[1].x && y < m_viewportDim[1].y)
-            || (m_ui.singleView && m_ui.mainViewOrient == 2))
+            || (m_ui.singleView && (m_ui.mainViewOrient == 2 || m_ui.mainViewOrient == 5)))
             && m_startPanningA)
         {
             // update axial translation vector
@@ -855,7 +1428,7 @@ void cursorPosCallback(GLFWwindow* window, double x, double y)
 
 void runGUI()
 {
-    GUI(m_ui, *m_volume, m_rayCasting.volTex, *m_drawScreenQuad, *m_drawSliceA, *m_drawSliceC, *m_drawSliceS);
+    GUI(m_ui, *m_volume, m_loader, m_timeSeries, m_brickPager, m_volumeStats, m_rayCasting.volTex, m_lookupTex, *m_drawScreenQuad, *m_drawSliceA, *m_drawSliceC, *m_drawSliceS);
 }
 
 int main(int argc, char** argv)
@@ -926,6 +1499,14 @@ int main(int argc, char** argv)
 
         // idle updates
         update();
+        updateLoading();
+        updateTimeSeries();
+        updatePaging();
+        updateFilter();
+        updateResample();
+        updateReformat();
+        updateSurface();
+        updateDistanceField();
         // rendering
         display();
         
@@ -936,6 +1517,11 @@ int main(int argc, char** argv)
         glfwSwapBuffers(m_window);
     }
 
+    // stop background loading, prefetching and paging, if any
+    m_loader.cancel();
+    m_timeSeries.close();
+    m_brickPager.close();
+
     // Cleanup imGui
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -0,0 +1,122 @@
+/*********************************************************************************************************************
+ *
+ * mappedFile.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#include "mappedFile.h"
+
+#ifdef _WIN32
+    #define NOMINMAX // avoid min*max macros to interfer with std::min/max from <windows.h>
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include "GLtools.h"
+
+
+bool MappedFile::open(const std::string& _filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(_filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        errorLog() << "MappedFile::open(): could not open " << _filename;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        errorLog() << "MappedFile::open(): empty or unreadable file " << _filename;
+        CloseHandle(file);
+        return false;
+    }
+
+    // PAGE_WRITECOPY + FILE_MAP_COPY = private copy-on-write view
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        errorLog() << "MappedFile::open(): could not create mapping for " << _filename;
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (view == nullptr)
+    {
+        errorLog() << "MappedFile::open(): could not map " << _filename;
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_fileHandle = file;
+    m_mappingHandle = mapping;
+    m_data = static_cast<std::uint8_t*>(view);
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(_filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        errorLog() << "MappedFile::open(): could not open " << _filename;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        errorLog() << "MappedFile::open(): empty or unreadable file " << _filename;
+        ::close(fd);
+        return false;
+    }
+
+    // MAP_PRIVATE = private copy-on-write view
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid once the descriptor is closed
+    ::close(fd);
+    if (view == MAP_FAILED)
+    {
+        errorLog() << "MappedFile::open(): could not map " << _filename;
+        return false;
+    }
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    m_data = static_cast<std::uint8_t*>(view);
+    m_size = static_cast<size_t>(st.st_size);
+#endif
+
+    return true;
+}
+
+
+void MappedFile::close()
+{
+    if (m_data == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(static_cast<HANDLE>(m_mappingHandle));
+    CloseHandle(static_cast<HANDLE>(m_fileHandle));
+    m_mappingHandle = nullptr;
+    m_fileHandle = nullptr;
+#else
+    munmap(m_data, m_size);
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
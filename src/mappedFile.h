@@ -0,0 +1,84 @@
+/*********************************************************************************************************************
+ *
+ * mappedFile.h
+ *
+ * Read-only memory-mapped file
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+/*!
+* \class MappedFile
+* \brief Maps the content of a file into memory
+* The mapping is private (copy-on-write): pages can be modified in place (e.g., byte swap)
+* without altering the file on disk, and only modified pages are duplicated in memory.
+*/
+class MappedFile
+{
+    public:
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                        CONSTRUCTORS / DESTRUCTORS                                           |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        MappedFile() {}
+
+        virtual ~MappedFile() { close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                   MISC                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*!
+        * \fn open
+        * \brief Map the whole content of a file into memory
+        * \param _filename : name of file to map
+        * \return true if mapping succeeded, false otherwise
+        */
+        bool open(const std::string& _filename);
+
+        /*!
+        * \fn close
+        * \brief Unmap the file (invalidates all pointers into the mapping)
+        */
+        void close();
+
+        inline bool isOpen() const { return m_data != nullptr; }
+        inline std::uint8_t* data() { return m_data; }
+        inline const std::uint8_t* data() const { return m_data; }
+        inline size_t size() const { return m_size; }
+
+
+    protected:
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                ATTRIBUTES                                                   |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        std::uint8_t* m_data = nullptr;     /*!< first byte of the mapping */
+        size_t m_size = 0;                  /*!< size of the mapping (i.e. file size) in bytes */
+
+#ifdef _WIN32
+        void* m_fileHandle = nullptr;       /*!< Win32 file handle */
+        void* m_mappingHandle = nullptr;    /*!< Win32 file mapping handle */
+#endif
+
+};
+
+#endif // MAPPEDFILE_H
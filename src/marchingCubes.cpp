@@ -0,0 +1,671 @@
+/*********************************************************************************************************************
+ *
+ * marchingCubes.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include "marchingCubes.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "volumeImg.h"
+#include "parallel.h"
+#include "GLtools.h"
+
+
+namespace MarchingCubes
+{
+
+namespace
+{
+    // max number of triangles in a cell (polygons of the case table are triangulated as fans)
+    const int maxCellTriangles = 8;
+
+    // corners of a cell: offsets along x, y and z
+    const int cornerOffsets[8][3] = { {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1} };
+
+    // edges of a cell: corners they join (from the lower coordinate)
+    const int edgeCorners[12][2] = { {0, 1}, {1, 2}, {3, 2}, {0, 3}, {4, 5}, {5, 6}, {7, 6}, {4, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7} };
+
+    // faces of a cell: corners, counter-clockwise seen from outside the cell
+    const int faceCorners[6][4] = { {0, 3, 2, 1}, {4, 5, 6, 7}, {0, 1, 5, 4}, {3, 7, 6, 2}, {0, 4, 7, 3}, {1, 2, 6, 5} };
+
+
+    /*!
+    * \struct CaseTable
+    * \brief Triangles of a cell for each configuration of its corners (bit c set if corner c is inside)
+    */
+    struct CaseTable
+    {
+        std::uint8_t nbTriangles[256];                      /*!< number of triangles */
+        std::int8_t edges[256][3 * maxCellTriangles];       /*!< edges holding the vertices of the triangles */
+    };
+
+    /*!
+    * \fn edgeIndex
+    * \brief Edge of a cell joining two corners (-1 if they are not adjacent)
+    */
+    int edgeIndex(int _a, int _b)
+    {
+        for (int e = 0; e < 12; e++)
+        {
+            if ((edgeCorners[e][0] == _a && edgeCorners[e][1] == _b) || (edgeCorners[e][0] == _b && edgeCorners[e][1] == _a))
+                return e;
+        }
+        return -1;
+    }
+
+    /*!
+    * \fn shareFace
+    * \brief True if two edges of a cell lie on the same face
+    */
+    bool shareFace(int _a, int _b)
+    {
+        for (int f = 0; f < 6; f++)
+        {
+            int nbCorners = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                for (int e : { _a, _b })
+                    nbCorners += (edgeCorners[e][0] == faceCorners[f][i] || edgeCorners[e][1] == faceCorners[f][i]) ? 1 : 0;
+            }
+            if (nbCorners == 4)
+                return true;
+        }
+        return false;
+    }
+
+    /*!
+    * \fn buildCaseTable
+    * \brief Triangulate each case from the contour of the surface on the faces of the cell
+    * On each face, going counter-clockwise, the contour enters at an edge from an outside to an inside corner,
+    * and leaves at the next edge from an inside to an outside corner: inside corners of ambiguous faces are separated.
+    * A crossed edge is left by the contour on one of its faces, and entered on the other one, so that the segments
+    * of all faces chain into closed polygons, oriented counter-clockwise seen from outside the surface.
+    */
+    CaseTable buildCaseTable()
+    {
+        CaseTable table;
+        for (int c = 0; c < 256; c++)
+        {
+            auto inside = [c](int _corner) { return ((c >> _corner) & 1) != 0; };
+
+            // next crossed edge along the contour
+            int next[12];
+            std::fill(next, next + 12, -1);
+            for (int f = 0; f < 6; f++)
+            {
+                const int* q = faceCorners[f];
+                for (int e = 0; e < 4; e++)
+                {
+                    if (inside(q[e]) || !inside(q[(e + 1) % 4]))
+                        continue;
+                    for (int p = e + 1; p < e + 4; p++)
+                    {
+                        if (inside(q[p % 4]) && !inside(q[(p + 1) % 4]))
+                        {
+                            next[edgeIndex(q[e], q[(e + 1) % 4])] = edgeIndex(q[p % 4], q[(p + 1) % 4]);
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // polygons, triangulated as fans
+            int nbTriangles = 0;
+            bool visited[12] = {};
+            for (int start = 0; start < 12; start++)
+            {
+                if (next[start] < 0 || visited[start])
+                    continue;
+                int polygon[12];
+                int size = 0;
+                for (int e = start; !visited[e]; e = next[e])
+                {
+                    visited[e] = true;
+                    polygon[size++] = e;
+                }
+
+                // fan apex whose diagonals all cross the cell: a diagonal along a face could also be a diagonal
+                // of the neighbor cell (ambiguous face), and its edge would then be shared by 4 triangles
+                // (such an apex exists for every polygon of the table)
+                int apex = 0;
+                for (int a = 0; a < size; a++)
+                {
+                    bool inner = true;
+                    for (int v = 2; v + 1 < size && inner; v++)
+                        inner = !shareFace(polygon[a], polygon[(a + v) % size]);
+                    if (inner)
+                    {
+                        apex = a;
+                        break;
+                    }
+                }
+                for (int v = 1; v + 1 < size; v++)
+                {
+                    table.edges[c][3 * nbTriangles] = std::int8_t(polygon[apex]);
+                    table.edges[c][3 * nbTriangles + 1] = std::int8_t(polygon[(apex + v) % size]);
+                    table.edges[c][3 * nbTriangles + 2] = std::int8_t(polygon[(apex + v + 1) % size]);
+                    nbTriangles++;
+                }
+            }
+            table.nbTriangles[c] = std::uint8_t(nbTriangles);
+        }
+        return table;
+    }
+
+    /*!
+    * \fn caseTable
+    * \brief Case table, built once
+    */
+    const CaseTable& caseTable()
+    {
+        static const CaseTable table = buildCaseTable();
+        return table;
+    }
+
+
+    /*!
+    * \struct RowInfo
+    * \brief Crossed edges starting from the voxels of a grid row, and triangles of the cells starting from it
+    */
+    struct RowInfo
+    {
+        std::uint32_t nbEdges[3] = { 0, 0, 0 }; /*!< number of crossed edges along x, y and z */
+        std::uint32_t nbTriangles = 0;          /*!< number of triangles of the cells */
+        int first = 0;                          /*!< first voxel with a crossed edge */
+        int last = -1;                          /*!< last voxel with a crossed edge (-1 if none) */
+        size_t firstVertex = 0;                 /*!< index of the first vertex of the row (x edges, then y and z edges) */
+        size_t firstTriangle = 0;               /*!< index of the first triangle of the cells */
+    };
+
+
+    /*!
+    * \struct Grid
+    * \brief Voxels, and what is needed to place vertices
+    */
+    template <typename VoxelType>
+    struct Grid
+    {
+        VolumeView<const VoxelType> vol;
+        glm::ivec3 dims;
+        glm::vec3 origin;
+        glm::vec3 spacing;
+        float isoValue;
+
+        inline float value(int _i, int _j, int _k) const { return float(vol.row(_j, _k)[_i]); }
+        inline bool inside(const VoxelType* _row, int _i) const { return float(_row[_i]) >= isoValue; }
+
+        // gradient by central differences (one-sided on the borders), world units
+        glm::vec3 gradient(int _i, int _j, int _k) const
+        {
+            glm::ivec3 p(_i, _j, _k);
+            glm::vec3 g;
+            for (int a = 0; a < 3; a++)
+            {
+                glm::ivec3 lo = p, hi = p;
+                lo[a] = std::max(p[a] - 1, 0);
+                hi[a] = std::min(p[a] + 1, dims[a] - 1);
+                float step = float(hi[a] - lo[a]) * spacing[a];
+                g[a] = step != 0.0f ? (value(hi.x, hi.y, hi.z) - value(lo.x, lo.y, lo.z)) / step : 0.0f;
+            }
+            return g;
+        }
+    };
+
+
+    /*!
+    * \fn countRow
+    * \brief Count the crossed edges starting from the voxels of a row, and trim it to them
+    */
+    template <typename VoxelType>
+    void countRow(const Grid<VoxelType>& _g, int _j, int _k, RowInfo& _info)
+    {
+        const VoxelType* row = _g.vol.row(_j, _k);
+        const VoxelType* rowY = _j + 1 < _g.dims.y ? _g.vol.row(_j + 1, _k) : nullptr;
+        const VoxelType* rowZ = _k + 1 < _g.dims.z ? _g.vol.row(_j, _k + 1) : nullptr;
+        const int nx = _g.dims.x;
+
+        _info = RowInfo();
+        _info.first = nx;
+        bool in = _g.inside(row, 0);
+        for (int i = 0; i < nx; i++)
+        {
+            bool inNext = i + 1 < nx && _g.inside(row, i + 1);
+            bool crossedX = i + 1 < nx && in != inNext;
+            bool crossedY = rowY && in != _g.inside(rowY, i);
+            bool crossedZ = rowZ && in != _g.inside(rowZ, i);
+            if (crossedX || crossedY || crossedZ)
+            {
+                _info.nbEdges[0] += crossedX;
+                _info.nbEdges[1] += crossedY;
+                _info.nbEdges[2] += crossedZ;
+                _info.first = std::min(_info.first, i);
+                _info.last = i;
+            }
+            in = inNext;
+        }
+    }
+
+    /*!
+    * \fn cellRange
+    * \brief Cells of a row of cells that may hold triangles: those touching crossed edges of its 4 grid rows
+    * \return false if none
+    */
+    inline bool cellRange(const RowInfo* _rows[4], int _nx, int* _first, int* _last)
+    {
+        int first = _nx, last = -1;
+        for (int r = 0; r < 4; r++)
+        {
+            if (_rows[r]->last < 0)
+                continue;
+            first = std::min(first, _rows[r]->first);
+            last = std::max(last, _rows[r]->last);
+        }
+        *_first = std::max(first - 1, 0);
+        *_last = std::min(last, _nx - 2);
+        return *_first <= *_last;
+    }
+
+    /*!
+    * \fn cellCase
+    * \brief Case of a cell from its 4 grid rows (j, k), (j + 1, k), (j, k + 1), (j + 1, k + 1)
+    */
+    template <typename VoxelType>
+    inline int cellCase(const Grid<VoxelType>& _g, const VoxelType* const _rows[4], int _i)
+    {
+        return  int(_g.inside(_rows[0], _i))            | int(_g.inside(_rows[0], _i + 1)) << 1
+              | int(_g.inside(_rows[1], _i + 1)) << 2   | int(_g.inside(_rows[1], _i)) << 3
+              | int(_g.inside(_rows[2], _i)) << 4       | int(_g.inside(_rows[2], _i + 1)) << 5
+              | int(_g.inside(_rows[3], _i + 1)) << 6   | int(_g.inside(_rows[3], _i)) << 7;
+    }
+
+    /*!
+    * \fn crossed
+    * \brief Whether an edge of a cell is crossed by the surface, from the case of the cell
+    */
+    inline std::uint32_t crossed(int _case, int _edge)
+    {
+        return ((_case >> edgeCorners[_edge][0]) ^ (_case >> edgeCorners[_edge][1])) & 1;
+    }
+
+    /*!
+    * \fn edgeVertex
+    * \brief Vertex on a crossed edge starting from voxel (i, j, k) along an axis
+    */
+    template <typename VoxelType>
+    void edgeVertex(const Grid<VoxelType>& _g, int _i, int _j, int _k, int _axis, glm::vec3* _position, glm::vec3* _normal)
+    {
+        glm::ivec3 a(_i, _j, _k);
+        glm::ivec3 b = a;
+        b[_axis]++;
+        float va = _g.value(a.x, a.y, a.z);
+        float vb = _g.value(b.x, b.y, b.z);
+        float t = std::clamp((_g.isoValue - va) / (vb - va), 0.0f, 1.0f);
+
+        glm::vec3 voxel(a);
+        voxel[_axis] += t;
+        *_position = _g.origin + voxel * _g.spacing;
+
+        // toward lower values (along the edge for flat gradients)
+        glm::vec3 gradient = (1.0f - t) * _g.gradient(a.x, a.y, a.z) + t * _g.gradient(b.x, b.y, b.z);
+        float length = glm::length(gradient);
+        if (length > 0.0f)
+            *_normal = -gradient / length;
+        else
+        {
+            *_normal = glm::vec3(0.0f);
+            (*_normal)[_axis] = va >= _g.isoValue ? 1.0f : -1.0f;
+        }
+    }
+
+    /*!
+    * \fn writeRowVertices
+    * \brief Vertices on the crossed edges starting from the voxels of a row
+    */
+    template <typename VoxelType>
+    void writeRowVertices(const Grid<VoxelType>& _g, int _j, int _k, const RowInfo& _info, Mesh* _mesh)
+    {
+        size_t v[3];
+        v[0] = _info.firstVertex;
+        v[1] = v[0] + _info.nbEdges[0];
+        v[2] = v[1] + _info.nbEdges[1];
+
+        const VoxelType* row = _g.vol.row(_j, _k);
+        const VoxelType* rowY = _j + 1 < _g.dims.y ? _g.vol.row(_j + 1, _k) : nullptr;
+        const VoxelType* rowZ = _k + 1 < _g.dims.z ? _g.vol.row(_j, _k + 1) : nullptr;
+        for (int i = _info.first; i <= _info.last; i++)
+        {
+            bool in = _g.inside(row, i);
+            bool crossedEdges[3] = { i + 1 < _g.dims.x && in != _g.inside(row, i + 1),
+                                     rowY && in != _g.inside(rowY, i),
+                                     rowZ && in != _g.inside(rowZ, i) };
+            for (int a = 0; a < 3; a++)
+            {
+                if (crossedEdges[a])
+                {
+                    edgeVertex(_g, i, _j, _k, a, &_mesh->vertices[v[a]], &_mesh->normals[v[a]]);
+                    v[a]++;
+                }
+            }
+        }
+    }
+
+    /*!
+    * \fn writeRowTriangles
+    * \brief Triangles of a row of cells (j, k)
+    * Vertices are indexed by counting the crossed edges met along the 4 grid rows of the cells.
+    */
+    template <typename VoxelType>
+    void writeRowTriangles(const Grid<VoxelType>& _g, int _j, int _k, const RowInfo* _rows[4], size_t _firstTriangle, Mesh* _mesh)
+    {
+        int first, last;
+        if (!cellRange(_rows, _g.dims.x, &first, &last))
+            return;
+
+        const CaseTable& table = caseTable();
+        const VoxelType* const rows[4] = { _g.vol.row(_j, _k), _g.vol.row(_j + 1, _k), _g.vol.row(_j, _k + 1), _g.vol.row(_j + 1, _k + 1) };
+
+        // next vertex along each grid row: x edges of the 4 rows, y edges of rows (j, k) and (j, k + 1),
+        // z edges of rows (j, k) and (j + 1, k)
+        size_t x00 = _rows[0]->firstVertex;
+        size_t x10 = _rows[1]->firstVertex;
+        size_t x01 = _rows[2]->firstVertex;
+        size_t x11 = _rows[3]->firstVertex;
+        size_t y00 = x00 + _rows[0]->nbEdges[0];
+        size_t y01 = x01 + _rows[2]->nbEdges[0];
+        size_t z00 = y00 + _rows[0]->nbEdges[1];
+        size_t z10 = x10 + _rows[1]->nbEdges[0] + _rows[1]->nbEdges[1];
+
+        std::uint32_t* indices = _mesh->indices.data() + 3 * _firstTriangle;
+        for (int i = first; i <= last; i++)
+        {
+            int c = cellCase(_g, rows, i);
+            int nbTriangles = table.nbTriangles[c];
+            if (nbTriangles > 0)
+            {
+                std::uint32_t edgeVertices[12];
+                edgeVertices[0] = std::uint32_t(x00);
+                edgeVertices[2] = std::uint32_t(x10);
+                edgeVertices[4] = std::uint32_t(x01);
+                edgeVertices[6] = std::uint32_t(x11);
+                edgeVertices[3] = std::uint32_t(y00);
+                edgeVertices[1] = std::uint32_t(y00 + crossed(c, 3));
+                edgeVertices[7] = std::uint32_t(y01);
+                edgeVertices[5] = std::uint32_t(y01 + crossed(c, 7));
+                edgeVertices[8] = std::uint32_t(z00);
+                edgeVertices[9] = std::uint32_t(z00 + crossed(c, 8));
+                edgeVertices[11] = std::uint32_t(z10);
+                edgeVertices[10] = std::uint32_t(z10 + crossed(c, 11));
+
+                const std::int8_t* edges = table.edges[c];
+                for (int t = 0; t < 3 * nbTriangles; t++)
+                    indices[t] = edgeVertices[edges[t]];
+                indices += 3 * nbTriangles;
+            }
+
+            x00 += crossed(c, 0);
+            x10 += crossed(c, 2);
+            x01 += crossed(c, 4);
+            x11 += crossed(c, 6);
+            y00 += crossed(c, 3);
+            y01 += crossed(c, 7);
+            z00 += crossed(c, 8);
+            z10 += crossed(c, 11);
+        }
+    }
+
+    /*!
+    * \fn writeValues
+    * \brief Write values to a binary file, in native byte order (little endian, see savePLY() and saveSTL())
+    */
+    template <typename T>
+    void writeValues(std::ofstream& _file, const T* _values, size_t _count)
+    {
+        _file.write(reinterpret_cast<const char*>(_values), std::streamsize(_count * sizeof(T)));
+    }
+
+} // namespace
+
+
+template <typename VoxelType>
+bool extract(VolumeView<const VoxelType> _vol, glm::vec3 _origin, glm::vec3 _spacing, float _isoValue, Mesh* _mesh)
+{
+    *_mesh = Mesh();
+    glm::ivec3 dims = _vol.getDimensions();
+    if (dims.x < 2 || dims.y < 2 || dims.z < 2 || std::isnan(_isoValue))
+        return true;
+
+    Grid<VoxelType> g{ _vol, dims, _origin, _spacing, _isoValue };
+    const int ny = dims.y;
+    auto rowIndex = [ny](int _j, int _k) { return size_t(_k) * size_t(ny) + size_t(_j); };
+
+    // crossed edges of each grid row
+    std::vector<RowInfo> rows(size_t(dims.y) * size_t(dims.z));
+    Parallel::parallelFor(0, size_t(dims.z), [&](size_t _first, size_t _last)
+    {
+        for (int k = int(_first); k < int(_last); k++)
+            for (int j = 0; j < dims.y; j++)
+                countRow(g, j, k, rows[rowIndex(j, k)]);
+    });
+
+    // triangles of each row of cells
+    Parallel::parallelFor(0, size_t(dims.z - 1), [&](size_t _first, size_t _last)
+    {
+        const CaseTable& table = caseTable();
+        for (int k = int(_first); k < int(_last); k++)
+        {
+            for (int j = 0; j < dims.y - 1; j++)
+            {
+                const RowInfo* cellRows[4] = { &rows[rowIndex(j, k)], &rows[rowIndex(j + 1, k)], &rows[rowIndex(j, k + 1)], &rows[rowIndex(j + 1, k + 1)] };
+                int first, last;
+                if (!cellRange(cellRows, dims.x, &first, &last))
+                    continue;
+                const VoxelType* const voxelRows[4] = { _vol.row(j, k), _vol.row(j + 1, k), _vol.row(j, k + 1), _vol.row(j + 1, k + 1) };
+                std::uint32_t nbTriangles = 0;
+                for (int i = first; i <= last; i++)
+                    nbTriangles += table.nbTriangles[cellCase(g, voxelRows, i)];
+                rows[rowIndex(j, k)].nbTriangles = nbTriangles;
+            }
+        }
+    });
+
+    // first vertex and triangle of each row
+    size_t nbVertices = 0;
+    size_t nbTriangles = 0;
+    for (RowInfo& row : rows)
+    {
+        row.firstVertex = nbVertices;
+        row.firstTriangle = nbTriangles;
+        nbVertices += size_t(row.nbEdges[0]) + size_t(row.nbEdges[1]) + size_t(row.nbEdges[2]);
+        nbTriangles += row.nbTriangles;
+    }
+    if (nbVertices > size_t(std::numeric_limits<std::uint32_t>::max()))
+        return false;
+
+    _mesh->vertices.resize(nbVertices);
+    _mesh->normals.resize(nbVertices);
+    _mesh->indices.resize(3 * nbTriangles);
+
+    // vertices and triangles, by slabs of rows
+    Parallel::parallelFor(0, size_t(dims.z), [&](size_t _first, size_t _last)
+    {
+        for (int k = int(_first); k < int(_last); k++)
+        {
+            for (int j = 0; j < dims.y; j++)
+            {
+                const RowInfo& row = rows[rowIndex(j, k)];
+                if (row.last >= 0)
+                    writeRowVertices(g, j, k, row, _mesh);
+                if (j + 1 < dims.y && k + 1 < dims.z && row.nbTriangles > 0)
+                {
+                    const RowInfo* cellRows[4] = { &row, &rows[rowIndex(j + 1, k)], &rows[rowIndex(j, k + 1)], &rows[rowIndex(j + 1, k + 1)] };
+                    writeRowTriangles(g, j, k, cellRows, row.firstTriangle, _mesh);
+                }
+            }
+        }
+    });
+
+    return true;
+}
+
+template bool extract<std::uint8_t>(VolumeView<const std::uint8_t>, glm::vec3, glm::vec3, float, Mesh*);
+template bool extract<std::uint16_t>(VolumeView<const std::uint16_t>, glm::vec3, glm::vec3, float, Mesh*);
+template bool extract<std::int16_t>(VolumeView<const std::int16_t>, glm::vec3, glm::vec3, float, Mesh*);
+template bool extract<float>(VolumeView<const float>, glm::vec3, glm::vec3, float, Mesh*);
+
+
+bool extract(VolumeImg& _vol, float _isoValue, Mesh* _mesh)
+{
+    *_mesh = Mesh();
+    const size_t nbVoxels = _vol.getNbVoxels();
+    bool done = false;
+    _vol.visit([&](auto& _typedVol)
+    {
+        // no data (e.g. out-of-core volume)
+        if (nbVoxels == 0 || _typedVol.getStorage().size() != nbVoxels)
+            return;
+
+        done = extract(std::as_const(_typedVol).view(), _vol.getOrigin(), _vol.getSpacing(), _isoValue, _mesh);
+    });
+    return done;
+}
+
+
+bool savePLY(const Mesh& _mesh, const std::string& _fileName)
+{
+    if (std::endian::native != std::endian::little)
+    {
+        errorLog() << "MarchingCubes::savePLY(): binary meshes are only written on little endian hosts";
+        return false;
+    }
+
+    std::ofstream file(_fileName, std::ios::binary);
+    if (!file)
+    {
+        errorLog() << "MarchingCubes::savePLY(): could not open " << _fileName;
+        return false;
+    }
+
+    file << "ply\n"
+         << "format binary_little_endian 1.0\n"
+         << "element vertex " << _mesh.vertices.size() << "\n"
+         << "property float x\nproperty float y\nproperty float z\n"
+         << "property float nx\nproperty float ny\nproperty float nz\n"
+         << "element face " << _mesh.nbTriangles() << "\n"
+         << "property list uchar uint vertex_indices\n"
+         << "end_header\n";
+
+    // interleaved vertex positions and normals, then faces (by blocks, to keep writes large)
+    const size_t blockSize = 1 << 16;
+    std::vector<float> vertexBlock;
+    vertexBlock.reserve(6 * blockSize);
+    for (size_t first = 0; first < _mesh.vertices.size(); first += blockSize)
+    {
+        vertexBlock.clear();
+        size_t last = std::min(first + blockSize, _mesh.vertices.size());
+        for (size_t v = first; v < last; v++)
+        {
+            const glm::vec3& p = _mesh.vertices[v];
+            const glm::vec3& n = _mesh.normals[v];
+            vertexBlock.insert(vertexBlock.end(), { p.x, p.y, p.z, n.x, n.y, n.z });
+        }
+        writeValues(file, vertexBlock.data(), vertexBlock.size());
+    }
+
+    const size_t faceSize = 1 + 3 * sizeof(std::uint32_t);
+    std::vector<char> faceBlock(faceSize * blockSize);
+    for (size_t first = 0; first < _mesh.nbTriangles(); first += blockSize)
+    {
+        size_t last = std::min(first + blockSize, _mesh.nbTriangles());
+        char* face = faceBlock.data();
+        for (size_t t = first; t < last; t++, face += faceSize)
+        {
+            face[0] = 3;
+            std::memcpy(face + 1, &_mesh.indices[3 * t], 3 * sizeof(std::uint32_t));
+        }
+        writeValues(file, faceBlock.data(), (last - first) * faceSize);
+    }
+
+    if (!file)
+    {
+        errorLog() << "MarchingCubes::savePLY(): could not write " << _fileName;
+        return false;
+    }
+    std::cout << "[INFO] MarchingCubes::savePLY(): " << _fileName << ": " << _mesh.vertices.size() << " vertices, "
+              << _mesh.nbTriangles() << " triangles" << std::endl;
+    return true;
+}
+
+
+bool saveSTL(const Mesh& _mesh, const std::string& _fileName)
+{
+    if (std::endian::native != std::endian::little)
+    {
+        errorLog() << "MarchingCubes::saveSTL(): binary meshes are only written on little endian hosts";
+        return false;
+    }
+
+    std::ofstream file(_fileName, std::ios::binary);
+    if (!file)
+    {
+        errorLog() << "MarchingCubes::saveSTL(): could not open " << _fileName;
+        return false;
+    }
+
+    // 80-byte header (must not start with "solid"), triangle count
+    char header[80] = {};
+    std::strncpy(header, "Vol_viewer isosurface", sizeof(header) - 1);
+    writeValues(file, header, sizeof(header));
+    std::uint32_t nbTriangles = std::uint32_t(_mesh.nbTriangles());
+    writeValues(file, &nbTriangles, 1);
+
+    // per triangle: facet normal, 3 vertices, attribute byte count (0), i.e. 50 bytes
+    const size_t facetSize = 50;
+    const size_t blockSize = 1 << 16;
+    std::vector<char> block(facetSize * blockSize);
+    for (size_t first = 0; first < _mesh.nbTriangles(); first += blockSize)
+    {
+        size_t last = std::min(first + blockSize, _mesh.nbTriangles());
+        char* facet = block.data();
+        for (size_t t = first; t < last; t++, facet += facetSize)
+        {
+            const glm::vec3& a = _mesh.vertices[_mesh.indices[3 * t]];
+            const glm::vec3& b = _mesh.vertices[_mesh.indices[3 * t + 1]];
+            const glm::vec3& c = _mesh.vertices[_mesh.indices[3 * t + 2]];
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+
+            float values[12] = { normal.x, normal.y, normal.z, a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z };
+            std::uint16_t attributes = 0;
+            std::memcpy(facet, values, sizeof(values));
+            std::memcpy(facet + sizeof(values), &attributes, sizeof(attributes));
+        }
+        writeValues(file, block.data(), (last - first) * facetSize);
+    }
+
+    if (!file)
+    {
+        errorLog() << "MarchingCubes::saveSTL(): could not write " << _fileName;
+        return false;
+    }
+    std::cout << "[INFO] MarchingCubes::saveSTL(): " << _fileName << ": " << _mesh.nbTriangles() << " triangles" << std::endl;
+    return true;
+}
+
+} // namespace MarchingCubes
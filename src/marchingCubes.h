@@ -0,0 +1,107 @@
+/*********************************************************************************************************************
+ *
+ * marchingCubes.h
+ *
+ * Isosurface extraction of volumes into indexed triangle meshes (marching cubes), and mesh export (binary PLY/STL)
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef MARCHINGCUBES_H
+#define MARCHINGCUBES_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "volumeView.h"
+
+
+class VolumeImg;
+
+
+/*!
+* \namespace MarchingCubes
+* \brief Triangle mesh of the isosurface of a volume, extracted once on the CPU so that it can be rasterized
+* (instead of ray casting the isosurface in every frame).
+* Voxels at or above the isovalue are inside (as in the isosurface shader). Cells are triangulated from a case table
+* built from the faces of the cell: ambiguous faces always separate their inside corners, so that neighbor cells agree
+* and the surface has no crack (it is only open where it reaches the bounds of the volume).
+* Vertices on the edges of the grid are shared by the triangles of the cells around them, without any hash table:
+* each grid row (i.e. row of voxels along x) owns the edges starting from its voxels, and the vertices of a row are
+* stored contiguously, x edges first, then y and z edges. A first pass counts the crossed edges and the triangles
+* of each row, so that rows are then processed in parallel (threads process slabs of rows along z), each one
+* writing its vertices and triangles at offsets given by prefix sums of the counts.
+* Rows are trimmed to the range of their crossed edges, so that empty parts of the volume are skipped quickly.
+* Vertices are in the coordinates of VolumeSampler (voxel (i, j, k) is centered on origin + (i, j, k) * spacing).
+*/
+namespace MarchingCubes
+{
+
+    /*!
+    * \struct Mesh
+    * \brief Indexed triangle mesh
+    */
+    struct Mesh
+    {
+        std::vector<glm::vec3> vertices;        /*!< vertex positions */
+        std::vector<glm::vec3> normals;         /*!< unit vertex normals, toward lower values (i.e. out of objects brighter than the isovalue) */
+        std::vector<std::uint32_t> indices;     /*!< 3 vertex indices per triangle, counter-clockwise seen from outside */
+
+        /*! \fn nbTriangles */
+        inline size_t nbTriangles() const { return indices.size() / 3; }
+        /*! \fn empty */
+        inline bool empty() const { return indices.empty(); }
+    };
+
+
+    /*!
+    * \fn extract
+    * \brief Extract the isosurface of a voxel grid (multithreaded, see MarchingCubes)
+    * \param _vol : voxels
+    * \param _origin : center of voxel (0, 0, 0)
+    * \param _spacing : distance between voxel centers along each axis
+    * \param _isoValue : isovalue (native units)
+    * \param _mesh : extracted surface (replaced)
+    * \return false if the surface has too many vertices for 32-bit indices (empty mesh)
+    */
+    template <typename VoxelType>
+    bool extract(VolumeView<const VoxelType> _vol, glm::vec3 _origin, glm::vec3 _spacing, float _isoValue, Mesh* _mesh);
+
+    /*!
+    * \fn extract
+    * \brief Extract the isosurface of a volume, whatever its voxel type (see above)
+    * \return false if the volume has no data in memory (e.g. out-of-core volume), or if the surface is too large
+    */
+    bool extract(VolumeImg& _vol, float _isoValue, Mesh* _mesh);
+
+
+    /*!
+    * \fn savePLY
+    * \brief Save a mesh as binary PLY (little endian), with vertex normals
+    * \param _mesh : mesh
+    * \param _fileName : name of the file to write
+    * \return false if the file cannot be written
+    */
+    bool savePLY(const Mesh& _mesh, const std::string& _fileName);
+
+    /*!
+    * \fn saveSTL
+    * \brief Save a mesh as binary STL (triangle soup with facet normals, e.g. for 3D printing)
+    * \param _mesh : mesh
+    * \param _fileName : name of the file to write
+    * \return false if the file cannot be written
+    */
+    bool saveSTL(const Mesh& _mesh, const std::string& _fileName);
+
+}
+
+#endif // MARCHINGCUBES_H
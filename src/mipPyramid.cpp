@@ -0,0 +1,102 @@
+/*********************************************************************************************************************
+ *
+ * mipPyramid.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include "mipPyramid.h"
+
+#include <algorithm>
+
+#include "parallel.h"
+
+
+namespace MipPyramid
+{
+
+template <typename VoxelType>
+void downsample(VolumeView<const VoxelType> _fine, VolumeView<VoxelType> _coarse)
+{
+    if (_fine.empty() || _coarse.empty())
+        return;
+
+    const size_t fx = _fine.extent(0), fy = _fine.extent(1), fz = _fine.extent(2);
+    const size_t cx = _coarse.extent(0), cy = _coarse.extent(1), cz = _coarse.extent(2);
+
+    // fine voxels covered by a coarse voxel along an axis: [2c ; 2c + 2[, up to the end of the axis for the last one
+    auto blockEnd = [](size_t _c, size_t _coarseExtent, size_t _fineExtent) { return _c + 1 == _coarseExtent ? _fineExtent : 2 * _c + 2; };
+
+    // one task per coarse row
+    Parallel::parallelFor(0, cy * cz, [&](size_t _first, size_t _last)
+    {
+        std::vector<VoxelType> rowMax(fx);
+        for (size_t r = _first; r < _last; r++)
+        {
+            size_t j = r % cy, k = r / cy;
+
+            // max of the fine rows of the block (elementwise), then along x
+            bool firstRow = true;
+            for (size_t fk = 2 * k; fk < blockEnd(k, cz, fz); fk++)
+            {
+                for (size_t fj = 2 * j; fj < blockEnd(j, cy, fy); fj++)
+                {
+                    const VoxelType* row = _fine.row(fj, fk);
+                    if (firstRow)
+                        std::copy(row, row + fx, rowMax.begin());
+                    else
+                        for (size_t i = 0; i < fx; i++)
+                            rowMax[i] = row[i] > rowMax[i] ? row[i] : rowMax[i];
+                    firstRow = false;
+                }
+            }
+
+            VoxelType* out = _coarse.row(j, k);
+            for (size_t i = 0; i < cx; i++)
+            {
+                VoxelType mx = rowMax[2 * i];
+                for (size_t fi = 2 * i + 1; fi < blockEnd(i, cx, fx); fi++)
+                    mx = rowMax[fi] > mx ? rowMax[fi] : mx;
+                out[i] = mx;
+            }
+        }
+    });
+}
+
+
+template <typename VoxelType>
+std::vector<std::vector<VoxelType>> build(VolumeView<const VoxelType> _vol, int _nbLevels)
+{
+    std::vector<std::vector<VoxelType>> levels;
+    if (_vol.empty())
+        return levels;
+
+    glm::ivec3 volDims = _vol.getDimensions();
+    VolumeView<const VoxelType> fine = _vol;
+    for (int l = 1; l < _nbLevels; l++)
+    {
+        glm::ivec3 dims = levelDimensions(volDims, l);
+        levels.emplace_back(size_t(dims.x) * size_t(dims.y) * size_t(dims.z));
+        VolumeView<VoxelType> coarse(levels.back().data(), dims);
+        downsample(fine, coarse);
+        fine = coarse;
+    }
+    return levels;
+}
+
+
+template void downsample<std::uint8_t>(VolumeView<const std::uint8_t>, VolumeView<std::uint8_t>);
+template void downsample<std::uint16_t>(VolumeView<const std::uint16_t>, VolumeView<std::uint16_t>);
+template void downsample<std::int16_t>(VolumeView<const std::int16_t>, VolumeView<std::int16_t>);
+template void downsample<float>(VolumeView<const float>, VolumeView<float>);
+
+template std::vector<std::vector<std::uint8_t>> build<std::uint8_t>(VolumeView<const std::uint8_t>, int);
+template std::vector<std::vector<std::uint16_t>> build<std::uint16_t>(VolumeView<const std::uint16_t>, int);
+template std::vector<std::vector<std::int16_t>> build<std::int16_t>(VolumeView<const std::int16_t>, int);
+template std::vector<std::vector<float>> build<float>(VolumeView<const float>, int);
+
+} // namespace MipPyramid
@@ -0,0 +1,85 @@
+/*********************************************************************************************************************
+ *
+ * mipPyramid.h
+ *
+ * Max-preserving mip pyramid of a volume, for coarser rendering during interaction
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef MIPPYRAMID_H
+#define MIPPYRAMID_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "volumeView.h"
+
+
+/*!
+* \namespace MipPyramid
+* \brief Downsampled levels of a volume, each one half the previous one along each axis (as OpenGL mip levels).
+* A voxel of a level keeps the max of the 2^3 voxels it covers, instead of their average: thin bright structures
+* (vessels, implants) survive downsampling, and coarse values never exceed the values of the full resolution voxels,
+* so that the macrocells of the volume still bound them (see Macrocells).
+* Along an odd dimension, the last voxel of a level also covers the last voxel of the previous one.
+*/
+namespace MipPyramid
+{
+
+    /*! max number of levels of a pyramid (level 0 is the volume itself) */
+    const int MAX_LEVELS = 4;
+
+
+    /*!
+    * \fn levelDimensions
+    * \brief Dimensions of a level (OpenGL mip level sizes)
+    */
+    inline glm::ivec3 levelDimensions(glm::ivec3 _volDims, int _level)
+    {
+        return glm::max(glm::ivec3(_volDims.x >> _level, _volDims.y >> _level, _volDims.z >> _level), glm::ivec3(1));
+    }
+
+    /*!
+    * \fn nbLevels
+    * \brief Number of levels of the pyramid of a volume, level 0 included (at most MAX_LEVELS, down to 1 voxel)
+    */
+    inline int nbLevels(glm::ivec3 _volDims)
+    {
+        int levels = 1;
+        while (levels < MAX_LEVELS && glm::any(glm::greaterThan(levelDimensions(_volDims, levels - 1), glm::ivec3(1))))
+            levels++;
+        return levels;
+    }
+
+
+    /*!
+    * \fn downsample
+    * \brief Compute a level from the previous one (multithreaded)
+    * \param _fine : voxels of the previous level
+    * \param _coarse : voxels of the level, of dimensions levelDimensions(fine dimensions, 1)
+    */
+    template <typename VoxelType>
+    void downsample(VolumeView<const VoxelType> _fine, VolumeView<VoxelType> _coarse);
+
+    /*!
+    * \fn build
+    * \brief Compute the levels of a volume, from level 1
+    * \param _vol : voxels of the volume (level 0)
+    * \param _nbLevels : number of levels, level 0 included (see nbLevels())
+    * \return voxels of levels 1 to _nbLevels - 1
+    */
+    template <typename VoxelType>
+    std::vector<std::vector<VoxelType>> build(VolumeView<const VoxelType> _vol, int _nbLevels);
+
+}
+
+#endif // MIPPYRAMID_H
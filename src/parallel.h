@@ -0,0 +1,74 @@
+/*********************************************************************************************************************
+ *
+ * parallel.h
+ *
+ * Minimal helpers for multithreaded loops
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+
+namespace Parallel
+{
+
+    /*!
+    * \fn nbThreads
+    * \brief Number of worker threads to use (i.e. number of hardware threads, at least 1)
+    */
+    inline unsigned int nbThreads()
+    {
+        unsigned int nb = std::thread::hardware_concurrency();
+        return nb == 0 ? 1 : nb;
+    }
+
+
+    /*!
+    * \fn parallelFor
+    * \brief Split [_begin ; _end[ into contiguous ranges and process them in parallel
+    * The calling thread processes the first range, so a single range runs without spawning any thread.
+    * \param _begin : first index
+    * \param _end : last index (excluded)
+    * \param _func : function called as _func(rangeBegin, rangeEnd)
+    * \param _minGrain : minimal number of indices per range
+    */
+    template <typename Func>
+    void parallelFor(size_t _begin, size_t _end, Func&& _func, size_t _minGrain = 1)
+    {
+        if (_end <= _begin)
+            return;
+
+        size_t size = _end - _begin;
+        size_t nbRanges = std::min<size_t>(nbThreads(), std::max<size_t>(1, size / std::max<size_t>(1, _minGrain)));
+        size_t rangeSize = (size + nbRanges - 1) / nbRanges;
+
+        std::vector<std::thread> workers;
+        workers.reserve(nbRanges - 1);
+        for (size_t r = 1; r < nbRanges; r++)
+        {
+            size_t rBegin = _begin + r * rangeSize;
+            size_t rEnd = std::min(_end, rBegin + rangeSize);
+            if (rBegin < rEnd)
+                workers.emplace_back([&_func, rBegin, rEnd]() { _func(rBegin, rEnd); });
+        }
+
+        _func(_begin, std::min(_end, _begin + rangeSize));
+
+        for (auto& w : workers)
+            w.join();
+    }
+
+} // namespace Parallel
+
+#endif // PARALLEL_H
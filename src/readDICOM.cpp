@@ -0,0 +1,520 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+#include "readDICOM.h"
+
+namespace ReadDICOM
+{
+    // Helpers for DICOM parsing
+    namespace
+    {
+        const std::uint32_t UNDEFINED_LENGTH = 0xFFFFFFFF;
+
+        const std::string IMPLICIT_VR_LITTLE_ENDIAN = "1.2.840.10008.1.2";
+        const std::string EXPLICIT_VR_LITTLE_ENDIAN = "1.2.840.10008.1.2.1";
+
+        // Build a tag from its group and element numbers
+        constexpr std::uint32_t makeTag(std::uint16_t group, std::uint16_t element)
+        {
+            return (std::uint32_t(group) << 16) | element;
+        }
+
+        const std::uint32_t TAG_TRANSFER_SYNTAX = makeTag(0x0002, 0x0010);
+        const std::uint32_t TAG_SLICE_THICKNESS = makeTag(0x0018, 0x0050);
+        const std::uint32_t TAG_SERIES_UID = makeTag(0x0020, 0x000E);
+        const std::uint32_t TAG_INSTANCE_NUMBER = makeTag(0x0020, 0x0013);
+        const std::uint32_t TAG_POSITION = makeTag(0x0020, 0x0032);
+        const std::uint32_t TAG_ORIENTATION = makeTag(0x0020, 0x0037);
+        const std::uint32_t TAG_SAMPLES_PER_PIXEL = makeTag(0x0028, 0x0002);
+        const std::uint32_t TAG_NUMBER_OF_FRAMES = makeTag(0x0028, 0x0008);
+        const std::uint32_t TAG_ROWS = makeTag(0x0028, 0x0010);
+        const std::uint32_t TAG_COLUMNS = makeTag(0x0028, 0x0011);
+        const std::uint32_t TAG_PIXEL_SPACING = makeTag(0x0028, 0x0030);
+        const std::uint32_t TAG_BITS_ALLOCATED = makeTag(0x0028, 0x0100);
+        const std::uint32_t TAG_BITS_STORED = makeTag(0x0028, 0x0101);
+        const std::uint32_t TAG_PIXEL_REPRESENTATION = makeTag(0x0028, 0x0103);
+        const std::uint32_t TAG_RESCALE_INTERCEPT = makeTag(0x0028, 0x1052);
+        const std::uint32_t TAG_RESCALE_SLOPE = makeTag(0x0028, 0x1053);
+        const std::uint32_t TAG_PIXEL_DATA = makeTag(0x7FE0, 0x0010);
+        const std::uint32_t TAG_ITEM_DELIMITATION = makeTag(0xFFFE, 0xE00D);
+        const std::uint32_t TAG_SEQUENCE_DELIMITATION = makeTag(0xFFFE, 0xE0DD);
+
+        // A data element, value at [offset ; offset + length[ in the file
+        struct Element {
+            std::uint32_t tag;
+            std::uint32_t length;
+            size_t offset;
+        };
+
+        // Sequential reader of data elements
+        struct ElementReader {
+            const std::uint8_t *data;
+            size_t size;
+            size_t pos;
+            bool explicitVR;
+        };
+
+        std::uint16_t readU16(const std::uint8_t *bytes)
+        {
+            return std::uint16_t(bytes[0] | (bytes[1] << 8));
+        }
+
+        std::uint32_t readU32(const std::uint8_t *bytes)
+        {
+            return std::uint32_t(bytes[0]) | (std::uint32_t(bytes[1]) << 8) | (std::uint32_t(bytes[2]) << 16)
+                   | (std::uint32_t(bytes[3]) << 24);
+        }
+
+        // Check if a VR uses the long form (2 reserved bytes and 32-bit length)
+        bool isLongVR(const char *vr)
+        {
+            static const char *longVRs[] = { "OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV" };
+            for (const char *longVR : longVRs) {
+                if (vr[0] == longVR[0] && vr[1] == longVR[1]) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Read the tag and length of the next element, and move the reader
+        // to its value (explicitVR is always true for group 0002)
+        bool nextElement(ElementReader *reader, Element *element)
+        {
+            if (reader->pos + 8 > reader->size) {
+                return false;
+            }
+            const std::uint8_t *bytes = reader->data + reader->pos;
+            std::uint16_t group = readU16(bytes);
+            element->tag = makeTag(group, readU16(bytes + 2));
+
+            // items and delimiters have no VR, whatever the transfer syntax
+            if (group == 0xFFFE || !(reader->explicitVR || group == 0x0002)) {
+                element->length = readU32(bytes + 4);
+                reader->pos += 8;
+            }
+            else {
+                const char *vr = reinterpret_cast<const char *>(bytes + 4);
+                if (isLongVR(vr)) {
+                    if (reader->pos + 12 > reader->size) {
+                        return false;
+                    }
+                    element->length = readU32(bytes + 8);
+                    reader->pos += 12;
+                }
+                else {
+                    element->length = readU16(bytes + 6);
+                    reader->pos += 8;
+                }
+            }
+
+            element->offset = reader->pos;
+            return element->length == UNDEFINED_LENGTH || reader->pos + element->length <= reader->size;
+        }
+
+        // Skip the content of an element of undefined length (sequence or
+        // item), up to and including its delimiter
+        bool skipUndefinedLength(ElementReader *reader, int depth = 0)
+        {
+            if (depth > 64) {
+                return false;
+            }
+            Element element;
+            while (nextElement(reader, &element)) {
+                if (element.tag == TAG_SEQUENCE_DELIMITATION || element.tag == TAG_ITEM_DELIMITATION) {
+                    return true;
+                }
+                if (element.length == UNDEFINED_LENGTH) {
+                    if (!skipUndefinedLength(reader, depth + 1)) {
+                        return false;
+                    }
+                }
+                else {
+                    reader->pos += element.length;
+                }
+            }
+            return false;
+        }
+
+        // Value of a text element, without padding
+        std::string stringValue(const ElementReader &reader, const Element &element)
+        {
+            std::string value(reinterpret_cast<const char *>(reader.data + element.offset), element.length);
+            size_t end = value.find_last_not_of(std::string(" \0", 2));
+            size_t start = value.find_first_not_of(' ');
+            if (end == std::string::npos || start > end) {
+                return "";
+            }
+            return value.substr(start, end - start + 1);
+        }
+
+        // Values of a multi-valued decimal string (e.g. "0.5\0.5")
+        std::vector<float> decimalValues(const ElementReader &reader, const Element &element)
+        {
+            std::vector<float> values;
+            std::string str = stringValue(reader, element);
+            size_t start = 0;
+            while (start <= str.size()) {
+                size_t end = str.find('\\', start);
+                if (end == std::string::npos) {
+                    end = str.size();
+                }
+                values.push_back(float(std::atof(str.substr(start, end - start).c_str())));
+                start = end + 1;
+            }
+            return values;
+        }
+
+        // Value of an unsigned short (US) element
+        int unsignedValue(const ElementReader &reader, const Element &element)
+        {
+            if (element.length >= 4) {
+                return int(readU32(reader.data + element.offset));
+            }
+            if (element.length >= 2) {
+                return readU16(reader.data + element.offset);
+            }
+            return 0;
+        }
+
+        // Check for the "DICM" prefix after the 128-byte preamble
+        bool hasDICMPrefix(const MappedFile &file)
+        {
+            return file.size() >= 132 && std::memcmp(file.data() + 128, "DICM", 4) == 0;
+        }
+
+        // Lower case extension of a path
+        std::string lowerExtension(const std::filesystem::path &path)
+        {
+            std::string ext = path.extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+            return ext;
+        }
+
+        // Range of the stored pixel values of a slice
+        glm::vec2 storedRange(const DICOMSlice &slice)
+        {
+            int bits = std::min(slice.bitsStored > 0 ? slice.bitsStored : slice.bitsAllocated, slice.bitsAllocated);
+            if (slice.pixelRepresentation == 0) {
+                return glm::vec2(0.0f, float((1 << bits) - 1));
+            }
+            return glm::vec2(-float(1 << (bits - 1)), float((1 << (bits - 1)) - 1));
+        }
+    }
+
+
+    bool isDICOMPath(const std::string &path)
+    {
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error) || lowerExtension(path) == ".dcm") {
+            return true;
+        }
+
+        // DICOM files often have no extension: look for the "DICM" prefix
+        if (!std::filesystem::path(path).has_extension() && std::filesystem::is_regular_file(path, error)) {
+            char prefix[132];
+            std::ifstream file(path, std::ios::binary);
+            return file.read(prefix, sizeof(prefix)) && std::memcmp(prefix + 128, "DICM", 4) == 0;
+        }
+        return false;
+    }
+
+
+    bool readSliceHeader(const MappedFile &file, DICOMSlice *slice)
+    {
+        ElementReader reader = { file.data(), file.size(), hasDICMPrefix(file) ? size_t(132) : size_t(0), false };
+
+        bool inMetaGroup = true;
+        std::string transferSyntax;
+        Element element;
+        while (true) {
+            // end of meta information: switch to the data set transfer syntax
+            if (inMetaGroup && reader.pos + 6 <= reader.size && readU16(reader.data + reader.pos) != 0x0002) {
+                inMetaGroup = false;
+                if (transferSyntax.empty()) {
+                    // no meta information: guess VR encoding from the first element
+                    reader.explicitVR = std::isupper(reader.data[reader.pos + 4]) && std::isupper(reader.data[reader.pos + 5]);
+                }
+                else if (transferSyntax == IMPLICIT_VR_LITTLE_ENDIAN || transferSyntax == EXPLICIT_VR_LITTLE_ENDIAN) {
+                    reader.explicitVR = (transferSyntax == EXPLICIT_VR_LITTLE_ENDIAN);
+                }
+                else {
+                    errorLog() << "ReadDICOM::readSliceHeader(): unsupported transfer syntax " << transferSyntax
+                               << " (only uncompressed little endian)";
+                    return false;
+                }
+            }
+            if (!nextElement(&reader, &element)) {
+                break;
+            }
+
+            if (element.tag == TAG_PIXEL_DATA) {
+                if (element.length == UNDEFINED_LENGTH) {
+                    errorLog() << "ReadDICOM::readSliceHeader(): encapsulated (compressed) pixel data not supported";
+                    return false;
+                }
+                slice->pixelOffset = element.offset;
+                slice->pixelLength = element.length;
+                return true;
+            }
+
+            if (element.length == UNDEFINED_LENGTH) {
+                if (!skipUndefinedLength(&reader)) {
+                    break;
+                }
+                continue;
+            }
+
+            switch (element.tag) {
+                case TAG_TRANSFER_SYNTAX:
+                    transferSyntax = stringValue(reader, element);
+                    break;
+                case TAG_SLICE_THICKNESS:
+                    slice->sliceThickness = float(std::atof(stringValue(reader, element).c_str()));
+                    break;
+                case TAG_SERIES_UID:
+                    slice->seriesUID = stringValue(reader, element);
+                    break;
+                case TAG_INSTANCE_NUMBER:
+                    slice->instanceNumber = std::atoi(stringValue(reader, element).c_str());
+                    break;
+                case TAG_POSITION: {
+                    std::vector<float> values = decimalValues(reader, element);
+                    if (values.size() >= 3) {
+                        slice->position = glm::vec3(values[0], values[1], values[2]);
+                        slice->hasPosition = true;
+                    }
+                    break;
+                }
+                case TAG_ORIENTATION: {
+                    std::vector<float> values = decimalValues(reader, element);
+                    if (values.size() >= 6) {
+                        slice->rowDirection = glm::vec3(values[0], values[1], values[2]);
+                        slice->columnDirection = glm::vec3(values[3], values[4], values[5]);
+                    }
+                    break;
+                }
+                case TAG_SAMPLES_PER_PIXEL:
+                    slice->samplesPerPixel = unsignedValue(reader, element);
+                    break;
+                case TAG_NUMBER_OF_FRAMES:
+                    slice->numberOfFrames = std::atoi(stringValue(reader, element).c_str());
+                    break;
+                case TAG_ROWS:
+                    slice->rows = unsignedValue(reader, element);
+                    break;
+                case TAG_COLUMNS:
+                    slice->columns = unsignedValue(reader, element);
+                    break;
+                case TAG_PIXEL_SPACING: {
+                    std::vector<float> values = decimalValues(reader, element);
+                    if (values.size() >= 2 && values[0] > 0.0f && values[1] > 0.0f) {
+                        slice->pixelSpacing = glm::vec2(values[0], values[1]);
+                    }
+                    break;
+                }
+                case TAG_BITS_ALLOCATED:
+                    slice->bitsAllocated = unsignedValue(reader, element);
+                    break;
+                case TAG_BITS_STORED:
+                    slice->bitsStored = unsignedValue(reader, element);
+                    break;
+                case TAG_PIXEL_REPRESENTATION:
+                    slice->pixelRepresentation = unsignedValue(reader, element);
+                    break;
+                case TAG_RESCALE_INTERCEPT:
+                    slice->rescaleIntercept = float(std::atof(stringValue(reader, element).c_str()));
+                    break;
+                case TAG_RESCALE_SLOPE:
+                    slice->rescaleSlope = float(std::atof(stringValue(reader, element).c_str()));
+                    break;
+                default:
+                    break;
+            }
+            reader.pos += element.length;
+        }
+
+        errorLog() << "ReadDICOM::readSliceHeader(): no pixel data found";
+        return false;
+    }
+
+
+    bool readSeries(const std::string &path, DICOMSeries *series, const std::function<bool()> &cancelled)
+    {
+        std::error_code error;
+        std::filesystem::path directory = std::filesystem::is_directory(path, error) ? std::filesystem::path(path)
+                                                                                      : std::filesystem::path(path).parent_path();
+
+        std::vector<std::string> filenames;
+        for (const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+            if (entry.is_regular_file(error)) {
+                filenames.push_back(entry.path().string());
+            }
+        }
+        std::sort(filenames.begin(), filenames.end());
+
+        // parse all headers in parallel; files that are not DICOM (no
+        // "DICM" prefix nor .dcm extension) are silently ignored
+        std::vector<DICOMSlice> slices(filenames.size());
+        std::vector<char> valid(filenames.size(), 0);
+        std::atomic<bool> stopped = false;
+        Parallel::parallelFor(0, filenames.size(), [&](size_t first, size_t last) {
+            for (size_t i = first; i < last && !stopped; i++) {
+                if (cancelled && cancelled()) {
+                    stopped = true;
+                    break;
+                }
+                MappedFile file;
+                if (!file.open(filenames[i])) {
+                    continue;
+                }
+                if (!hasDICMPrefix(file) && lowerExtension(filenames[i]) != ".dcm") {
+                    continue;
+                }
+                slices[i].filename = filenames[i];
+                valid[i] = readSliceHeader(file, &slices[i]) ? 1 : 0;
+            }
+        }, 8);
+        if (stopped) {
+            return false;
+        }
+
+        // keep the series of the selected file, or the largest series
+        std::map<std::string, int> seriesSizes;
+        for (size_t i = 0; i < slices.size(); i++) {
+            if (valid[i]) {
+                seriesSizes[slices[i].seriesUID]++;
+            }
+        }
+        if (seriesSizes.empty()) {
+            errorLog() << "ReadDICOM::readSeries(): no DICOM slice found in " << directory.string();
+            return false;
+        }
+
+        std::string seriesUID;
+        auto selected = std::find(filenames.begin(), filenames.end(), path);
+        if (selected != filenames.end() && valid[selected - filenames.begin()]) {
+            seriesUID = slices[selected - filenames.begin()].seriesUID;
+        }
+        else {
+            int largest = 0;
+            for (const auto &s : seriesSizes) {
+                if (s.second > largest) {
+                    largest = s.second;
+                    seriesUID = s.first;
+                }
+            }
+        }
+        if (seriesSizes.size() > 1) {
+            warningLog() << "ReadDICOM::readSeries(): " << seriesSizes.size() << " series in " << directory.string()
+                         << ", loading series " << seriesUID << " (" << seriesSizes[seriesUID] << " slices)";
+        }
+
+        series->slices.clear();
+        for (size_t i = 0; i < slices.size(); i++) {
+            if (valid[i] && slices[i].seriesUID == seriesUID) {
+                series->slices.push_back(slices[i]);
+            }
+        }
+
+        // all slices must share the same pixel format
+        const DICOMSlice &ref = series->slices.front();
+        if (ref.rows <= 0 || ref.columns <= 0 || (ref.bitsAllocated != 8 && ref.bitsAllocated != 16)) {
+            errorLog() << "ReadDICOM::readSeries(): unsupported pixel format (" << ref.columns << "x" << ref.rows << ", "
+                       << ref.bitsAllocated << " bits allocated)";
+            return false;
+        }
+        for (const DICOMSlice &slice : series->slices) {
+            if (slice.samplesPerPixel != 1 || slice.numberOfFrames > 1) {
+                errorLog() << "ReadDICOM::readSeries(): only single-frame grayscale slices are supported (" << slice.filename << ")";
+                return false;
+            }
+            if (slice.rows != ref.rows || slice.columns != ref.columns || slice.bitsAllocated != ref.bitsAllocated
+                || slice.pixelRepresentation != ref.pixelRepresentation) {
+                errorLog() << "ReadDICOM::readSeries(): slices of different sizes or formats (" << slice.filename << ")";
+                return false;
+            }
+        }
+
+        // sort slices along the normal of the slices (position), or by instance number
+        bool hasPositions = std::all_of(series->slices.begin(), series->slices.end(), [](const DICOMSlice &s) { return s.hasPosition; });
+        glm::vec3 normal = glm::cross(ref.rowDirection, ref.columnDirection);
+        auto distance = [&](const DICOMSlice &s) { return glm::dot(s.position, normal); };
+        if (hasPositions) {
+            std::stable_sort(series->slices.begin(), series->slices.end(),
+                             [&](const DICOMSlice &a, const DICOMSlice &b) { return distance(a) < distance(b); });
+        }
+        else {
+            warningLog() << "ReadDICOM::readSeries(): no slice position, slices sorted by instance number";
+            std::stable_sort(series->slices.begin(), series->slices.end(),
+                             [](const DICOMSlice &a, const DICOMSlice &b) { return a.instanceNumber < b.instanceNumber; });
+        }
+
+        size_t nbSlices = series->slices.size();
+        series->dimensions = glm::ivec3(ref.columns, ref.rows, int(nbSlices));
+        series->origin = series->slices.front().position;
+
+        // PixelSpacing is (between rows, between columns), i.e. (y, x)
+        float spacingZ = ref.sliceThickness > 0.0f ? ref.sliceThickness : 1.0f;
+        if (hasPositions && nbSlices > 1) {
+            float extent = distance(series->slices.back()) - distance(series->slices.front());
+            if (extent > 0.0f) {
+                spacingZ = extent / float(nbSlices - 1);
+                for (size_t z = 1; z < nbSlices; z++) {
+                    float gap = distance(series->slices[z]) - distance(series->slices[z - 1]);
+                    if (std::abs(gap - spacingZ) > 0.01f * spacingZ) {
+                        warningLog() << "ReadDICOM::readSeries(): non-uniform slice spacing (" << gap << " instead of "
+                                     << spacingZ << " between slices " << z - 1 << " and " << z << ")";
+                        break;
+                    }
+                }
+            }
+        }
+        series->spacing = glm::vec3(ref.pixelSpacing[1], ref.pixelSpacing[0], spacingZ);
+
+        // output datatype: native when stored values are used as is, int16
+        // when an integer rescale fits (e.g. CT in Hounsfield units), float otherwise
+        bool unitSlope = true, integralIntercept = true;
+        float minIntercept = ref.rescaleIntercept, maxIntercept = ref.rescaleIntercept;
+        series->rescale = false;
+        for (const DICOMSlice &slice : series->slices) {
+            series->rescale |= (slice.rescaleSlope != 1.0f || slice.rescaleIntercept != 0.0f);
+            unitSlope &= (slice.rescaleSlope == 1.0f);
+            integralIntercept &= (slice.rescaleIntercept == std::round(slice.rescaleIntercept));
+            minIntercept = std::min(minIntercept, slice.rescaleIntercept);
+            maxIntercept = std::max(maxIntercept, slice.rescaleIntercept);
+        }
+
+        glm::vec2 range = storedRange(ref);
+        if (!series->rescale) {
+            if (ref.bitsAllocated == 8 && ref.pixelRepresentation == 0) {
+                series->datatype = "uint8";
+            }
+            else if (ref.pixelRepresentation == 0) {
+                series->datatype = "uint16";
+            }
+            else {
+                series->datatype = "int16";
+            }
+        }
+        else if (unitSlope && integralIntercept && range[0] + minIntercept >= -32768.0f && range[1] + maxIntercept <= 32767.0f) {
+            series->datatype = "int16";
+        }
+        else {
+            series->datatype = "float32";
+        }
+
+        return true;
+    }
+
+}
@@ -0,0 +1,199 @@
+#ifndef READDICOM_H
+#define READDICOM_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <type_traits>
+
+#include "volumeBase.h"
+#include "mappedFile.h"
+#include "parallel.h"
+
+
+// Reading of a series of uncompressed DICOM slices (one file per slice,
+// implicit or explicit VR little endian transfer syntax)
+namespace ReadDICOM
+{
+
+    // Struct for the tags of a DICOM slice
+    struct DICOMSlice {
+        std::string filename;
+        std::string seriesUID;      // (0020,000E) SeriesInstanceUID
+        int instanceNumber;         // (0020,0013) InstanceNumber
+        bool hasPosition;
+        glm::vec3 position;         // (0020,0032) ImagePositionPatient
+        glm::vec3 rowDirection;     // (0020,0037) ImageOrientationPatient (direction of increasing column index)
+        glm::vec3 columnDirection;  // (0020,0037) ImageOrientationPatient (direction of increasing row index)
+        int rows;                   // (0028,0010) Rows
+        int columns;                // (0028,0011) Columns
+        glm::vec2 pixelSpacing;     // (0028,0030) PixelSpacing (between rows, between columns)
+        float sliceThickness;       // (0018,0050) SliceThickness
+        int samplesPerPixel;        // (0028,0002) SamplesPerPixel
+        int bitsAllocated;          // (0028,0100) BitsAllocated
+        int bitsStored;             // (0028,0101) BitsStored
+        int pixelRepresentation;    // (0028,0103) PixelRepresentation (0 = unsigned, 1 = signed)
+        int numberOfFrames;         // (0028,0008) NumberOfFrames
+        float rescaleSlope;         // (0028,1053) RescaleSlope
+        float rescaleIntercept;     // (0028,1052) RescaleIntercept
+        size_t pixelOffset;         // offset (in bytes) of (7FE0,0010) PixelData value in the file
+        size_t pixelLength;         // length (in bytes) of PixelData value
+
+        DICOMSlice() :
+            instanceNumber(0),
+            hasPosition(false),
+            position(glm::vec3(0.0f, 0.0f, 0.0f)),
+            rowDirection(glm::vec3(1.0f, 0.0f, 0.0f)),
+            columnDirection(glm::vec3(0.0f, 1.0f, 0.0f)),
+            rows(0),
+            columns(0),
+            pixelSpacing(glm::vec2(1.0f, 1.0f)),
+            sliceThickness(0.0f),
+            samplesPerPixel(1),
+            bitsAllocated(0),
+            bitsStored(0),
+            pixelRepresentation(0),
+            numberOfFrames(1),
+            rescaleSlope(1.0f),
+            rescaleIntercept(0.0f),
+            pixelOffset(0),
+            pixelLength(0)
+        {}
+    };
+
+    // Struct for the volume made of a series of slices
+    struct DICOMSeries {
+        std::vector<DICOMSlice> slices;     // sorted along the slice normal
+        glm::ivec3 dimensions;
+        glm::vec3 origin;
+        glm::vec3 spacing;
+        std::string datatype;               // "uint8", "uint16", "int16", or "float32" (rescaled values)
+        bool rescale;                       // rescale slope / intercept must be applied
+
+        DICOMSeries() :
+            dimensions(glm::ivec3(0, 0, 0)),
+            origin(glm::vec3(0.0f, 0.0f, 0.0f)),
+            spacing(glm::vec3(1.0f, 1.0f, 1.0f)),
+            datatype(""),
+            rescale(false)
+        {}
+    };
+
+    // Check if a path is a DICOM series (a directory, or a .dcm file or
+    // a DICOM file without extension of the series)
+    bool isDICOMPath(const std::string &path);
+
+    // Parse the tags of a DICOM slice, up to the PixelData element
+    bool readSliceHeader(const MappedFile &file, DICOMSlice *slice);
+
+    // Parse (in parallel) all slices of a directory (or of the directory
+    // of a .dcm file), keep the largest series (or the series of the
+    // .dcm file), sort its slices and derive the volume attributes
+    // (cancelled, if set, is polled between files: reading stops and
+    // fails when it returns true)
+    bool readSeries(const std::string &path, DICOMSeries *series, const std::function<bool()> &cancelled = nullptr);
+
+    // Decode the pixels of all slices (in parallel) straight into imageData
+    // at their Z offset, with rescale slope / intercept if required
+    // (cancelled, if set, is polled between slices)
+    template<typename T>
+    bool readPixels(const DICOMSeries &series, T *imageData, const std::function<bool()> &cancelled = nullptr);
+
+
+    // Convert a stored pixel value to the volume type, with rescale
+    template<typename T, typename S>
+    inline T convertPixel(S value, float slope, float intercept, bool rescale)
+    {
+        if (!rescale) {
+            return static_cast<T>(value);
+        }
+        float v = float(value) * slope + intercept;
+        if constexpr (std::is_integral_v<T>) {
+            v = std::min(float(std::numeric_limits<T>::max()), std::max(float(std::numeric_limits<T>::lowest()), v));
+            return static_cast<T>(std::lround(v));
+        }
+        else {
+            return static_cast<T>(v);
+        }
+    }
+
+    // Decode the pixels of a slice (stored type S) into imageData; bits
+    // above BitsStored are discarded (with sign extension for signed data)
+    template<typename T, typename S>
+    void readSlicePixels(const std::uint8_t *pixels, size_t n, const DICOMSlice &slice, bool rescale, T *imageData)
+    {
+        int unusedBits = int(sizeof(S) * 8) - slice.bitsStored;
+        if (slice.bitsStored <= 0 || unusedBits < 0) {
+            unusedBits = 0;
+        }
+
+        if constexpr (std::is_same_v<T, S>) {
+            if (!rescale && unusedBits == 0) {
+                std::memcpy(imageData, pixels, n * sizeof(T));
+                return;
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            S value;
+            std::memcpy(&value, pixels + i * sizeof(S), sizeof(S));
+            if (unusedBits > 0) {
+                using U = std::make_unsigned_t<S>;
+                U bits = U(U(value) << unusedBits);
+                value = std::is_signed_v<S> ? S(S(bits) >> unusedBits) : S(bits >> unusedBits);
+            }
+            imageData[i] = convertPixel<T>(value, slice.rescaleSlope, slice.rescaleIntercept, rescale);
+        }
+    }
+
+    // Decode the pixels of all slices (in parallel) straight into imageData
+    // at their Z offset, with rescale slope / intercept if required
+    template<typename T>
+    bool readPixels(const DICOMSeries &series, T *imageData, const std::function<bool()> &cancelled)
+    {
+        size_t sliceSize = size_t(series.dimensions.x) * size_t(series.dimensions.y);
+        std::atomic<bool> ok = true;
+
+        Parallel::parallelFor(0, series.slices.size(), [&](size_t first, size_t last) {
+            for (size_t z = first; z < last && ok; z++) {
+                if (cancelled && cancelled()) {
+                    ok = false;
+                    break;
+                }
+                const DICOMSlice &slice = series.slices[z];
+                MappedFile file;
+                size_t bytesPerPixel = size_t(slice.bitsAllocated / 8);
+                if (!file.open(slice.filename) || slice.pixelLength < sliceSize * bytesPerPixel
+                    || slice.pixelOffset + sliceSize * bytesPerPixel > file.size()) {
+                    errorLog() << "ReadDICOM::readPixels(): could not read pixels of " << slice.filename;
+                    ok = false;
+                    break;
+                }
+
+                const std::uint8_t *pixels = file.data() + slice.pixelOffset;
+                T *dst = imageData + z * sliceSize;
+                if (slice.bitsAllocated == 8) {
+                    if (slice.pixelRepresentation == 0) {
+                        readSlicePixels<T, std::uint8_t>(pixels, sliceSize, slice, series.rescale, dst);
+                    }
+                    else {
+                        readSlicePixels<T, std::int8_t>(pixels, sliceSize, slice, series.rescale, dst);
+                    }
+                }
+                else if (slice.pixelRepresentation == 0) {
+                    readSlicePixels<T, std::uint16_t>(pixels, sliceSize, slice, series.rescale, dst);
+                }
+                else {
+                    readSlicePixels<T, std::int16_t>(pixels, sliceSize, slice, series.rescale, dst);
+                }
+            }
+        }, 4);
+
+        return ok;
+    }
+
+}
+
+#endif // READDICOM_H
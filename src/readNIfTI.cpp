@@ -0,0 +1,528 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "readNIfTI.h"
+
+namespace ReadNIfTI
+{
+    // Helpers for gzip decompression and header parsing
+    namespace
+    {
+        const std::uint8_t GZIP_FEXTRA = 0x04;
+        const std::uint8_t GZIP_FNAME = 0x08;
+        const std::uint8_t GZIP_FCOMMENT = 0x10;
+        const std::uint8_t GZIP_FHCRC = 0x02;
+
+        const size_t INFLATE_CHUNK = 1 << 20;   // output chunk of sequential inflate
+
+        // A gzip member made of a BGZF block: deflate data at
+        // [dataBegin ; dataEnd[, uncompressed size and CRC in the trailer
+        struct GzipBlock {
+            size_t dataBegin;
+            size_t dataEnd;
+            std::uint32_t crc;
+            std::uint32_t size;
+            size_t outBegin;    // offset of the block in the uncompressed stream
+        };
+
+        std::uint16_t readU16(const std::uint8_t *bytes)
+        {
+            return std::uint16_t(bytes[0] | (bytes[1] << 8));
+        }
+
+        std::uint32_t readU32(const std::uint8_t *bytes)
+        {
+            return std::uint32_t(bytes[0]) | (std::uint32_t(bytes[1]) << 8) | (std::uint32_t(bytes[2]) << 16)
+                   | (std::uint32_t(bytes[3]) << 24);
+        }
+
+        // Parse the header of the gzip member at pos. Returns the offset of
+        // its deflate data, and the size of the whole member in *bgzfSize
+        // if it is a BGZF block (0 otherwise). Returns 0 if invalid.
+        size_t parseGzipHeader(const MappedFile &file, size_t pos, size_t *bgzfSize)
+        {
+            const std::uint8_t *bytes = file.data();
+            *bgzfSize = 0;
+            if (pos + 10 > file.size() || bytes[pos] != 0x1F || bytes[pos + 1] != 0x8B || bytes[pos + 2] != 8) {
+                return 0;
+            }
+            std::uint8_t flags = bytes[pos + 3];
+            size_t p = pos + 10;
+
+            if (flags & GZIP_FEXTRA) {
+                if (p + 2 > file.size()) {
+                    return 0;
+                }
+                size_t extraEnd = p + 2 + readU16(bytes + p);
+                if (extraEnd > file.size()) {
+                    return 0;
+                }
+                // look for the BGZF subfield ("BC", 2 bytes: member size - 1)
+                for (size_t s = p + 2; s + 4 <= extraEnd; s += 4 + readU16(bytes + s + 2)) {
+                    if (bytes[s] == 'B' && bytes[s + 1] == 'C' && readU16(bytes + s + 2) == 2 && s + 6 <= extraEnd) {
+                        *bgzfSize = size_t(readU16(bytes + s + 4)) + 1;
+                    }
+                }
+                p = extraEnd;
+            }
+            if (flags & GZIP_FNAME) {
+                while (p < file.size() && bytes[p] != 0) {
+                    p++;
+                }
+                p++;
+            }
+            if (flags & GZIP_FCOMMENT) {
+                while (p < file.size() && bytes[p] != 0) {
+                    p++;
+                }
+                p++;
+            }
+            if (flags & GZIP_FHCRC) {
+                p += 2;
+            }
+            return p < file.size() ? p : 0;
+        }
+
+        // List the members of a file made of BGZF blocks only (returns false
+        // if any member is not a BGZF block)
+        bool listBGZFBlocks(const MappedFile &file, std::vector<GzipBlock> *blocks)
+        {
+            size_t pos = 0, outPos = 0;
+            while (pos < file.size()) {
+                size_t bgzfSize = 0;
+                size_t dataBegin = parseGzipHeader(file, pos, &bgzfSize);
+                if (dataBegin == 0 || bgzfSize == 0 || pos + bgzfSize > file.size() || dataBegin + 8 > pos + bgzfSize) {
+                    return false;
+                }
+                GzipBlock block;
+                block.dataBegin = dataBegin;
+                block.dataEnd = pos + bgzfSize - 8;
+                block.crc = readU32(file.data() + block.dataEnd);
+                block.size = readU32(file.data() + block.dataEnd + 4);
+                block.outBegin = outPos;
+                blocks->push_back(block);
+                outPos += block.size;
+                pos += bgzfSize;
+            }
+            return !blocks->empty();
+        }
+
+        // Inflate a BGZF block into dst (of block.size bytes), and check its CRC
+        bool inflateBlock(const MappedFile &file, const GzipBlock &block, std::uint8_t *dst)
+        {
+            z_stream stream;
+            std::memset(&stream, 0, sizeof(stream));
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+                return false;
+            }
+            stream.next_in = const_cast<Bytef *>(file.data() + block.dataBegin);
+            stream.avail_in = uInt(block.dataEnd - block.dataBegin);
+            stream.next_out = dst;
+            stream.avail_out = uInt(block.size);
+            int ret = inflate(&stream, Z_FINISH);
+            bool ok = (ret == Z_STREAM_END && stream.total_out == block.size);
+            inflateEnd(&stream);
+
+            return ok && crc32(crc32(0L, Z_NULL, 0), dst, uInt(block.size)) == block.crc;
+        }
+
+        // Inflate blocks in parallel, each one straight into dst when it
+        // lies in the requested range, through a temporary buffer when it
+        // overlaps one of its bounds
+        bool inflateBlocks(const MappedFile &file, const std::vector<GzipBlock> &blocks, size_t begin, size_t size,
+                           std::uint8_t *dst, size_t *produced, const std::function<bool()> &cancelled)
+        {
+            size_t total = blocks.back().outBegin + blocks.back().size;
+            size_t end = std::min(begin + size, total);
+            *produced = end > begin ? end - begin : 0;
+
+            std::atomic<bool> ok = true, stopped = false;
+            Parallel::parallelFor(0, blocks.size(), [&](size_t first, size_t last) {
+                std::vector<std::uint8_t> buffer;
+                for (size_t b = first; b < last && ok && !stopped; b++) {
+                    if (cancelled && cancelled()) {
+                        stopped = true;
+                        break;
+                    }
+                    const GzipBlock &block = blocks[b];
+                    size_t blockEnd = block.outBegin + block.size;
+                    if (blockEnd <= begin || block.outBegin >= end || block.size == 0) {
+                        continue;
+                    }
+                    if (block.outBegin >= begin && blockEnd <= end) {
+                        ok = ok && inflateBlock(file, block, dst + (block.outBegin - begin));
+                    }
+                    else {
+                        buffer.resize(block.size);
+                        if (!inflateBlock(file, block, buffer.data())) {
+                            ok = false;
+                            break;
+                        }
+                        size_t copyBegin = std::max(begin, block.outBegin);
+                        size_t copyEnd = std::min(end, blockEnd);
+                        std::memcpy(dst + (copyBegin - begin), buffer.data() + (copyBegin - block.outBegin), copyEnd - copyBegin);
+                    }
+                }
+            });
+
+            if (!ok) {
+                errorLog() << "ReadNIfTI::inflateRange(): corrupted gzip block";
+            }
+            return ok && !stopped;
+        }
+
+        // Inflate a gzip stream (of one or several members) sequentially,
+        // and keep the requested range
+        bool inflateSequential(const MappedFile &file, size_t begin, size_t size, std::uint8_t *dst, size_t *produced,
+                               const std::function<bool()> &cancelled = nullptr)
+        {
+            z_stream stream;
+            std::memset(&stream, 0, sizeof(stream));
+            if (inflateInit2(&stream, MAX_WBITS + 16) != Z_OK) {
+                return false;
+            }
+
+            std::vector<std::uint8_t> buffer(INFLATE_CHUNK);
+            size_t inPos = 0, outPos = 0, end = begin + size;
+            bool ok = true, stopped = false;
+            *produced = 0;
+            while (outPos < end) {
+                if (cancelled && cancelled()) {
+                    stopped = true;
+                    break;
+                }
+
+                // output straight into dst once the range is reached
+                bool direct = (outPos >= begin);
+                std::uint8_t *out = direct ? dst + (outPos - begin) : buffer.data();
+                size_t outSize = direct ? std::min(end - outPos, INFLATE_CHUNK) : std::min(begin - outPos, INFLATE_CHUNK);
+
+                if (stream.avail_in == 0) {
+                    size_t inSize = std::min(file.size() - inPos, INFLATE_CHUNK);
+                    stream.next_in = const_cast<Bytef *>(file.data() + inPos);
+                    stream.avail_in = uInt(inSize);
+                    inPos += inSize;
+                }
+                stream.next_out = out;
+                stream.avail_out = uInt(outSize);
+                int ret = inflate(&stream, Z_NO_FLUSH);
+                outPos += outSize - stream.avail_out;
+
+                if (ret == Z_STREAM_END) {
+                    // next member, if any
+                    if (stream.avail_in == 0 && inPos >= file.size()) {
+                        break;
+                    }
+                    inflateReset(&stream);
+                }
+                else if (ret != Z_OK && !(ret == Z_BUF_ERROR && stream.avail_in == 0 && inPos < file.size())) {
+                    ok = false;
+                    break;
+                }
+                else if (stream.avail_in == 0 && inPos >= file.size() && stream.avail_out != 0) {
+                    // truncated stream
+                    ok = false;
+                    break;
+                }
+            }
+            inflateEnd(&stream);
+
+            *produced = outPos > begin ? outPos - begin : 0;
+            if (!ok) {
+                errorLog() << "ReadNIfTI::inflateRange(): corrupted gzip stream";
+            }
+            return ok && !stopped;
+        }
+
+        // Read NIfTI header fields (in file byte order)
+        template<typename T>
+        T field(const std::uint8_t *bytes, size_t offset, bool swap)
+        {
+            return static_cast<T>(storedValue<T>(bytes + offset, swap));
+        }
+
+        // Datatype name of a NIfTI datatype code used in place (empty if
+        // it must be converted)
+        std::string nativeDatatype(int storedType)
+        {
+            switch (storedType) {
+                case DT_UINT8: return "uint8";
+                case DT_UINT16: return "uint16";
+                case DT_INT16: return "int16";
+                case DT_FLOAT32: return "float32";
+                default: return "";
+            }
+        }
+
+        // Matrix (voxel indices to world) of a quaternion-based qform
+        glm::mat4 qformMatrix(float b, float c, float d, glm::vec3 offset, glm::vec3 pixdim, float qfac)
+        {
+            float a = std::sqrt(std::max(0.0f, 1.0f - (b * b + c * c + d * d)));
+            glm::mat4 m(1.0f);  // column-major: m[column][row]
+            m[0] = glm::vec4(a * a + b * b - c * c - d * d, 2.0f * (b * c + a * d), 2.0f * (b * d - a * c), 0.0f) * pixdim.x;
+            m[1] = glm::vec4(2.0f * (b * c - a * d), a * a + c * c - b * b - d * d, 2.0f * (c * d + a * b), 0.0f) * pixdim.y;
+            m[2] = glm::vec4(2.0f * (b * d + a * c), 2.0f * (c * d - a * b), a * a + d * d - c * c - b * b, 0.0f) * (pixdim.z * qfac);
+            m[3] = glm::vec4(offset, 1.0f);
+            return m;
+        }
+
+        // Lower case copy of a string
+        std::string toLower(std::string str)
+        {
+            std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+            return str;
+        }
+
+        bool endsWith(const std::string &str, const std::string &suffix)
+        {
+            return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+    }
+
+
+    bool isNIfTIFile(const std::string &filename)
+    {
+        std::string lower = toLower(filename);
+        return endsWith(lower, ".nii") || endsWith(lower, ".nii.gz");
+    }
+
+
+    bool isGzip(const MappedFile &file)
+    {
+        return file.size() >= 2 && file.data()[0] == 0x1F && file.data()[1] == 0x8B;
+    }
+
+
+    bool inflateRange(const MappedFile &file, size_t begin, size_t size, std::uint8_t *dst, size_t *produced,
+                      const std::function<bool()> &cancelled)
+    {
+        std::vector<GzipBlock> blocks;
+        if (listBGZFBlocks(file, &blocks)) {
+            return inflateBlocks(file, blocks, begin, size, dst, produced, cancelled);
+        }
+        return inflateSequential(file, begin, size, dst, produced, cancelled);
+    }
+
+
+    bool readHeader(const MappedFile &file, NIfTIHeader *header)
+    {
+        // NIfTI-2 header is 540 bytes, NIfTI-1 header is 348 bytes
+        std::uint8_t bytes[540];
+        size_t available = 0;
+        header->compressed = isGzip(file);
+        if (header->compressed) {
+            // only the first member(s) are inflated
+            std::memset(bytes, 0, sizeof(bytes));
+            if (!inflateSequential(file, 0, sizeof(bytes), bytes, &available) && available < 348) {
+                return false;
+            }
+        }
+        else {
+            available = std::min(file.size(), sizeof(bytes));
+            std::memcpy(bytes, file.data(), available);
+        }
+        if (available < 348) {
+            errorLog() << "ReadNIfTI::readHeader(): file is too short";
+            return false;
+        }
+
+        // version and byte order given by sizeof_hdr
+        std::int32_t sizeofHdr = field<std::int32_t>(bytes, 0, false);
+        bool swap = false;
+        if (sizeofHdr != 348 && sizeofHdr != 540) {
+            swap = true;
+            sizeofHdr = field<std::int32_t>(bytes, 0, true);
+        }
+        header->bigEndian = (std::endian::native == std::endian::big) != swap;
+
+        std::int64_t dim[8];
+        double pixdim[8];
+        double sclSlope, sclInter, quatern[3], qoffset[3], srow[3][4];
+        int qformCode, sformCode, xyztUnits;
+        if (sizeofHdr == 348 && std::memcmp(bytes + 344, "n+1", 4) == 0) {
+            header->version = 1;
+            for (int i = 0; i < 8; i++) {
+                dim[i] = field<std::int16_t>(bytes, 40 + 2 * i, swap);
+                pixdim[i] = field<float>(bytes, 76 + 4 * i, swap);
+            }
+            header->storedType = field<std::int16_t>(bytes, 70, swap);
+            header->voxOffset = size_t(field<float>(bytes, 108, swap));
+            sclSlope = field<float>(bytes, 112, swap);
+            sclInter = field<float>(bytes, 116, swap);
+            xyztUnits = bytes[123];
+            qformCode = field<std::int16_t>(bytes, 252, swap);
+            sformCode = field<std::int16_t>(bytes, 254, swap);
+            for (int i = 0; i < 3; i++) {
+                quatern[i] = field<float>(bytes, 256 + 4 * i, swap);
+                qoffset[i] = field<float>(bytes, 268 + 4 * i, swap);
+                for (int j = 0; j < 4; j++) {
+                    srow[i][j] = field<float>(bytes, 280 + 16 * i + 4 * j, swap);
+                }
+            }
+        }
+        else if (sizeofHdr == 540 && available >= 540 && std::memcmp(bytes + 4, "n+2\0\r\n\032\n", 8) == 0) {
+            header->version = 2;
+            for (int i = 0; i < 8; i++) {
+                dim[i] = field<std::int64_t>(bytes, 16 + 8 * i, swap);
+                pixdim[i] = field<double>(bytes, 104 + 8 * i, swap);
+            }
+            header->storedType = field<std::int16_t>(bytes, 12, swap);
+            header->voxOffset = size_t(field<std::int64_t>(bytes, 168, swap));
+            sclSlope = field<double>(bytes, 176, swap);
+            sclInter = field<double>(bytes, 184, swap);
+            qformCode = field<std::int32_t>(bytes, 344, swap);
+            sformCode = field<std::int32_t>(bytes, 348, swap);
+            for (int i = 0; i < 3; i++) {
+                quatern[i] = field<double>(bytes, 352 + 8 * i, swap);
+                qoffset[i] = field<double>(bytes, 376 + 8 * i, swap);
+                for (int j = 0; j < 4; j++) {
+                    srow[i][j] = field<double>(bytes, 400 + 32 * i + 8 * j, swap);
+                }
+            }
+            xyztUnits = field<std::int32_t>(bytes, 500, swap);
+        }
+        else {
+            errorLog() << "ReadNIfTI::readHeader(): not a single-file NIfTI-1 (n+1) or NIfTI-2 (n+2) file";
+            return false;
+        }
+
+        // dimensions (a 2D image is a volume of 1 slice)
+        if (dim[0] < 2 || dim[0] > 7) {
+            errorLog() << "ReadNIfTI::readHeader(): invalid number of dimensions " << dim[0];
+            return false;
+        }
+        for (int i = 1; i <= 3; i++) {
+            std::int64_t d = (i <= dim[0]) ? dim[i] : 1;
+            if (d <= 0 || d > std::numeric_limits<int>::max()) {
+                errorLog() << "ReadNIfTI::readHeader(): invalid dimension " << d;
+                return false;
+            }
+            header->dimensions[i - 1] = int(d);
+        }
+        header->nbVolumes = 1;
+        for (int i = 4; i <= dim[0]; i++) {
+            header->nbVolumes *= int(std::max<std::int64_t>(1, dim[i]));
+        }
+
+        if (sizeOfStoredType(header->storedType) == 0) {
+            errorLog() << "ReadNIfTI::readHeader(): unsupported datatype " << header->storedType;
+            return false;
+        }
+        if (header->voxOffset < size_t(sizeofHdr)) {
+            header->voxOffset = size_t(sizeofHdr) + 4;
+        }
+
+        // spatial units, converted to mm
+        float unitScale = 1.0f;
+        switch (xyztUnits & 0x07) {
+            case 1: unitScale = 1000.0f; break;     // meter
+            case 3: unitScale = 0.001f; break;      // micron
+            default: break;                         // mm or unknown
+        }
+
+        // voxel to world transform: sform, then qform, then pixdim only
+        glm::vec3 spacing(1.0f);
+        for (int i = 0; i < 3; i++) {
+            if (pixdim[i + 1] > 0.0) {
+                spacing[i] = float(pixdim[i + 1]);
+            }
+        }
+        if (sformCode > 0) {
+            glm::mat4 m(1.0f);
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 4; j++) {
+                    m[j][i] = float(srow[i][j]);
+                }
+            }
+            header->transform = m;
+            header->transformSource = "sform";
+        }
+        else if (qformCode > 0) {
+            header->transform = qformMatrix(float(quatern[0]), float(quatern[1]), float(quatern[2]),
+                                            glm::vec3(qoffset[0], qoffset[1], qoffset[2]), spacing, pixdim[0] < 0.0 ? -1.0f : 1.0f);
+            header->transformSource = "qform";
+        }
+        else {
+            header->transform = glm::scale(glm::mat4(1.0f), spacing);
+            header->transformSource = "pixdim";
+        }
+        header->transform = glm::scale(glm::mat4(1.0f), glm::vec3(unitScale)) * header->transform;
+
+        // spacing and origin of the (axis aligned) volume: length of the
+        // transformed index axes, and position of the first voxel
+        for (int i = 0; i < 3; i++) {
+            float length = glm::length(glm::vec3(header->transform[i]));
+            header->spacing[i] = length > 0.0f ? length : spacing[i] * unitScale;
+        }
+        header->origin = glm::vec3(header->transform[3]);
+
+        // rescale (slope 0 means no rescale)
+        header->sclSlope = float(sclSlope);
+        header->sclInter = float(sclInter);
+        header->rescale = std::isfinite(sclSlope) && std::isfinite(sclInter) && sclSlope != 0.0 && (sclSlope != 1.0 || sclInter != 0.0);
+        if (!header->rescale) {
+            header->sclSlope = 1.0f;
+            header->sclInter = 0.0f;
+        }
+
+        // voxels kept in their type when possible, int16 for integer
+        // rescales that fit (e.g. CT), float otherwise
+        int st = header->storedType;
+        if (!header->rescale) {
+            header->datatype = nativeDatatype(st);
+            if (header->datatype.empty()) {
+                header->datatype = (st == DT_INT8) ? "int16" : "float32";
+            }
+        }
+        else {
+            bool smallInteger = (st == DT_UINT8 || st == DT_INT8 || st == DT_INT16);
+            double low = (st == DT_UINT8) ? 0.0 : (st == DT_INT8) ? -128.0 : -32768.0;
+            double high = (st == DT_UINT8) ? 255.0 : (st == DT_INT8) ? 127.0 : 32767.0;
+            if (smallInteger && sclSlope == 1.0 && sclInter == std::round(sclInter) && low + sclInter >= -32768.0 && high + sclInter <= 32767.0) {
+                header->datatype = "int16";
+            }
+            else {
+                header->datatype = "float32";
+            }
+        }
+
+        return true;
+    }
+
+
+    size_t sizeOfStoredType(int storedType)
+    {
+        switch (storedType) {
+            case DT_UINT8:
+            case DT_INT8:
+                return 1;
+            case DT_UINT16:
+            case DT_INT16:
+                return 2;
+            case DT_UINT32:
+            case DT_INT32:
+            case DT_FLOAT32:
+                return 4;
+            case DT_FLOAT64:
+                return 8;
+            default:
+                return 0;
+        }
+    }
+
+
+    bool needsConversion(const NIfTIHeader &header)
+    {
+        return header.rescale || nativeDatatype(header.storedType) != header.datatype;
+    }
+
+}
@@ -0,0 +1,241 @@
+#ifndef READNIFTI_H
+#define READNIFTI_H
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "volumeBase.h"
+#include "mappedFile.h"
+#include "parallel.h"
+#include "voxelConvert.h"
+
+
+// Reading of NIfTI-1 and NIfTI-2 volumes (single file .nii), plain or
+// gzip-compressed (.nii.gz)
+namespace ReadNIfTI
+{
+
+    // NIfTI datatype codes of supported voxel types
+    enum DataTypeCode {
+        DT_UINT8 = 2,
+        DT_INT16 = 4,
+        DT_INT32 = 8,
+        DT_FLOAT32 = 16,
+        DT_FLOAT64 = 64,
+        DT_INT8 = 256,
+        DT_UINT16 = 512,
+        DT_UINT32 = 768
+    };
+
+    // Struct for NIfTI header info
+    struct NIfTIHeader {
+        int version;                // 1 or 2
+        glm::ivec3 dimensions;
+        int nbVolumes;              // product of dimensions 4 to 7 (time, etc.)
+        glm::vec3 origin;
+        glm::vec3 spacing;
+        glm::mat4 transform;        // voxel indices to world coordinates (mm)
+        std::string transformSource;// "sform", "qform", or "pixdim"
+        int storedType;             // NIfTI datatype code of the stored voxels
+        std::string datatype;       // "uint8", "uint16", "int16", or "float32" (voxels after conversion)
+        bool bigEndian;             // byte order of the file
+        bool compressed;            // gzip-compressed file
+        size_t voxOffset;           // offset of the voxels in the (uncompressed) file
+        float sclSlope;
+        float sclInter;
+        bool rescale;               // scl_slope / scl_inter must be applied
+
+        NIfTIHeader() :
+            version(0),
+            dimensions(glm::ivec3(0, 0, 0)),
+            nbVolumes(1),
+            origin(glm::vec3(0.0f, 0.0f, 0.0f)),
+            spacing(glm::vec3(1.0f, 1.0f, 1.0f)),
+            transform(glm::mat4(1.0f)),
+            transformSource("pixdim"),
+            storedType(0),
+            datatype(""),
+            bigEndian(false),
+            compressed(false),
+            voxOffset(0),
+            sclSlope(1.0f),
+            sclInter(0.0f),
+            rescale(false)
+        {}
+    };
+
+    // Check if a file name has a NIfTI extension (.nii or .nii.gz)
+    bool isNIfTIFile(const std::string &filename);
+
+    // Check if a (mapped) file starts with a gzip member
+    bool isGzip(const MappedFile &file);
+
+    // Decompress the bytes [begin ; begin + size[ of the uncompressed
+    // stream of a gzip file into dst. Files made of BGZF members (bgzip)
+    // are inflated in parallel, member by member; other files (single or
+    // multiple members) are inflated sequentially, up to the last byte
+    // requested. *produced receives the number of bytes written (less
+    // than size if the stream is shorter). cancelled, if set, is polled
+    // between blocks / chunks: inflating stops and fails when it returns
+    // true.
+    bool inflateRange(const MappedFile &file, size_t begin, size_t size, std::uint8_t *dst, size_t *produced,
+                      const std::function<bool()> &cancelled = nullptr);
+
+    // Parse a NIfTI-1 or NIfTI-2 header from a (mapped, possibly gzip-
+    // compressed) file
+    bool readHeader(const MappedFile &file, NIfTIHeader *header);
+
+    // Size in bytes of a voxel of a given NIfTI datatype (0 if unsupported)
+    size_t sizeOfStoredType(int storedType);
+
+    // Check if stored voxels must be converted (other type, or rescale)
+    // into the header datatype, i.e. cannot be used in place
+    bool needsConversion(const NIfTIHeader &header);
+
+    // Read the voxels of the first volume into a voxel storage (of the
+    // header datatype). Plain files without conversion are mapped in
+    // place (swapBytes = false leaves the data in file byte order);
+    // otherwise voxels are decompressed and/or converted, with
+    // scl_slope / scl_inter, in parallel (cancelled, if set, is polled
+    // while decompressing).
+    template<typename VoxelType>
+    bool readData(std::shared_ptr<MappedFile> file, const NIfTIHeader &header, VoxelStorage<VoxelType> *imageData,
+                  bool swapBytes = true, const std::function<bool()> &cancelled = nullptr);
+
+
+    // Read a stored value (in file byte order) as a double
+    template<typename S>
+    inline double storedValue(const std::uint8_t *src, bool swap)
+    {
+        using U = std::conditional_t<sizeof(S) == 1, std::uint8_t,
+                  std::conditional_t<sizeof(S) == 2, std::uint16_t,
+                  std::conditional_t<sizeof(S) == 4, std::uint32_t, std::uint64_t>>>;
+        U bits;
+        std::memcpy(&bits, src, sizeof(S));
+        if (swap && sizeof(S) > 1) {
+            U swapped = 0;
+            for (size_t b = 0; b < sizeof(S); b++) {
+                swapped = U((swapped << 8) | ((bits >> (8 * b)) & 0xFF));
+            }
+            bits = swapped;
+        }
+        S value;
+        std::memcpy(&value, &bits, sizeof(S));
+        return double(value);
+    }
+
+    // Convert n stored voxels of type S into imageData (in parallel),
+    // with byte swap and rescale if required
+    template<typename T, typename S>
+    void convertVoxels(const std::uint8_t *src, size_t n, const NIfTIHeader &header, bool swap, T *imageData)
+    {
+        Parallel::parallelFor(0, n, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                double v = storedValue<S>(src + i * sizeof(S), swap);
+                if (header.rescale) {
+                    v = v * header.sclSlope + header.sclInter;
+                }
+                if constexpr (std::is_integral_v<T>) {
+                    v = std::min(double(std::numeric_limits<T>::max()), std::max(double(std::numeric_limits<T>::lowest()), v));
+                    imageData[i] = static_cast<T>(std::lround(v));
+                }
+                else {
+                    imageData[i] = static_cast<T>(v);
+                }
+            }
+        }, 1 << 16);
+    }
+
+    // Convert n stored voxels (of the header stored type) into imageData
+    template<typename T>
+    bool convertVoxels(const std::uint8_t *src, size_t n, const NIfTIHeader &header, bool swap, T *imageData)
+    {
+        switch (header.storedType) {
+            case DT_UINT8: convertVoxels<T, std::uint8_t>(src, n, header, swap, imageData); return true;
+            case DT_INT8: convertVoxels<T, std::int8_t>(src, n, header, swap, imageData); return true;
+            case DT_UINT16: convertVoxels<T, std::uint16_t>(src, n, header, swap, imageData); return true;
+            case DT_INT16: convertVoxels<T, std::int16_t>(src, n, header, swap, imageData); return true;
+            case DT_UINT32: convertVoxels<T, std::uint32_t>(src, n, header, swap, imageData); return true;
+            case DT_INT32: convertVoxels<T, std::int32_t>(src, n, header, swap, imageData); return true;
+            case DT_FLOAT32: convertVoxels<T, float>(src, n, header, swap, imageData); return true;
+            case DT_FLOAT64: convertVoxels<T, double>(src, n, header, swap, imageData); return true;
+            default: return false;
+        }
+    }
+
+    // Read the voxels of the first volume into a voxel storage
+    template<typename VoxelType>
+    bool readData(std::shared_ptr<MappedFile> file, const NIfTIHeader &header, VoxelStorage<VoxelType> *imageData,
+                  bool swapBytes, const std::function<bool()> &cancelled)
+    {
+        size_t numElements = size_t(header.dimensions[0]) * size_t(header.dimensions[1]) * size_t(header.dimensions[2]);
+        size_t storedSize = sizeOfStoredType(header.storedType);
+        size_t dataSize = numElements * storedSize;
+        bool swap = header.bigEndian != (std::endian::native == std::endian::big);
+        bool sameType = (storedSize == sizeof(VoxelType) && !needsConversion(header));
+        if (storedSize == 0) {
+            return false;
+        }
+
+        if (!header.compressed) {
+            if (header.voxOffset + dataSize > file->size()) {
+                errorLog() << "ReadNIfTI::readData(): file is too short for its dimensions";
+                return false;
+            }
+            if (!sameType) {
+                imageData->resize(numElements);
+                return convertVoxels(file->data() + header.voxOffset, numElements, header, swap, imageData->data());
+            }
+
+            // data exposed in place (copy-on-write mapping), copied once
+            // into owned memory only if not aligned on sizeof(VoxelType)
+            if (!imageData->adoptMapping(file, header.voxOffset, numElements)) {
+                imageData->resize(numElements);
+                std::memcpy(imageData->data(), file->data() + header.voxOffset, dataSize);
+            }
+            if (swapBytes && swap && sizeof(VoxelType) > 1) {
+                VoxelConvert::swapBytes(imageData->data(), numElements);
+            }
+            return true;
+        }
+
+        // compressed data: inflated straight into the storage when no
+        // conversion is needed, through a temporary buffer otherwise
+        size_t produced = 0;
+        if (sameType) {
+            imageData->resize(numElements);
+            if (!inflateRange(*file, header.voxOffset, dataSize, reinterpret_cast<std::uint8_t *>(imageData->data()), &produced, cancelled)) {
+                return false;
+            }
+            if (produced != dataSize) {
+                errorLog() << "ReadNIfTI::readData(): file is too short for its dimensions";
+                return false;
+            }
+            if (swapBytes && swap && sizeof(VoxelType) > 1) {
+                VoxelConvert::swapBytes(imageData->data(), numElements);
+            }
+            return true;
+        }
+
+        std::vector<std::uint8_t> stored(dataSize);
+        if (!inflateRange(*file, header.voxOffset, dataSize, stored.data(), &produced, cancelled)) {
+            return false;
+        }
+        if (produced != dataSize) {
+            errorLog() << "ReadNIfTI::readData(): file is too short for its dimensions";
+            return false;
+        }
+        imageData->resize(numElements);
+        return convertVoxels(stored.data(), numElements, header, swap, imageData->data());
+    }
+
+}
+
+#endif // READNIFTI_H
@@ -0,0 +1,429 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <filesystem>
+
+#include "readRawHeader.h"
+
+namespace ReadRawHeader
+{
+    // Helpers for header parsing
+    namespace
+    {
+        // Return the line starting at *pos (without end-of-line characters)
+        // and move *pos to the beginning of the next line
+        std::string nextLine(const MappedFile &file, size_t *pos)
+        {
+            const char *bytes = reinterpret_cast<const char *>(file.data());
+            size_t start = *pos;
+            const void *eol = std::memchr(bytes + start, '\n', file.size() - start);
+            size_t end = (eol != nullptr) ? static_cast<const char *>(eol) - bytes : file.size();
+            *pos = (eol != nullptr) ? end + 1 : end;
+
+            // trim trailing '\r' and blanks, leading blanks
+            while (end > start && (bytes[end - 1] == '\r' || bytes[end - 1] == ' ' || bytes[end - 1] == '\t')) {
+                end--;
+            }
+            while (start < end && (bytes[start] == ' ' || bytes[start] == '\t')) {
+                start++;
+            }
+            return std::string(bytes + start, end - start);
+        }
+
+        // Trim leading and trailing blanks
+        std::string trim(const std::string &str)
+        {
+            size_t start = str.find_first_not_of(" \t");
+            if (start == std::string::npos) {
+                return "";
+            }
+            return str.substr(start, str.find_last_not_of(" \t") - start + 1);
+        }
+
+        // Lower case copy of a string
+        std::string toLower(std::string str)
+        {
+            std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+            return str;
+        }
+
+        // Split a "key <separator> value" line, returns false if there is no separator
+        bool splitLine(const std::string &line, const std::string &separator, std::string *key, std::string *value)
+        {
+            size_t sep = line.find(separator);
+            if (sep == std::string::npos) {
+                return false;
+            }
+            *key = toLower(trim(line.substr(0, sep)));
+            *value = trim(line.substr(sep + separator.size()));
+            return true;
+        }
+
+        // Resolve the path of a data file given relatively to its header file
+        std::string dataFilePath(const std::string &headerFilename, const std::string &dataFilename)
+        {
+            return (std::filesystem::path(headerFilename).parent_path() / dataFilename).string();
+        }
+
+        // Convert a MetaImage element type to a datatype name (empty if unsupported)
+        std::string metaImageType(const std::string &typestring)
+        {
+            if (typestring == "MET_UCHAR") {
+                return "uint8";
+            }
+            else if (typestring == "MET_USHORT") {
+                return "uint16";
+            }
+            else if (typestring == "MET_SHORT") {
+                return "int16";
+            }
+            else if (typestring == "MET_UINT") {
+                return "uint32";
+            }
+            else if (typestring == "MET_FLOAT") {
+                return "float32";
+            }
+            return "";
+        }
+
+        // Convert a NRRD type (or one of its aliases) to a datatype name (empty if unsupported)
+        std::string nrrdType(const std::string &typestring)
+        {
+            std::string type = toLower(typestring);
+            if (type == "uchar" || type == "unsigned char" || type == "uint8" || type == "uint8_t") {
+                return "uint8";
+            }
+            else if (type == "ushort" || type == "unsigned short" || type == "unsigned short int"
+                     || type == "uint16" || type == "uint16_t") {
+                return "uint16";
+            }
+            else if (type == "short" || type == "short int" || type == "signed short" || type == "signed short int"
+                     || type == "int16" || type == "int16_t") {
+                return "int16";
+            }
+            else if (type == "uint" || type == "unsigned int" || type == "uint32" || type == "uint32_t") {
+                return "uint32";
+            }
+            else if (type == "float") {
+                return "float32";
+            }
+            return "";
+        }
+
+        // Parse a NRRD vector "(x,y,z)"
+        bool parseNRRDVector(const char *str, glm::vec3 *vec, int *numChars)
+        {
+            float x, y, z;
+            if (sscanf(str, " ( %f , %f , %f )%n", &x, &y, &z, numChars) != 3) {
+                return false;
+            }
+            *vec = glm::vec3(x, y, z);
+            return true;
+        }
+    }
+
+    // Check if a file name has a MetaImage or NRRD header extension
+    bool isHeaderFile(const std::string &filename)
+    {
+        std::string extension = toLower(std::filesystem::path(filename).extension().string());
+        return extension == ".mhd" || extension == ".mha" || extension == ".nhdr" || extension == ".nrrd";
+    }
+
+    // Find the header describing a .raw file (same name with .mhd or
+    // .nhdr extension), returns an empty string if there is none
+    std::string findSidecarHeader(const std::string &rawFilename)
+    {
+        for (const char *extension : { ".mhd", ".nhdr" }) {
+            std::filesystem::path headerPath(rawFilename);
+            headerPath.replace_extension(extension);
+            std::error_code error;
+            if (std::filesystem::is_regular_file(headerPath, error)) {
+                return headerPath.string();
+            }
+        }
+        return "";
+    }
+
+    // Size in bytes of a voxel of a given datatype (0 if unknown)
+    size_t sizeOfDatatype(const std::string &datatype)
+    {
+        if (datatype == "uint8") {
+            return 1;
+        }
+        else if (datatype == "uint16" || datatype == "int16") {
+            return 2;
+        }
+        else if (datatype == "uint32" || datatype == "float32") {
+            return 4;
+        }
+        return 0;
+    }
+
+    // Parse a MetaImage header, made of "Key = Value" lines and ending
+    // with the ElementDataFile line, e.g.:
+    //
+    // ObjectType = Image
+    // NDims = 3
+    // DimSize = 256 256 128
+    // ElementSpacing = 0.5 0.5 1.0
+    // Offset = 0 0 0
+    // ElementType = MET_SHORT
+    // ElementByteOrderMSB = False
+    // ElementDataFile = volume.raw     (or LOCAL: data follows the header)
+    bool readMetaImage(const MappedFile &file, const std::string &filename, RawHeader *header)
+    {
+        bool foundDims = false;
+        bool foundSpacing = false;
+        size_t pos = 0;
+        while (pos < file.size()) {
+            std::string key, value;
+            if (!splitLine(nextLine(file, &pos), "=", &key, &value)) {
+                continue;
+            }
+
+            if (key == "ndims") {
+                if (value != "3") {
+                    errorLog() << "ReadRawHeader::readMetaImage(): only 3D images are supported (NDims = " << value << ")";
+                    return false;
+                }
+            }
+            else if (key == "dimsize") {
+                int width, height, depth;
+                if (sscanf(value.c_str(), "%d %d %d", &width, &height, &depth) != 3) {
+                    return false;
+                }
+                header->dimensions = glm::ivec3(width, height, depth);
+                foundDims = true;
+            }
+            else if (key == "elementspacing" || (key == "elementsize" && !foundSpacing)) {
+                // ElementSize is only used if there is no ElementSpacing
+                float sx, sy, sz;
+                if (sscanf(value.c_str(), "%f %f %f", &sx, &sy, &sz) != 3) {
+                    return false;
+                }
+                header->spacing = glm::vec3(sx, sy, sz);
+                foundSpacing = (key == "elementspacing");
+            }
+            else if (key == "offset" || key == "origin" || key == "position") {
+                float ox, oy, oz;
+                if (sscanf(value.c_str(), "%f %f %f", &ox, &oy, &oz) != 3) {
+                    return false;
+                }
+                header->origin = glm::vec3(ox, oy, oz);
+            }
+            else if (key == "elementtype") {
+                header->datatype = metaImageType(value);
+                if (header->datatype.empty()) {
+                    errorLog() << "ReadRawHeader::readMetaImage(): unsupported element type " << value;
+                    return false;
+                }
+            }
+            else if (key == "binarydatabyteordermsb" || key == "elementbyteordermsb") {
+                header->bigEndian = (toLower(value) == "true");
+            }
+            else if (key == "headersize") {
+                header->byteSkip = std::atoll(value.c_str());
+            }
+            else if (key == "elementnumberofchannels" && value != "1") {
+                errorLog() << "ReadRawHeader::readMetaImage(): multi-channel images are not supported";
+                return false;
+            }
+            else if (key == "compresseddata" && toLower(value) == "true") {
+                errorLog() << "ReadRawHeader::readMetaImage(): compressed data are not supported";
+                return false;
+            }
+            else if (key == "elementdatafile") {
+                // last field of the header
+                if (value == "LOCAL") {
+                    header->dataFile = filename;
+                    header->dataStart = pos;
+                }
+                else if (value.find("LIST") == 0 || value.find('%') != std::string::npos) {
+                    errorLog() << "ReadRawHeader::readMetaImage(): multi-file data are not supported";
+                    return false;
+                }
+                else {
+                    header->dataFile = dataFilePath(filename, value);
+                }
+                break;
+            }
+        }
+
+        if (!foundDims || header->datatype.empty() || header->dataFile.empty()) {
+            errorLog() << "ReadRawHeader::readMetaImage(): DimSize, ElementType or ElementDataFile missing in " << filename;
+            return false;
+        }
+        return true;
+    }
+
+    // Parse a NRRD header, made of the "NRRD000X" magic line, "#" comments
+    // and "field: value" lines, and ending with an empty line (attached
+    // data follow) or at the end of the file (detached header), e.g.:
+    //
+    // NRRD0004
+    // type: short
+    // dimension: 3
+    // sizes: 256 256 128
+    // space directions: (0.5,0,0) (0,0.5,0) (0,0,1)
+    // space origin: (0,0,0)
+    // endian: little
+    // encoding: raw
+    // data file: volume.raw
+    bool readNRRD(const MappedFile &file, const std::string &filename, RawHeader *header)
+    {
+        size_t pos = 0;
+        if (nextLine(file, &pos).substr(0, 7) != "NRRD000") {
+            errorLog() << "ReadRawHeader::readNRRD(): not a NRRD file";
+            return false;
+        }
+
+        bool foundDims = false;
+        while (pos < file.size()) {
+            std::string line = nextLine(file, &pos);
+            if (line.empty()) {
+                break; // end of header
+            }
+            std::string key, value;
+            if (line[0] == '#' || line.find(":=") != std::string::npos || !splitLine(line, ":", &key, &value)) {
+                continue; // comment or key/value pair
+            }
+
+            if (key == "dimension") {
+                if (value != "3") {
+                    errorLog() << "ReadRawHeader::readNRRD(): only 3D images are supported (dimension: " << value << ")";
+                    return false;
+                }
+            }
+            else if (key == "type") {
+                header->datatype = nrrdType(value);
+                if (header->datatype.empty()) {
+                    errorLog() << "ReadRawHeader::readNRRD(): unsupported type " << value;
+                    return false;
+                }
+            }
+            else if (key == "sizes") {
+                int width, height, depth;
+                if (sscanf(value.c_str(), "%d %d %d", &width, &height, &depth) != 3) {
+                    return false;
+                }
+                header->dimensions = glm::ivec3(width, height, depth);
+                foundDims = true;
+            }
+            else if (key == "spacings") {
+                float sx, sy, sz;
+                if (sscanf(value.c_str(), "%f %f %f", &sx, &sy, &sz) == 3) {
+                    header->spacing = glm::vec3(sx, sy, sz);
+                }
+            }
+            else if (key == "space directions") {
+                // spacing is the length of each axis direction (orientation is ignored)
+                const char *str = value.c_str();
+                for (int axis = 0; axis < 3; axis++) {
+                    glm::vec3 direction;
+                    int numChars = 0;
+                    if (!parseNRRDVector(str, &direction, &numChars)) {
+                        return false;
+                    }
+                    header->spacing[axis] = std::sqrt(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+                    str += numChars;
+                }
+            }
+            else if (key == "space origin") {
+                int numChars = 0;
+                if (!parseNRRDVector(value.c_str(), &header->origin, &numChars)) {
+                    return false;
+                }
+            }
+            else if (key == "endian") {
+                header->bigEndian = (toLower(value) == "big");
+            }
+            else if (key == "encoding") {
+                if (toLower(value) != "raw") {
+                    errorLog() << "ReadRawHeader::readNRRD(): unsupported encoding " << value;
+                    return false;
+                }
+            }
+            else if (key == "data file" || key == "datafile") {
+                if (value.find("LIST") == 0 || value.find('%') != std::string::npos) {
+                    errorLog() << "ReadRawHeader::readNRRD(): multi-file data are not supported";
+                    return false;
+                }
+                header->dataFile = dataFilePath(filename, value);
+            }
+            else if (key == "line skip" || key == "lineskip") {
+                header->lineSkip = std::atoi(value.c_str());
+            }
+            else if (key == "byte skip" || key == "byteskip") {
+                header->byteSkip = std::atoll(value.c_str());
+            }
+        }
+
+        if (header->dataFile.empty()) {
+            // attached data, right after the empty line ending the header
+            header->dataFile = filename;
+            header->dataStart = pos;
+        }
+
+        if (!foundDims || header->datatype.empty()) {
+            errorLog() << "ReadRawHeader::readNRRD(): sizes or type missing in " << filename;
+            return false;
+        }
+        return true;
+    }
+
+    // Parse a MetaImage or NRRD header (format given by the magic line)
+    bool readHeader(const MappedFile &file, const std::string &filename, RawHeader *header)
+    {
+        bool valid = (file.size() >= 4 && std::memcmp(file.data(), "NRRD", 4) == 0) ? readNRRD(file, filename, header)
+                                                                                     : readMetaImage(file, filename, header);
+        if (!valid) {
+            return false;
+        }
+
+        // positive dimensions, whose number of bytes (of any voxel type) fits in size_t
+        glm::ivec3 dims = header->dimensions;
+        if (dims.x <= 0 || dims.y <= 0 || dims.z <= 0
+            || size_t(dims.x) * size_t(dims.y) > std::numeric_limits<size_t>::max() / sizeof(double) / size_t(dims.z)) {
+            errorLog() << "ReadRawHeader::readHeader(): invalid dimensions " << dims.x << " " << dims.y << " " << dims.z << " in " << filename;
+            return false;
+        }
+        return true;
+    }
+
+    // Offset (in bytes) of the data in the (mapped) data file
+    bool dataOffset(const MappedFile &dataFile, const RawHeader &header, size_t *offset)
+    {
+        size_t dataSize = size_t(header.dimensions[0]) * size_t(header.dimensions[1]) * size_t(header.dimensions[2])
+                          * sizeOfDatatype(header.datatype);
+
+        if (header.byteSkip < 0) {
+            // data at the end of the file
+            if (dataSize > dataFile.size()) {
+                errorLog() << "ReadRawHeader::dataOffset(): file " << header.dataFile << " is too short for its dimensions";
+                return false;
+            }
+            *offset = dataFile.size() - dataSize;
+            return true;
+        }
+
+        size_t pos = std::min(header.dataStart, dataFile.size());
+        for (int l = 0; l < header.lineSkip; l++) {
+            nextLine(dataFile, &pos);
+        }
+        // (compared without computing the end of the data, which may overflow)
+        if (size_t(header.byteSkip) > dataFile.size() - pos || dataSize > dataFile.size() - pos - size_t(header.byteSkip)) {
+            errorLog() << "ReadRawHeader::dataOffset(): file " << header.dataFile << " is too short for its dimensions";
+            return false;
+        }
+        *offset = pos + size_t(header.byteSkip);
+        return true;
+    }
+
+} // end namespace ReadRawHeader
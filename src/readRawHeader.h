@@ -0,0 +1,100 @@
+#ifndef READRAWHEADER_H
+#define READRAWHEADER_H
+
+#include <bit>
+#include <cstring>
+
+#include "volumeBase.h"
+#include "mappedFile.h"
+#include "voxelConvert.h"
+
+
+// Reading of RAW volumes described by a header: MetaImage (.mhd
+// detached, .mha attached) and NRRD (.nhdr detached, .nrrd attached)
+namespace ReadRawHeader
+{
+
+    // Struct for RAW header info
+    struct RawHeader {
+        glm::ivec3 dimensions;
+        glm::vec3 origin;
+        glm::vec3 spacing;
+        std::string datatype;   // "uint8", "uint16", "int16", "uint32", or "float32"
+        bool bigEndian;         // byte order of the data
+        std::string dataFile;   // file containing the data (may be the header file itself)
+        size_t dataStart;       // where skips start in dataFile (end of header for attached data)
+        int lineSkip;           // lines to skip from dataStart (NRRD only)
+        long long byteSkip;     // bytes to skip after lineSkip, -1 = data at end of file
+
+        RawHeader() :
+            dimensions(glm::ivec3(0, 0, 0)),
+            origin(glm::vec3(0.0f, 0.0f, 0.0f)),
+            spacing(glm::vec3(1.0f, 1.0f, 1.0f)),
+            datatype(""),
+            bigEndian(false),
+            dataFile(""),
+            dataStart(0),
+            lineSkip(0),
+            byteSkip(0)
+        {}
+    };
+
+    // Check if a file name has a MetaImage or NRRD header extension
+    bool isHeaderFile(const std::string &filename);
+
+    // Find the header describing a .raw file (same name with .mhd or
+    // .nhdr extension), returns an empty string if there is none
+    std::string findSidecarHeader(const std::string &rawFilename);
+
+    // Parse a MetaImage header (.mhd or .mha) from a (mapped) file
+    bool readMetaImage(const MappedFile &file, const std::string &filename, RawHeader *header);
+
+    // Parse a NRRD header (.nhdr or .nrrd) from a (mapped) file
+    bool readNRRD(const MappedFile &file, const std::string &filename, RawHeader *header);
+
+    // Parse a MetaImage or NRRD header (format given by the magic line)
+    bool readHeader(const MappedFile &file, const std::string &filename, RawHeader *header);
+
+    // Size in bytes of a voxel of a given datatype (0 if unknown)
+    size_t sizeOfDatatype(const std::string &datatype);
+
+    // Offset (in bytes) of the data in the (mapped) data file
+    bool dataOffset(const MappedFile &dataFile, const RawHeader &header, size_t *offset);
+
+    // Map the data part of the data file directly into a voxel storage
+    // (swapBytes = false leaves the data in file byte order)
+    template<typename VoxelType>
+    bool mapData(std::shared_ptr<MappedFile> file, const RawHeader &header, VoxelStorage<VoxelType> *imageData,
+                 bool swapBytes = true);
+
+
+    // Map the data part of the data file directly into a voxel storage
+    // Data is exposed in place (copy-on-write mapping) and byte-swapped
+    // only if its byte order differs from the host one; it is copied once
+    // into owned memory only if it is not aligned on sizeof(VoxelType).
+    template<typename VoxelType>
+    bool mapData(std::shared_ptr<MappedFile> file, const RawHeader &header, VoxelStorage<VoxelType> *imageData,
+                 bool swapBytes)
+    {
+        size_t numElements = size_t(header.dimensions[0]) * size_t(header.dimensions[1]) * size_t(header.dimensions[2]);
+        size_t offset = 0;
+        if (sizeOfDatatype(header.datatype) != sizeof(VoxelType) || !dataOffset(*file, header, &offset)) {
+            return false;
+        }
+
+        if (!imageData->adoptMapping(file, offset, numElements)) {
+            // misaligned data: single copy from mapping to owned memory
+            imageData->resize(numElements);
+            std::memcpy(imageData->data(), file->data() + offset, numElements * sizeof(VoxelType));
+        }
+
+        if (swapBytes && sizeof(VoxelType) > 1 && header.bigEndian != (std::endian::native == std::endian::big)) {
+            VoxelConvert::swapBytes(imageData->data(), numElements);
+        }
+
+        return true;
+    }
+
+}
+
+#endif // READRAWHEADER_H
@@ -5,28 +5,120 @@
 #include <fstream>
 #include <cstdio>
 #include <cstring>
+#include <cctype>
+#include <algorithm>
 
 #include "readVTK.h"
 
 namespace ReadVTK
 {
-    bool isVTKFile(const std::string &filename)
+    // Helpers for header parsing
+    namespace
     {
-        std::ifstream f(filename, std::ios::binary);
-        if (!f.is_open()) {
-            errorLog() << "Could not open " << filename;
-            return false;
+        // Return the line starting at *pos (without end-of-line characters)
+        // and move *pos to the beginning of the next line
+        std::string nextLine(const MappedFile &file, size_t *pos)
+        {
+            const char *bytes = reinterpret_cast<const char *>(file.data());
+            size_t start = *pos;
+            const void *eol = std::memchr(bytes + start, '\n', file.size() - start);
+            size_t end = (eol != nullptr) ? static_cast<const char *>(eol) - bytes : file.size();
+            *pos = (eol != nullptr) ? end + 1 : end;
+
+            // trim trailing '\r' and blanks, leading blanks
+            while (end > start && (bytes[end - 1] == '\r' || bytes[end - 1] == ' ' || bytes[end - 1] == '\t')) {
+                end--;
+            }
+            while (start < end && (bytes[start] == ' ' || bytes[start] == '\t')) {
+                start++;
+            }
+            return std::string(bytes + start, end - start);
         }
 
-        std::string checkvtk;
-        f >> checkvtk; // #
-        f >> checkvtk; // vtk
-        f.close();
-        if (!(checkvtk == "vtk" || checkvtk == "VTK")) {
-            return false;
+        // Return the first word of a line, in upper case
+        std::string keyword(const std::string &line)
+        {
+            std::string word = line.substr(0, line.find_first_of(" \t"));
+            std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) { return (char)std::toupper(c); });
+            return word;
         }
 
-        return true;
+        // Size in bytes of a VTK data type name (0 if unknown)
+        size_t sizeOfType(const std::string &typestring)
+        {
+            if (typestring == "unsigned_char" || typestring == "char") {
+                return 1;
+            }
+            else if (typestring == "unsigned_short" || typestring == "short") {
+                return 2;
+            }
+            else if (typestring == "unsigned_int" || typestring == "int" || typestring == "float") {
+                return 4;
+            }
+            else if (typestring == "unsigned_long" || typestring == "long" || typestring == "double"
+                     || typestring == "vtktypeint64" || typestring == "vtktypeuint64") {
+                return 8;
+            }
+            return 0;
+        }
+
+        // Skip the arrays of a "FIELD name numArrays" block (and their values)
+        bool skipField(const MappedFile &file, const std::string &fieldLine, bool binary, size_t *pos)
+        {
+            int numArrays = 0;
+            if (sscanf(fieldLine.c_str(), "%*s %*s %d", &numArrays) != 1) {
+                return false;
+            }
+
+            for (int a = 0; a < numArrays; a++) {
+                std::string arrayLine;
+                while (arrayLine.empty() && *pos < file.size()) {
+                    arrayLine = nextLine(file, pos);
+                }
+                if (keyword(arrayLine) == "NULL_ARRAY") {
+                    continue;
+                }
+
+                char typeBuffer[32];
+                long long numComponents = 0, numTuples = 0;
+                if (sscanf(arrayLine.c_str(), "%*s %lld %lld %31s", &numComponents, &numTuples, typeBuffer) != 3) {
+                    return false;
+                }
+                size_t numValues = size_t(numComponents) * size_t(numTuples);
+
+                if (binary) {
+                    size_t typeSize = sizeOfType(typeBuffer);
+                    if (typeSize == 0 || *pos + numValues * typeSize > file.size()) {
+                        return false;
+                    }
+                    *pos += numValues * typeSize;
+                    nextLine(file, pos); // end of line after binary values
+                }
+                else {
+                    const char *bytes = reinterpret_cast<const char *>(file.data());
+                    for (size_t v = 0; v < numValues; v++) {
+                        while (*pos < file.size() && std::isspace((unsigned char)bytes[*pos])) {
+                            (*pos)++;
+                        }
+                        while (*pos < file.size() && !std::isspace((unsigned char)bytes[*pos])) {
+                            (*pos)++;
+                        }
+                    }
+                    nextLine(file, pos);
+                }
+            }
+            return true;
+        }
+    }
+
+    // Check the magic first line of a (mapped) file
+    bool isVTKFile(const MappedFile &file)
+    {
+        size_t pos = 0;
+        std::string checkvtk = nextLine(file, &pos);
+        std::transform(checkvtk.begin(), checkvtk.end(), checkvtk.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        checkvtk.erase(std::remove_if(checkvtk.begin(), checkvtk.end(), [](unsigned char c) { return std::isspace(c); }), checkvtk.end());
+        return checkvtk.substr(0, 4) == "#vtk";
     }
 
     // Extract data format (ASCII or BINARY) from header strings
@@ -51,8 +143,14 @@ namespace ReadVTK
     {
         for (auto it = headerLines.begin(); it != headerLines.end(); ++it) {
             if (it->substr(0, 10) == "DIMENSIONS") {
+                // positive dimensions, whose number of bytes (of any voxel type) fits in size_t
                 int width, height, depth;
-                sscanf(it->c_str(), "%*s %d %d %d", &width, &height, &depth);
+                if (sscanf(it->c_str(), "%*s %d %d %d", &width, &height, &depth) != 3
+                    || width <= 0 || height <= 0 || depth <= 0
+                    || size_t(width) * size_t(height) > std::numeric_limits<size_t>::max() / sizeof(double) / size_t(depth)) {
+                    errorLog() << "ReadVTK::extractDimensions(): invalid dimensions in " << *it;
+                    return false;
+                }
                 header->dimensions = glm::ivec3(width, height, depth);
                 return true;
             }
@@ -78,7 +176,7 @@ namespace ReadVTK
     bool extractSpacing(const std::vector<std::string> &headerLines, VTKHeader *header)
     {
         for (auto it = headerLines.begin(); it != headerLines.end(); ++it) {
-            if (it->substr(0, 7) == "SPACING") {
+            if (it->substr(0, 7) == "SPACING" || it->substr(0, 12) == "ASPECT_RATIO") {
                 float sx, sy, sz;
                 sscanf(it->c_str(), "%*s %f %f %f", &sx, &sy, &sz);
                 header->spacing = glm::vec3(sx, sy, sz);
@@ -133,6 +231,12 @@ namespace ReadVTK
         return data.c[0] == 1;
     }
 
+    // Check if the data part of the file is not in host byte order
+    bool needsByteSwap(const VTKHeader &header)
+    {
+        return header.binary && isLittleEndian();
+    }
+
     // Swap byte order of 2-byte element
     void swap2Bytes(unsigned char* &ptr)
     {
@@ -148,29 +252,95 @@ namespace ReadVTK
         tmp = ptr[1]; ptr[1] = ptr[2]; ptr[2] = tmp;
     }
 
-    // Read the header part (the first ten lines) of the file
-    bool readHeader(const std::string filename, VTKHeader *header)
+    // Count (up to maxValues) the ASCII values in [begin ; end[
+    size_t countASCIIValues(const char *begin, const char *end, size_t maxValues)
+    {
+        size_t count = 0;
+        const char *p = begin;
+        while (count < maxValues) {
+            while (p < end && isSeparator(*p)) {
+                p++;
+            }
+            if (p == end) {
+                break;
+            }
+            while (p < end && !isSeparator(*p)) {
+                p++;
+            }
+            count++;
+        }
+        return count;
+    }
+
+    // Parse the header part of a (mapped) file, of any length: comments,
+    // blank lines and FIELD blocks are skipped. Also sets header->dataOffset.
+    // Expects the usual legacy layout:
+    //
+    // # vtk DataFile Version x.x\n
+    // Some information about the file\n
+    // BINARY\n
+    // DATASET STRUCTURED_POINTS\n
+    // DIMENSIONS 128 128 128\n
+    // ORIGIN 0.0 0.0 0.0\n
+    // SPACING 1.0 1.0 1.0\n
+    // POINT_DATA 2097152\n
+    // SCALARS image_data unsigned_char\n
+    // LOOKUP_TABLE default\n
+    // raw data........\n
+    bool readHeader(const MappedFile &file, VTKHeader *header)
     {
-        std::ifstream VTKFile(filename, std::ios::binary);
-        if (!VTKFile.is_open()) {
-            errorLog() << "ReadVTK::readHeader(): could not open " << filename;
+        if (!isVTKFile(file)) {
+            errorLog() << "ReadVTK::readHeader(): not a VTK file";
             return false;
         }
 
-        // Read header
-        int numHeaderLines = 10;
+        size_t pos = 0;
+        nextLine(file, &pos); // # vtk DataFile Version x.x
+        nextLine(file, &pos); // title (free text)
+
         std::vector<std::string> headerLines;
-        for (int i = 0; i < numHeaderLines; i++) {
-            std::string line;
-            std::getline(VTKFile, line);
-            if (line.empty()) {
-                VTKFile.close();
+        bool foundScalars = false;
+        while (!foundScalars && pos < file.size()) {
+            std::string line = nextLine(file, &pos);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            std::string key = keyword(line);
+            if (key == "FIELD") {
+                if (!extractFormat(headerLines, header) || !skipField(file, line, header->binary, &pos)) {
+                    errorLog() << "ReadVTK::readHeader(): invalid FIELD block: " << line;
+                    return false;
+                }
+                continue;
+            }
+            else if (key == "METADATA") {
+                // metadata block ends with an empty line
+                while (pos < file.size() && !nextLine(file, &pos).empty()) {}
+                continue;
+            }
+            else if (key == "DATASET" && line.find("STRUCTURED_POINTS") == std::string::npos) {
+                errorLog() << "ReadVTK::readHeader(): unsupported dataset: " << line;
                 return false;
             }
-            else {
-                headerLines.push_back(line);
+            else if (key == "SCALARS") {
+                foundScalars = true;
+
+                // optional LOOKUP_TABLE line, data starts right after it
+                size_t lutPos = pos;
+                if (keyword(nextLine(file, &lutPos)) == "LOOKUP_TABLE") {
+                    pos = lutPos;
+                }
             }
+
+            headerLines.push_back(line);
+        }
+
+        if (!foundScalars) {
+            errorLog() << "ReadVTK::readHeader(): no SCALARS data found";
+            return false;
         }
+        header->dataOffset = pos;
 
         // Extract header information
         if (!extractFormat(headerLines, header)) {
@@ -193,4 +363,4 @@ namespace ReadVTK
     }
 
 
-} // end namespace ReadVTK
\ No newline at end of file
+} // end namespace ReadVTK
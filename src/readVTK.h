@@ -1,12 +1,22 @@
 #ifndef READVTK_H
 #define READVTK_H
 
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <type_traits>
+
 #include "volumeBase.h"
+#include "mappedFile.h"
+#include "parallel.h"
+#include "voxelConvert.h"
 
 
 namespace ReadVTK
 {
-    
+
     // Struct for VTK header info
     struct VTKHeader {
         bool binary;
@@ -14,17 +24,20 @@ namespace ReadVTK
         glm::vec3 origin;
         glm::vec3 spacing;
         std::string datatype;
+        size_t dataOffset;  // offset (in bytes) of the data part in the file
 
         VTKHeader() :
             binary(true),
             dimensions(glm::ivec3(0, 0, 0)),
             origin(glm::vec3(0.0f, 0.0f, 0.0f)),
             spacing(glm::vec3(0.0f, 0.0f, 0.0f)),
-            datatype("")
+            datatype(""),
+            dataOffset(0)
         {}
     };
 
-    bool isVTKFile(const std::string &filename);
+    // Check the magic first line of a (mapped) file
+    bool isVTKFile(const MappedFile &file);
 
     // Extract data format (ASCII or BINARY) from header strings
     bool extractFormat(const std::vector<std::string> &headerLines, VTKHeader *header);
@@ -55,101 +68,244 @@ namespace ReadVTK
     template<typename T>
     void swapByteOrder(std::vector<T> *imageData);
 
-    // Read image data in binary format
+    // Swap byte order of n elements, in place
     template<typename T>
-    void readVTKBinary(std::ifstream &is, std::vector<T> *imageData, int n);
+    void swapByteOrder(T *imageData, size_t n);
 
-    // Read image data in ASCII format
+    // Check if a character separates ASCII values
+    inline bool isSeparator(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+    }
+
+    // Parse one ASCII value [first ; last[
+    template<typename T>
+    T parseASCIIValue(const char *first, const char *last);
+
+    // Count (up to maxValues) the ASCII values in [begin ; end[
+    size_t countASCIIValues(const char *begin, const char *end, size_t maxValues);
+
+    // Parse (up to maxValues) the ASCII values in [begin ; end[, returns
+    // the number of values written into imageData
+    template<typename T>
+    size_t parseASCIIChunk(const char *begin, const char *end, T *imageData, size_t maxValues);
+
+    // Read image data in ASCII format (cancelled, if set, is polled
+    // between chunks: reading stops and fails when it returns true)
     template<typename T>
-    void readVTKASCII(std::ifstream &is, std::vector<T> *imageData, int n);
+    bool readVTKASCII(const char *begin, const char *end, T *imageData, size_t n,
+                      const std::function<bool()> &cancelled = nullptr);
 
-    // Read the header part (the first ten lines) of the file
-    bool readHeader(const std::string filename, VTKHeader *header);
+    // Parse the header part of a (mapped) file, of any length: comments,
+    // blank lines and FIELD blocks are skipped. Also sets header->dataOffset.
+    bool readHeader(const MappedFile &file, VTKHeader *header);
 
-    // Read the data part of the file
+    // Check if the data part of the file is not in host byte order
+    // (binary data is big endian)
+    bool needsByteSwap(const VTKHeader &header);
+
+    // Map the data part of the file directly into a voxel storage
+    // (cancelled, if set, is polled while parsing ASCII data)
     template<typename VoxelType>
-    bool readData(const std::string filename, const VTKHeader &header, std::vector<VoxelType> *imageData);
+    bool mapData(std::shared_ptr<MappedFile> file, const VTKHeader &header, VoxelStorage<VoxelType> *imageData,
+                 bool swapBytes = true, const std::function<bool()> &cancelled = nullptr);
+
 
-    
     // Swap byte order of image data elements
     template<typename T>
     void swapByteOrder(std::vector<T> *imageData)
     {
-        int numElements = (int)imageData->size();
-        int elementSizeInBytes = sizeof(T);
-        unsigned char *elementPointer = reinterpret_cast<unsigned char *>(&(*imageData)[0]);
-        switch (elementSizeInBytes) {
-        case 2: // uint16, int16
-            for (int i = 0; i < numElements; i++, elementPointer += elementSizeInBytes) {
-                swap2Bytes(elementPointer);
+        swapByteOrder(imageData->data(), imageData->size());
+    }
+
+    // Swap byte order of n elements, in place (vectorized and multithreaded)
+    template<typename T>
+    void swapByteOrder(T *imageData, size_t n)
+    {
+        VoxelConvert::swapBytes(imageData, n);
+    }
+
+    // Parse one ASCII value [first ; last[
+    template<typename T>
+    T parseASCIIValue(const char *first, const char *last)
+    {
+        if (first != last && *first == '+') {
+            first++;
+        }
+
+        if constexpr (std::is_integral_v<T>) {
+            // parsed as a number, even for 1-byte types
+            T value = 0;
+            auto result = std::from_chars(first, last, value);
+            if (result.ec == std::errc() && result.ptr == last) {
+                return value;
             }
-            break;
-        case 4: // uint32, float32
-            for (int i = 0; i < numElements; i++, elementPointer += elementSizeInBytes) {
-                swap4Bytes(elementPointer);
+        }
+        else {
+            T value = 0;
+            auto result = std::from_chars(first, last, value);
+            if (result.ec == std::errc()) {
+                return value;
             }
-            break;
-        default:
-            break;
         }
+
+        // non-integral notation for an integral type (e.g. "12.0" or "1e2"), or out of range
+        // (clamped to the range of T, as out-of-range conversions are undefined; NaN gives 0 for integral types)
+        double value = 0.0;
+        std::from_chars(first, last, value);
+        if (std::isnan(value)) {
+            return std::is_integral_v<T> ? T(0) : std::numeric_limits<T>::quiet_NaN();
+        }
+        if (value <= double(std::numeric_limits<T>::lowest())) {
+            return std::numeric_limits<T>::lowest();
+        }
+        if (value >= double(std::numeric_limits<T>::max())) {
+            return std::numeric_limits<T>::max();
+        }
+        return static_cast<T>(value);
     }
 
-    // Read image data in binary format
+    // Parse (up to maxValues) the ASCII values in [begin ; end[, returns
+    // the number of values written into imageData
     template<typename T>
-    void readVTKBinary(std::ifstream &is, std::vector<T> *imageData, int n)
+    size_t parseASCIIChunk(const char *begin, const char *end, T *imageData, size_t maxValues)
     {
-        if (isLittleEndian()) {
-            is.read(reinterpret_cast<char *>(&(*imageData)[0]), sizeof(T) * n);
-            swapByteOrder(imageData);
-        }
-        else {
-            is.read(reinterpret_cast<char *>(&(*imageData)[0]), sizeof(T) * n);
+        size_t count = 0;
+        const char *p = begin;
+        while (count < maxValues) {
+            while (p < end && isSeparator(*p)) {
+                p++;
+            }
+            if (p == end) {
+                break;
+            }
+            const char *tokenEnd = p;
+            while (tokenEnd < end && !isSeparator(*tokenEnd)) {
+                tokenEnd++;
+            }
+            imageData[count++] = parseASCIIValue<T>(p, tokenEnd);
+            p = tokenEnd;
         }
+        return count;
     }
 
     // Read image data in ASCII format
+    // The text is split into chunks at separator boundaries. Values are first
+    // counted per chunk (in parallel) to know where each chunk starts in the
+    // output, then parsed (in parallel) straight into imageData. Chunks
+    // are also bounded in size, so that cancellation is polled often.
     template<typename T>
-    void readVTKASCII(std::ifstream &is, std::vector<T> *imageData, int n)
+    bool readVTKASCII(const char *begin, const char *end, T *imageData, size_t n,
+                      const std::function<bool()> &cancelled)
     {
-        T value;
-        for(int i = 0; i < n; i++) {
-            is >> value;
-            imageData->push_back(value);
+        const size_t minChunkSize = 1 << 20, maxChunkSize = 16 << 20;
+        size_t size = end - begin;
+        size_t nbChunks = std::max<size_t>(1, std::min<size_t>(std::max<size_t>(Parallel::nbThreads() * 4, size / maxChunkSize),
+                                                               size / minChunkSize));
+        std::atomic<bool> stopped = false;
+
+        // chunk boundaries, moved forward to the next separator so that no value is split
+        std::vector<const char *> bounds(nbChunks + 1);
+        bounds[0] = begin;
+        bounds[nbChunks] = end;
+        for (size_t c = 1; c < nbChunks; c++) {
+            const char *p = std::max(bounds[c - 1], begin + c * (size / nbChunks));
+            while (p < end && !isSeparator(*p)) {
+                p++;
+            }
+            bounds[c] = p;
+        }
+
+        // 1. count values in each chunk
+        std::vector<size_t> counts(nbChunks, 0);
+        Parallel::parallelFor(0, nbChunks, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last && !stopped; c++) {
+                if (cancelled && cancelled()) {
+                    stopped = true;
+                    break;
+                }
+                counts[c] = countASCIIValues(bounds[c], bounds[c + 1], n);
+            }
+        });
+        if (stopped) {
+            return false;
+        }
+
+        // 2. output offset of each chunk
+        std::vector<size_t> offsets(nbChunks, 0);
+        size_t total = 0;
+        for (size_t c = 0; c < nbChunks; c++) {
+            offsets[c] = total;
+            total += counts[c];
         }
+        if (total < n) {
+            errorLog() << "ReadVTK::readVTKASCII(): expected " << n << " values, found " << total;
+            return false;
+        }
+
+        // 3. parse values of each chunk at its offset
+        Parallel::parallelFor(0, nbChunks, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last && !stopped; c++) {
+                if (cancelled && cancelled()) {
+                    stopped = true;
+                    break;
+                }
+                if (offsets[c] < n) {
+                    parseASCIIChunk(bounds[c], bounds[c + 1], imageData + offsets[c], std::min(counts[c], n - offsets[c]));
+                }
+            }
+        });
+
+        return !stopped;
     }
 
-    // Read the data part of the file
+    // Map the data part of the file directly into a voxel storage
+    // Binary data is exposed in place (copy-on-write mapping) and byte-swapped
+    // only on little endian architectures; it is copied once into owned
+    // memory only if the data section is not aligned on sizeof(VoxelType).
+    // ASCII data is parsed from the mapping into owned memory.
+    // With swapBytes = false, binary data is left in file byte order (see
+    // needsByteSwap()), e.g. to be swapped on the fly by a conversion kernel.
     template<typename VoxelType>
-    bool readData(const std::string filename, const VTKHeader &header, std::vector<VoxelType> *imageData)
+    bool mapData(std::shared_ptr<MappedFile> file, const VTKHeader &header, VoxelStorage<VoxelType> *imageData,
+                 bool swapBytes, const std::function<bool()> &cancelled)
     {
-        std::ifstream VTKFile(filename, std::ios::binary);
-        if (!VTKFile.is_open()) {
-            errorLog() << "Could not open " << filename;
+        glm::ivec3 dimensions = header.dimensions;
+        size_t numElements = size_t(dimensions[0]) * size_t(dimensions[1]) * size_t(dimensions[2]);
+        size_t offset = header.dataOffset;
+
+        if (offset > file->size()) {
+            errorLog() << "ReadVTK::mapData(): file is too short for its dimensions";
             return false;
         }
 
-        // Jump to data
-        int numHeaderLines = 10;
-        for (int i = 0; i < numHeaderLines; i++) {
-            std::string line;
-            std::getline(VTKFile, line);
-            if (line.empty()) {
-                VTKFile.close();
+        if (!header.binary) {
+            // each value takes at least one character and a separator
+            if (numElements > (file->size() - offset) / 2 + 1) {
+                errorLog() << "ReadVTK::mapData(): file is too short for its dimensions";
                 return false;
             }
+            const char *begin = reinterpret_cast<const char *>(file->data()) + offset;
+            const char *end = reinterpret_cast<const char *>(file->data()) + file->size();
+            imageData->resize(numElements);
+            return readVTKASCII(begin, end, imageData->data(), numElements, cancelled);
         }
 
-        // Read data
-        glm::ivec3 dimensions = header.dimensions;
-        int numElements = dimensions[0] * dimensions[1] * dimensions[2];
-        imageData->clear();
-        imageData->reserve(numElements);
-        if (header.binary) {
+        // (compared without computing the end of the data, which may overflow)
+        if (numElements > (file->size() - offset) / sizeof(VoxelType)) {
+            errorLog() << "ReadVTK::mapData(): file is too short for its dimensions";
+            return false;
+        }
+
+        if (!imageData->adoptMapping(file, offset, numElements)) {
+            // misaligned data section: single copy from mapping to owned memory
             imageData->resize(numElements);
-            readVTKBinary(VTKFile, imageData, numElements);
+            std::memcpy(imageData->data(), file->data() + offset, numElements * sizeof(VoxelType));
         }
-        else {
-            readVTKASCII(VTKFile, imageData, numElements);
+
+        // VTK binary data is big endian
+        if (swapBytes && isLittleEndian()) {
+            swapByteOrder(imageData->data(), numElements);
         }
 
         return true;
@@ -157,4 +313,4 @@ namespace ReadVTK
 
 }
 
-#endif // READVTK_H
\ No newline at end of file
+#endif // READVTK_H
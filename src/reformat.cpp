@@ -0,0 +1,315 @@
+/*********************************************************************************************************************
+ *
+ * reformat.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include "reformat.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "volumeImg.h"
+#include "parallel.h"
+#include "simd.h"
+
+
+namespace Reformat
+{
+
+namespace
+{
+    // max number of points sampled in a batch: below twice the grain of VolumeSampler::sample(), so that batches
+    // are sampled by the calling thread (threads already process bands of rows)
+    const size_t batchSize = 1 << 12;
+
+    // pixels per AVX2 register
+    const size_t simdWidth = 8;
+
+
+    /*!
+    * \fn imageCorner
+    * \brief Center of the first pixel of an image centered on a plane
+    */
+    glm::vec3 imageCorner(const Plane& _plane, glm::ivec2 _size, float _pixelSize)
+    {
+        return _plane.center - (0.5f * float(_size.x - 1) * _pixelSize) * _plane.axisU
+                             - (0.5f * float(_size.y - 1) * _pixelSize) * _plane.axisV;
+    }
+
+    /*!
+    * \fn slabOutside
+    * \brief Value of samples out of the grid, neutral for the projection (NaN for the average, which counts the other ones)
+    */
+    float slabOutside(SlabMode _mode, float _outside)
+    {
+        switch (_mode)
+        {
+            case SLAB_MIP: return -std::numeric_limits<float>::infinity();
+            case SLAB_MINIP: return std::numeric_limits<float>::infinity();
+            case SLAB_AVERAGE: return std::numeric_limits<float>::quiet_NaN();
+            default: return _outside;
+        }
+    }
+
+#if defined(SIMD_X86)
+    /*!
+    * \fn combineLayerAVX2
+    * \brief AVX2 version of combineLayer(), 8 pixels at a time
+    * \return number of pixels processed (the remaining ones are left to the scalar loop)
+    */
+    SIMD_TARGET_AVX2 size_t combineLayerAVX2(SlabMode _mode, const float* _values, float* _acc, float* _count, size_t _n)
+    {
+        size_t i = 0;
+        if (_mode == SLAB_MIP)
+        {
+            for (; i + simdWidth <= _n; i += simdWidth)
+                _mm256_storeu_ps(_acc + i, _mm256_max_ps(_mm256_loadu_ps(_acc + i), _mm256_loadu_ps(_values + i)));
+        }
+        else if (_mode == SLAB_MINIP)
+        {
+            for (; i + simdWidth <= _n; i += simdWidth)
+                _mm256_storeu_ps(_acc + i, _mm256_min_ps(_mm256_loadu_ps(_acc + i), _mm256_loadu_ps(_values + i)));
+        }
+        else
+        {
+            // samples out of the grid (NaN) are masked out
+            const __m256 one = _mm256_set1_ps(1.0f);
+            for (; i + simdWidth <= _n; i += simdWidth)
+            {
+                __m256 v = _mm256_loadu_ps(_values + i);
+                __m256 inside = _mm256_cmp_ps(v, v, _CMP_ORD_Q);
+                _mm256_storeu_ps(_acc + i, _mm256_add_ps(_mm256_loadu_ps(_acc + i), _mm256_and_ps(inside, v)));
+                _mm256_storeu_ps(_count + i, _mm256_add_ps(_mm256_loadu_ps(_count + i), _mm256_and_ps(inside, one)));
+            }
+        }
+        return i;
+    }
+#endif
+
+    /*!
+    * \fn combineLayer
+    * \brief Combine the samples of a layer of the slab into the accumulators of a tile of pixels
+    * \param _mode : projection (not SLAB_THIN)
+    * \param _values : samples of the layer
+    * \param _acc : max, min or sum of the samples
+    * \param _count : number of samples within the volume (average only)
+    * \param _n : number of pixels
+    */
+    void combineLayer(SlabMode _mode, const float* _values, float* _acc, float* _count, size_t _n)
+    {
+        size_t i = 0;
+#if defined(SIMD_X86)
+        if (Simd::hasAVX2())
+            i = combineLayerAVX2(_mode, _values, _acc, _count, _n);
+#endif
+        for (; i < _n; i++)
+        {
+            float v = _values[i];
+            if (_mode == SLAB_MIP)
+                _acc[i] = std::max(_acc[i], v);
+            else if (_mode == SLAB_MINIP)
+                _acc[i] = std::min(_acc[i], v);
+            else if (!std::isnan(v))
+            {
+                _acc[i] += v;
+                _count[i] += 1.0f;
+            }
+        }
+    }
+
+} // namespace
+
+
+Plane planeFromAngles(glm::vec3 _center, float _yaw, float _pitch, float _offset)
+{
+    // rotation around Y
+    glm::vec3 u(std::cos(_yaw), 0.0f, -std::sin(_yaw));
+    glm::vec3 v(0.0f, 1.0f, 0.0f);
+    glm::vec3 n(std::sin(_yaw), 0.0f, std::cos(_yaw));
+
+    // rotation around the rotated x axis
+    Plane plane;
+    plane.axisU = u;
+    plane.axisV = std::cos(_pitch) * v + std::sin(_pitch) * n;
+    plane.center = _center + _offset * plane.normal();
+    return plane;
+}
+
+
+float slabStep(glm::vec3 _spacing)
+{
+    float step = std::numeric_limits<float>::infinity();
+    for (int a = 0; a < 3; a++)
+    {
+        if (_spacing[a] != 0.0f)
+            step = std::min(step, std::abs(_spacing[a]));
+    }
+    return std::isinf(step) ? 1.0f : step;
+}
+
+
+int nbSlabSamples(float _thickness, float _step)
+{
+    if (!(_thickness > 0.0f) || !(_step > 0.0f))
+        return 1;
+
+    // samples at both faces of the slab, at most _step apart
+    float halfSamples = std::ceil(0.5f * _thickness / _step);
+    return std::min(1 + 2 * int(std::min(halfSamples, float(MAX_SLAB_SAMPLES))), MAX_SLAB_SAMPLES);
+}
+
+
+glm::mat4 textureMatrix(const Plane& _plane, float _side, glm::vec3 _origin, glm::vec3 _spacing, glm::ivec3 _dims)
+{
+    // texture coordinates of a point p: (p - origin + spacing / 2) / extent
+    glm::vec3 invExtent = glm::vec3(1.0f) / (glm::vec3(_dims) * _spacing);
+    glm::vec3 corner = _plane.center - (0.5f * _side) * (_plane.axisU + _plane.axisV);
+
+    glm::mat4 mat(1.0f);
+    mat[0] = glm::vec4(_side * _plane.axisU * invExtent, 0.0f);
+    mat[1] = glm::vec4(_side * _plane.axisV * invExtent, 0.0f);
+    mat[2] = glm::vec4(_plane.normal() * invExtent, 0.0f);
+    mat[3] = glm::vec4((corner - _origin + 0.5f * _spacing) * invExtent, 1.0f);
+    return mat;
+}
+
+
+template <typename VoxelType>
+void reformat(VolumeView<const VoxelType> _vol, glm::vec3 _origin, glm::vec3 _spacing, const Plane& _plane,
+              glm::ivec2 _size, float _pixelSize, SlabMode _mode, float _thickness,
+              VolumeSampler::Filter _filter, float* _image, float _outside)
+{
+    if (_size.x <= 0 || _size.y <= 0)
+        return;
+    const size_t width = size_t(_size.x);
+    const size_t height = size_t(_size.y);
+
+    // layers of the slab, centered on the plane
+    const int nbLayers = _mode == SLAB_THIN ? 1 : nbSlabSamples(_thickness, slabStep(_spacing));
+    const SlabMode mode = nbLayers == 1 ? SLAB_THIN : _mode;
+    std::vector<glm::vec3> layerOffsets(nbLayers, glm::vec3(0.0f));
+    if (nbLayers > 1)
+    {
+        glm::vec3 step = (_thickness / float(nbLayers - 1)) * _plane.normal();
+        for (int l = 0; l < nbLayers; l++)
+            layerOffsets[l] = (float(l) - 0.5f * float(nbLayers - 1)) * step;
+    }
+
+    // tiles of pixels whose whole slab fits in a batch
+    const size_t tileWidth = std::max(simdWidth, batchSize / size_t(nbLayers) / simdWidth * simdWidth);
+    const float outside = slabOutside(mode, _outside);
+    const glm::vec3 du = _pixelSize * _plane.axisU;
+    const glm::vec3 dv = _pixelSize * _plane.axisV;
+    const glm::vec3 corner = imageCorner(_plane, _size, _pixelSize);
+
+    Parallel::parallelFor(0, height, [&](size_t _first, size_t _last)
+    {
+        std::vector<glm::vec3> points(tileWidth * nbLayers);
+        std::vector<float> values(tileWidth * nbLayers);
+        std::vector<float> acc(tileWidth);
+        std::vector<float> count(tileWidth);
+
+        for (size_t y = _first; y < _last; y++)
+        {
+            float* row = _image + y * width;
+            glm::vec3 rowStart = corner + float(y) * dv;
+
+            for (size_t x0 = 0; x0 < width; x0 += tileWidth)
+            {
+                size_t n = std::min(tileWidth, width - x0);
+
+                // samples of the tile through the slab, layer after layer
+                for (int l = 0; l < nbLayers; l++)
+                {
+                    glm::vec3 start = rowStart + float(x0) * du + layerOffsets[l];
+                    glm::vec3* layerPoints = points.data() + size_t(l) * n;
+                    for (size_t x = 0; x < n; x++)
+                        layerPoints[x] = start + float(x) * du;
+                }
+                if (mode == SLAB_THIN)
+                {
+                    VolumeSampler::sample(_vol, _origin, _spacing, points.data(), n, _filter, row + x0, outside);
+                    continue;
+                }
+                VolumeSampler::sample(_vol, _origin, _spacing, points.data(), n * nbLayers, _filter, values.data(), outside);
+
+                std::fill(acc.begin(), acc.begin() + n, mode == SLAB_AVERAGE ? 0.0f : outside);
+                std::fill(count.begin(), count.begin() + n, 0.0f);
+                for (int l = 0; l < nbLayers; l++)
+                    combineLayer(mode, values.data() + size_t(l) * n, acc.data(), count.data(), n);
+
+                // pixels whose samples are all out of the grid
+                for (size_t x = 0; x < n; x++)
+                {
+                    if (mode == SLAB_AVERAGE)
+                        row[x0 + x] = count[x] > 0.0f ? acc[x] / count[x] : _outside;
+                    else
+                        row[x0 + x] = std::isinf(acc[x]) ? _outside : acc[x];
+                }
+            }
+        }
+    });
+}
+
+template void reformat<std::uint8_t>(VolumeView<const std::uint8_t>, glm::vec3, glm::vec3, const Plane&, glm::ivec2, float, SlabMode, float, VolumeSampler::Filter, float*, float);
+template void reformat<std::uint16_t>(VolumeView<const std::uint16_t>, glm::vec3, glm::vec3, const Plane&, glm::ivec2, float, SlabMode, float, VolumeSampler::Filter, float*, float);
+template void reformat<std::int16_t>(VolumeView<const std::int16_t>, glm::vec3, glm::vec3, const Plane&, glm::ivec2, float, SlabMode, float, VolumeSampler::Filter, float*, float);
+template void reformat<float>(VolumeView<const float>, glm::vec3, glm::vec3, const Plane&, glm::ivec2, float, SlabMode, float, VolumeSampler::Filter, float*, float);
+
+
+bool reformat(VolumeImg& _src, VolumeImg* _dst, const Plane& _plane, glm::ivec2 _size, float _pixelSize,
+              SlabMode _mode, float _thickness, VolumeSampler::Filter _filter)
+{
+    // no data (e.g. out-of-core volume)
+    const size_t nbVoxels = _src.getNbVoxels();
+    bool inCore = false;
+    _src.visit([&](auto& _typedVol) { inCore = nbVoxels != 0 && _typedVol.getStorage().size() == nbVoxels; });
+    if (!inCore)
+        return false;
+
+    // single slice, on the plane in world space (sampling coordinates are relative to the origin of the volume, along its axes)
+    glm::ivec2 size = glm::max(_size, glm::ivec2(1));
+    glm::ivec3 dims(size.x, size.y, 1);
+    glm::mat3 orientation = _src.getOrientation();
+    glm::vec3 origin = _src.getOrigin() + orientation * (imageCorner(_plane, size, _pixelSize) - _src.getOrigin());
+    float sliceSpacing = _mode == SLAB_THIN ? _pixelSize : std::max(_thickness, _pixelSize);
+    glm::vec3 spacing(_pixelSize, _pixelSize, sliceSpacing);
+    if (!_dst->volumeInitHeader("float32", dims, origin, spacing, _src.getValueRange()))
+        return false;
+
+    // pixels out of the volume get its lowest value (i.e. background)
+    float outside = _src.getValueRange().x;
+    bool done = false;
+    _dst->visit([&](auto& _dstVol)
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(*_dstVol.getFront())>, float>)
+        {
+            VoxelStorage<float>& storage = _dstVol.getStorage();
+            storage.resize(size_t(size.x) * size_t(size.y));
+            _src.visit([&](auto& _typedVol)
+            {
+                reformat(std::as_const(_typedVol).view(), _src.getOrigin(), _src.getSpacing(), _plane, size, _pixelSize,
+                         _mode, _thickness, _filter, storage.data(), outside);
+            });
+            done = true;
+        }
+    });
+    if (!done)
+        return false;
+
+    _dst->setOrientation(orientation * glm::mat3(_plane.axisU, _plane.axisV, _plane.normal()));
+    _dst->dataModified();
+    return true;
+}
+
+} // namespace Reformat
@@ -0,0 +1,148 @@
+/*********************************************************************************************************************
+ *
+ * reformat.h
+ *
+ * Oblique multi-planar reformats and thick-slab projections (MIP, MinIP, average) of volumes
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef REFORMAT_H
+#define REFORMAT_H
+
+
+#include <cstdint>
+#include <cstddef>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "volumeView.h"
+#include "volumeSampler.h"
+
+
+class VolumeImg;
+
+
+/*!
+* \namespace Reformat
+* \brief Images of a volume on an arbitrary plane (multi-planar reformat, MPR), optionally projected over a slab
+* of given thickness centered on the plane: max (MIP), min (MinIP) or average of the samples along the plane normal.
+* Planes are in the coordinates of VolumeSampler (voxel (i, j, k) is centered on origin + (i, j, k) * spacing).
+* Slabs are sampled from face to face, at most the finest spacing of the volume apart (see nbSlabSamples()), as the slice
+* shader does for the interactive view: images computed here match the displayed ones.
+* Each thread processes a band of image rows, by tiles of pixels whose samples through the whole slab are gathered
+* in one batch (see VolumeSampler), then combined layer by layer (vectorized on AVX2).
+*/
+namespace Reformat
+{
+
+    /*! Projection over the slab */
+    enum SlabMode
+    {
+        SLAB_THIN,      /*!< single sample on the plane (no slab) */
+        SLAB_MIP,       /*!< maximum intensity projection */
+        SLAB_MINIP,     /*!< minimum intensity projection */
+        SLAB_AVERAGE    /*!< average of the samples within the volume */
+    };
+
+    /*! max number of samples across a slab (thicker slabs are sampled with larger steps) */
+    const int MAX_SLAB_SAMPLES = 255;
+
+
+    /*!
+    * \struct Plane
+    * \brief Plane of a reformat: image rows follow axisU, image columns follow axisV (orthonormal)
+    */
+    struct Plane
+    {
+        glm::vec3 center = glm::vec3(0.0f);         /*!< point of the plane at the center of the image */
+        glm::vec3 axisU = glm::vec3(1.0f, 0.0f, 0.0f); /*!< direction of the image x axis */
+        glm::vec3 axisV = glm::vec3(0.0f, 1.0f, 0.0f); /*!< direction of the image y axis */
+
+        /*! \fn normal : normal of the plane, direction of the slab */
+        inline glm::vec3 normal() const { return glm::normalize(glm::cross(axisU, axisV)); }
+    };
+
+
+    /*!
+    * \fn planeFromAngles
+    * \brief Plane rotated from the axial one (axisU = X, axisV = Y): first around Y (yaw), then around its rotated x axis (pitch)
+    * \param _center : center of rotation (e.g. center of the volume)
+    * \param _yaw : rotation around Y (radians, 90 degrees gives a sagittal plane)
+    * \param _pitch : rotation around the rotated x axis (radians, 90 degrees gives a coronal plane)
+    * \param _offset : translation of the plane along its normal
+    */
+    Plane planeFromAngles(glm::vec3 _center, float _yaw, float _pitch, float _offset);
+
+    /*!
+    * \fn slabStep
+    * \brief Largest distance between samples across slabs: finest spacing of the volume
+    */
+    float slabStep(glm::vec3 _spacing);
+
+    /*!
+    * \fn nbSlabSamples
+    * \brief Number of samples across a slab, evenly spaced from face to face (odd, so that the middle one is on the plane;
+    * at most MAX_SLAB_SAMPLES)
+    * \param _thickness : thickness of the slab (world units)
+    * \param _step : largest distance between samples (see slabStep())
+    */
+    int nbSlabSamples(float _thickness, float _step);
+
+    /*!
+    * \fn textureMatrix
+    * \brief Mapping from the coordinates (s, t) in [0 ; 1]^2 of a square centered on a plane to 3D texture coordinates
+    * of the volume (for the texture matrix of a slice quad)
+    * \param _plane : plane
+    * \param _side : side of the square (world units)
+    * \param _origin : center of voxel (0, 0, 0)
+    * \param _spacing : spacing of the volume
+    * \param _dims : dimensions of the volume
+    */
+    glm::mat4 textureMatrix(const Plane& _plane, float _side, glm::vec3 _origin, glm::vec3 _spacing, glm::ivec3 _dims);
+
+
+    /*!
+    * \fn reformat
+    * \brief Sample a voxel grid on a plane, projected over a slab (multithreaded, see Reformat)
+    * \param _vol : voxels
+    * \param _origin : center of voxel (0, 0, 0)
+    * \param _spacing : spacing of the volume
+    * \param _plane : plane
+    * \param _size : size of the image (pixels), centered on the plane center
+    * \param _pixelSize : size of pixels (world units)
+    * \param _mode : projection over the slab
+    * \param _thickness : thickness of the slab (world units, unused for SLAB_THIN)
+    * \param _filter : interpolation filter
+    * \param _image : output image, _size.x * _size.y values (rows along axisU)
+    * \param _outside : value of pixels whose samples are all out of the grid
+    */
+    template <typename VoxelType>
+    void reformat(VolumeView<const VoxelType> _vol, glm::vec3 _origin, glm::vec3 _spacing, const Plane& _plane,
+                  glm::ivec2 _size, float _pixelSize, SlabMode _mode, float _thickness,
+                  VolumeSampler::Filter _filter, float* _image, float _outside = 0.0f);
+
+    /*!
+    * \fn reformat
+    * \brief Create a single-slice volume (float) from a reformat of a volume, placed in world space
+    * (its voxel axes are axisU, axisV and the normal of the plane, transformed by the orientation of the volume)
+    * \param _src : volume
+    * \param _dst : new volume
+    * \param _plane : plane (see above)
+    * \param _size : size of the image (pixels)
+    * \param _pixelSize : size of pixels (world units)
+    * \param _mode : projection over the slab
+    * \param _thickness : thickness of the slab (world units)
+    * \param _filter : interpolation filter
+    * \return false if the source volume has no data in memory (e.g. out-of-core volume)
+    */
+    bool reformat(VolumeImg& _src, VolumeImg* _dst, const Plane& _plane, glm::ivec2 _size, float _pixelSize,
+                  SlabMode _mode, float _thickness, VolumeSampler::Filter _filter);
+
+}
+
+#endif // REFORMAT_H
@@ -8,6 +8,18 @@ layout(location = 2) out vec4 gColor;
 
 
 uniform sampler3D u_volumeTexture;
+uniform vec2 u_window; // window [low ; high] in texture units
+uniform bool u_paged; // out-of-core volume: u_volumeTexture is a brick atlas (see samplePaged())
+uniform usampler3D u_pageTable; // per brick: slot in the atlas (rgb), resident or not (a)
+uniform vec3 u_volumeDims; // volume dimensions (voxels)
+uniform float u_brickSize; // brick size (voxels), atlas slots add a 1-voxel apron
+uniform sampler3D u_macrocells; // min (r) and max (g) values read by samples in each cell of the volume (see Macrocells)
+uniform bool u_useMacrocells; // skip empty macrocells
+uniform float u_cellSize; // macrocell size (voxels)
+uniform usampler3D u_distanceField; // Chebyshev distance (in cells) from each macrocell to the nearest occupied one (see Macrocells::distanceField())
+uniform bool u_useDistanceField; // cross blocks of empty macrocells at once
+uniform sampler3D u_gradientTexture; // precomputed gradients: unit direction (rgb, signed normalized), magnitude (a)
+uniform bool u_useGradientTex; // u_gradientTexture holds the gradients of u_volumeTexture
 uniform sampler2D u_backFaceTexture;
 uniform sampler2D u_frontFaceTexture;
 uniform sampler2D u_perlinTex;
@@ -17,6 +29,7 @@ uniform bool u_useShadow;
 uniform bool u_useJitter;
 uniform int u_useTF;
 uniform int u_maxSteps;
+uniform float u_lod; // mip level of the volume to sample (coarser while interacting, u_maxSteps is reduced accordingly)
 uniform float u_isoValue;
 uniform float u_isoValue2;
 uniform vec3 u_lightDir;
@@ -36,6 +49,78 @@ out vec4 frag_color;
 vec2 perlinNoiseScale = vec2(u_screenDims[0] * 0.01, u_screenDims[1] * 0.01);
 const float PI = 3.14159265359;
 
+// -------------------------------------------------------------------------------
+// Window/level: maps a volume value in [u_window.x ; u_window.y] to [0 ; 1]
+float windowLevel(in float value)
+{
+	return clamp((value - u_window.x) / (u_window.y - u_window.x), 0.0, 1.0);
+}
+
+// Sample an out-of-core volume: the brick holding pos is found in the page table, then sampled in its atlas slot
+// (bricks not resident yet read as the low bound of the window, i.e. empty)
+vec4 samplePaged(in vec3 pos)
+{
+	if (any(lessThan(pos, vec3(0.0))) || any(greaterThan(pos, vec3(1.0))))
+		return vec4(0.0);
+
+	vec3 voxel = pos * u_volumeDims;
+	ivec3 brick = min(ivec3(voxel / u_brickSize), textureSize(u_pageTable, 0) - 1);
+	uvec4 entry = texelFetch(u_pageTable, brick, 0);
+	if (entry.a == 0u)
+		return vec4(u_window.x);
+
+	vec3 atlasVoxel = vec3(entry.rgb) * (u_brickSize + 2.0) + 1.0 + voxel - vec3(brick) * u_brickSize;
+	return texture(u_volumeTexture, atlasVoxel / vec3(textureSize(u_volumeTexture, 0)));
+}
+
+// Sample the volume, in-core (3D texture, at mip level u_lod) or out-of-core (brick atlas)
+vec4 sampleVolume(in vec3 pos)
+{
+	return u_paged ? samplePaged(pos) : textureLod(u_volumeTexture, pos, u_lod);
+}
+
+// Empty space skipping: windowed max of the macrocell holding pos
+// (1 without macrocells, out of the grid, or at a coarse mip level whose samples read voxels of the neighbor cells,
+// i.e. the cell is never skipped)
+float macrocellMax(in vec3 pos)
+{
+	if (!u_useMacrocells || u_lod > 0.0)
+		return 1.0;
+
+	ivec3 cell = ivec3(floor(pos * vec3(textureSize(u_volumeTexture, 0)) / u_cellSize));
+	if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, textureSize(u_macrocells, 0))))
+		return 1.0;
+	return windowLevel(texelFetch(u_macrocells, cell, 0).g);
+}
+
+// Number of steps (at least 1) for a ray to leave the block of macrocells within radius (in cells) of the one holding pos,
+// so that samples keep their positions
+int macrocellExitSteps(in vec3 pos, in vec3 dir, in float stepSize, in float radius)
+{
+	vec3 cellsPerUnit = vec3(textureSize(u_volumeTexture, 0)) / u_cellSize;
+	vec3 exitPlanes = (floor(pos * cellsPerUnit) + step(0.0, dir) + sign(dir) * radius) / cellsPerUnit;
+	vec3 t = mix(vec3(1.0e6), (exitPlanes - pos) / dir, notEqual(dir, vec3(0.0)));
+	return int(floor(max(min(t.x, min(t.y, t.z)), 0.0) / stepSize)) + 1;
+}
+
+// Empty space skipping: number of steps for a ray to cross the block of empty macrocells around pos, from the distance field
+// (0 if the macrocell is occupied, without distance field or out of the grid)
+// At a coarse mip level, samples read voxels beyond the apron of their cell (texels of a level cover 2^lod voxels, the last one
+// along an odd dimension up to twice as many): blocks lose a margin of cells.
+int emptyBlockSteps(in vec3 pos, in vec3 dir, in float stepSize)
+{
+	if (!u_useDistanceField)
+		return 0;
+
+	ivec3 cell = ivec3(floor(pos * vec3(textureSize(u_volumeTexture, 0)) / u_cellSize));
+	if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, textureSize(u_distanceField, 0))))
+		return 0;
+	float margin = u_lod > 0.0 ? ceil((exp2(u_lod + 1.0) - 1.0) / u_cellSize) : 0.0;
+	float dist = float(texelFetch(u_distanceField, cell, 0).r);
+	return dist <= margin ? 0 : macrocellExitSteps(pos, dir, stepSize, dist - 1.0 - margin);
+}
+
+
 // -------------------------------------------------------------------------------
 // PBR functions
 // see https://learnopengl.com/PBR/
@@ -106,7 +191,7 @@ vec3 interval_bisection(vec3 ray_position, vec3 ray_direction, float _stepSize,
 		// test pos = middle between start and end
 		vec3 test_position = (start + end) / 2.0;
 
-		if (texture(u_volumeTexture, test_position).r < _isoValue)
+		if (windowLevel(sampleVolume(test_position).r) < _isoValue)
 		{
 			// if test pos is outside isosurface, use it as new start position
 			start = test_position;
@@ -136,7 +221,20 @@ int shadowRay(vec3 _pos, vec3 _lightDir, vec3 _rayDir, float _stepSize)
 	{
 		_pos += _stepSize * _lightDir;
 
-		if (texture(u_volumeTexture, _pos).r > u_isoValue)
+		// jump over blocks of empty macrocells (distance field), or a macrocell below the isovalue
+		// (to the last sample in the cells, next one is taken by the loop)
+		int skip = emptyBlockSteps(_pos, _lightDir, _stepSize);
+		if (skip == 0 && macrocellMax(_pos) <= u_isoValue)
+			skip = macrocellExitSteps(_pos, _lightDir, _stepSize, 0.0);
+		if (skip > 0)
+		{
+			skip -= 1;
+			_pos += float(skip) * _stepSize * _lightDir;
+			i += skip;
+			continue;
+		}
+
+		if (windowLevel(sampleVolume(_pos).r) > u_isoValue)
 			return 1;
 	}
 
@@ -150,14 +248,28 @@ int shadowRay(vec3 _pos, vec3 _lightDir, vec3 _rayDir, float _stepSize)
 // Find highest intensity value in 6-voxel neigborhood
 float maxNbhVal(in sampler3D image, in vec3 pos)
 {
-	float maxVal = texture(image, pos).r;
+	if (u_paged)
+	{
+		// neighbors 1 voxel away, through the page table
+		vec3 d = 1.0 / u_volumeDims;
+		float maxPaged = samplePaged(pos).r;
+		maxPaged = max(maxPaged, samplePaged(pos + vec3(d.x, 0.0, 0.0)).r);
+		maxPaged = max(maxPaged, samplePaged(pos - vec3(d.x, 0.0, 0.0)).r);
+		maxPaged = max(maxPaged, samplePaged(pos + vec3(0.0, d.y, 0.0)).r);
+		maxPaged = max(maxPaged, samplePaged(pos - vec3(0.0, d.y, 0.0)).r);
+		maxPaged = max(maxPaged, samplePaged(pos + vec3(0.0, 0.0, d.z)).r);
+		maxPaged = max(maxPaged, samplePaged(pos - vec3(0.0, 0.0, d.z)).r);
+		return maxPaged;
+	}
+
+	float maxVal = textureLod(image, pos, u_lod).r;
 
-	maxVal = max(maxVal, textureOffset(image, pos, ivec3(1, 0, 0)).r);
-	maxVal = max(maxVal, textureOffset(image, pos, -ivec3(1, 0, 0)).r);
-	maxVal = max(maxVal, textureOffset(image, pos, ivec3(0, 1, 0)).r);
-	maxVal = max(maxVal, textureOffset(image, pos, -ivec3(0, 1, 0)).r);
-	maxVal = max(maxVal, textureOffset(image, pos, ivec3(0, 0, 1)).r);
-	maxVal = max(maxVal, textureOffset(image, pos, -ivec3(0, 0, 1)).r);
+	maxVal = max(maxVal, textureLodOffset(image, pos, u_lod, ivec3(1, 0, 0)).r);
+	maxVal = max(maxVal, textureLodOffset(image, pos, u_lod, -ivec3(1, 0, 0)).r);
+	maxVal = max(maxVal, textureLodOffset(image, pos, u_lod, ivec3(0, 1, 0)).r);
+	maxVal = max(maxVal, textureLodOffset(image, pos, u_lod, -ivec3(0, 1, 0)).r);
+	maxVal = max(maxVal, textureLodOffset(image, pos, u_lod, ivec3(0, 0, 1)).r);
+	maxVal = max(maxVal, textureLodOffset(image, pos, u_lod, -ivec3(0, 0, 1)).r);
 
 	return maxVal;
 }
@@ -165,13 +277,32 @@ float maxNbhVal(in sampler3D image, in vec3 pos)
 // 6-voxel neigborhood Sobel filter
 vec3 imageGradient(in sampler3D image, in vec3 pos)
 {
+	// precomputed gradient: a single fetch of the filtered direction (normalized by callers),
+	// unless opposite directions cancel out (e.g. on thin structures): computed below then
+	if (u_useGradientTex)
+	{
+		vec3 dir = texture(u_gradientTexture, pos).rgb;
+		if (dot(dir, dir) > 1.0e-4)
+			return dir;
+	}
+
 	vec3 grad = vec3(0.0);
-	grad.x += textureOffset(image, pos, ivec3(1, 0, 0)).r;
-	grad.x -= textureOffset(image, pos, -ivec3(1, 0, 0)).r;
-	grad.y += textureOffset(image, pos, ivec3(0, 1, 0)).r;
-	grad.y -= textureOffset(image, pos, -ivec3(0, 1, 0)).r;
-	grad.z += textureOffset(image, pos, ivec3(0, 0, 1)).r;
-	grad.z -= textureOffset(image, pos, -ivec3(0, 0, 1)).r;
+	if (u_paged)
+	{
+		// neighbors 1 voxel away, through the page table
+		vec3 d = 1.0 / u_volumeDims;
+		grad.x = samplePaged(pos + vec3(d.x, 0.0, 0.0)).r - samplePaged(pos - vec3(d.x, 0.0, 0.0)).r;
+		grad.y = samplePaged(pos + vec3(0.0, d.y, 0.0)).r - samplePaged(pos - vec3(0.0, d.y, 0.0)).r;
+		grad.z = samplePaged(pos + vec3(0.0, 0.0, d.z)).r - samplePaged(pos - vec3(0.0, 0.0, d.z)).r;
+		return grad;
+	}
+
+	grad.x += textureLodOffset(image, pos, u_lod, ivec3(1, 0, 0)).r;
+	grad.x -= textureLodOffset(image, pos, u_lod, -ivec3(1, 0, 0)).r;
+	grad.y += textureLodOffset(image, pos, u_lod, ivec3(0, 1, 0)).r;
+	grad.y -= textureLodOffset(image, pos, u_lod, -ivec3(0, 1, 0)).r;
+	grad.z += textureLodOffset(image, pos, u_lod, ivec3(0, 0, 1)).r;
+	grad.z -= textureLodOffset(image, pos, u_lod, -ivec3(0, 0, 1)).r;
 
 	return grad;
 }
@@ -224,7 +355,18 @@ void main()
 
 	for (int i = 0; i < numSteps; ++i) 
 	{
-		intensity = texture(u_volumeTexture, pos).r;
+		// jump over blocks of empty macrocells (distance field), or a macrocell below the isovalue
+		int skip = emptyBlockSteps(pos, rayDir, stepSize);
+		if (skip == 0 && macrocellMax(pos) < u_isoValue)
+			skip = macrocellExitSteps(pos, rayDir, stepSize, 0.0);
+		if (skip > 0)
+		{
+			pos += float(skip) * stepSize * rayDir;
+			i += skip - 1;
+			continue;
+		}
+
+		intensity = windowLevel(sampleVolume(pos).r);
 
 		if (intensity >= u_isoValue)
 		{
@@ -253,14 +395,14 @@ void main()
 		float intensity2 = 0.0;
 		for (int i = 0; i < numSteps2 && accumAB.a < 1.0 && intensity2 < u_isoValue2; ++i)
 		{
-			intensity2 = texture(u_volumeTexture, pos2).r;
+			intensity2 = windowLevel(sampleVolume(pos2).r);
 
 			float transparency = u_transparency;
 			if (intensity2 >= u_isoValue2)
 			{
 				// render second isosurface 
 				transparency = 0.002;
-				intensity2 = maxNbhVal(u_volumeTexture, pos2 + stepSize * (-1 * normal));
+				intensity2 = windowLevel(maxNbhVal(u_volumeTexture, pos2 + stepSize * (-1 * normal)));
 			}
 
 			// read color from TF
@@ -0,0 +1,54 @@
+// Fragment shader
+#version 330
+
+// Ouput data (G-buffer)
+layout(location = 0) out vec4 gPosition;
+layout(location = 1) out vec4 gNormal;
+layout(location = 2) out vec4 gColor;
+
+
+uniform bool u_useGammaCorrec;
+uniform vec3 u_lightDir;
+uniform mat4 u_matRot;      // rotation of the volume in 3D texture space (model matrix of isoSurf.frag)
+uniform mat4 u_matV;
+uniform vec3 u_ambientColor;
+
+
+in vec3 vert_texPos;
+in vec3 vert_normal;
+
+
+vec3 linearToGamma(in vec3 color)
+{
+    return pow(color, vec3(1.0 / 2.2));
+}
+
+
+void main()
+{
+	// same shading and G-buffer values as isoSurf.frag, from the interpolated mesh normal
+	vec3 normal = normalize(vert_normal);
+
+	// light vector in 3D texture space
+	vec3 vecL = normalize(mat3(inverse(u_matRot)) * u_lightDir);
+
+	// grey material
+	vec3 material = vec3(0.9, 0.9, 0.9);
+
+	// Blinn-Phong illumination
+	vec3 color = material * max(0.0, dot(normal, vecL)) + u_ambientColor;
+
+	// write model space position coords into G-buffer
+	vec4 Preturn = u_matRot * vec4(vert_texPos, 1.0);
+	gPosition = vec4(Preturn.rgb, 1.0);
+
+	// write normal in view space into G-buffer
+	vec4 Nreturn = normalize(mat4(u_matV * u_matRot) * vec4(normal, 1.0));
+	gNormal = vec4(Nreturn.xyz, 1.0);
+
+	if(u_useGammaCorrec)
+		color = linearToGamma(color);
+
+	// write final color into G-buffer
+	gColor = vec4(color, 1.0);
+}
@@ -0,0 +1,29 @@
+// Vertex shader
+#version 330
+#extension GL_ARB_explicit_attrib_location : require
+
+// VERTEX ATTRIBUTES
+layout(location = 0) in vec4 a_position;
+layout(location = 1) in vec3 a_normal;
+
+// UNIFORMS
+uniform mat4 u_matM;        // model matrix of the bounding geometry
+uniform mat4 u_matV;
+uniform mat4 u_matP;
+uniform mat4 u_matTex;      // vertex coords to 3D texture coords
+uniform mat3 u_matNormal;   // inverse transpose of u_matTex
+
+// OUTPUT
+out vec3 vert_texPos;
+out vec3 vert_normal;
+
+void main()
+{
+	// position and normal in 3D texture space, as ray-cast isosurfaces
+	vert_texPos = (u_matTex * vec4(a_position.xyz, 1.0)).xyz;
+	vert_normal = u_matNormal * a_normal;
+
+	// the bounding geometry is at (1 - 3D texture coords), see boundingGeom.vert
+	mat4 matMVP = u_matP * u_matV * u_matM;
+	gl_Position = matMVP * vec4(vec3(1.0) - vert_texPos, 1.0);
+}
@@ -3,6 +3,16 @@
 
 
 uniform sampler3D u_volumeTexture;
+uniform vec2 u_window; // window [low ; high] in texture units
+uniform bool u_paged; // out-of-core volume: u_volumeTexture is a brick atlas (see samplePaged())
+uniform usampler3D u_pageTable; // per brick: slot in the atlas (rgb), resident or not (a)
+uniform vec3 u_volumeDims; // volume dimensions (voxels)
+uniform float u_brickSize; // brick size (voxels), atlas slots add a 1-voxel apron
+uniform sampler3D u_macrocells; // min (r) and max (g) values read by samples in each cell of the volume (see Macrocells)
+uniform bool u_useMacrocells; // skip empty macrocells
+uniform float u_cellSize; // macrocell size (voxels)
+uniform usampler3D u_distanceField; // Chebyshev distance (in cells) from each macrocell to the nearest occupied one (see Macrocells::distanceField())
+uniform bool u_useDistanceField; // cross blocks of empty macrocells at once
 uniform sampler2D u_backFaceTexture;
 uniform sampler2D u_frontFaceTexture;
 uniform sampler1D u_lookupTexture;
@@ -10,6 +20,7 @@ uniform bool u_useGammaCorrec;
 uniform int u_useTF;
 uniform int u_modeVR; // MIP = 1, alpha blending = 2
 uniform int u_maxSteps;
+uniform float u_lod; // mip level of the volume to sample (coarser while interacting, u_maxSteps is reduced accordingly)
 uniform mat4 u_matMVP;
 uniform float u_transparency;
 
@@ -20,6 +31,76 @@ in vec2 v_texcoord;
 out vec4 frag_color;
 
 
+// Window/level: maps a volume value in [u_window.x ; u_window.y] to [0 ; 1]
+float windowLevel(in float value)
+{
+	return clamp((value - u_window.x) / (u_window.y - u_window.x), 0.0, 1.0);
+}
+
+// Sample an out-of-core volume: the brick holding pos is found in the page table, then sampled in its atlas slot
+// (bricks not resident yet read as the low bound of the window, i.e. empty)
+vec4 samplePaged(in vec3 pos)
+{
+	if (any(lessThan(pos, vec3(0.0))) || any(greaterThan(pos, vec3(1.0))))
+		return vec4(0.0);
+
+	vec3 voxel = pos * u_volumeDims;
+	ivec3 brick = min(ivec3(voxel / u_brickSize), textureSize(u_pageTable, 0) - 1);
+	uvec4 entry = texelFetch(u_pageTable, brick, 0);
+	if (entry.a == 0u)
+		return vec4(u_window.x);
+
+	vec3 atlasVoxel = vec3(entry.rgb) * (u_brickSize + 2.0) + 1.0 + voxel - vec3(brick) * u_brickSize;
+	return texture(u_volumeTexture, atlasVoxel / vec3(textureSize(u_volumeTexture, 0)));
+}
+
+// Sample the volume, in-core (3D texture, at mip level u_lod) or out-of-core (brick atlas)
+vec4 sampleVolume(in vec3 pos)
+{
+	return u_paged ? samplePaged(pos) : textureLod(u_volumeTexture, pos, u_lod);
+}
+
+// Empty space skipping: windowed max of the macrocell holding pos
+// (1 without macrocells, out of the grid, or at a coarse mip level whose samples read voxels of the neighbor cells,
+// i.e. the cell is never skipped)
+float macrocellMax(in vec3 pos)
+{
+	if (!u_useMacrocells || u_lod > 0.0)
+		return 1.0;
+
+	ivec3 cell = ivec3(floor(pos * vec3(textureSize(u_volumeTexture, 0)) / u_cellSize));
+	if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, textureSize(u_macrocells, 0))))
+		return 1.0;
+	return windowLevel(texelFetch(u_macrocells, cell, 0).g);
+}
+
+// Number of steps (at least 1) for a ray to leave the block of macrocells within radius (in cells) of the one holding pos,
+// so that samples keep their positions
+int macrocellExitSteps(in vec3 pos, in vec3 dir, in float stepSize, in float radius)
+{
+	vec3 cellsPerUnit = vec3(textureSize(u_volumeTexture, 0)) / u_cellSize;
+	vec3 exitPlanes = (floor(pos * cellsPerUnit) + step(0.0, dir) + sign(dir) * radius) / cellsPerUnit;
+	vec3 t = mix(vec3(1.0e6), (exitPlanes - pos) / dir, notEqual(dir, vec3(0.0)));
+	return int(floor(max(min(t.x, min(t.y, t.z)), 0.0) / stepSize)) + 1;
+}
+
+// Empty space skipping: number of steps for a ray to cross the block of empty macrocells around pos, from the distance field
+// (0 if the macrocell is occupied, without distance field or out of the grid)
+// At a coarse mip level, samples read voxels beyond the apron of their cell (texels of a level cover 2^lod voxels, the last one
+// along an odd dimension up to twice as many): blocks lose a margin of cells.
+int emptyBlockSteps(in vec3 pos, in vec3 dir, in float stepSize)
+{
+	if (!u_useDistanceField)
+		return 0;
+
+	ivec3 cell = ivec3(floor(pos * vec3(textureSize(u_volumeTexture, 0)) / u_cellSize));
+	if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, textureSize(u_distanceField, 0))))
+		return 0;
+	float margin = u_lod > 0.0 ? ceil((exp2(u_lod + 1.0) - 1.0) / u_cellSize) : 0.0;
+	float dist = float(texelFetch(u_distanceField, cell, 0).r);
+	return dist <= margin ? 0 : macrocellExitSteps(pos, dir, stepSize, dist - 1.0 - margin);
+}
+
 vec4 TF(in float intensity)
 { 
     vec4 color;
@@ -65,7 +146,20 @@ void main()
 
 	for (int i = 0; i < numSteps && accumAB.a < 1.0; ++i)
 	{
-		intensity = texture(u_volumeTexture, pos).r;
+		// jump over macrocells that cannot change the result: blocks of transparent macrocells (distance field),
+		// or a macrocell whose max is below the current maximum (MIP) or below the window (alpha blending, i.e. transparent)
+		int skip = emptyBlockSteps(pos, rayDir, stepSize);
+		float cellMax = skip == 0 ? macrocellMax(pos) : 0.0;
+		if (skip == 0 && (u_modeVR == 1 ? cellMax <= accumMIP.r : cellMax <= 0.0))
+			skip = macrocellExitSteps(pos, rayDir, stepSize, 0.0);
+		if (skip > 0)
+		{
+			pos += float(skip) * stepSize * rayDir;
+			i += skip - 1;
+			continue;
+		}
+
+		intensity = windowLevel(sampleVolume(pos).r);
 		//intensity = textureLod(u_volumeTexture, pos, 5.0).r;
 
 		accumMIP = max(accumMIP, vec4(intensity, intensity, intensity, 1.0));
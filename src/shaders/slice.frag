@@ -4,7 +4,15 @@
 
 // UNIFORMS
 uniform sampler3D u_volumeTexture;
+uniform vec2 u_window; // window [low ; high] in texture units
+uniform bool u_paged; // out-of-core volume: u_volumeTexture is a brick atlas (see samplePaged())
+uniform usampler3D u_pageTable; // per brick: slot in the atlas (rgb), resident or not (a)
+uniform vec3 u_volumeDims; // volume dimensions (voxels)
+uniform float u_brickSize; // brick size (voxels), atlas slots add a 1-voxel apron
 uniform mat4 u_matTex;
+uniform int u_slabMode; // projection over the slab: 0 = thin slice, 1 = MIP, 2 = MinIP, 3 = average (see Reformat::SlabMode)
+uniform int u_slabSamples; // number of samples across the slab (odd, centered on the slice)
+uniform vec3 u_slabStep; // distance between samples across the slab (texture units)
 uniform float u_brightness;
 uniform bool u_useGammaCorrec;
 
@@ -17,6 +25,64 @@ out vec4 frag_color;
 
 
 
+// Window/level: maps a volume value in [u_window.x ; u_window.y] to [0 ; 1]
+float windowLevel(in float value)
+{
+	return clamp((value - u_window.x) / (u_window.y - u_window.x), 0.0, 1.0);
+}
+
+// Sample an out-of-core volume: the brick holding pos is found in the page table, then sampled in its atlas slot
+// (bricks not resident yet read as the low bound of the window, i.e. empty)
+vec4 samplePaged(in vec3 pos)
+{
+	if (any(lessThan(pos, vec3(0.0))) || any(greaterThan(pos, vec3(1.0))))
+		return vec4(0.0);
+
+	vec3 voxel = pos * u_volumeDims;
+	ivec3 brick = min(ivec3(voxel / u_brickSize), textureSize(u_pageTable, 0) - 1);
+	uvec4 entry = texelFetch(u_pageTable, brick, 0);
+	if (entry.a == 0u)
+		return vec4(u_window.x);
+
+	vec3 atlasVoxel = vec3(entry.rgb) * (u_brickSize + 2.0) + 1.0 + voxel - vec3(brick) * u_brickSize;
+	return texture(u_volumeTexture, atlasVoxel / vec3(textureSize(u_volumeTexture, 0)));
+}
+
+// Sample the volume, in-core (3D texture, full resolution level) or out-of-core (brick atlas)
+vec4 sampleVolume(in vec3 pos)
+{
+	return u_paged ? samplePaged(pos) : textureLod(u_volumeTexture, pos, 0.0);
+}
+
+// Project the volume over the slab centered on pos (samples out of the volume are skipped)
+// returns false if all samples are out of the volume
+bool sampleSlab(in vec3 pos, out float value)
+{
+	int nbInside = 0;
+	float acc = 0.0;
+	vec3 first = pos - 0.5 * float(u_slabSamples - 1) * u_slabStep;
+	for (int i = 0; i < u_slabSamples; i++)
+	{
+		vec3 p = first + float(i) * u_slabStep;
+		if (any(lessThan(p, vec3(0.0))) || any(greaterThan(p, vec3(1.0))))
+			continue;
+
+		float v = sampleVolume(p).r;
+		if (nbInside == 0 || u_slabMode == 0)
+			acc = v;
+		else if (u_slabMode == 1)
+			acc = max(acc, v);
+		else if (u_slabMode == 2)
+			acc = min(acc, v);
+		else
+			acc += v;
+		nbInside++;
+	}
+
+	value = (u_slabMode == 3 && nbInside > 0) ? acc / float(nbInside) : acc;
+	return nbInside > 0;
+}
+
 vec3 gammaToLinear(in vec3 color)
 {
     return pow(color, vec3(2.2));
@@ -31,7 +97,11 @@ void main()
 {
 	vec4 texCoords = u_matTex * vec4(vert_uvw.xyz, 1.0);
 	
-	float intensity = texture(u_volumeTexture, vec3(texCoords) ).r;
+	// (oblique slices extend out of the volume)
+	float value;
+	if (!sampleSlab(vec3(texCoords), value))
+		discard;
+	float intensity = windowLevel(value);
 
 	vec4 color = vec4(intensity, intensity, intensity, 1.0);
 	
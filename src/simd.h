@@ -0,0 +1,113 @@
+/*********************************************************************************************************************
+ *
+ * simd.h
+ *
+ * Runtime selection of the SIMD kernels
+ * Kernels are compiled for their instruction set with SIMD_TARGET_* (whatever the global compiler flags),
+ * and only called when the CPU supports it, so the binary still runs on CPUs without AVX2.
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef SIMD_H
+#define SIMD_H
+
+
+#if !defined(VOL_VIEWER_NO_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+    #define SIMD_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+#endif
+
+
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+    // functions using intrinsics of an instruction set (including helpers and templates called by kernels)
+    #define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+    #define SIMD_TARGET_SSE4 __attribute__((target("sse4.1")))
+#else
+    // MSVC compiles any intrinsics without specific flags
+    #define SIMD_TARGET_AVX2
+    #define SIMD_TARGET_SSE4
+#endif
+
+
+namespace Simd
+{
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+
+    namespace detail
+    {
+        inline bool cpuHasAVX2()
+        {
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+
+            // AVX and OS support of the YMM registers
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            bool avx = (info[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+                return false;
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+        }
+
+        inline bool cpuHasSSE4()
+        {
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 19)) != 0;
+        }
+    }
+
+#endif
+
+
+    /*!
+    * \fn hasAVX2
+    * \brief True if the AVX2 kernels can run on this CPU (tested once)
+    */
+    inline bool hasAVX2()
+    {
+#if defined(SIMD_X86) && defined(_MSC_VER)
+        static const bool avx2 = detail::cpuHasAVX2();
+        return avx2;
+#elif defined(SIMD_X86)
+        static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+        return avx2;
+#else
+        return false;
+#endif
+    }
+
+
+    /*!
+    * \fn hasSSE4
+    * \brief True if the SSE4.1 kernels can run on this CPU (tested once)
+    */
+    inline bool hasSSE4()
+    {
+#if defined(SIMD_X86) && defined(_MSC_VER)
+        static const bool sse4 = detail::cpuHasSSE4();
+        return sse4;
+#elif defined(SIMD_X86)
+        static const bool sse4 = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.1"));
+        return sse4;
+#else
+        return false;
+#endif
+    }
+
+} // namespace Simd
+
+
+#endif // SIMD_H
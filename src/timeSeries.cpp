@@ -0,0 +1,333 @@
+/*********************************************************************************************************************
+ *
+ * timeSeries.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include <algorithm>
+#include <filesystem>
+#include <cctype>
+
+#include "timeSeries.h"
+#include "utils.h"
+
+
+// Size (in bytes) aimed for a single texture upload call, so that uploads
+// can stop close to the time budget
+static const size_t UPLOAD_SLAB_SIZE = 4 * 1024 * 1024;
+
+
+int TimeSeries::getNbReadyFrames()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int nb = 0;
+    while (nb < int(m_slots.size()) && isDisplayable(m_position + nb))
+        nb++;
+    return nb;
+}
+
+
+void TimeSeries::setFrame(int _frame)
+{
+    if (m_files.empty())
+        return;
+
+    long long nbFrames = (long long)m_files.size();
+    _frame = std::max(0, std::min(_frame, int(nbFrames) - 1));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_position = m_position - m_position % nbFrames + _frame;
+        m_late = false;
+    }
+    m_wakeUp.notify_one();
+    m_lastAdvance = std::chrono::steady_clock::now();
+}
+
+
+std::vector<std::string> TimeSeries::findSequence(const std::string& _fileName)
+{
+    std::filesystem::path path(_fileName);
+    std::string name = path.filename().string();
+
+    // last number in the file name
+    size_t numEnd = name.find_last_of("0123456789");
+    if (numEnd == std::string::npos)
+        return { _fileName };
+    size_t numBegin = name.find_last_not_of("0123456789", numEnd);
+    numBegin = (numBegin == std::string::npos) ? 0 : numBegin + 1;
+    std::string prefix = name.substr(0, numBegin);
+    std::string suffix = name.substr(numEnd + 1);
+
+    // files with the same prefix and suffix, and a number in between
+    std::vector<std::pair<long long, std::string>> frames;
+    std::filesystem::path folder = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(folder, error))
+    {
+        std::string entryName = entry.path().filename().string();
+        if (entryName.size() <= prefix.size() + suffix.size() || entryName.compare(0, prefix.size(), prefix) != 0
+            || entryName.compare(entryName.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+
+        std::string number = entryName.substr(prefix.size(), entryName.size() - prefix.size() - suffix.size());
+        if (number.size() > 18 || !std::all_of(number.begin(), number.end(), [](unsigned char c) { return std::isdigit(c); }))
+            continue;
+        frames.emplace_back(std::stoll(number), entry.path().string());
+    }
+    std::sort(frames.begin(), frames.end());
+
+    std::vector<std::string> files;
+    for (const auto& frame : frames)
+        files.push_back(frame.second);
+    if (files.empty())
+        files.push_back(_fileName);
+    return files;
+}
+
+
+bool TimeSeries::open(const std::string& _fileName, int _ringSize)
+{
+    close();
+
+    std::vector<std::string> files = findSequence(_fileName);
+    std::error_code error;
+    if (!std::filesystem::exists(files.front(), error))
+    {
+        errorLog() << "TimeSeries::open(): file " << _fileName << " not found";
+        return false;
+    }
+
+    m_files = files;
+    m_slots = std::vector<Slot>(std::max(1, std::min(_ringSize, int(m_files.size()))));
+    m_position = 0;
+    m_displayedPosition = -1;
+    m_displayedSlot = -1;
+    m_displayedVolume.reset();
+    m_hasReference = false;
+    m_late = false;
+    m_nbLateFrames = 0;
+    m_lastAdvance = std::chrono::steady_clock::now();
+    m_stop = false;
+    m_thread = std::thread(&TimeSeries::run, this);
+
+    std::cout << "[INFO] TimeSeries::open(): " << m_files.size() << " frames (" << m_files.front() << " to " << m_files.back()
+              << "), ring of " << m_slots.size() << " frames" << std::endl;
+    return true;
+}
+
+
+void TimeSeries::close()
+{
+    stopPrefetch();
+
+    for (Slot& slot : m_slots)
+    {
+        if (slot.tex != 0)
+            glDeleteTextures(1, &slot.tex);
+    }
+    m_slots.clear();
+    m_files.clear();
+    m_displayedPosition = -1;
+    m_displayedSlot = -1;
+    m_displayedVolume.reset();
+    m_playing = false;
+}
+
+
+bool TimeSeries::update(double _uploadBudget, bool _useNearest)
+{
+    if (m_files.empty())
+        return false;
+
+    // upload decoded frames of the window, in playback order, within the budget
+    // (the prefetch thread only writes slots holding positions out of the window,
+    // and the window only moves on this thread: slots found here can be used unlocked)
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double, std::milli>(_uploadBudget));
+    for (int k = 0; k < int(m_slots.size()) && std::chrono::steady_clock::now() < deadline; k++)
+    {
+        Slot* slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Slot& candidate = m_slots[(m_position + k) % m_slots.size()];
+            if (candidate.position == m_position + k && (candidate.state == SLOT_DECODED || candidate.state == SLOT_UPLOADING))
+                slot = &candidate;
+        }
+        if (slot == nullptr)
+            continue;
+
+        bool complete = uploadSlot(*slot, deadline, _useNearest);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        slot->state = (slot->volume == nullptr) ? SLOT_FAILED : complete ? SLOT_UPLOADED : SLOT_UPLOADING;
+    }
+
+    // move to the next frame when it is due and ready (or to the current
+    // position if it is not displayed yet, e.g. after open() or setFrame())
+    long long target = m_position;
+    if (m_displayedPosition == m_position && m_playing && m_files.size() > 1)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto period = std::chrono::duration<double>(1.0 / m_fps);
+        if (now - m_lastAdvance < period)
+            return false;
+        target = m_position + 1;
+    }
+    else if (m_displayedPosition == m_position)
+        return false;
+
+    Slot* slot = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!isDisplayable(target))
+        {
+            // next frame not ready in time: keep the current one
+            if (target != m_position && !m_late)
+            {
+                m_late = true;
+                m_nbLateFrames++;
+            }
+            return false;
+        }
+        m_position = target;
+        slot = &m_slots[target % m_slots.size()];
+    }
+    m_wakeUp.notify_one();
+
+    // keep pace with the requested rate, without catching up after a stall
+    auto now = std::chrono::steady_clock::now();
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / m_fps));
+    m_lastAdvance = (m_late || now - m_lastAdvance > 2 * period) ? now : m_lastAdvance + period;
+    m_late = false;
+
+    m_displayedPosition = target;
+    if (slot->state == SLOT_FAILED)
+        return false; // skipped: keep the texture of the previous frame
+
+    m_displayedSlot = int(slot - m_slots.data());
+    m_displayedVolume = slot->volume;
+    return true;
+}
+
+
+bool TimeSeries::isDisplayable(long long _position) const
+{
+    const Slot& slot = m_slots[_position % m_slots.size()];
+    return slot.position == _position && (slot.state == SLOT_UPLOADED || slot.state == SLOT_FAILED);
+}
+
+
+bool TimeSeries::uploadSlot(Slot& _slot, std::chrono::steady_clock::time_point _deadline, bool _useNearest)
+{
+    glm::ivec3 dim = _slot.volume->getDimensions();
+
+    if (_slot.state == SLOT_DECODED)
+    {
+        // all frames must have the dimensions and format of the first one, to share the same rendering settings
+        if (!m_hasReference)
+        {
+            m_dimensions = dim;
+            m_format = _slot.volume->getVoxelFormat();
+            m_hasReference = true;
+        }
+        else if (dim != m_dimensions || _slot.volume->getVoxelFormat() != m_format)
+        {
+            errorLog() << "TimeSeries::uploadSlot(): frame " << _slot.position % m_files.size() << " has other dimensions or format than the first one, skipped";
+            _slot.volume.reset();
+            return false;
+        }
+
+        // textures are allocated once, then reused by all frames of the slot
+        if (_slot.tex == 0)
+            build3DTex(_slot.tex, _slot.volume.get(), _useNearest, false);
+        _slot.zUploaded = 0;
+    }
+
+    size_t voxelSize = (m_format == VolumeImg::FORMAT_UINT8) ? 1 : (m_format == VolumeImg::FORMAT_FLOAT32) ? 4 : 2;
+    int slabDepth = std::max(1, int(UPLOAD_SLAB_SIZE / std::max(size_t(1), size_t(dim.x) * size_t(dim.y) * voxelSize)));
+    while (_slot.zUploaded < dim.z && std::chrono::steady_clock::now() < _deadline)
+    {
+        int zEnd = std::min(_slot.zUploaded + slabDepth, dim.z);
+        update3DTex(&_slot.tex, _slot.volume.get(), _slot.zUploaded, zEnd);
+        _slot.zUploaded = zEnd;
+    }
+    if (_slot.zUploaded < dim.z)
+        return false;
+
+    GLint param = _useNearest ? GL_NEAREST : GL_LINEAR;
+    glBindTexture(GL_TEXTURE_3D, _slot.tex);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, param);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, param);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    return true;
+}
+
+
+void TimeSeries::stopPrefetch()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeUp.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+
+void TimeSeries::run()
+{
+    long long nbFrames = (long long)m_files.size();
+    long long ringSize = (long long)m_slots.size();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+        // first position of the window whose frame is not in its slot yet
+        long long position = -1;
+        for (long long k = 0; k < ringSize && position < 0; k++)
+        {
+            if (m_slots[(m_position + k) % ringSize].position != m_position + k)
+                position = m_position + k;
+        }
+        if (position < 0)
+        {
+            m_wakeUp.wait(lock);
+            continue;
+        }
+
+        Slot& slot = m_slots[position % ringSize];
+        int frame = int(position % nbFrames);
+
+        // the slot already holds this frame (series looping within the ring): reuse it
+        if (slot.position >= 0 && slot.position % nbFrames == frame && slot.state != SLOT_DECODING && slot.state != SLOT_EMPTY)
+        {
+            slot.position = position;
+            continue;
+        }
+
+        slot.position = position;
+        slot.state = SLOT_DECODING;
+        slot.volume.reset();
+
+        // decode without holding the lock (the render thread keeps going)
+        lock.unlock();
+        auto volume = std::make_shared<VolumeImg>();
+        bool loaded = volume->volumeLoad(m_files[frame]);
+        lock.lock();
+
+        // the slot may have been given another position meanwhile
+        if (slot.position == position)
+        {
+            slot.volume = loaded ? volume : nullptr;
+            slot.state = loaded ? SLOT_DECODED : SLOT_FAILED;
+            if (!loaded)
+                errorLog() << "TimeSeries::run(): could not load frame " << m_files[frame];
+        }
+    }
+}
@@ -0,0 +1,217 @@
+/*********************************************************************************************************************
+ *
+ * timeSeries.h
+ *
+ * Time series of volumes (numbered sequence of files), with prefetching for cine playback
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include "volumeImg.h"
+
+
+/*!
+* \class TimeSeries
+* \brief Plays a time series of volumes (e.g. cardiac or perfusion frames) stored as a numbered sequence of files
+* Frames are held in a fixed-size ring of slots, each made of a volume (CPU) and a 3D texture (GPU), so that memory
+* use depends on the ring size only, not on the length of the series. Playback goes through increasing positions
+* (frame = position modulo number of frames, looping at the end of the series); slot (position modulo ring size)
+* holds the frame of a position of the window [current position ; current position + ring size[.
+* A prefetch thread decodes the frames of the window ahead of the current position into their slots, and the render
+* thread uploads decoded frames into their textures within a time budget (see update()). Playback only moves to the
+* next frame once its texture is complete, so it never shows a partial frame, and a frame late is counted instead of
+* stalling the viewer. A series shorter than the ring is decoded once, then looped from the textures.
+* Only the render thread calls the public functions (with the GL context current for update() and close()).
+*/
+class TimeSeries
+{
+    public:
+
+        static const int DEFAULT_RING_SIZE = 8;     /*!< default number of slots of the ring */
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                        CONSTRUCTORS / DESTRUCTORS                                           |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        TimeSeries() {}
+
+        /*! textures must be released with close() while the GL context exists */
+        virtual ~TimeSeries() { stopPrefetch(); }
+
+        TimeSeries(const TimeSeries&) = delete;
+        TimeSeries& operator=(const TimeSeries&) = delete;
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                GETTERS                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        inline bool isOpen() const { return !m_files.empty(); }
+        inline int getNbFrames() const { return int(m_files.size()); }
+        inline int getRingSize() const { return int(m_slots.size()); }
+        /*! \fn getFrame : frame index of the current position */
+        inline int getFrame() const { return m_files.empty() ? 0 : int(m_position % (long long)m_files.size()); }
+        inline bool isPlaying() const { return m_playing; }
+        inline float getFps() const { return m_fps; }
+        /*! \fn getNbLateFrames : number of frames not ready in time for playback since open() */
+        inline int getNbLateFrames() const { return m_nbLateFrames; }
+        /*! \fn getTexture : 3D texture of the displayed frame (0 until the first frame is uploaded) */
+        inline GLuint getTexture() const { return m_displayedSlot < 0 ? 0 : m_slots[m_displayedSlot].tex; }
+        /*! \fn getVolume : volume of the displayed frame (nullptr until the first frame is uploaded) */
+        inline std::shared_ptr<VolumeImg> getVolume() const { return m_displayedVolume; }
+
+        /*!
+        * \fn getNbReadyFrames
+        * \brief Number of consecutive frames from the current position that are ready to be displayed
+        */
+        int getNbReadyFrames();
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                SETTERS                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        inline void setPlaying(bool _playing) { m_playing = _playing; m_lastAdvance = std::chrono::steady_clock::now(); }
+        inline void setFps(float _fps) { m_fps = std::max(0.1f, _fps); }
+
+        /*!
+        * \fn setFrame
+        * \brief Move the current position to a frame (e.g. slider): frames around it are prefetched again
+        * The displayed frame changes once the new one is uploaded.
+        */
+        void setFrame(int _frame);
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                   MISC                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*!
+        * \fn findSequence
+        * \brief Find the numbered sequence a file belongs to, i.e. files of its folder with the same name except for
+        * the last number in the name (e.g. heart_07.vtk -> heart_00.vtk, heart_01.vtk, ...), sorted by number
+        * \param _fileName : name of a file of the sequence
+        * \return names of all files of the sequence (only _fileName if it has no number)
+        */
+        static std::vector<std::string> findSequence(const std::string& _fileName);
+
+        /*!
+        * \fn open
+        * \brief Open the numbered sequence of a file (see findSequence()), and start prefetching from its first frame
+        * \param _fileName : name of a file of the sequence
+        * \param _ringSize : number of slots of the ring (clamped to the number of frames)
+        * \return true if a sequence was found, false otherwise
+        */
+        bool open(const std::string& _fileName, int _ringSize = DEFAULT_RING_SIZE);
+
+        /*!
+        * \fn close
+        * \brief Stop prefetching and release volumes and textures
+        */
+        void close();
+
+        /*!
+        * \fn update
+        * \brief Upload decoded frames into their textures within a time budget, and move playback to the next frame
+        * when it is due and ready
+        * \param _uploadBudget : time budget (in ms) for texture uploads
+        * \param _useNearest : texture filtering (GL_NEAREST if true, GL_LINEAR otherwise) of uploaded frames
+        * \return true if the displayed frame changed
+        */
+        bool update(double _uploadBudget, bool _useNearest);
+
+
+    protected:
+
+        /*! State of a slot */
+        enum SlotState { SLOT_EMPTY, SLOT_DECODING, SLOT_DECODED, SLOT_UPLOADING, SLOT_UPLOADED, SLOT_FAILED };
+
+        /*! Slot of the ring */
+        struct Slot
+        {
+            long long position = -1;                /*!< playback position held by the slot (-1: none) */
+            SlotState state = SLOT_EMPTY;           /*!< state of the frame of the position */
+            std::shared_ptr<VolumeImg> volume;      /*!< decoded frame */
+            GLuint tex = 0;                         /*!< 3D texture (render thread only) */
+            int zUploaded = 0;                      /*!< number of slices uploaded into the texture (render thread only) */
+        };
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                ATTRIBUTES                                                   |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        std::vector<std::string> m_files;                   /*!< files of the frames */
+        std::vector<Slot> m_slots;                          /*!< ring of slots */
+
+        std::thread m_thread;                               /*!< prefetch thread */
+        std::mutex m_mutex;                                 /*!< protects positions and states of slots, m_position and m_stop */
+        std::condition_variable m_wakeUp;                   /*!< wakes up the prefetch thread when the window moves */
+        bool m_stop = false;                                /*!< stop request for the prefetch thread */
+
+        long long m_position = 0;                           /*!< current playback position */
+        long long m_displayedPosition = -1;                 /*!< position of the displayed frame (-1: none) */
+        int m_displayedSlot = -1;                           /*!< slot of the displayed frame (-1: none) */
+        std::shared_ptr<VolumeImg> m_displayedVolume;       /*!< volume of the displayed frame */
+        bool m_hasReference = false;                        /*!< m_dimensions and m_format are set (first uploaded frame) */
+        glm::ivec3 m_dimensions = glm::ivec3(0);            /*!< dimensions of the frames */
+        VolumeImg::VoxelFormat m_format = VolumeImg::FORMAT_UINT8; /*!< voxel format of the frames */
+
+        bool m_playing = false;                             /*!< playback is running */
+        float m_fps = 10.0f;                                /*!< playback rate (frames per second) */
+        std::chrono::steady_clock::time_point m_lastAdvance;/*!< time of the last move to the next frame */
+        bool m_late = false;                                /*!< next frame already counted as late */
+        int m_nbLateFrames = 0;                             /*!< number of frames not ready in time */
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                   MISC                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*!
+        * \fn isDisplayable
+        * \brief Check if the frame of a position is ready to be displayed (uploaded, or failed and skipped)
+        * To be called with m_mutex locked.
+        */
+        bool isDisplayable(long long _position) const;
+
+        /*!
+        * \fn uploadSlot
+        * \brief Upload slices of a decoded frame into the texture of its slot, until the deadline
+        * \return true if the texture is complete
+        */
+        bool uploadSlot(Slot& _slot, std::chrono::steady_clock::time_point _deadline, bool _useNearest);
+
+        /*!
+        * \fn stopPrefetch
+        * \brief Stop the prefetch thread (waits for the frame being decoded, if any)
+        */
+        void stopPrefetch();
+
+        /*!
+        * \fn run
+        * \brief Body of the prefetch thread
+        */
+        void run();
+
+};
+
+#endif // TIMESERIES_H
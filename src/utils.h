@@ -13,7 +13,11 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-#include "volumeBase.h"
+#include "volumeImg.h"
+#include "gradientVolume.h"
+#include "volumeStats.h"
+#include "macrocells.h"
+#include "mipPyramid.h"
 
 #define QT_NO_OPENGL_ES_2
 #include <GL/glew.h>
@@ -25,6 +29,7 @@
 #include <sstream>
 #include <random>
 #include <algorithm>
+#include <utility>
 #define NOMINMAX // avoid min*max macros to interfer with std::min/max from <windows.h>
 
 #include <glm/gtc/type_ptr.hpp>
@@ -49,6 +54,9 @@ struct RayCasting
     GLuint frontPosTex = 0; /*!< Front face bounding geometry position screen-texture */
     GLuint backPosTex = 0;  /*!< Back face bounding geometry position screen-texture */
     GLuint volTex = 0;      /*!< Volume 3D texture */
+    GLuint gradTex = 0;     /*!< Packed gradients 3D texture (see GradientVolume), 0 if not available */
+    GLuint macrocellTex = 0;    /*!< Min-max macrocell grid 3D texture (see Macrocells), 0 if not available */
+    GLuint distanceFieldTex = 0;    /*!< Distance field of the occupied macrocells 3D texture (see Macrocells::distanceField()), 0 if not available */
 };
 
 struct MVPmatrices
@@ -239,6 +247,126 @@ namespace
 
 
 
+    /*!
+    * \fn buildMacrocellTex
+    * \brief Create a RG32F 3D texture holding the min-max macrocell grid of a volume (see Macrocells)
+    * The texture is released if the volume has no data in memory.
+    * \param _cellTex : reference to id of texture to generate
+    * \param _cells : cells of the texture, kept in memory (e.g. for distanceField()), cleared with the texture
+    * \param _vol : 3D image data (i.e., volume) (nullptr to only release the texture)
+    * \param _withData : if false, cells are zeroed (as the 3D texture of a volume being loaded), to be filled with updateMacrocellTex()
+    */
+    void buildMacrocellTex(GLuint& _cellTex, std::vector<glm::vec2>& _cells, VolumeImg* _vol, bool _withData = true)
+    {
+        // release previous texture
+        if (_cellTex != 0)
+            glDeleteTextures(1, &_cellTex);
+        _cellTex = 0;
+        _cells.clear();
+
+        if (_vol == nullptr)
+            return;
+
+        glm::ivec3 grid = Macrocells::gridDimensions(_vol->getDimensions());
+        std::vector<glm::vec2> cells;
+        if (!_withData)
+            cells.assign(size_t(grid.x) * size_t(grid.y) * size_t(grid.z), glm::vec2(0.0f));
+        else if (!Macrocells::compute(_vol, 0, grid.z, &cells))
+            return;
+        if (cells.empty())
+            return;
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // generate 3D texture (cells are read with texelFetch())
+        glGenTextures(1, &_cellTex);
+        glBindTexture(GL_TEXTURE_3D, _cellTex);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RG32F, grid.x, grid.y, grid.z, 0, GL_RG, GL_FLOAT, cells.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        errorLog().lastGLerror();
+
+        _cells = std::move(cells);
+    }
+
+
+    /*!
+    * \fn updateMacrocellTex
+    * \brief Update the cells of a range of layers of a macrocell texture (see Macrocells::layersOfSlab())
+    * \param _cellTex : id of texture (see buildMacrocellTex())
+    * \param _cells : cells of the texture, kept in memory (see buildMacrocellTex())
+    * \param _vol : 3D image data (i.e., volume)
+    * \param _layerBegin : first layer
+    * \param _layerEnd : layer after the last one
+    */
+    void updateMacrocellTex(GLuint _cellTex, std::vector<glm::vec2>& _cells, VolumeImg* _vol, int _layerBegin, int _layerEnd)
+    {
+        glm::ivec3 grid = Macrocells::gridDimensions(_vol->getDimensions());
+        int layerBegin = std::max(_layerBegin, 0);
+        int layerEnd = std::min(_layerEnd, grid.z);
+
+        std::vector<glm::vec2> cells;
+        if (_cellTex == 0 || layerEnd <= layerBegin || !Macrocells::compute(_vol, layerBegin, layerEnd, &cells))
+            return;
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        glBindTexture(GL_TEXTURE_3D, _cellTex);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, layerBegin, grid.x, grid.y, layerEnd - layerBegin, GL_RG, GL_FLOAT, cells.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        errorLog().lastGLerror();
+
+        if (_cells.size() == size_t(grid.x) * size_t(grid.y) * size_t(grid.z))
+            std::copy(cells.begin(), cells.end(), _cells.begin() + size_t(grid.x) * size_t(grid.y) * size_t(layerBegin));
+    }
+
+
+    /*!
+    * \fn buildDistanceFieldTex
+    * \brief Create a R8UI 3D texture holding the distance field of the occupied macrocells (see Macrocells::distanceField())
+    * The texture is released if there are no cells.
+    * \param _distTex : reference to id of texture to generate
+    * \param _cells : macrocell grid (see buildMacrocellTex())
+    * \param _grid : grid dimensions
+    * \param _threshold : cells whose max (3D texture units) is above it are occupied
+    */
+    void buildDistanceFieldTex(GLuint& _distTex, const std::vector<glm::vec2>& _cells, glm::ivec3 _grid, float _threshold)
+    {
+        // release previous texture
+        if (_distTex != 0)
+            glDeleteTextures(1, &_distTex);
+        _distTex = 0;
+
+        std::vector<std::uint8_t> dist;
+        Macrocells::distanceField(_cells, _grid, _threshold, &dist);
+        if (dist.empty())
+            return;
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // generate 3D texture (distances are read with texelFetch())
+        glGenTextures(1, &_distTex);
+        glBindTexture(GL_TEXTURE_3D, _distTex);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, _grid.x, _grid.y, _grid.z, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, dist.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        errorLog().lastGLerror();
+    }
+
+
     /*!
     * \fn buildScreenFBOandTex
     * \brief Generate a FBO and attach a texture to its color output (used for various screen texture generation)
@@ -290,30 +418,56 @@ namespace
     * \fn build1DTex
     * \brief Creates a 1D texture 
     * This texture is a lookup table / palette for 8b volume rendering, therefore the width is always 256
-    * \param _1dTex : reference to id of texture to generate
+    * It is indexed by windowed values: tissue classes are placed from the statistics of the volume if given
+    * (background below Otsu's threshold, then percentiles of the voxels above it), at fixed positions otherwise.
+    * \param _1dTex : reference to id of texture to generate (previous texture is released)
+    * \param _stats : statistics of the volume (nullptr or empty for the fixed palette)
+    * \param _window : window [low ; high] applied to volume values (native units), used with _stats only
     */
-    void build1DTex(GLuint& _1dTex)
+    void build1DTex(GLuint& _1dTex, const VolumeStats::Stats* _stats = nullptr, glm::vec2 _window = glm::vec2(0.0f, 255.0f))
     {
+        // lower bounds (in [0 ; 255]) of fabric, skin, soft tissue, cartilage & others, bone and implants
+        float bounds[6] = { 3.0f, 13.0f, 61.0f, 70.0f, 82.0f, 200.0f };
+        if (_stats != nullptr && !_stats->empty() && _window.y > _window.x)
+        {
+            auto toIndex = [&](float _value) { return 255.0f * (_value - _window.x) / (_window.y - _window.x); };
+            float background = VolumeStats::otsuThreshold(*_stats);
+            float objectBegin = _stats->fractionBelow(background);
+            auto objectPercentile = [&](float _fraction) { return _stats->percentile(100.0f * (objectBegin + _fraction * (1.0f - objectBegin))); };
+
+            // no fabric class: everything below the threshold is background
+            bounds[0] = bounds[1] = toIndex(background);
+            bounds[2] = toIndex(objectPercentile(0.4f));
+            bounds[3] = toIndex(objectPercentile(0.7f));
+            bounds[4] = toIndex(objectPercentile(0.85f));
+            bounds[5] = toIndex(objectPercentile(0.995f));
+        }
+
         // create array of 256 values,
         std::vector<glm::vec4> values;
         for (unsigned int i = 0; i < 256; i++)
         {
-            if (i > 200)     // implants
+            float id = float(i);
+            if (id > bounds[5])      // implants
                 values.push_back(glm::vec4(0.8, 0.8, 0.8, 1.0));
-            else if (i > 82) // bone
+            else if (id > bounds[4]) // bone
                 values.push_back(glm::vec4(0.97, 0.93, 0.78, 1.0));
-            else if (i > 70) // cartilage & others
+            else if (id > bounds[3]) // cartilage & others
                 values.push_back(glm::vec4(0.7, 0.68, 0.5, 1.0));
-            else if (i > 61) // soft tissue
+            else if (id > bounds[2]) // soft tissue
                 values.push_back(glm::vec4(0.8, 0.09, 0.0, 1.0));
-            else if (i > 13) // skin
+            else if (id > bounds[1]) // skin
                 values.push_back(glm::vec4(0.97, 0.82, 0.7, 1.0));
-            else if (i > 3) // fabric
+            else if (id > bounds[0]) // fabric
                 values.push_back(glm::vec4(0.8, 0.8, 0.8, 1.0));
-            else             // other
+            else                     // other
                 values.push_back(glm::vec4(0.9, 0.9, 0.9, 0.0));
         }
 
+        // release previous texture
+        if (_1dTex != 0)
+            glDeleteTextures(1, &_1dTex);
+
         // generate 1D texture
         glGenTextures(1, &_1dTex);
         glBindTexture(GL_TEXTURE_1D, _1dTex);
@@ -328,34 +482,137 @@ namespace
     }
 
 
+    /*!
+    * \struct TexFormat
+    * \brief OpenGL formats of a 3D texture holding voxels of a given type
+    * Integer types use normalized formats: texture() returns value / 255 (uint8), value / 65535 (uint16),
+    * or value / 32767 (int16, signed normalized so that no precision is lost, unlike GL_R16F)
+    */
+    template <typename VoxelType> struct TexFormat;
+    template <> struct TexFormat<std::uint8_t>  { static constexpr GLint internalFormat = GL_R8;        static constexpr GLenum type = GL_UNSIGNED_BYTE; };
+    template <> struct TexFormat<std::uint16_t> { static constexpr GLint internalFormat = GL_R16;       static constexpr GLenum type = GL_UNSIGNED_SHORT; };
+    template <> struct TexFormat<std::int16_t>  { static constexpr GLint internalFormat = GL_R16_SNORM; static constexpr GLenum type = GL_SHORT; };
+    template <> struct TexFormat<float>         { static constexpr GLint internalFormat = GL_R32F;      static constexpr GLenum type = GL_FLOAT; };
+
+
+    /*!
+    * \fn build3DTexMipmaps
+    * \brief Upload the mip levels of a 3D texture whose level 0 holds the volume (max-preserving, see MipPyramid),
+    * and set its filtering. Levels are sampled explicitly (textureLod()), e.g. coarser ones during interaction.
+    * \param _volTex : id of texture
+    * \param _vol : 3D image data (i.e., volume), fully loaded
+    * \param _useNearest : flag to indicate if texture uses GL_NEAREST param (if not, uses GL_LINEAR by default)
+    */
+    template <typename VoxelType>
+    void build3DTexMipmaps(GLuint _volTex, VolumeBase<VoxelType>* _vol, bool _useNearest = false)
+    {
+        glm::ivec3 dims = _vol->getDimensions();
+        int nbLevels = MipPyramid::nbLevels(dims);
+        std::vector<std::vector<VoxelType>> levels = MipPyramid::build(std::as_const(*_vol).view(), nbLevels);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        glBindTexture(GL_TEXTURE_3D, _volTex);
+        for (int l = 1; l <= int(levels.size()); l++)
+        {
+            glm::ivec3 levelDims = MipPyramid::levelDimensions(dims, l);
+            glTexImage3D(GL_TEXTURE_3D, l, TexFormat<VoxelType>::internalFormat, levelDims.x, levelDims.y, levelDims.z, 0, GL_RED, TexFormat<VoxelType>::type, levels[l - 1].data());
+        }
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, int(levels.size()));
+
+        GLint param;
+        if (levels.empty())
+            _useNearest ? param = GL_NEAREST : param = GL_LINEAR;
+        else
+            _useNearest ? param = GL_NEAREST_MIPMAP_NEAREST : param = GL_LINEAR_MIPMAP_NEAREST;
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, param);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, _useNearest ? GL_NEAREST : GL_LINEAR);
+
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        errorLog().lastGLerror();
+    }
+
+
+    /*!
+    * \fn build3DTexMipmaps
+    * \brief Upload the mip levels of a 3D texture whose level 0 holds the volume, whatever the voxel type of the volume (see above).
+    */
+    void build3DTexMipmaps(GLuint _volTex, VolumeImg* _vol, bool _useNearest = false)
+    {
+        _vol->visit([&](auto& _typedVol) { build3DTexMipmaps(_volTex, &_typedVol, _useNearest); });
+    }
+
+
+    /*!
+    * \fn get3DTexMaxLevel
+    * \brief Coarsest mip level of a 3D texture built by build3DTex() (0 without mip levels)
+    */
+    int get3DTexMaxLevel(GLuint _volTex)
+    {
+        GLint maxLevel = 0;
+        glBindTexture(GL_TEXTURE_3D, _volTex);
+        glGetTexParameteriv(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        return maxLevel;
+    }
+
+
     /*!
     * \fn build3DTex
-    * \brief Create a 3D texture and copy volume data into it.
+    * \brief Create a 3D texture and copy volume data into it (texture format matches voxel type, see TexFormat),
+    * with its mip levels (see build3DTexMipmaps()).
     * \param _volTex : reference to id of texture to generate
     * \param _vol : 3D image data (i.e., volume)
     * \param _useNearest : flag to indicate if texture uses GL_NEAREST param (if not, uses GL_LINEAR by default)
+    * \param _withData : if false, texture storage is only allocated (zeroed, level 0 only), to be filled with update3DTex()
+    * (mip levels are then built by build3DTexMipmaps() once the volume is loaded)
     */
-    void build3DTex(GLuint& _volTex, VolumeBase<std::uint8_t>* _vol, bool _useNearest = false)
+    template <typename VoxelType>
+    void build3DTex(GLuint& _volTex, VolumeBase<VoxelType>* _vol, bool _useNearest = false, bool _withData = true)
     {
         GLint param;
         _useNearest ? param = GL_NEAREST : param = GL_LINEAR;
-        //_useNearest ? param = GL_NEAREST_MIPMAP_NEAREST : param = GL_LINEAR_MIPMAP_NEAREST;
+
+        // rows of voxels are not padded
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // release previous texture
+        if (_volTex != 0)
+            glDeleteTextures(1, &_volTex);
 
         // generate 3D texture
         glGenTextures(1, &_volTex);
         glBindTexture(GL_TEXTURE_3D, _volTex);
-        glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, _vol->getDimensions().x, _vol->getDimensions().y, _vol->getDimensions().z, 0, GL_RED, GL_UNSIGNED_BYTE, _vol->getFront());
+        glTexImage3D(GL_TEXTURE_3D, 0, TexFormat<VoxelType>::internalFormat, _vol->getDimensions().x, _vol->getDimensions().y, _vol->getDimensions().z, 0, GL_RED, TexFormat<VoxelType>::type, _withData ? _vol->getFront() : nullptr);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, param);
         glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, param);
-
-        //glGenerateMipmap(GL_TEXTURE_3D);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, 0);
 
         glBindTexture(GL_TEXTURE_3D, 0);
 
         errorLog().lastGLerror();
+
+        if (_withData)
+            build3DTexMipmaps(_volTex, _vol, _useNearest);
+    }
+
+
+    /*!
+    * \fn build3DTex
+    * \brief Create a 3D texture and copy volume data into it, whatever the voxel type of the volume.
+    * \param _volTex : reference to id of texture to generate
+    * \param _vol : 3D image data (i.e., volume)
+    * \param _useNearest : flag to indicate if texture uses GL_NEAREST param (if not, uses GL_LINEAR by default)
+    * \param _withData : if false, texture storage is only allocated (zeroed), to be filled with update3DTex()
+    */
+    void build3DTex(GLuint& _volTex, VolumeImg* _vol, bool _useNearest = false, bool _withData = true)
+    {
+        _vol->visit([&](auto& _typedVol) { build3DTex(_volTex, &_typedVol, _useNearest, _withData); });
     }
 
 
@@ -365,11 +622,14 @@ namespace
     * \param _volTex : pointer to id of texture
     * \param _vol : new 3D image data (i.e., volume)
     */
-    void update3DTex(GLuint* _volTex, VolumeBase<std::uint8_t>* _vol)
+    template <typename VoxelType>
+    void update3DTex(GLuint* _volTex, VolumeBase<VoxelType>* _vol)
     {
 
         glBindTexture(GL_TEXTURE_3D, *_volTex);
 
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
         glTexSubImage3D(GL_TEXTURE_3D, // target
             0, // level
             0, // x offset
@@ -379,7 +639,7 @@ namespace
             _vol->getDimensions().y,
             _vol->getDimensions().z,
             GL_RED, // format
-            GL_UNSIGNED_BYTE, // type
+            TexFormat<VoxelType>::type, // type
             _vol->getFront()); // zeroed memory
 
         //glGenerateMipmap(GL_TEXTURE_3D);
@@ -390,6 +650,91 @@ namespace
     }
 
 
+    /*!
+    * \fn update3DTex
+    * \brief Update a slab (i.e. a range of Z slices) of a 3D texture.
+    * \param _volTex : pointer to id of texture
+    * \param _vol : 3D image data (i.e., volume)
+    * \param _zBegin : first slice of the slab
+    * \param _zEnd : slice after the last one of the slab
+    */
+    template <typename VoxelType>
+    void update3DTex(GLuint* _volTex, VolumeBase<VoxelType>* _vol, int _zBegin, int _zEnd)
+    {
+        glBindTexture(GL_TEXTURE_3D, *_volTex);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        size_t sliceSize = size_t(_vol->getDimensions().x) * size_t(_vol->getDimensions().y);
+        glTexSubImage3D(GL_TEXTURE_3D, // target
+            0, // level
+            0, // x offset
+            0, // y offset
+            _zBegin, // z offset
+            _vol->getDimensions().x,
+            _vol->getDimensions().y,
+            _zEnd - _zBegin,
+            GL_RED, // format
+            TexFormat<VoxelType>::type, // type
+            _vol->getFront() + size_t(_zBegin) * sliceSize); // first voxel of the slab
+
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        errorLog().lastGLerror();
+    }
+
+
+    /*!
+    * \fn update3DTex
+    * \brief Update a slab (i.e. a range of Z slices) of a 3D texture, whatever the voxel type of the volume.
+    * \param _volTex : pointer to id of texture
+    * \param _vol : 3D image data (i.e., volume)
+    * \param _zBegin : first slice of the slab
+    * \param _zEnd : slice after the last one of the slab
+    */
+    void update3DTex(GLuint* _volTex, VolumeImg* _vol, int _zBegin, int _zEnd)
+    {
+        _vol->visit([&](auto& _typedVol) { update3DTex(_volTex, &_typedVol, _zBegin, _zEnd); });
+    }
+
+
+    /*!
+    * \fn buildGradientTex
+    * \brief Create a RGBA8_SNORM 3D texture holding the packed gradients of a volume (see GradientVolume),
+    * read from the derived data cache or computed. The texture is released if gradients are not available.
+    * \param _gradTex : reference to id of texture to generate
+    * \param _vol : 3D image data (i.e., volume), fully loaded (nullptr to only release the texture)
+    */
+    void buildGradientTex(GLuint& _gradTex, VolumeImg* _vol)
+    {
+        // release previous texture
+        if (_gradTex != 0)
+            glDeleteTextures(1, &_gradTex);
+        _gradTex = 0;
+
+        VoxelStorage<std::uint32_t> gradients;
+        if (_vol == nullptr || !GradientVolume::compute(_vol, &gradients))
+            return;
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // generate 3D texture (signed bytes r, g, b, a in memory order, see GradientVolume)
+        // signed directions are filtered linearly, and normalized by the shaders
+        glGenTextures(1, &_gradTex);
+        glBindTexture(GL_TEXTURE_3D, _gradTex);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8_SNORM, _vol->getDimensions().x, _vol->getDimensions().y, _vol->getDimensions().z, 0, GL_RGBA, GL_BYTE, gradients.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        errorLog().lastGLerror();
+    }
+
+
     /*!
     * \fn buildScreenFBOandTex
     * \brief Generate a FBO and attach a texture to its color output (used for various screen texture generation)
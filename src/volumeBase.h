@@ -27,6 +27,9 @@
 
 #include "GLtools.h"
 
+#include "voxelStorage.h"
+#include "volumeView.h"
+
 
 /*!
 * \class VolumeBase
@@ -51,53 +54,72 @@ class VolumeBase
         |                                       VOXEL VALUES GETTERS/SETTERS                                          |
         +-------------------------------------------------------------------------------------------------------------*/
 
-        VoxelType getValue1ui(unsigned int _id) 
+        /*! \fn view : unchecked view of the voxels, to be used in CPU kernels (see VolumeView) */
+        inline VolumeView<VoxelType> view() { return VolumeView<VoxelType>(m_data.data(), m_dimensions); }
+        inline VolumeView<const VoxelType> view() const { return VolumeView<const VoxelType>(m_data.data(), m_dimensions); }
+
+        /*! \fn getNbVoxels : number of voxels of the grid (64 bits, may exceed 2^31) */
+        inline size_t getNbVoxels() const { return size_t(m_dimensions.x) * size_t(m_dimensions.y) * size_t(m_dimensions.z); }
+
+        inline bool isInData(std::int64_t _i, std::int64_t _j, std::int64_t _k) const
+        {
+            return _i >= 0 && _i < m_dimensions.x && _j >= 0 && _j < m_dimensions.y && _k >= 0 && _k < m_dimensions.z;
+        }
+
+        // Checked accessors: out of bound accesses are logged and return 0 (or are ignored).
+        // Hot loops should check their bounds once and use view() instead.
+
+        VoxelType getValue1ui(size_t _id)
         {
-            if( _id < 0 || _id >= m_data.size() )
+            if( _id >= m_data.size() )
+            {
                 errorLog() << "VolumeBase::getValue1ui(): out of bound: " << _id;
+                return VoxelType(0);
+            }
 
             return m_data[_id]; 
         }
 
-        VoxelType getValue3ui(unsigned int _i, unsigned int _j, unsigned int _k)
+        VoxelType getValue3ui(std::int64_t _i, std::int64_t _j, std::int64_t _k)
         {
-            int index = 0; 
-            if (_i >= 0 && _i < m_dimensions.x && _j >= 0 && _j < m_dimensions.y && _k >= 0 && _k < m_dimensions.z)
-                index = (m_dimensions.x * m_dimensions.y * _k) + (m_dimensions.x * _j) + _i;
-            else
+            if (!isInData(_i, _j, _k))
             {
                 errorLog() << "VolumeBase::getValue3ui(): out of bound: " << _i << " " << _j << " " << _k;
                 errorLog() << "VolumeBase::getValue3ui(): out of bound: " << m_dimensions.x << " " << m_dimensions.y << " " << m_dimensions.z;
+                return VoxelType(0);
             }
 
-            return m_data[index];
+            return m_data[indexUnchecked(_i, _j, _k)];
         }
 
-        VoxelType getValue3uiBound(unsigned int _i, unsigned int _j, unsigned int _k)
+        VoxelType getValue3uiBound(std::int64_t _i, std::int64_t _j, std::int64_t _k)
         {
-            int index = 0; 
-            if (_i >= 0 && _i < m_dimensions.x && _j >= 0 && _j < m_dimensions.y && _k >= 0 && _k < m_dimensions.z)
-                index = (m_dimensions.x * m_dimensions.y * _k) + (m_dimensions.x * _j) + _i;
-            else
-                return 0;
-
-            return m_data[index];
+            return isInData(_i, _j, _k) ? m_data[indexUnchecked(_i, _j, _k)] : VoxelType(0);
         }
 
         VoxelType getValue3ui(glm::ivec3 _uiCoords){ return getValue3ui(_uiCoords.x, _uiCoords.y, _uiCoords.z); }
 
-        unsigned int getIdfromCoords(unsigned int _i, unsigned int _j, unsigned int _k) 
+        size_t getIdfromCoords(std::int64_t _i, std::int64_t _j, std::int64_t _k) 
         { 
-            if (_i < 0 || _i >= m_dimensions.x || _j < 0 || _j >= m_dimensions.y || _k < 0 || _k >= m_dimensions.z)
+            if (!isInData(_i, _j, _k))
                 errorLog() << "VolumeBase::getIdfromCoords(): out of bound: " << _i << " " << _j << " " << _k;
 
-            return (m_dimensions.x * m_dimensions.y * _k) + (m_dimensions.x * _j) + _i; 
+            return indexUnchecked(_i, _j, _k); 
         }
 
-        void setValue3ui(unsigned int _i, unsigned int _j, unsigned int _k, VoxelType _val) { setValue1ui( getIdfromCoords(_i, _j, _k), _val); }
+        void setValue3ui(std::int64_t _i, std::int64_t _j, std::int64_t _k, VoxelType _val)
+        {
+            if (!isInData(_i, _j, _k))
+            {
+                errorLog() << "VolumeBase::setValue3ui(): out of bound: " << _i << " " << _j << " " << _k;
+                return;
+            }
+
+            m_data[indexUnchecked(_i, _j, _k)] = _val;
+        }
         void setValue3ui(glm::ivec3 _uiCoords, VoxelType _val) { setValue3ui(_uiCoords.x, _uiCoords.y, _uiCoords.z, _val); }
 
-        inline void setValue1ui(unsigned int _id, VoxelType _val) { m_data[_id] = _val; }
+        inline void setValue1ui(size_t _id, VoxelType _val) { m_data[_id] = _val; }
 
         VoxelType getValue3f(float _x, float _y, float _z)
         {
@@ -191,13 +213,16 @@ class VolumeBase
             return glm::scale(glm::mat4(1.0), scale);
         }
 
-        inline VoxelType* getFront() { return &m_data[0]; }
+        inline VoxelType* getFront() { return m_data.data(); }
+
+        /*! \fn getStorage : voxel array (e.g., to be filled by a file reader) */
+        inline VoxelStorage<VoxelType>& getStorage() { return m_data; }
 
         void clear() { if(m_data.size() != 0) m_data.clear(); }
 
-        void assign(unsigned int _nbElem, VoxelType _val) 
+        void assign(size_t _nbElem, VoxelType _val) 
         {
-            if( _nbElem > m_dimensions.x*m_dimensions.y*m_dimensions.z)
+            if( _nbElem > getNbVoxels())
                 errorLog() << "VolumeBase::assign(): assign more than grid dimensions: " << _nbElem;
 
             m_data.assign(_nbElem, _val); 
@@ -248,9 +273,17 @@ class VolumeBase
             return false;
         }
 
-        template <typename VoxelType>
-        glm::vec3 getGradient3ui(unsigned int _i, unsigned int _j, unsigned int _k)
+        glm::vec3 getGradient3ui(std::int64_t _i, std::int64_t _j, std::int64_t _k)
         {
+            if (!isInData(_i, _j, _k))
+            {
+                errorLog() << "VolumeBase::getGradient3ui(): out of bound: " << _i << " " << _j << " " << _k;
+                return glm::vec3(0.0f);
+            }
+
+            VolumeView<const VoxelType> vol = view();
+            const double center = double(vol(size_t(_i), size_t(_j), size_t(_k)));
+
             // 3D sobel filter
             double sobelX[27] = { -1.0f, 0.0f, 1.0f,
                                   -1.0f, 0.0f, 1.0f,
@@ -295,22 +328,12 @@ class VolumeBase
             int cpt = 0;
 
             // scan  3x3x3 neighborhood
-            for (unsigned int z = _k - 1; z <= _k + 1; z++)
-                for (unsigned int y = _j - 1; y <= _j + 1; y++)
-                    for (unsigned int x = _i - 1; x <= _i + 1; x++)
+            for (std::int64_t z = _k - 1; z <= _k + 1; z++)
+                for (std::int64_t y = _j - 1; y <= _j + 1; y++)
+                    for (std::int64_t x = _i - 1; x <= _i + 1; x++)
                     {
-                        // get value of current voxel
-                        VoxelType valImg;
-
-                        //border checking
-                        if (x >= 0 && x < m_dimensions.x && y >= 0 && y < m_dimensions.y && z >= 0 && z < m_dimensions.z)
-                        {
-                            valImg = getValue3ui(x, y, z);
-                        }
-                        else
-                        {
-                            valImg = getValue3ui(_i, _j, _k);
-                        }
+                        // get value of current voxel (border checking: neighbors out of the grid take the center value)
+                        double valImg = vol.isInData(x, y, z) ? double(vol(size_t(x), size_t(y), size_t(z))) : center;
 
                         // apply sobel filters
                         Gx += sobelX[cpt] * valImg;
@@ -334,16 +357,22 @@ class VolumeBase
         glm::vec3 m_origin = { 0.0, 0.0, 0.0 };     /*!< volume origin (i.e. real coords of bottom corner in space) */
         glm::vec3 m_spacing = { 0.0, 0.0, 0.0 };    /*!< voxel spacing (i.e. real distance between two voxels along each axis) */
         std::string m_datatype = "";                /*!< voxel data type string */
-        std::vector<VoxelType> m_data;              /*!< voxel data (i.e. voxel grid) */
+        VoxelStorage<VoxelType> m_data;             /*!< voxel data (i.e. voxel grid), owned or mapped from file */
 
 
         /*------------------------------------------------------------------------------------------------------------+
         |                                                   MISC                                                      |
         +-------------------------------------------------------------------------------------------------------------*/
 
-        void resize(unsigned int _size)
+        /*! \fn indexUnchecked : index in array of voxel (_i, _j, _k), in 64 bits */
+        inline size_t indexUnchecked(std::int64_t _i, std::int64_t _j, std::int64_t _k) const
+        {
+            return (size_t(_k) * size_t(m_dimensions.y) + size_t(_j)) * size_t(m_dimensions.x) + size_t(_i);
+        }
+
+        void resize(size_t _size)
         {
-            if( _size > m_dimensions.x*m_dimensions.y*m_dimensions.z)
+            if( _size > getNbVoxels())
                 errorLog() << "VolumeBase::resize(): new array size larger than grid dimensions: " << _size;
 
             m_data.resize(_size);
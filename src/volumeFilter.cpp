@@ -0,0 +1,583 @@
+/*********************************************************************************************************************
+ *
+ * volumeFilter.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include "volumeFilter.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "volumeImg.h"
+#include "parallel.h"
+#include "simd.h"
+
+
+namespace VolumeFilter
+{
+
+namespace
+{
+    // minimal number of rows processed by a thread (median, bilateral)
+    const size_t minRowsPerRange = 16;
+
+    // number of entries of the range kernel of the bilateral filter
+    const int rangeLutSize = 1024;
+
+
+    /*!
+    * \fn toVoxel
+    * \brief Convert a filtered value to the voxel type (rounded as floor(x + 0.5) and clamped for integer types)
+    */
+    template <typename VoxelType>
+    inline VoxelType toVoxel(float _v)
+    {
+        if constexpr (std::is_floating_point_v<VoxelType>)
+            return _v;
+        else
+        {
+            _v = std::floor(_v + 0.5f);
+            _v = std::min(std::max(_v, float(std::numeric_limits<VoxelType>::lowest())), float(std::numeric_limits<VoxelType>::max()));
+            return VoxelType(_v);
+        }
+    }
+
+    /*!
+    * \fn clampIndex
+    * \brief Index clamped to [0 ; _extent - 1] (border voxels repeated)
+    */
+    inline size_t clampIndex(std::int64_t _id, size_t _extent)
+    {
+        return _id < 0 ? 0 : (size_t(_id) >= _extent ? _extent - 1 : size_t(_id));
+    }
+
+    /*!
+    * \fn gaussianKernel
+    * \brief Half of a normalized Gaussian kernel truncated at 3 sigma: weights of offsets 0 to radius
+    * (the identity {1} for sigma < 0.1)
+    */
+    std::vector<float> gaussianKernel(float _sigma)
+    {
+        if (!(_sigma >= 0.1f))
+            return std::vector<float>(1, 1.0f);
+
+        int radius = std::min(int(std::ceil(3.0f * _sigma)), MAX_RADIUS);
+        std::vector<float> weights(radius + 1);
+        float sum = 0.0f;
+        for (int t = 0; t <= radius; t++)
+        {
+            weights[t] = std::exp(-0.5f * float(t * t) / (_sigma * _sigma));
+            sum += t == 0 ? weights[t] : 2.0f * weights[t];
+        }
+        for (float& w : weights)
+            w /= sum;
+        return weights;
+    }
+
+
+#if defined(SIMD_X86)
+    // AVX2 versions of the row kernels below, 8 voxels at a time,
+    // returning the number of voxels processed (the remaining ones are left to the scalar loops)
+
+    SIMD_TARGET_AVX2 size_t scaleRowAVX2(float* _dst, const float* _src, float _w, size_t _n)
+    {
+        size_t x = 0;
+        const __m256 w = _mm256_set1_ps(_w);
+        for (; x + 8 <= _n; x += 8)
+            _mm256_storeu_ps(_dst + x, _mm256_mul_ps(w, _mm256_loadu_ps(_src + x)));
+        return x;
+    }
+
+    SIMD_TARGET_AVX2 size_t accumulatePairAVX2(float* _acc, const float* _a, const float* _b, float _w, size_t _n)
+    {
+        size_t x = 0;
+        const __m256 w = _mm256_set1_ps(_w);
+        for (; x + 8 <= _n; x += 8)
+        {
+            __m256 sum = _mm256_add_ps(_mm256_loadu_ps(_a + x), _mm256_loadu_ps(_b + x));
+            _mm256_storeu_ps(_acc + x, _mm256_add_ps(_mm256_loadu_ps(_acc + x), _mm256_mul_ps(w, sum)));
+        }
+        return x;
+    }
+
+    SIMD_TARGET_AVX2 size_t accumulateBilateralAVX2(float* _num, float* _den, const float* _neighbor, const float* _center, size_t _n,
+                                                    float _spatial, float _maxDiff, float _lutScale, const float* _rangeLut)
+    {
+        size_t i = 0;
+        const __m256 spatial = _mm256_set1_ps(_spatial), maxDiff8 = _mm256_set1_ps(_maxDiff);
+        const __m256 scale8 = _mm256_set1_ps(_lutScale), half = _mm256_set1_ps(0.5f), absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const __m256i lastEntry = _mm256_set1_epi32(rangeLutSize - 1);
+        for (; i + 8 <= _n; i += 8)
+        {
+            __m256 v = _mm256_loadu_ps(_neighbor + i);
+            __m256 d = _mm256_and_ps(_mm256_sub_ps(v, _mm256_loadu_ps(_center + i)), absMask);
+            // entries of lanes out of the table (including NaN differences, converted to 0x80000000) are clamped
+            __m256i entry = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(d, scale8), half));
+            entry = _mm256_min_epu32(entry, lastEntry);
+            __m256 w = _mm256_mul_ps(spatial, _mm256_i32gather_ps(_rangeLut, entry, 4));
+            w = _mm256_and_ps(w, _mm256_cmp_ps(d, maxDiff8, _CMP_LT_OQ));
+            _mm256_storeu_ps(_num + i, _mm256_add_ps(_mm256_loadu_ps(_num + i), _mm256_mul_ps(w, v)));
+            _mm256_storeu_ps(_den + i, _mm256_add_ps(_mm256_loadu_ps(_den + i), w));
+        }
+        return i;
+    }
+#endif
+
+    /*!
+    * \fn scaleRow
+    * \brief _dst = _w * _src
+    */
+    void scaleRow(float* _dst, const float* _src, float _w, size_t _n)
+    {
+        size_t x = 0;
+#if defined(SIMD_X86)
+        if (Simd::hasAVX2())
+            x = scaleRowAVX2(_dst, _src, _w, _n);
+#endif
+        for (; x < _n; x++)
+            _dst[x] = _w * _src[x];
+    }
+
+    /*!
+    * \fn accumulatePair
+    * \brief _acc += _w * (_a + _b) (symmetric taps of a kernel)
+    */
+    void accumulatePair(float* _acc, const float* _a, const float* _b, float _w, size_t _n)
+    {
+        size_t x = 0;
+#if defined(SIMD_X86)
+        if (Simd::hasAVX2())
+            x = accumulatePairAVX2(_acc, _a, _b, _w, _n);
+#endif
+        for (; x < _n; x++)
+            _acc[x] += _w * (_a[x] + _b[x]);
+    }
+
+    /*!
+    * \fn convolve
+    * \brief Convolution of lines with a symmetric kernel: _dst = sum over t of _weights[|t|] * _line(t),
+    * where _line(t) is the line shifted by t
+    * \param _dst : result
+    * \param _line : function const float*(t) giving the line shifted by t (t in [-radius ; radius])
+    */
+    template <typename LineFunc>
+    void convolve(float* _dst, const std::vector<float>& _weights, size_t _n, LineFunc&& _line)
+    {
+        scaleRow(_dst, _line(0), _weights[0], _n);
+        for (int t = 1; t < int(_weights.size()); t++)
+            accumulatePair(_dst, _line(-t), _line(t), _weights[t], _n);
+    }
+
+
+    /*!
+    * \fn smoothSlice
+    * \brief Smooth a slice along x, then y
+    * \param _slice : voxels of the slice
+    * \param _padded : buffer of nx + 2 * radius along x values
+    * \param _tmp : buffer of a slice
+    * \param _out : smoothed slice
+    */
+    template <typename VoxelType>
+    void smoothSlice(const VoxelType* _slice, size_t _nx, size_t _ny, const std::vector<float>& _wx, const std::vector<float>& _wy,
+                     float* _padded, float* _tmp, float* _out)
+    {
+        const size_t rx = _wx.size() - 1;
+        for (size_t j = 0; j < _ny; j++)
+        {
+            // row in float, border voxels repeated
+            const VoxelType* row = _slice + j * _nx;
+            for (size_t i = 0; i < _nx; i++)
+                _padded[rx + i] = float(row[i]);
+            std::fill(_padded, _padded + rx, _padded[rx]);
+            std::fill(_padded + rx + _nx, _padded + 2 * rx + _nx, _padded[rx + _nx - 1]);
+
+            const float* center = _padded + rx;
+            convolve(_tmp + j * _nx, _wx, _nx, [&](int _t) { return center + _t; });
+        }
+
+        for (size_t j = 0; j < _ny; j++)
+            convolve(_out + j * _nx, _wy, _nx, [&](int _t) { return _tmp + clampIndex(std::int64_t(j) + _t, _ny) * _nx; });
+    }
+
+
+    /*!
+    * \fn medianHistogram
+    * \brief Median filter of integer volumes (see median())
+    */
+    template <typename VoxelType>
+    void medianHistogram(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, int _radius)
+    {
+        // one bin per value (shifted for signed types), and coarse bins of 256 values
+        const int nbBins = 1 << (8 * sizeof(VoxelType));
+        const int offset = std::is_signed_v<VoxelType> ? nbBins / 2 : 0;
+        const int nbBlocks = (nbBins + 255) / 256;
+
+        const size_t nx = _src.extent(0), ny = _src.extent(1), nz = _src.extent(2);
+        const int width = 2 * _radius + 1;
+        const int medianRank = width * width * width / 2;
+
+        // one task per row
+        Parallel::parallelFor(0, ny * nz, [&](size_t _first, size_t _last)
+        {
+            std::vector<std::uint16_t> hist(nbBins, 0), blocks(nbBlocks, 0);
+            std::vector<const VoxelType*> rows(width * width);
+
+            // median bin, and number of window values in bins below it
+            int m = 0, below = 0;
+
+            auto update = [&](size_t _column, int _delta)
+            {
+                for (const VoxelType* row : rows)
+                {
+                    int bin = int(row[_column]) + offset;
+                    hist[bin] = std::uint16_t(hist[bin] + _delta);
+                    blocks[bin >> 8] = std::uint16_t(blocks[bin >> 8] + _delta);
+                    below += bin < m ? _delta : 0;
+                }
+            };
+
+            // replace the values of a column by those of another one (same values are skipped)
+            auto slide = [&](size_t _oldColumn, size_t _newColumn)
+            {
+                for (const VoxelType* row : rows)
+                {
+                    int oldBin = int(row[_oldColumn]) + offset, newBin = int(row[_newColumn]) + offset;
+                    if (oldBin == newBin)
+                        continue;
+                    hist[oldBin]--;
+                    hist[newBin]++;
+                    if ((oldBin >> 8) != (newBin >> 8))
+                    {
+                        blocks[oldBin >> 8]--;
+                        blocks[newBin >> 8]++;
+                    }
+                    below += int(newBin < m) - int(oldBin < m);
+                }
+            };
+
+            auto updateMedian = [&]()
+            {
+                // down to the previous non-empty bins, skipping empty blocks
+                while (below > medianRank)
+                {
+                    if ((m & 255) == 0)
+                        while (blocks[(m >> 8) - 1] == 0)
+                            m -= 256;
+                    m--;
+                    below -= hist[m];
+                }
+                // up to the bin holding the median
+                while (below + hist[m] <= medianRank)
+                {
+                    below += hist[m];
+                    m++;
+                    if ((m & 255) == 0)
+                        while (blocks[m >> 8] == 0)
+                            m += 256;
+                }
+            };
+
+            for (size_t r = _first; r < _last; r++)
+            {
+                std::int64_t j = std::int64_t(r % ny), k = std::int64_t(r / ny);
+                for (int dk = 0; dk < width; dk++)
+                    for (int dj = 0; dj < width; dj++)
+                        rows[dk * width + dj] = _src.row(clampIndex(j + dj - _radius, ny), clampIndex(k + dk - _radius, nz));
+
+                // window of the first voxel, then slide along x
+                for (int di = -_radius; di <= _radius; di++)
+                    update(clampIndex(di, nx), 1);
+
+                VoxelType* out = _dst.row(size_t(j), size_t(k));
+                for (size_t i = 0; i < nx; i++)
+                {
+                    if (i > 0)
+                        slide(clampIndex(std::int64_t(i) - _radius - 1, nx), clampIndex(std::int64_t(i) + _radius, nx));
+                    updateMedian();
+                    out[i] = VoxelType(m - offset);
+                }
+
+                // empty the histogram for the next row (the median bin is kept as a first guess)
+                for (int di = -_radius; di <= _radius; di++)
+                    update(clampIndex(std::int64_t(nx) - 1 + di, nx), -1);
+            }
+        }, minRowsPerRange);
+    }
+
+
+    /*!
+    * \fn medianSelect
+    * \brief Median filter of float volumes (see median())
+    */
+    void medianSelect(VolumeView<const float> _src, VolumeView<float> _dst, int _radius)
+    {
+        const size_t nx = _src.extent(0), ny = _src.extent(1), nz = _src.extent(2);
+        const int width = 2 * _radius + 1;
+
+        // one task per row
+        Parallel::parallelFor(0, ny * nz, [&](size_t _first, size_t _last)
+        {
+            std::vector<const float*> rows(width * width);
+            std::vector<float> window(width * width * width);
+            for (size_t r = _first; r < _last; r++)
+            {
+                std::int64_t j = std::int64_t(r % ny), k = std::int64_t(r / ny);
+                for (int dk = 0; dk < width; dk++)
+                    for (int dj = 0; dj < width; dj++)
+                        rows[dk * width + dj] = _src.row(clampIndex(j + dj - _radius, ny), clampIndex(k + dk - _radius, nz));
+
+                float* out = _dst.row(size_t(j), size_t(k));
+                for (size_t i = 0; i < nx; i++)
+                {
+                    float* value = window.data();
+                    for (int di = -_radius; di <= _radius; di++)
+                    {
+                        size_t column = clampIndex(std::int64_t(i) + di, nx);
+                        for (const float* row : rows)
+                            *value++ = row[column];
+                    }
+                    std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+                    out[i] = window[window.size() / 2];
+                }
+            }
+        }, minRowsPerRange);
+    }
+
+} // anonymous namespace
+
+
+template <typename VoxelType>
+void gaussian(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, glm::vec3 _sigma)
+{
+    if (_src.empty() || _dst.size() != _src.size())
+        return;
+
+    const size_t nx = _src.extent(0), ny = _src.extent(1), nz = _src.extent(2);
+    const size_t sliceSize = nx * ny;
+    const std::vector<float> wx = gaussianKernel(_sigma.x), wy = gaussianKernel(_sigma.y), wz = gaussianKernel(_sigma.z);
+    const size_t ringSize = 2 * wz.size() - 1;
+
+    // bands of slices: each thread walks along z, with a ring of the slices smoothed along x and y
+    // (the 2 * radius slices around a band are smoothed by both threads sharing them)
+    Parallel::parallelFor(0, nz, [&](size_t _first, size_t _last)
+    {
+        std::vector<float> ring(ringSize * sliceSize), tmp(sliceSize), acc(sliceSize), padded(nx + 2 * (wx.size() - 1));
+        std::vector<std::int64_t> ringSlices(ringSize, -1);
+
+        // slices of the window of a slice are in distinct entries of the ring
+        auto smoothedSlice = [&](std::int64_t _k)
+        {
+            size_t s = clampIndex(_k, nz);
+            size_t entry = s % ringSize;
+            float* slice = ring.data() + entry * sliceSize;
+            if (ringSlices[entry] != std::int64_t(s))
+            {
+                smoothSlice(_src.slice(s), nx, ny, wx, wy, padded.data(), tmp.data(), slice);
+                ringSlices[entry] = std::int64_t(s);
+            }
+            return static_cast<const float*>(slice);
+        };
+
+        for (size_t k = _first; k < _last; k++)
+        {
+            convolve(acc.data(), wz, sliceSize, [&](int _t) { return smoothedSlice(std::int64_t(k) + _t); });
+
+            VoxelType* out = _dst.slice(k);
+            for (size_t v = 0; v < sliceSize; v++)
+                out[v] = toVoxel<VoxelType>(acc[v]);
+        }
+    }, std::max<size_t>(8, ringSize));
+}
+
+
+template <typename VoxelType>
+void median(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, int _radius)
+{
+    if (_src.empty() || _dst.size() != _src.size())
+        return;
+
+    _radius = std::min(std::max(_radius, 1), 2);
+    if constexpr (std::is_floating_point_v<VoxelType>)
+        medianSelect(_src, _dst, _radius);
+    else
+        medianHistogram(_src, _dst, _radius);
+}
+
+
+template <typename VoxelType>
+void bilateral(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, glm::vec3 _sigmaSpatial, float _sigmaRange)
+{
+    if (_src.empty() || _dst.size() != _src.size())
+        return;
+
+    const size_t nx = _src.extent(0), ny = _src.extent(1), nz = _src.extent(2);
+    if (!(_sigmaRange > 0.0f))
+    {
+        std::copy(_src.data(), _src.data() + _src.size(), _dst.data());
+        return;
+    }
+
+    // spatial taps within 2 sigma, grouped by source row
+    glm::ivec3 radius;
+    for (int a = 0; a < 3; a++)
+    {
+        _sigmaSpatial[a] = std::max(_sigmaSpatial[a], 1.0e-3f);
+        radius[a] = std::min(int(2.0f * _sigmaSpatial[a]), MAX_RADIUS);
+    }
+
+    struct RowTaps
+    {
+        int dj, dk;
+        std::vector<std::pair<int, float>> taps;   // offset along x, spatial weight
+    };
+    std::vector<RowTaps> rowTaps;
+    for (int dk = -radius.z; dk <= radius.z; dk++)
+    {
+        for (int dj = -radius.y; dj <= radius.y; dj++)
+        {
+            RowTaps row{ dj, dk, {} };
+            for (int di = -radius.x; di <= radius.x; di++)
+            {
+                glm::vec3 d = glm::vec3(float(di), float(dj), float(dk)) / _sigmaSpatial;
+                float d2 = glm::dot(d, d);
+                if (d2 <= 4.0f)
+                    row.taps.emplace_back(di, std::exp(-0.5f * d2));
+            }
+            if (!row.taps.empty())
+                rowTaps.push_back(std::move(row));
+        }
+    }
+
+    // range kernel, tabulated over [0 ; 3 sigma[ (0 beyond)
+    const float maxDiff = 3.0f * _sigmaRange;
+    const float lutScale = float(rangeLutSize - 1) / maxDiff;
+    std::vector<float> rangeLut(rangeLutSize);
+    for (int l = 0; l < rangeLutSize; l++)
+    {
+        float d = float(l) / lutScale / _sigmaRange;
+        rangeLut[l] = std::exp(-0.5f * d * d);
+    }
+
+    // one task per row
+    Parallel::parallelFor(0, ny * nz, [&](size_t _first, size_t _last)
+    {
+        const size_t paddedSize = nx + 2 * size_t(radius.x);
+        std::vector<float> padded(rowTaps.size() * paddedSize), num(nx), den(nx);
+        for (size_t r = _first; r < _last; r++)
+        {
+            std::int64_t j = std::int64_t(r % ny), k = std::int64_t(r / ny);
+
+            // source rows in float, border voxels repeated
+            const float* center = nullptr;
+            for (size_t g = 0; g < rowTaps.size(); g++)
+            {
+                const VoxelType* row = _src.row(clampIndex(j + rowTaps[g].dj, ny), clampIndex(k + rowTaps[g].dk, nz));
+                float* p = padded.data() + g * paddedSize;
+                for (size_t i = 0; i < nx; i++)
+                    p[radius.x + i] = float(row[i]);
+                std::fill(p, p + radius.x, p[radius.x]);
+                std::fill(p + radius.x + nx, p + paddedSize, p[radius.x + nx - 1]);
+                if (rowTaps[g].dj == 0 && rowTaps[g].dk == 0)
+                    center = p + radius.x;
+            }
+
+            std::fill(num.begin(), num.end(), 0.0f);
+            std::fill(den.begin(), den.end(), 0.0f);
+            for (size_t g = 0; g < rowTaps.size(); g++)
+            {
+                const float* p = padded.data() + g * paddedSize + radius.x;
+                for (const std::pair<int, float>& tap : rowTaps[g].taps)
+                {
+                    const float* neighbor = p + tap.first;
+                    size_t i = 0;
+#if defined(SIMD_X86)
+                    if (Simd::hasAVX2())
+                        i = accumulateBilateralAVX2(num.data(), den.data(), neighbor, center, nx, tap.second, maxDiff, lutScale, rangeLut.data());
+#endif
+                    for (; i < nx; i++)
+                    {
+                        float d = std::abs(neighbor[i] - center[i]);
+                        float w = d < maxDiff ? tap.second * rangeLut[size_t(d * lutScale + 0.5f)] : 0.0f;
+                        num[i] += w * neighbor[i];
+                        den[i] += w;
+                    }
+                }
+            }
+
+            VoxelType* out = _dst.row(size_t(j), size_t(k));
+            for (size_t i = 0; i < nx; i++)
+                out[i] = den[i] > 0.0f ? toVoxel<VoxelType>(num[i] / den[i]) : toVoxel<VoxelType>(center[i]);
+        }
+    }, minRowsPerRange);
+}
+
+
+template void gaussian<std::uint8_t>(VolumeView<const std::uint8_t>, VolumeView<std::uint8_t>, glm::vec3);
+template void gaussian<std::uint16_t>(VolumeView<const std::uint16_t>, VolumeView<std::uint16_t>, glm::vec3);
+template void gaussian<std::int16_t>(VolumeView<const std::int16_t>, VolumeView<std::int16_t>, glm::vec3);
+template void gaussian<float>(VolumeView<const float>, VolumeView<float>, glm::vec3);
+
+template void median<std::uint8_t>(VolumeView<const std::uint8_t>, VolumeView<std::uint8_t>, int);
+template void median<std::uint16_t>(VolumeView<const std::uint16_t>, VolumeView<std::uint16_t>, int);
+template void median<std::int16_t>(VolumeView<const std::int16_t>, VolumeView<std::int16_t>, int);
+template void median<float>(VolumeView<const float>, VolumeView<float>, int);
+
+template void bilateral<std::uint8_t>(VolumeView<const std::uint8_t>, VolumeView<std::uint8_t>, glm::vec3, float);
+template void bilateral<std::uint16_t>(VolumeView<const std::uint16_t>, VolumeView<std::uint16_t>, glm::vec3, float);
+template void bilateral<std::int16_t>(VolumeView<const std::int16_t>, VolumeView<std::int16_t>, glm::vec3, float);
+template void bilateral<float>(VolumeView<const float>, VolumeView<float>, glm::vec3, float);
+
+
+bool apply(VolumeImg* _vol, FilterType _type, float _sigma, int _radius, float _sigmaRange)
+{
+    size_t nbVoxels = _vol->getNbVoxels();
+    glm::ivec3 dims = _vol->getDimensions();
+
+    // sigma along each axis, in voxels (isotropic kernel in world space)
+    glm::vec3 spacing = glm::abs(_vol->getSpacing());
+    float finest = std::min(spacing.x, std::min(spacing.y, spacing.z));
+    glm::vec3 sigma(_sigma);
+    if (finest > 0.0f)
+        sigma = glm::vec3(_sigma * finest) / spacing;
+
+    bool filtered = false;
+    _vol->visit([&](auto& _typedVol)
+    {
+        using VoxelType = std::decay_t<decltype(*_typedVol.getFront())>;
+
+        // no data (e.g. out-of-core volume)
+        if (nbVoxels == 0 || _typedVol.getStorage().size() != nbVoxels)
+            return;
+
+        VoxelStorage<VoxelType> filteredData;
+        filteredData.resize(nbVoxels);
+        VolumeView<const VoxelType> src = std::as_const(_typedVol).view();
+        VolumeView<VoxelType> dst(filteredData.data(), dims);
+        if (_type == FILTER_GAUSSIAN)
+            gaussian(src, dst, sigma);
+        else if (_type == FILTER_MEDIAN)
+            median(src, dst, _radius);
+        else
+            bilateral(src, dst, sigma, _sigmaRange);
+
+        _typedVol.getStorage() = std::move(filteredData);
+        filtered = true;
+    });
+    if (!filtered)
+        return false;
+
+    _vol->dataModified();
+    return true;
+}
+
+} // namespace VolumeFilter
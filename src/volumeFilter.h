@@ -0,0 +1,100 @@
+/*********************************************************************************************************************
+ *
+ * volumeFilter.h
+ *
+ * Denoising filters of volumes (Gaussian, median, bilateral)
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef VOLUMEFILTER_H
+#define VOLUMEFILTER_H
+
+
+#include <cstdint>
+#include <cstddef>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "volumeView.h"
+
+
+class VolumeImg;
+
+
+/*!
+* \namespace VolumeFilter
+* \brief Filters smoothing the voxels of a volume (e.g. noise of low-dose CT, which makes isosurfaces spongy).
+* Filters read a volume and write another one of the same dimensions and type (integer results are rounded).
+* Voxels out of the grid take the value of the nearest border voxel.
+* All filters are multithreaded: threads process bands of slices (Gaussian) or of rows (median, bilateral).
+*/
+namespace VolumeFilter
+{
+
+    /*! Available filters */
+    enum FilterType { FILTER_GAUSSIAN, FILTER_MEDIAN, FILTER_BILATERAL };
+
+    /*! largest radius (in voxels) of the kernels */
+    const int MAX_RADIUS = 16;
+
+
+    /*!
+    * \fn gaussian
+    * \brief Gaussian smoothing, separable (vectorized on AVX2)
+    * Kernels are truncated at 3 sigma. Each thread walks along z through its band of slices, keeping the slices
+    * smoothed along x and y needed by the pass along z only.
+    * \param _src : voxels
+    * \param _dst : smoothed voxels, same dimensions as _src
+    * \param _sigma : standard deviation along each axis, in voxels (no smoothing along axes with sigma < 0.1)
+    */
+    template <typename VoxelType>
+    void gaussian(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, glm::vec3 _sigma);
+
+    /*!
+    * \fn median
+    * \brief Median of the (2 * radius + 1)^3 voxels around each voxel
+    * Integer volumes use a histogram of the window sliding along x, whose median is tracked from voxel to voxel
+    * (with coarse bins of 256 values to skip empty ranges of 16b values); float volumes select the median
+    * of the window values.
+    * \param _src : voxels
+    * \param _dst : filtered voxels, same dimensions as _src
+    * \param _radius : 1 (3x3x3 window) or 2 (5x5x5 window)
+    */
+    template <typename VoxelType>
+    void median(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, int _radius);
+
+    /*!
+    * \fn bilateral
+    * \brief Edge-preserving smoothing (vectorized on AVX2): voxels are averaged with weights decreasing with their distance
+    * (spatial Gaussian, truncated at 2 sigma) and with their difference of value (range Gaussian, tabulated up to 3 sigma)
+    * \param _src : voxels
+    * \param _dst : filtered voxels, same dimensions as _src
+    * \param _sigmaSpatial : standard deviation of the spatial Gaussian along each axis, in voxels
+    * \param _sigmaRange : standard deviation of the range Gaussian, in native units
+    */
+    template <typename VoxelType>
+    void bilateral(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, glm::vec3 _sigmaSpatial, float _sigmaRange);
+
+
+    /*!
+    * \fn apply
+    * \brief Filter a volume: filtered voxels replace the voxels of the volume (its value range and content hash
+    * are updated, textures and derived data are to be rebuilt by the caller)
+    * \param _vol : volume
+    * \param _type : filter
+    * \param _sigma : standard deviation of the Gaussian (spatial one for the bilateral filter), in voxels along
+    *                 the finest axis (scaled along the other ones, so that the kernel is isotropic in world space)
+    * \param _radius : radius of the median window (1 or 2)
+    * \param _sigmaRange : standard deviation of the range Gaussian of the bilateral filter, in native units
+    * \return false if the volume has no data in memory (e.g. out-of-core volume)
+    */
+    bool apply(VolumeImg* _vol, FilterType _type, float _sigma, int _radius, float _sigmaRange);
+
+}
+
+#endif // VOLUMEFILTER_H
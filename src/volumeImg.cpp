@@ -12,9 +12,20 @@
 #define NOMINMAX // avoid min*max macros to interfer with std::min/max
 
 #include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <limits>
+#include <bit>
+#include <cstdio>
 
 #include "volumeImg.h"
 #include "readVTK.h"
+#include "readRawHeader.h"
+#include "vvolFile.h"
+#include "readDICOM.h"
+#include "readNIfTI.h"
+#include "voxelConvert.h"
+#include "parallel.h"
 
 
 void VolumeImg::volumeInit()
@@ -26,18 +37,78 @@ void VolumeImg::volumeInit()
     m_spacing = glm::vec3(0.2f, 0.2f, 0.2f);
     m_datatype = "uint8";
 
+    resetWideVolume();
+    m_pendingSwap = false;
+    m_contentHashValid = false;
     m_data.resize(100 * 100 * 100);
+    updateValueRange();
 
 }
 
-void VolumeImg::volumeLoad(const std::string& filename)
+
+bool VolumeImg::volumeInitHeader(const std::string& _datatype, glm::ivec3 _dimensions, glm::vec3 _origin, glm::vec3 _spacing, glm::vec2 _range)
+{
+    m_dimensions = _dimensions;
+    m_origin = _origin;
+    m_spacing = _spacing;
+    m_datatype = _datatype;
+    m_orientation = glm::mat3(1.0f);
+    m_pendingSwap = false;
+    m_contentHashValid = false;
+
+    // empty storage of the matching type
+    if (!loadData(_datatype, [](auto* _storage) { _storage->clear(); return true; }))
+        return false;
+
+    setValueRange(_range);
+    return true;
+}
+
+bool VolumeImg::volumeLoad(const std::string& filename, bool _deferred, const std::function<bool()>& _cancelled)
 {
-    if (filename.find(".vtk") != std::string::npos)
-        volumeLoadVTK(filename);
+    bool loaded = false;
+    m_orientation = glm::mat3(1.0f);
+    if (ReadNIfTI::isNIfTIFile(filename))
+        loaded = volumeLoadNIfTI(filename, _cancelled);
+    else if (ReadDICOM::isDICOMPath(filename))
+        loaded = volumeLoadDICOM(filename, _cancelled);
+    else if (ReadRawHeader::isHeaderFile(filename))
+        loaded = volumeLoadRawHeader(filename);
+    else if (filename.find(".vvol") != std::string::npos)
+        loaded = volumeLoadVVol(filename, _cancelled);
+    else if (filename.find(".vtk") != std::string::npos)
+        loaded = volumeLoadVTK(filename, _cancelled);
     else if (filename.find(".raw") != std::string::npos)
-        volumeLoadRAW(filename);
+    {
+        // use the MetaImage / NRRD header next to the file if any
+        std::string headerFile = ReadRawHeader::findSidecarHeader(filename);
+        if (!headerFile.empty())
+            loaded = volumeLoadRawHeader(headerFile);
+        else
+            loaded = volumeLoadRAW(filename);
+    }
     else
         errorLog() << "VolumeImg::volumeLoad(): file " << filename << " format no supported";
+
+    m_contentHashValid = false;
+    if (!loaded)
+        return false;
+
+    if (_deferred)
+    {
+        // values are unknown yet: use the full range of the voxel type
+        switch (m_format)
+        {
+            case FORMAT_UINT8:  setValueRange(glm::vec2(0.0f, 255.0f)); break;
+            case FORMAT_UINT16: setValueRange(glm::vec2(0.0f, 65535.0f)); break;
+            case FORMAT_INT16:  setValueRange(glm::vec2(-32768.0f, 32767.0f)); break;
+            default:            setValueRange(glm::vec2(0.0f, 1.0f)); break;
+        }
+    }
+    else
+        updateValueRange();
+
+    return true;
 }
 
 
@@ -51,25 +122,83 @@ bool VolumeImg::volumeLoadRAW(const std::string& filename)
     m_datatype = "uint8";
 
     // Note: files contain [0,255] values encoded as short integers
-    const int nbVoxels = 208 * 224 * 208;
+    const size_t nbVoxels = 208 * 224 * 208;
 
-    std::vector<short> dataShort;
-    dataShort.resize(nbVoxels);
-    FILE* file;
-    errno_t err = fopen_s(&file, filename.c_str(), "rb");
-    if (err != 0)
+    MappedFile file;
+    if (!file.open(filename) || file.size() < nbVoxels * sizeof(short))
     {
-        throw std::runtime_error{ "Could not open file!" };
+        errorLog() << "VolumeImg::volumeLoadRAW(): could not read file " << filename;
+        return false;
     }
-    // read short int values and copy them in a vector
-    fread(dataShort.data(), sizeof(short), nbVoxels, file);
 
+    resetWideVolume();
     m_data.resize(nbVoxels);
 
-    // cast each element from short to uChar and copy them into a new vector
-    std::transform(dataShort.begin(), dataShort.end(), m_data.begin(), [](auto ptr) { return static_cast<unsigned char>(ptr); });
+    // cast each element from short to uChar, straight from the mapped file
+    const short* dataShort = reinterpret_cast<const short*>(file.data());
+    Parallel::parallelFor(0, nbVoxels, [&](size_t _first, size_t _last)
+    {
+        std::transform(dataShort + _first, dataShort + _last, m_data.begin() + _first, [](auto ptr) { return static_cast<unsigned char>(ptr); });
+    }, 1 << 16);
+    m_pendingSwap = false;
+
+    return true;
+}
+
+
+
+// Reads a RAW volume described by a MetaImage (.mhd / .mha) or NRRD
+// (.nhdr / .nrrd) header. Returns true on success, false otherwise.
+// Data are mapped from the data file (detached) or from the header
+// file itself (attached), and used in place in their native type.
+bool VolumeImg::volumeLoadRawHeader(const std::string& filename)
+{
+    auto tStart = std::chrono::steady_clock::now();
+
+    // Open and read header
+    auto headerFile = std::make_shared<MappedFile>();
+    if (!headerFile->open(filename)) {
+        return false;
+    }
+
+    ReadRawHeader::RawHeader header;
+    if (!ReadRawHeader::readHeader(*headerFile, filename, &header)) {
+        errorLog() << "VolumeImage::volumeLoadRawHeader(): invalid header in " << filename;
+        return false;
+    }
+    auto tHeader = std::chrono::steady_clock::now();
+
+    // Open data file (unless data are attached to the header)
+    std::shared_ptr<MappedFile> dataFile = headerFile;
+    if (header.dataFile != filename) {
+        dataFile = std::make_shared<MappedFile>();
+        if (!dataFile->open(header.dataFile)) {
+            return false;
+        }
+    }
+
+    m_dimensions = header.dimensions;
+    m_origin = header.origin;
+    m_spacing = header.spacing;
+    m_datatype = header.datatype;
 
-    fclose(file);
+    std::cout << "[INFO] VolumeImage::volumeLoadRawHeader(): load " << header.dataFile << std::endl;
+    std::cout << std::endl << "    HEADER INFO:" << std::endl;
+    std::cout << "    dimension (x,y,z) :" << header.dimensions.x << " " << header.dimensions.y << " " << header.dimensions.z << std::endl;
+    std::cout << "    spacing (x,y,z) :" << header.spacing.x << " " << header.spacing.y << " " << header.spacing.z << std::endl;
+    std::cout << "    origin (x,y,z) :" << header.origin.x << " " << header.origin.y << " " << header.origin.z << std::endl;
+    std::cout << "    datatype :" << header.datatype << (header.bigEndian ? " (big endian)" : " (little endian)") << std::endl << std::endl;
+
+    // Read data: mapped into memory and used in place (no intermediate buffer).
+    // Byte swap is left to processSlab()
+    m_pendingSwap = (header.bigEndian != (std::endian::native == std::endian::big));
+    if (!loadData(header.datatype, [&](auto* _storage) { return ReadRawHeader::mapData(dataFile, header, _storage, false); })) {
+        return false;
+    }
+    auto tData = std::chrono::steady_clock::now();
+
+    std::cout << "    load timings (ms): header " << std::chrono::duration<double, std::milli>(tHeader - tStart).count()
+              << ", data " << std::chrono::duration<double, std::milli>(tData - tHeader).count() << std::endl;
 
     return true;
 }
@@ -79,32 +208,27 @@ bool VolumeImg::volumeLoadRAW(const std::string& filename)
 // Reads a volume image in the legacy VTK StructuredPoints format
 // from a file. Returns true on success, false otherwise. Possible
 // datatypes are: "uint8", "uint16", "int16", "uint32", and "float32".
-// Assumes that the file starts with a ten line header
-// section followed by a data section in ASCII or binary format,
-// i.e.:
-//
-// # vtk DataFile Version x.x\n
-// Some information about the file\n
-// BINARY\n
-// DATASET STRUCTURED_POINTS\n
-// DIMENSIONS 128 128 128\n
-// ORIGIN 0.0 0.0 0.0\n
-// SPACING 1.0 1.0 1.0\n
-// POINT_DATA 2097152\n
-// SCALARS image_data unsigned_char\n
-// LOOKUP_TABLE default\n
-// raw data........\n
-bool VolumeImg::volumeLoadVTK(const std::string& filename)
-{
-    if (!ReadVTK::isVTKFile(filename)) {
+// The file is opened (mapped) only once: the header section, of any
+// length, is parsed in a single pass (see ReadVTK::readHeader()) and
+// the data section, in ASCII or binary format, starts right after it.
+bool VolumeImg::volumeLoadVTK(const std::string& filename, const std::function<bool()>& _cancelled)
+{
+    auto tStart = std::chrono::steady_clock::now();
+
+    // Open file
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(filename)) {
         return false;
     }
+    auto tOpen = std::chrono::steady_clock::now();
 
     // Read header
     ReadVTK::VTKHeader header;
-    if (!ReadVTK::readHeader(filename, &header)) {
+    if (!ReadVTK::readHeader(*file, &header)) {
+        errorLog() << "VolumeImage::volumeLoadVTK(): invalid header in " << filename;
         return false;
     }
+    auto tHeader = std::chrono::steady_clock::now();
 
     m_dimensions = header.dimensions;
     m_origin = header.origin;
@@ -120,92 +244,304 @@ bool VolumeImg::volumeLoadVTK(const std::string& filename)
     std::cout << "    volume box size: " << header.dimensions.x * header.spacing.x << " " <<
               header.dimensions.y * header.spacing.y << " " << header.dimensions.z * header.spacing.z << std::endl;
 
-    // Read data
-    if (header.datatype == "uint8") {
-        std::vector<uint8_t> imageData;
-        if (!ReadVTK::readData(filename, header, &imageData)) {
-            return false;
-        }
-        size_t nBytes = imageData.size() * sizeof(imageData[0]);
-        m_data.resize(nBytes);
-        std::memcpy(&m_data[0], &imageData[0], nBytes);
-    }
-    else if (header.datatype == "uint16") {
-        errorLog() << "VolumeImage::volumeLoadVTK(): uint16 datatype not supported";
-        std::vector<uint16_t> imageData;
-        if (!ReadVTK::readData(filename, header, &imageData)) {
-            return false;
-        }
-        size_t nBytes = imageData.size() * sizeof(imageData[0]);
-        m_data.resize(nBytes);
-        std::memcpy(&m_data[0], &imageData[0], nBytes);
-    }
-    else if (header.datatype == "int16") {
-        warningLog() << "VolumeImage::volumeLoadVTK(): int16 datatype cast to uint8";
-        std::vector<int16_t> imageData;
-        if (!ReadVTK::readData(filename, header, &imageData)) {
-            return false;
-        }
-        size_t nBytes = imageData.size() * sizeof(imageData[0]);
-        m_data.resize(nBytes);
+    // Read data: the data section of the file is mapped into memory
+    // and used in place (no intermediate buffer), in its native type.
+    // Byte swap is left to processSlab()
+    m_pendingSwap = ReadVTK::needsByteSwap(header);
+    if (!loadData(header.datatype, [&](auto* _storage) { return ReadVTK::mapData(file, header, _storage, false, _cancelled); })) {
+        return false;
+    }
+    auto tData = std::chrono::steady_clock::now();
+
+    std::cout << "    load timings (ms): open " << std::chrono::duration<double, std::milli>(tOpen - tStart).count()
+              << ", header " << std::chrono::duration<double, std::milli>(tHeader - tOpen).count()
+              << ", data " << std::chrono::duration<double, std::milli>(tData - tHeader).count() << std::endl;
+
+    return true;
+}
+
 
-        // convert 16 to 8 bits
-        convertInt16ToUint8(&imageData);
+// Reads a volume from a native .vvol file (see VVolFile). Returns true
+// on success, false otherwise. Bricks are decoded in parallel straight
+// into the volume, in its native type.
+bool VolumeImg::volumeLoadVVol(const std::string& filename, const std::function<bool()>& _cancelled)
+{
+    auto tStart = std::chrono::steady_clock::now();
 
-        // call the function Int16ToUint8 for each element of imageData and store the result in volume->data
-        //std::transform(imageData.begin(), imageData.end(), m_data.begin(), Int16ToUint8 );
+    VVolFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+    auto tHeader = std::chrono::steady_clock::now();
 
-        //std::memcpy(&volume->data[0], &imageData[0], nBytes);
+    m_dimensions = file.getDimensions();
+    m_origin = file.getOrigin();
+    m_spacing = file.getSpacing();
+    m_datatype = file.getDatatype();
+    m_pendingSwap = false;
+
+    std::cout << "[INFO] VolumeImage::volumeLoadVVol(): load " << filename << std::endl;
+    std::cout << std::endl << "    HEADER INFO:" << std::endl;
+    std::cout << "    dimension (x,y,z) :" << m_dimensions.x << " " << m_dimensions.y << " " << m_dimensions.z << std::endl;
+    std::cout << "    spacing (x,y,z) :" << m_spacing.x << " " << m_spacing.y << " " << m_spacing.z << std::endl;
+    std::cout << "    origin (x,y,z) :" << m_origin.x << " " << m_origin.y << " " << m_origin.z << std::endl;
+    std::cout << "    datatype :" << m_datatype << std::endl;
+    std::cout << "    bricks :" << file.getBrickInfos().size() << " of " << file.getBrickSize() << "^3" << std::endl << std::endl;
+
+    size_t nbVoxels = size_t(m_dimensions.x) * size_t(m_dimensions.y) * size_t(m_dimensions.z);
+    if (!loadData(m_datatype, [&](auto* _storage) { _storage->resize(nbVoxels); return file.readVolume(_storage->data(), _cancelled); })) {
+        return false;
     }
-    else if (header.datatype == "uint32") {
-        errorLog() << "VolumeImage::volumeLoadVTK(): uint32 datatype not supported";
-        std::vector<uint32_t> imageData;
-        if (!ReadVTK::readData(filename, header, &imageData)) {
-            return false;
-        }
-        size_t nBytes = imageData.size() * sizeof(imageData[0]);
-        m_data.resize(nBytes);
-        std::memcpy(&m_data[0], &imageData[0], nBytes);
-    }
-    else if (header.datatype == "float32") {
-        errorLog() << "VolumeImage::volumeLoadVTK(): float32 datatype not supported";
-        std::vector<float> imageData;
-        if (!ReadVTK::readData(filename, header, &imageData)) {
-            return false;
+    auto tData = std::chrono::steady_clock::now();
+
+    std::cout << "    load timings (ms): header " << std::chrono::duration<double, std::milli>(tHeader - tStart).count()
+              << ", data " << std::chrono::duration<double, std::milli>(tData - tHeader).count() << std::endl;
+
+    return true;
+}
+
+
+// Reads a series of uncompressed DICOM slices, from a directory or from
+// one .dcm file of the series. Returns true on success, false otherwise.
+// Slice headers are parsed in parallel, slices are sorted along their
+// normal, then decoded in parallel straight into their Z offset.
+bool VolumeImg::volumeLoadDICOM(const std::string& path, const std::function<bool()>& _cancelled)
+{
+    auto tStart = std::chrono::steady_clock::now();
+
+    ReadDICOM::DICOMSeries series;
+    if (!ReadDICOM::readSeries(path, &series, _cancelled)) {
+        if (!_cancelled || !_cancelled()) {
+            errorLog() << "VolumeImage::volumeLoadDICOM(): no valid DICOM series in " << path;
         }
-        size_t nBytes = imageData.size() * sizeof(imageData[0]);
-        m_data.resize(nBytes);
-        std::memcpy(&m_data[0], &imageData[0], nBytes);
+        return false;
     }
-    else {
+    auto tHeader = std::chrono::steady_clock::now();
+
+    m_dimensions = series.dimensions;
+    m_origin = series.origin;
+    m_spacing = series.spacing;
+    m_datatype = series.datatype;
+    m_pendingSwap = false;
+    m_orientation = glm::mat3(series.slices.front().rowDirection, series.slices.front().columnDirection,
+                              glm::cross(series.slices.front().rowDirection, series.slices.front().columnDirection));
+
+    const ReadDICOM::DICOMSlice& first = series.slices.front();
+    std::cout << "[INFO] VolumeImage::volumeLoadDICOM(): load " << path << std::endl;
+    std::cout << std::endl << "    HEADER INFO:" << std::endl;
+    std::cout << "    dimension (x,y,z) :" << m_dimensions.x << " " << m_dimensions.y << " " << m_dimensions.z << std::endl;
+    std::cout << "    spacing (x,y,z) :" << m_spacing.x << " " << m_spacing.y << " " << m_spacing.z << std::endl;
+    std::cout << "    origin (x,y,z) :" << m_origin.x << " " << m_origin.y << " " << m_origin.z << std::endl;
+    std::cout << "    datatype :" << m_datatype << " (" << first.bitsStored << " bits stored, "
+              << (first.pixelRepresentation ? "signed" : "unsigned") << ")" << std::endl;
+    if (series.rescale)
+        std::cout << "    rescale (slope, intercept) :" << first.rescaleSlope << " " << first.rescaleIntercept << std::endl;
+    std::cout << std::endl;
+
+    size_t nbVoxels = size_t(m_dimensions.x) * size_t(m_dimensions.y) * size_t(m_dimensions.z);
+    if (!loadData(m_datatype, [&](auto* _storage) { _storage->resize(nbVoxels); return ReadDICOM::readPixels(series, _storage->data(), _cancelled); })) {
         return false;
     }
+    auto tData = std::chrono::steady_clock::now();
+
+    std::cout << "    load timings (ms): headers " << std::chrono::duration<double, std::milli>(tHeader - tStart).count()
+              << ", data " << std::chrono::duration<double, std::milli>(tData - tHeader).count() << std::endl;
 
     return true;
 }
 
 
-std::uint8_t VolumeImg::Int16ToUint8(std::int16_t _imageVal)
+// Reads a NIfTI-1 or NIfTI-2 volume (.nii, or gzip-compressed .nii.gz).
+// Returns true on success, false otherwise. Plain files are mapped and
+// used in place when voxels need no conversion; compressed files are
+// inflated in parallel when made of BGZF members (bgzip). Voxels are
+// rescaled with scl_slope / scl_inter, and origin, spacing and
+// orientation are taken from the sform, qform, or pixdim (in this order).
+bool VolumeImg::volumeLoadNIfTI(const std::string& filename, const std::function<bool()>& _cancelled)
 {
-    // first ensure that the value is in [-1024 ; 3071] (apply threshold if not)
-    _imageVal = std::max((std::int16_t )-1024, std::min((std::int16_t)3071, _imageVal));
-    // cross multiplication to convert value into [0 ; 255]
-    _imageVal = static_cast<int>(255.0f * ((float(_imageVal) + 1024.0f) / 4095.0f));
-    return std::uint8_t(_imageVal);
+    auto tStart = std::chrono::steady_clock::now();
+
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(filename)) {
+        return false;
+    }
+
+    ReadNIfTI::NIfTIHeader header;
+    if (!ReadNIfTI::readHeader(*file, &header)) {
+        errorLog() << "VolumeImage::volumeLoadNIfTI(): invalid header in " << filename;
+        return false;
+    }
+    auto tHeader = std::chrono::steady_clock::now();
+
+    m_dimensions = header.dimensions;
+    m_origin = header.origin;
+    m_spacing = header.spacing;
+    m_datatype = header.datatype;
+    for (int i = 0; i < 3; i++)
+        m_orientation[i] = glm::vec3(header.transform[i]) / m_spacing[i];
+
+    std::cout << "[INFO] VolumeImage::volumeLoadNIfTI(): load " << filename << std::endl;
+    std::cout << std::endl << "    HEADER INFO:" << std::endl;
+    std::cout << "    NIfTI-" << header.version << (header.compressed ? " (gzip)" : "") << std::endl;
+    std::cout << "    dimension (x,y,z) :" << m_dimensions.x << " " << m_dimensions.y << " " << m_dimensions.z << std::endl;
+    std::cout << "    spacing (x,y,z) :" << m_spacing.x << " " << m_spacing.y << " " << m_spacing.z << std::endl;
+    std::cout << "    origin (x,y,z) :" << m_origin.x << " " << m_origin.y << " " << m_origin.z << " (" << header.transformSource << ")" << std::endl;
+    std::cout << "    datatype :" << m_datatype << " (stored type " << header.storedType << (header.bigEndian ? ", big endian)" : ", little endian)") << std::endl;
+    if (header.rescale)
+        std::cout << "    rescale (slope, intercept) :" << header.sclSlope << " " << header.sclInter << std::endl;
+    std::cout << std::endl;
+    if (header.nbVolumes > 1)
+        warningLog() << "VolumeImage::volumeLoadNIfTI(): " << header.nbVolumes << " volumes in file, only the first one is loaded";
+
+    // Read data: used in place if possible, byte swap then left to processSlab()
+    m_pendingSwap = !ReadNIfTI::needsConversion(header) && (header.bigEndian != (std::endian::native == std::endian::big));
+    if (!loadData(header.datatype, [&](auto* _storage) { return ReadNIfTI::readData(file, header, _storage, false, _cancelled); })) {
+        return false;
+    }
+    auto tData = std::chrono::steady_clock::now();
+
+    std::cout << "    load timings (ms): header " << std::chrono::duration<double, std::milli>(tHeader - tStart).count()
+              << ", data " << std::chrono::duration<double, std::milli>(tData - tHeader).count() << std::endl;
+
+    return true;
 }
 
 
-void VolumeImg::convertInt16ToUint8(std::vector<int16_t>* _imageData)
+bool VolumeImg::volumeSaveVVol(const std::string& filename, const std::function<bool()>& _cancelled)
 {
-    for (int id = 0; id < m_dimensions.x * m_dimensions.y * m_dimensions.z; id++)
+    VVolFile::DataType dataType;
+    switch (m_format)
     {
-        float value = (*_imageData)[id];
-        // int16bit data are encoded on 4095 values contained in [-1024 ; 3071]
+        case FORMAT_UINT8:  dataType = VVolFile::TYPE_UINT8; break;
+        case FORMAT_UINT16: dataType = VVolFile::TYPE_UINT16; break;
+        case FORMAT_INT16:  dataType = VVolFile::TYPE_INT16; break;
+        default:            dataType = VVolFile::TYPE_FLOAT32; break;
+    }
+
+    bool saved = false;
+    visit([&](auto& _vol)
+    {
+        saved = VVolFile::write(filename, _vol.getFront(), dataType, m_dimensions, m_origin, m_spacing,
+                                VVolFile::DEFAULT_BRICK_SIZE, m_pendingSwap, _cancelled);
+    });
+    return saved;
+}
 
-        // first ensure that the value is in [-1024 ; 3071] (apply threshold if not)
-        value = std::max(-1024.0f, std::min(3071.0f, value));
-        // cross multiplication to convert value into [0 ; 255]
-        value = 255.0f * ((value + 1024.0f) / 4095.0f);
-        m_data[id] = static_cast<int>(value);
+
+glm::vec2 VolumeImg::windowToTexture(glm::vec2 _window)
+{
+    switch (m_format)
+    {
+        case FORMAT_UINT8:
+            return _window / 255.0f;    // GL_R8, normalized
+        case FORMAT_UINT16:
+            return _window / 65535.0f;  // GL_R16, normalized
+        case FORMAT_INT16:
+            return _window / 32767.0f;  // GL_R16_SNORM, normalized
+        default:
+            return _window;             // GL_R32F
     }
 }
+
+
+std::uint64_t VolumeImg::getContentHash()
+{
+    if (!m_contentHashValid)
+    {
+        visit([&](auto& _vol)
+        {
+            m_contentHash = DerivedCache::contentHash(_vol.getFront(), _vol.getStorage().size() * sizeof(*_vol.getFront()));
+        });
+
+        char attributes[64];
+        std::snprintf(attributes, sizeof(attributes), "%d %d %d %d", m_dimensions.x, m_dimensions.y, m_dimensions.z, int(m_format));
+        m_contentHash = DerivedCache::combineHash(m_contentHash, attributes);
+        m_contentHashValid = true;
+    }
+    return m_contentHash;
+}
+
+
+void VolumeImg::resetWideVolume()
+{
+    m_wideVolume = std::monostate();
+    m_format = FORMAT_UINT8;
+}
+
+
+void VolumeImg::processSlab(int _zBegin, int _zEnd, glm::vec2* _range)
+{
+    visit([&](auto& _vol)
+    {
+        using VoxelType = std::decay_t<decltype(*_vol.getFront())>;
+        size_t sliceSize = size_t(m_dimensions.x) * size_t(m_dimensions.y);
+        VoxelType* slab = _vol.getFront() + size_t(_zBegin) * sliceSize;
+        size_t nbElem = size_t(_zEnd - _zBegin) * sliceSize;
+        if (nbElem == 0)
+            return;
+
+        if constexpr (sizeof(VoxelType) > 1)
+        {
+            if (m_pendingSwap)
+                VoxelConvert::swapBytes(slab, nbElem);
+        }
+
+        float minVal, maxVal;
+        if constexpr (std::is_same_v<VoxelType, uint8_t>)
+        {
+            auto minMax = std::minmax_element(slab, slab + nbElem);
+            minVal = *minMax.first;
+            maxVal = *minMax.second;
+        }
+        else
+            VoxelConvert::valueRange(slab, nbElem, false, &minVal, &maxVal);
+
+        _range->x = std::min(_range->x, minVal);
+        _range->y = std::max(_range->y, maxVal);
+    });
+}
+
+
+void VolumeImg::finishLoad(glm::vec2 _range)
+{
+    m_pendingSwap = false;
+    setValueRange(_range);
+}
+
+
+void VolumeImg::dataModified()
+{
+    m_contentHashValid = false;
+    updateValueRange();
+}
+
+
+void VolumeImg::setValueRange(glm::vec2 _range)
+{
+    // empty range (no data)
+    if (_range.y < _range.x)
+        _range = glm::vec2(0.0f);
+
+    m_valueRange = _range;
+
+    if (m_format == FORMAT_UINT8)
+        m_defaultWindow = glm::vec2(0.0f, 255.0f);
+    else if (m_format == FORMAT_INT16)
+        m_defaultWindow = glm::vec2(-1024.0f, 3071.0f); // CT data are encoded on 4095 values contained in [-1024 ; 3071]
+    else if (_range.y > _range.x)
+        m_defaultWindow = m_valueRange;
+    else
+        m_defaultWindow = glm::vec2(_range.x, _range.x + 1.0f);
+}
+
+
+void VolumeImg::updateValueRange()
+{
+    glm::vec2 range(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+    processSlab(0, m_dimensions.z, &range);
+    m_pendingSwap = false;
+    setValueRange(range);
+
+    std::cout << "[INFO] VolumeImg::updateValueRange(): values in [" << m_valueRange.x << " ; " << m_valueRange.y << "], default window ["
+              << m_defaultWindow.x << " ; " << m_defaultWindow.y << "]" << std::endl;
+}
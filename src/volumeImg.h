@@ -2,8 +2,8 @@
  *
  * volumeImg.h
  *
- * 8b 3D image
- * 
+ * 3D image (8b, 16b, or float data)
+ *
  * Vol_viewer
  * Ludovic Blache
  *
@@ -17,39 +17,294 @@
 
 
 #include "volumeBase.h"
+#include "parallel.h"
+#include "voxelConvert.h"
+#include "derivedCache.h"
 
 #include <fstream>
+#include <variant>
+#include <functional>
+#include <type_traits>
 
 
 /*!
 * \class VolumeImg
-* \brief Represents a 3D image with 8b data
-* Uses beamformer to update its content from ultrasound data
+* \brief Represents a 3D image with 8b data, or native 16b / float data
+* 8b data are stored in the VolumeBase<uint8_t> parent, other types in a VolumeBase of matching type
+* (data are never quantized: window/level is applied at rendering time)
 */
 class VolumeImg : public VolumeBase<uint8_t>
 {
 
     public:
 
+        /*! Voxel format of the volume (i.e. which VolumeBase holds the data) */
+        enum VoxelFormat { FORMAT_UINT8, FORMAT_UINT16, FORMAT_INT16, FORMAT_FLOAT32 };
+
         VolumeImg() : VolumeBase<uint8_t>() {}
 
         virtual ~VolumeImg() {m_data.clear();}
 
         void volumeInit();
 
-        void volumeLoad(const std::string& filename);
+        /*!
+        * \fn volumeInitHeader
+        * \brief Set the attributes of a volume whose data are not held in memory (e.g. paged from disk, see BrickPager)
+        * \param _datatype : "uint8", "uint16", "int16", or "float32"
+        * \param _dimensions, _origin, _spacing : volume attributes
+        * \param _range : [min ; max] voxel values (native units)
+        * \return true if the datatype is supported, false otherwise
+        */
+        bool volumeInitHeader(const std::string& _datatype, glm::ivec3 _dimensions, glm::vec3 _origin, glm::vec3 _spacing, glm::vec2 _range);
+
+        /*!
+        * \fn volumeLoad
+        * \brief Load a volume from a file (.vtk, .raw, .mhd/.mha, .nhdr/.nrrd, .nii/.nii.gz, .vvol) or a DICOM series (directory or .dcm file)
+        * \param filename : name of file to load
+        * \param _deferred : if true, only the header is read and data are mapped:
+        *                   data must then be finished slab by slab with processSlab() (e.g. on a loader thread)
+        * \param _cancelled : if set, polled while decoding (compressed, ASCII, DICOM or .vvol data):
+        *                    loading stops (and fails) when it returns true
+        * \return true if loading succeeded, false otherwise
+        */
+        bool volumeLoad(const std::string& filename, bool _deferred = false, const std::function<bool()>& _cancelled = nullptr);
+
+        /*!
+        * \fn volumeSaveVVol
+        * \brief Save the volume into a native .vvol file (compressed bricks, see VVolFile)
+        * Data of a deferred load need not be processed first: a pending byte swap is applied brick by brick while
+        * writing, without modifying the (mapped) data.
+        * \param filename : name of file to write
+        * \param _cancelled : if set, polled while writing: saving stops (and fails) when it returns true
+        * \return true if saving succeeded, false otherwise
+        */
+        bool volumeSaveVVol(const std::string& filename, const std::function<bool()>& _cancelled = nullptr);
+
+        /*!
+        * \fn processSlab
+        * \brief Finish loading of slices [_zBegin ; _zEnd[ (pending byte swap) and extend a value range with their values
+        * Slabs can be processed concurrently with rendering, but each slab by a single thread.
+        * \param _zBegin : first slice of the slab
+        * \param _zEnd : slice after the last one of the slab
+        * \param _range : [min ; max] value range to extend
+        */
+        void processSlab(int _zBegin, int _zEnd, glm::vec2* _range);
+
+        /*!
+        * \fn finishLoad
+        * \brief End a deferred load, once all slabs are processed
+        * \param _range : [min ; max] value range of all slabs
+        */
+        void finishLoad(glm::vec2 _range);
+
+        /*!
+        * \fn dataModified
+        * \brief Update value range, default window and content hash after voxel data were modified in place (e.g. filtered)
+        */
+        void dataModified();
+
+        /*! \fn getVoxelFormat */
+        inline VoxelFormat getVoxelFormat() { return m_format; }
+        /*! \fn getValueRange : min and max voxel values (native units) */
+        inline glm::vec2 getValueRange() { return m_valueRange; }
+        /*! \fn getDefaultWindow : window [low ; high] to use after loading (native units) */
+        inline glm::vec2 getDefaultWindow() { return m_defaultWindow; }
+        /*! \fn getOrientation : directions (columns) of the voxel axes in world coordinates, as given by the file */
+        inline glm::mat3 getOrientation() { return m_orientation; }
+        /*! \fn setOrientation : set directions (columns) of the voxel axes in world coordinates */
+        inline void setOrientation(const glm::mat3& _orientation) { m_orientation = _orientation; }
+
+        /*!
+        * \fn windowToTexture
+        * \brief Convert a window [low ; high] from native units to 3D texture units
+        * (i.e. values returned by texture() in shaders, normalized for integer formats)
+        * \param _window : window in native units
+        * \return window in texture units
+        */
+        glm::vec2 windowToTexture(glm::vec2 _window);
+
+        /*!
+        * \fn getContentHash
+        * \brief Hash of the voxel data, dimensions and format (computed on first call after loading)
+        */
+        std::uint64_t getContentHash();
+
+        /*!
+        * \fn derivedData
+        * \brief Get data derived from this volume from the disk cache (see DerivedCache), or compute and cache them
+        * \param _name : kind of data (e.g. "gradient")
+        * \param _version : version of the algorithm and format of the data, to increment on any change of the result
+        * (so that entries cached by previous versions are not reused)
+        * \param _params : processing parameters (anything changing the result)
+        * \param _out : derived data
+        * \param _compute : function bool(VoxelStorage<T>*) computing the data, called on cache miss only
+        * \return true if data were read from the cache or computed, false otherwise
+        */
+        template <typename T, typename ComputeFunc>
+        bool derivedData(const std::string& _name, int _version, const std::string& _params, VoxelStorage<T>* _out, ComputeFunc&& _compute);
+
+        /*!
+        * \fn visit
+        * \brief Call _func(VolumeBase<T>&) on the volume holding the data, whatever its voxel type
+        */
+        template <typename Func>
+        void visit(Func&& _func);
 
-        
 
     protected:
 
-        bool volumeLoadVTK(const std::string& filename);
+        VoxelFormat m_format = FORMAT_UINT8;                    /*!< voxel format */
+        glm::vec2 m_valueRange = glm::vec2(0.0f, 255.0f);      /*!< min and max voxel values */
+        glm::vec2 m_defaultWindow = glm::vec2(0.0f, 255.0f);   /*!< default window [low ; high] */
+        glm::mat3 m_orientation = glm::mat3(1.0f);             /*!< directions of the voxel axes in world coordinates */
+        bool m_pendingSwap = false;                             /*!< data are mapped in file byte order, not swapped yet */
+        std::uint64_t m_contentHash = 0;                        /*!< hash of voxel data (see getContentHash()) */
+        bool m_contentHashValid = false;                        /*!< m_contentHash is up to date */
+
+        /*! 16b or float volume (monostate for 8b data, stored in VolumeBase<uint8_t> parent) */
+        std::variant<std::monostate, VolumeBase<uint16_t>, VolumeBase<int16_t>, VolumeBase<float>> m_wideVolume;
+
+        bool volumeLoadVTK(const std::string& filename, const std::function<bool()>& _cancelled);
         bool volumeLoadRAW(const std::string& filename);
+        bool volumeLoadRawHeader(const std::string& filename);
+        bool volumeLoadVVol(const std::string& filename, const std::function<bool()>& _cancelled);
+        bool volumeLoadDICOM(const std::string& path, const std::function<bool()>& _cancelled);
+        bool volumeLoadNIfTI(const std::string& filename, const std::function<bool()>& _cancelled);
+
+        /*!
+        * \fn resetWideVolume
+        * \brief Switch back to 8b data (releases 16b / float data)
+        */
+        void resetWideVolume();
+
+        /*!
+        * \fn makeWideVolume
+        * \brief Create a 16b / float volume with the same attributes (dimensions, spacing, etc.) as this one
+        * 8b data are released.
+        * \param _format : voxel format matching VoxelType
+        * \return new volume, to be filled with data
+        */
+        template <typename VoxelType>
+        VolumeBase<VoxelType>& makeWideVolume(VoxelFormat _format);
+
+        /*!
+        * \fn loadData
+        * \brief Create the volume matching a datatype and fill it with _mapFunc
+        * (uint32 data are converted to float32)
+        * \param _datatype : "uint8", "uint16", "int16", "uint32", or "float32"
+        * \param _mapFunc : generic function bool(VoxelStorage<VoxelType>*) filling the storage (e.g. mapping a file)
+        * \return true if data were loaded
+        */
+        template <typename MapFunc>
+        bool loadData(const std::string& _datatype, MapFunc&& _mapFunc);
+
+        /*!
+        * \fn setValueRange
+        * \brief Set min and max voxel values (native units), and update default window accordingly
+        */
+        void setValueRange(glm::vec2 _range);
 
-        std::uint8_t Int16ToUint8(std::int16_t _imageVal);
-        void convertInt16ToUint8(std::vector<int16_t>* _imageData);
+        /*!
+        * \fn updateValueRange
+        * \brief Compute value range and default window of current data (applies pending byte swap)
+        */
+        void updateValueRange();
 
 
 };
 
+
+template <typename Func>
+void VolumeImg::visit(Func&& _func)
+{
+    if (std::holds_alternative<std::monostate>(m_wideVolume))
+    {
+        _func(static_cast<VolumeBase<uint8_t>&>(*this));
+        return;
+    }
+
+    std::visit([&](auto& _vol)
+    {
+        if constexpr (!std::is_same_v<std::decay_t<decltype(_vol)>, std::monostate>)
+            _func(_vol);
+    }, m_wideVolume);
+}
+
+
+template <typename VoxelType>
+VolumeBase<VoxelType>& VolumeImg::makeWideVolume(VoxelFormat _format)
+{
+    m_data.clear();
+    m_format = _format;
+
+    VolumeBase<VoxelType>& vol = m_wideVolume.template emplace<VolumeBase<VoxelType>>();
+    vol.setDimensions(m_dimensions);
+    vol.setOrigin(m_origin);
+    vol.setSpacing(m_spacing);
+    vol.setDatatype(m_datatype);
+    return vol;
+}
+
+
+template <typename T, typename ComputeFunc>
+bool VolumeImg::derivedData(const std::string& _name, int _version, const std::string& _params, VoxelStorage<T>* _out, ComputeFunc&& _compute)
+{
+    std::uint64_t key = DerivedCache::combineHash(getContentHash(), _name + "|v" + std::to_string(_version) + "|" + _params);
+    if (DerivedCache::load(_name, key, _out))
+        return true;
+
+    if (!_compute(_out))
+        return false;
+
+    DerivedCache::store(_name, key, *_out);
+    return true;
+}
+
+
+template <typename MapFunc>
+bool VolumeImg::loadData(const std::string& _datatype, MapFunc&& _mapFunc)
+{
+    if (_datatype == "uint8")
+    {
+        resetWideVolume();
+        return _mapFunc(&m_data);
+    }
+    else if (_datatype == "uint16")
+    {
+        return _mapFunc(&makeWideVolume<uint16_t>(FORMAT_UINT16).getStorage());
+    }
+    else if (_datatype == "int16")
+    {
+        return _mapFunc(&makeWideVolume<int16_t>(FORMAT_INT16).getStorage());
+    }
+    else if (_datatype == "uint32")
+    {
+        warningLog() << "VolumeImg::loadData(): uint32 datatype converted to float32";
+        VoxelStorage<uint32_t> imageData;
+        if (!_mapFunc(&imageData))
+            return false;
+        if (m_pendingSwap)
+        {
+            VoxelConvert::swapBytes(imageData.data(), imageData.size());
+            m_pendingSwap = false;
+        }
+
+        VoxelStorage<float>& data = makeWideVolume<float>(FORMAT_FLOAT32).getStorage();
+        data.resize(imageData.size());
+        Parallel::parallelFor(0, imageData.size(), [&](size_t _first, size_t _last)
+        {
+            for (size_t i = _first; i < _last; i++)
+                data[i] = static_cast<float>(imageData[i]);
+        }, 1 << 16);
+        return true;
+    }
+    else if (_datatype == "float32")
+    {
+        return _mapFunc(&makeWideVolume<float>(FORMAT_FLOAT32).getStorage());
+    }
+
+    errorLog() << "VolumeImg::loadData(): unsupported datatype " << _datatype;
+    return false;
+}
+
 #endif // VOLUMEIMG_H
\ No newline at end of file
@@ -0,0 +1,147 @@
+/*********************************************************************************************************************
+ *
+ * volumeLoader.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "volumeLoader.h"
+
+
+// Size (in bytes) aimed for a slab: small enough to be uploaded within
+// a frame, large enough to keep the number of upload calls low
+static const size_t SLAB_SIZE = 16 * 1024 * 1024;
+
+
+float VolumeLoader::getProgress() const
+{
+    LoadState state = getState();
+    if (state == LOAD_IDLE)
+        return 1.0f;
+    if ((state != LOAD_DATA && state != LOAD_DONE) || m_nbSlabs == 0)
+        return 0.0f;
+
+    return float(m_nbSlabsUploaded) / float(m_nbSlabs);
+}
+
+
+void VolumeLoader::start(const std::string& _fileName)
+{
+    cancel();
+
+    m_volume = std::make_shared<VolumeImg>();
+    m_fileName = _fileName;
+    m_nbSlabs = 0;
+    m_slabDepth = 1;
+    m_nbSlabsUploaded = 0;
+    m_nbSlabsReady.store(0);
+    m_cancel.store(false);
+    m_state.store(LOAD_HEADER, std::memory_order_release);
+
+    m_thread = std::thread(&VolumeLoader::run, this);
+}
+
+
+void VolumeLoader::cancel()
+{
+    if (m_thread.joinable())
+    {
+        m_cancel.store(true);
+        m_thread.join();
+    }
+
+    if (getState() != LOAD_IDLE)
+    {
+        if (isLoading())
+            std::cout << "[INFO] VolumeLoader::cancel(): load of " << m_fileName << " cancelled" << std::endl;
+        m_state.store(LOAD_IDLE, std::memory_order_release);
+    }
+}
+
+
+bool VolumeLoader::nextSlab(int* _zBegin, int* _zEnd)
+{
+    LoadState state = getState();
+    if (state != LOAD_DATA && state != LOAD_DONE)
+        return false;
+
+    // acquire: the slab data written by the loader thread are visible
+    if (m_nbSlabsUploaded >= m_nbSlabsReady.load(std::memory_order_acquire))
+        return false;
+
+    *_zBegin = m_nbSlabsUploaded * m_slabDepth;
+    *_zEnd = std::min(*_zBegin + m_slabDepth, m_volume->getDimensions().z);
+    m_nbSlabsUploaded++;
+    return true;
+}
+
+
+bool VolumeLoader::finish()
+{
+    if (getState() != LOAD_DONE || m_nbSlabsUploaded < m_nbSlabs)
+        return false;
+
+    m_thread.join();
+    m_volume->finishLoad(m_valueRange);
+    m_state.store(LOAD_IDLE, std::memory_order_release);
+
+    std::cout << "[INFO] VolumeLoader::finish(): " << m_fileName << " loaded, values in [" << m_valueRange.x << " ; " << m_valueRange.y
+              << "], default window [" << m_volume->getDefaultWindow().x << " ; " << m_volume->getDefaultWindow().y << "]" << std::endl;
+    return true;
+}
+
+
+void VolumeLoader::run()
+{
+    auto tStart = std::chrono::steady_clock::now();
+
+    // read header and map data (decoding of compressed, ASCII, DICOM or .vvol data stops as soon as the load is cancelled,
+    // so that cancel() or start() do not wait for it)
+    if (!m_volume->volumeLoad(m_fileName, true, [this] { return m_cancel.load(); }))
+    {
+        if (m_cancel.load())
+            return;
+        errorLog() << "VolumeLoader::run(): could not load " << m_fileName;
+        m_state.store(LOAD_FAILED, std::memory_order_release);
+        return;
+    }
+
+    // split volume into slabs of Z slices
+    glm::ivec3 dim = m_volume->getDimensions();
+    size_t voxelSize = (m_volume->getVoxelFormat() == VolumeImg::FORMAT_UINT8) ? 1 :
+                       (m_volume->getVoxelFormat() == VolumeImg::FORMAT_FLOAT32) ? 4 : 2;
+    size_t sliceSize = std::max(size_t(1), size_t(dim.x) * size_t(dim.y) * voxelSize);
+    m_slabDepth = std::max(1, std::min(dim.z, int(SLAB_SIZE / sliceSize)));
+    m_nbSlabs = (dim.z + m_slabDepth - 1) / m_slabDepth;
+    m_state.store(LOAD_DATA, std::memory_order_release);
+
+    // finish slabs (byte swap, value range), which also brings mapped data into memory
+    glm::vec2 range(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+    for (int s = 0; s < m_nbSlabs; s++)
+    {
+        if (m_cancel.load())
+            return;
+
+        int zBegin = s * m_slabDepth;
+        m_volume->processSlab(zBegin, std::min(zBegin + m_slabDepth, dim.z), &range);
+        m_nbSlabsReady.store(s + 1, std::memory_order_release);
+    }
+
+    // content hash (key of derived data in the disk cache), computed here rather than on the render thread
+    m_volume->getContentHash();
+
+    m_valueRange = range;
+    m_state.store(LOAD_DONE, std::memory_order_release);
+
+    auto tEnd = std::chrono::steady_clock::now();
+    std::cout << "[INFO] VolumeLoader::run(): " << m_nbSlabs << " slabs of " << m_slabDepth << " slices read in "
+              << std::chrono::duration<double, std::milli>(tEnd - tStart).count() << " ms" << std::endl;
+}
@@ -0,0 +1,140 @@
+/*********************************************************************************************************************
+ *
+ * volumeLoader.h
+ *
+ * Background loading of a volume, slab by slab
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef VOLUMELOADER_H
+#define VOLUMELOADER_H
+
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "volumeImg.h"
+
+
+/*!
+* \class VolumeLoader
+* \brief Loads a volume on a background thread
+* The loader thread reads the header and maps the data (see VolumeImg::volumeLoad()), then finishes the volume
+* slab by slab (i.e. groups of Z slices, see VolumeImg::processSlab()). The render thread polls the loader every
+* frame: it can switch to the new volume as soon as its header is read, and upload finished slabs into the 3D texture
+* (see nextSlab()) within a time budget, so that the viewer stays interactive while the volume fills in.
+* Only the render thread calls the public functions.
+*/
+class VolumeLoader
+{
+    public:
+
+        /*! State of the loader */
+        enum LoadState { LOAD_IDLE, LOAD_HEADER, LOAD_DATA, LOAD_DONE, LOAD_FAILED };
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                        CONSTRUCTORS / DESTRUCTORS                                           |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        VolumeLoader() {}
+
+        virtual ~VolumeLoader() { cancel(); }
+
+        VolumeLoader(const VolumeLoader&) = delete;
+        VolumeLoader& operator=(const VolumeLoader&) = delete;
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                GETTERS                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*! \fn getState */
+        inline LoadState getState() const { return m_state.load(std::memory_order_acquire); }
+        /*! \fn isLoading : a load is running (header, data, or upload of finished slabs) */
+        inline bool isLoading() const { LoadState state = getState(); return state == LOAD_HEADER || state == LOAD_DATA || state == LOAD_DONE; }
+        /*! \fn getVolume : volume being loaded (dimensions and format are valid from LOAD_DATA state) */
+        inline std::shared_ptr<VolumeImg> getVolume() { return m_volume; }
+        /*! \fn getFileName */
+        inline const std::string& getFileName() const { return m_fileName; }
+
+        /*!
+        * \fn getProgress
+        * \brief Fraction of the volume uploaded into the 3D texture, in [0 ; 1]
+        */
+        float getProgress() const;
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                   MISC                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*!
+        * \fn start
+        * \brief Start loading a volume on the loader thread (cancels the current load, if any)
+        * \param _fileName : name of file to load
+        */
+        void start(const std::string& _fileName);
+
+        /*!
+        * \fn cancel
+        * \brief Stop the current load (waits for the loader thread)
+        * The volume keeps the slabs loaded so far.
+        */
+        void cancel();
+
+        /*!
+        * \fn nextSlab
+        * \brief Get the next slab finished by the loader thread and not uploaded yet
+        * \param _zBegin : first slice of the slab
+        * \param _zEnd : slice after the last one of the slab
+        * \return true if a slab is available (it is then considered as uploaded)
+        */
+        bool nextSlab(int* _zBegin, int* _zEnd);
+
+        /*!
+        * \fn finish
+        * \brief End the load once all slabs are uploaded: set the value range of the volume
+        * \return true if the load just ended (i.e. once per load)
+        */
+        bool finish();
+
+
+    protected:
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                ATTRIBUTES                                                   |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        std::thread m_thread;                               /*!< loader thread */
+        std::atomic<LoadState> m_state = LOAD_IDLE;         /*!< current state (written by loader thread until LOAD_DONE) */
+        std::atomic<bool> m_cancel = false;                 /*!< cancel request for the loader thread */
+        std::atomic<int> m_nbSlabsReady = 0;                /*!< number of slabs finished by the loader thread */
+
+        std::shared_ptr<VolumeImg> m_volume;                /*!< volume being loaded */
+        std::string m_fileName;                             /*!< name of file being loaded */
+        int m_nbSlabs = 0;                                  /*!< number of slabs (valid from LOAD_DATA state) */
+        int m_slabDepth = 1;                                /*!< number of slices per slab (valid from LOAD_DATA state) */
+        int m_nbSlabsUploaded = 0;                          /*!< number of slabs returned by nextSlab() */
+        glm::vec2 m_valueRange = glm::vec2(0.0f);           /*!< value range of the volume (valid from LOAD_DONE state) */
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                   MISC                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*!
+        * \fn run
+        * \brief Body of the loader thread
+        */
+        void run();
+
+};
+
+#endif // VOLUMELOADER_H
@@ -0,0 +1,539 @@
+/*********************************************************************************************************************
+ *
+ * volumeResampler.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include "volumeResampler.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "volumeImg.h"
+#include "parallel.h"
+#include "simd.h"
+
+
+namespace VolumeResampler
+{
+
+namespace
+{
+    // side of the blocks of voxels reoriented by a task
+    const size_t blockSize = 16;
+
+    // half width of the Lanczos kernel, in voxels of the coarsest grid
+    const int lanczosLobes = 3;
+
+
+    /*!
+    * \fn toVoxel
+    * \brief Convert an interpolated value to the voxel type (rounded as floor(x + 0.5) and clamped for integer types)
+    */
+    template <typename VoxelType>
+    inline VoxelType toVoxel(float _v)
+    {
+        if constexpr (std::is_floating_point_v<VoxelType>)
+            return _v;
+        else
+        {
+            _v = std::floor(_v + 0.5f);
+            _v = std::min(std::max(_v, float(std::numeric_limits<VoxelType>::lowest())), float(std::numeric_limits<VoxelType>::max()));
+            return VoxelType(_v);
+        }
+    }
+
+    /*!
+    * \fn datatypeName
+    * \brief Datatype of a voxel type, as given to VolumeImg::volumeInitHeader()
+    */
+    template <typename VoxelType>
+    const char* datatypeName()
+    {
+        if constexpr (std::is_same_v<VoxelType, std::uint16_t>)
+            return "uint16";
+        else if constexpr (std::is_same_v<VoxelType, std::int16_t>)
+            return "int16";
+        else if constexpr (std::is_same_v<VoxelType, float>)
+            return "float32";
+        else
+            return "uint8";
+    }
+
+    /*!
+    * \fn clampIndex
+    * \brief Index clamped to [0 ; _extent - 1] (border voxels repeated)
+    */
+    inline std::int64_t clampIndex(std::int64_t _id, size_t _extent)
+    {
+        return std::min(std::max<std::int64_t>(_id, 0), std::int64_t(_extent) - 1);
+    }
+
+    /*!
+    * \fn positiveSpacing
+    * \brief Spacing with positive components (1 for null ones)
+    */
+    glm::vec3 positiveSpacing(glm::vec3 _spacing)
+    {
+        for (int a = 0; a < 3; a++)
+            _spacing[a] = _spacing[a] != 0.0f ? std::abs(_spacing[a]) : 1.0f;
+        return _spacing;
+    }
+
+    /*!
+    * \fn lanczos
+    * \brief Lanczos kernel sinc(x) * sinc(x / lobes), null beyond lobes
+    */
+    float lanczos(float _x)
+    {
+        const float pi = 3.14159265358979f;
+        _x = std::abs(_x);
+        if (_x < 1.0e-6f)
+            return 1.0f;
+        if (_x >= float(lanczosLobes))
+            return 0.0f;
+        float px = pi * _x;
+        return float(lanczosLobes) * std::sin(px) * std::sin(px / float(lanczosLobes)) / (px * px);
+    }
+
+
+    /*!
+    * \struct AxisTaps
+    * \brief Source voxels (clamped to the grid) and normalized weights of the output voxels along an axis
+    */
+    struct AxisTaps
+    {
+        int nbTaps = 1;                     /*!< number of taps of each output voxel */
+        std::vector<std::int64_t> index;    /*!< source voxels, nbTaps per output voxel */
+        std::vector<float> weights;         /*!< weights, nbTaps per output voxel */
+    };
+
+    /*!
+    * \fn axisTaps
+    * \brief Taps of the output voxels along an axis (grids aligned on their bounds)
+    */
+    AxisTaps axisTaps(size_t _srcExtent, size_t _dstExtent, Kernel _kernel)
+    {
+        AxisTaps taps;
+        const double scale = double(_srcExtent) / double(_dstExtent);
+        const double filterScale = std::max(1.0, scale);
+
+        // same grid: copy
+        if (_srcExtent == _dstExtent)
+            _kernel = KERNEL_NEAREST;
+        if (_kernel == KERNEL_TRILINEAR)
+            taps.nbTaps = 2;
+        else if (_kernel == KERNEL_LANCZOS)
+            taps.nbTaps = 2 * int(std::ceil(lanczosLobes * filterScale));
+
+        taps.index.resize(_dstExtent * size_t(taps.nbTaps));
+        taps.weights.resize(_dstExtent * size_t(taps.nbTaps));
+        for (size_t o = 0; o < _dstExtent; o++)
+        {
+            // position of the output voxel center in source voxels
+            double center = (double(o) + 0.5) * scale - 0.5;
+            std::int64_t base = std::int64_t(std::floor(center));
+            std::int64_t* index = taps.index.data() + o * size_t(taps.nbTaps);
+            float* weights = taps.weights.data() + o * size_t(taps.nbTaps);
+
+            if (_kernel == KERNEL_NEAREST)
+            {
+                index[0] = clampIndex(std::int64_t(std::floor(center + 0.5)), _srcExtent);
+                weights[0] = 1.0f;
+            }
+            else if (_kernel == KERNEL_TRILINEAR)
+            {
+                float f = float(center - double(base));
+                index[0] = clampIndex(base, _srcExtent);
+                index[1] = clampIndex(base + 1, _srcExtent);
+                weights[0] = 1.0f - f;
+                weights[1] = f;
+            }
+            else
+            {
+                // voxels within the support, i.e. [base - radius + 1 ; base + radius]
+                float sum = 0.0f;
+                for (int t = 0; t < taps.nbTaps; t++)
+                {
+                    std::int64_t i = base - taps.nbTaps / 2 + 1 + t;
+                    index[t] = clampIndex(i, _srcExtent);
+                    weights[t] = lanczos(float((double(i) - center) / filterScale));
+                    sum += weights[t];
+                }
+                for (int t = 0; t < taps.nbTaps; t++)
+                    weights[t] /= sum;
+            }
+        }
+        return taps;
+    }
+
+
+#if defined(SIMD_X86)
+    // AVX2 versions of the row kernels below, 8 voxels at a time,
+    // returning the number of voxels processed (the remaining ones are left to the scalar loops)
+
+    SIMD_TARGET_AVX2 size_t scaleRowAVX2(float* _dst, const float* _src, float _w, size_t _n)
+    {
+        size_t x = 0;
+        const __m256 w = _mm256_set1_ps(_w);
+        for (; x + 8 <= _n; x += 8)
+            _mm256_storeu_ps(_dst + x, _mm256_mul_ps(w, _mm256_loadu_ps(_src + x)));
+        return x;
+    }
+
+    SIMD_TARGET_AVX2 size_t accumulateRowAVX2(float* _acc, const float* _src, float _w, size_t _n)
+    {
+        size_t x = 0;
+        const __m256 w = _mm256_set1_ps(_w);
+        for (; x + 8 <= _n; x += 8)
+            _mm256_storeu_ps(_acc + x, _mm256_add_ps(_mm256_loadu_ps(_acc + x), _mm256_mul_ps(w, _mm256_loadu_ps(_src + x))));
+        return x;
+    }
+#endif
+
+    /*!
+    * \fn scaleRow
+    * \brief _dst = _w * _src
+    */
+    void scaleRow(float* _dst, const float* _src, float _w, size_t _n)
+    {
+        size_t x = 0;
+#if defined(SIMD_X86)
+        if (Simd::hasAVX2())
+            x = scaleRowAVX2(_dst, _src, _w, _n);
+#endif
+        for (; x < _n; x++)
+            _dst[x] = _w * _src[x];
+    }
+
+    /*!
+    * \fn accumulateRow
+    * \brief _acc += _w * _src
+    */
+    void accumulateRow(float* _acc, const float* _src, float _w, size_t _n)
+    {
+        size_t x = 0;
+#if defined(SIMD_X86)
+        if (Simd::hasAVX2())
+            x = accumulateRowAVX2(_acc, _src, _w, _n);
+#endif
+        for (; x < _n; x++)
+            _acc[x] += _w * _src[x];
+    }
+
+    /*!
+    * \fn combineLines
+    * \brief Weighted sum of the lines of the taps of an output line
+    * \param _dst : result
+    * \param _line : function const float*(source index) giving a source line
+    */
+    template <typename LineFunc>
+    void combineLines(float* _dst, size_t _n, const AxisTaps& _taps, size_t _output, LineFunc&& _line)
+    {
+        const std::int64_t* index = _taps.index.data() + _output * size_t(_taps.nbTaps);
+        const float* weights = _taps.weights.data() + _output * size_t(_taps.nbTaps);
+        scaleRow(_dst, _line(index[0]), weights[0], _n);
+        for (int t = 1; t < _taps.nbTaps; t++)
+            accumulateRow(_dst, _line(index[t]), weights[t], _n);
+    }
+
+    /*!
+    * \fn resampleSlice
+    * \brief Resample a source slice along x, then y
+    * \param _slice : voxels of the slice
+    * \param _tmp : buffer of output nx * source ny values
+    * \param _out : resampled slice (output nx * output ny)
+    */
+    template <typename VoxelType>
+    void resampleSlice(const VoxelType* _slice, size_t _nx, size_t _ny, const AxisTaps& _tx, const AxisTaps& _ty,
+                       size_t _mx, size_t _my, float* _tmp, float* _out)
+    {
+        for (size_t j = 0; j < _ny; j++)
+        {
+            const VoxelType* row = _slice + j * _nx;
+            float* out = _tmp + j * _mx;
+            for (size_t o = 0; o < _mx; o++)
+            {
+                const std::int64_t* index = _tx.index.data() + o * size_t(_tx.nbTaps);
+                const float* weights = _tx.weights.data() + o * size_t(_tx.nbTaps);
+                float v = weights[0] * float(row[index[0]]);
+                for (int t = 1; t < _tx.nbTaps; t++)
+                    v += weights[t] * float(row[index[t]]);
+                out[o] = v;
+            }
+        }
+
+        for (size_t j = 0; j < _my; j++)
+            combineLines(_out + j * _mx, _mx, _ty, j, [&](std::int64_t _j) { return static_cast<const float*>(_tmp + size_t(_j) * _mx); });
+    }
+
+} // anonymous namespace
+
+
+glm::ivec3 resampledDimensions(glm::ivec3 _dims, glm::vec3 _spacing, glm::vec3 _newSpacing)
+{
+    _spacing = positiveSpacing(_spacing);
+    glm::ivec3 dims;
+    for (int a = 0; a < 3; a++)
+    {
+        float newSpacing = std::abs(_newSpacing[a]);
+        // clamped so that tiny spacings give oversized (not wrapped) dimensions
+        double n = newSpacing > 0.0f ? double(_dims[a]) * _spacing[a] / newSpacing : double(_dims[a]);
+        dims[a] = std::max(1, int(std::min(std::round(n), double(std::numeric_limits<int>::max()))));
+    }
+    return dims;
+}
+
+
+glm::ivec3 resampledDimensions(VolumeImg& _src, glm::vec3 _spacing, bool _reorient)
+{
+    glm::ivec3 axes(0, 1, 2);
+    glm::bvec3 flips(false);
+    if (_reorient)
+        axisPermutation(_src.getOrientation(), &axes, &flips);
+
+    glm::vec3 targetSpacing;
+    for (int a = 0; a < 3; a++)
+        targetSpacing[axes[a]] = _spacing[a];
+    glm::ivec3 newDims = resampledDimensions(_src.getDimensions(), _src.getSpacing(), targetSpacing);
+    return glm::ivec3(newDims[axes.x], newDims[axes.y], newDims[axes.z]);
+}
+
+
+float spacingForBudget(glm::ivec3 _dims, glm::vec3 _spacing, size_t _maxVoxels)
+{
+    glm::vec3 extent = glm::vec3(glm::max(_dims, glm::ivec3(1))) * positiveSpacing(_spacing);
+    float spacing = float(std::cbrt(double(extent.x) * double(extent.y) * double(extent.z) / double(std::max<size_t>(_maxVoxels, 1))));
+
+    // voxels are rounded to the nearest whole number along each axis: coarsen until the budget is met
+    auto nbVoxels = [&](float _s)
+    {
+        glm::ivec3 dims = resampledDimensions(_dims, _spacing, glm::vec3(_s));
+        return size_t(dims.x) * size_t(dims.y) * size_t(dims.z);
+    };
+    while (nbVoxels(spacing) > std::max<size_t>(_maxVoxels, 1))
+        spacing *= 1.01f;
+    return spacing;
+}
+
+
+void axisPermutation(const glm::mat3& _orientation, glm::ivec3* _axes, glm::bvec3* _flips)
+{
+    // permutation maximizing the alignment of the voxel axes with the world axes (6 candidates)
+    const int permutations[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 } };
+    float bestScore = -1.0f;
+    for (const auto& p : permutations)
+    {
+        // _orientation[c][r]: component along world axis r of voxel axis c
+        float score = std::abs(_orientation[p[0]][0]) + std::abs(_orientation[p[1]][1]) + std::abs(_orientation[p[2]][2]);
+        if (score > bestScore)
+        {
+            bestScore = score;
+            *_axes = glm::ivec3(p[0], p[1], p[2]);
+        }
+    }
+    for (int a = 0; a < 3; a++)
+        (*_flips)[a] = _orientation[(*_axes)[a]][a] < 0.0f;
+}
+
+
+template <typename VoxelType>
+void resample(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, Kernel _kernel)
+{
+    if (_src.empty() || _dst.empty())
+        return;
+
+    const size_t nx = _src.extent(0), ny = _src.extent(1), nz = _src.extent(2);
+    const size_t mx = _dst.extent(0), my = _dst.extent(1), mz = _dst.extent(2);
+    const AxisTaps tx = axisTaps(nx, mx, _kernel), ty = axisTaps(ny, my, _kernel), tz = axisTaps(nz, mz, _kernel);
+    const size_t sliceSize = mx * my;
+    const size_t ringSize = size_t(tz.nbTaps);
+
+    // bands of output slices: each thread walks along z, with a ring of the source slices resampled along x and y
+    // (taps of an output slice are consecutive source slices, in distinct entries of the ring)
+    Parallel::parallelFor(0, mz, [&](size_t _first, size_t _last)
+    {
+        std::vector<float> ring(ringSize * sliceSize), tmp(mx * ny), acc(sliceSize);
+        std::vector<std::int64_t> ringSlices(ringSize, -1);
+
+        auto resampledSlice = [&](std::int64_t _s)
+        {
+            size_t entry = size_t(_s) % ringSize;
+            float* slice = ring.data() + entry * sliceSize;
+            if (ringSlices[entry] != _s)
+            {
+                resampleSlice(_src.slice(size_t(_s)), nx, ny, tx, ty, mx, my, tmp.data(), slice);
+                ringSlices[entry] = _s;
+            }
+            return static_cast<const float*>(slice);
+        };
+
+        for (size_t k = _first; k < _last; k++)
+        {
+            combineLines(acc.data(), sliceSize, tz, k, resampledSlice);
+
+            VoxelType* out = _dst.slice(k);
+            for (size_t v = 0; v < sliceSize; v++)
+                out[v] = toVoxel<VoxelType>(acc[v]);
+        }
+    }, std::max<size_t>(8, ringSize));
+}
+
+
+template <typename VoxelType>
+void reorient(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, glm::ivec3 _axes, glm::bvec3 _flips)
+{
+    if (_src.empty() || _dst.size() != _src.size())
+        return;
+
+    // offset in _src of the first voxel of _dst, and steps in _src along the axes of _dst
+    std::int64_t first = 0;
+    std::int64_t step[3];
+    for (int a = 0; a < 3; a++)
+    {
+        std::int64_t stride = std::int64_t(_src.stride(_axes[a]));
+        step[a] = _flips[a] ? -stride : stride;
+        if (_flips[a])
+            first += std::int64_t(_src.extent(_axes[a]) - 1) * stride;
+    }
+
+    const size_t mx = _dst.extent(0), my = _dst.extent(1), mz = _dst.extent(2);
+    const size_t bx = (mx + blockSize - 1) / blockSize, by = (my + blockSize - 1) / blockSize, bz = (mz + blockSize - 1) / blockSize;
+
+    // one task per block
+    Parallel::parallelFor(0, bx * by * bz, [&](size_t _first, size_t _last)
+    {
+        for (size_t b = _first; b < _last; b++)
+        {
+            size_t i0 = (b % bx) * blockSize, j0 = ((b / bx) % by) * blockSize, k0 = (b / (bx * by)) * blockSize;
+            size_t i1 = std::min(i0 + blockSize, mx), j1 = std::min(j0 + blockSize, my), k1 = std::min(k0 + blockSize, mz);
+            for (size_t k = k0; k < k1; k++)
+            {
+                for (size_t j = j0; j < j1; j++)
+                {
+                    const VoxelType* src = _src.data() + (first + std::int64_t(k) * step[2] + std::int64_t(j) * step[1]);
+                    VoxelType* dst = _dst.row(j, k);
+                    for (size_t i = i0; i < i1; i++)
+                        dst[i] = src[std::int64_t(i) * step[0]];
+                }
+            }
+        }
+    }, 4);
+}
+
+
+template void resample<std::uint8_t>(VolumeView<const std::uint8_t>, VolumeView<std::uint8_t>, Kernel);
+template void resample<std::uint16_t>(VolumeView<const std::uint16_t>, VolumeView<std::uint16_t>, Kernel);
+template void resample<std::int16_t>(VolumeView<const std::int16_t>, VolumeView<std::int16_t>, Kernel);
+template void resample<float>(VolumeView<const float>, VolumeView<float>, Kernel);
+
+template void reorient<std::uint8_t>(VolumeView<const std::uint8_t>, VolumeView<std::uint8_t>, glm::ivec3, glm::bvec3);
+template void reorient<std::uint16_t>(VolumeView<const std::uint16_t>, VolumeView<std::uint16_t>, glm::ivec3, glm::bvec3);
+template void reorient<std::int16_t>(VolumeView<const std::int16_t>, VolumeView<std::int16_t>, glm::ivec3, glm::bvec3);
+template void reorient<float>(VolumeView<const float>, VolumeView<float>, glm::ivec3, glm::bvec3);
+
+
+bool resample(VolumeImg& _src, VolumeImg* _dst, glm::vec3 _spacing, Kernel _kernel, bool _reorient)
+{
+    glm::ivec3 dims = _src.getDimensions();
+    glm::vec3 spacing = positiveSpacing(_src.getSpacing());
+    glm::mat3 orientation = _src.getOrientation();
+
+    glm::ivec3 axes(0, 1, 2);
+    glm::bvec3 flips(false);
+    if (_reorient)
+        axisPermutation(orientation, &axes, &flips);
+    bool permuted = axes != glm::ivec3(0, 1, 2) || glm::any(flips);
+
+    // resampled grid, along the source axes (same extent, spacing adjusted to whole numbers of voxels)
+    glm::vec3 targetSpacing;
+    for (int a = 0; a < 3; a++)
+        targetSpacing[axes[a]] = _spacing[a];
+    glm::ivec3 newDims = resampledDimensions(dims, spacing, targetSpacing);
+    glm::vec3 newSpacing = glm::vec3(dims) * spacing / glm::vec3(newDims);
+    bool resampled = newDims != dims;
+
+    // first voxel center of the resampled grid is half a new voxel inside the bounds
+    glm::vec3 origin = _src.getOrigin() + orientation * (0.5f * (newSpacing - spacing));
+
+    // reoriented grid: permuted axes, starting from the last voxel along flipped ones
+    glm::ivec3 dstDims;
+    glm::vec3 dstSpacing, firstVoxel(0.0f);
+    glm::mat3 dstOrientation;
+    for (int a = 0; a < 3; a++)
+    {
+        int s = axes[a];
+        dstDims[a] = newDims[s];
+        dstSpacing[a] = newSpacing[s];
+        dstOrientation[a] = flips[a] ? -orientation[s] : orientation[s];
+        if (flips[a])
+            firstVoxel[s] = float(newDims[s] - 1) * newSpacing[s];
+    }
+    glm::vec3 dstOrigin = origin + orientation * firstVoxel;
+
+    const size_t nbVoxels = _src.getNbVoxels();
+    const size_t nbNewVoxels = size_t(newDims.x) * size_t(newDims.y) * size_t(newDims.z);
+    bool done = false;
+    _src.visit([&](auto& _typedVol)
+    {
+        using VoxelType = std::decay_t<decltype(*_typedVol.getFront())>;
+
+        // no data (e.g. out-of-core volume)
+        if (nbVoxels == 0 || _typedVol.getStorage().size() != nbVoxels)
+            return;
+        if (!_dst->volumeInitHeader(datatypeName<VoxelType>(), dstDims, dstOrigin, dstSpacing, _src.getValueRange()))
+            return;
+
+        _dst->visit([&](auto& _dstVol)
+        {
+            if constexpr (std::is_same_v<std::decay_t<decltype(*_dstVol.getFront())>, VoxelType>)
+            {
+                VoxelStorage<VoxelType>& storage = _dstVol.getStorage();
+                storage.resize(nbNewVoxels);
+                VolumeView<const VoxelType> src = std::as_const(_typedVol).view();
+                VolumeView<VoxelType> dst(storage.data(), dstDims);
+
+                if (!permuted)
+                    resample(src, dst, _kernel);
+                else if (!resampled)
+                    reorient(src, dst, axes, flips);
+                else
+                {
+                    // permute the smaller of the two grids
+                    std::vector<VoxelType> tmp(std::min(nbVoxels, nbNewVoxels));
+                    if (nbNewVoxels < nbVoxels)
+                    {
+                        VolumeView<VoxelType> resampledView(tmp.data(), newDims);
+                        resample(src, resampledView, _kernel);
+                        reorient(VolumeView<const VoxelType>(resampledView), dst, axes, flips);
+                    }
+                    else
+                    {
+                        glm::ivec3 permutedDims(dims[axes.x], dims[axes.y], dims[axes.z]);
+                        VolumeView<VoxelType> reorientedView(tmp.data(), permutedDims);
+                        reorient(src, reorientedView, axes, flips);
+                        resample(VolumeView<const VoxelType>(reorientedView), dst, _kernel);
+                    }
+                }
+                done = true;
+            }
+        });
+    });
+    if (!done)
+        return false;
+
+    _dst->setOrientation(dstOrientation);
+    _dst->dataModified();
+    return true;
+}
+
+} // namespace VolumeResampler
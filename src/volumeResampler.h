@@ -0,0 +1,124 @@
+/*********************************************************************************************************************
+ *
+ * volumeResampler.h
+ *
+ * Resampling of volumes to a new grid (e.g. isotropic spacing), and reorientation along world axes
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef VOLUMERESAMPLER_H
+#define VOLUMERESAMPLER_H
+
+
+#include <cstdint>
+#include <cstddef>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "volumeView.h"
+
+
+class VolumeImg;
+
+
+/*!
+* \namespace VolumeResampler
+* \brief Resample a volume once to a new spacing (e.g. isotropic, or fitting a voxel budget), so that renderers do not
+* oversample anisotropic data in every frame.
+* Grids are aligned on their bounds: the resampled grid covers the same extent as the original one, and its spacing
+* is adjusted for a whole number of voxels. Resampling is separable (along x, then y, then z), each thread walking along z
+* through its band of output slices with a ring of the source slices resampled along x and y.
+* Reorientation permutes and flips the voxel axes, so that they follow the world axes (see axisPermutation()).
+*/
+namespace VolumeResampler
+{
+
+    /*! Interpolation kernel */
+    enum Kernel
+    {
+        KERNEL_NEAREST,     /*!< nearest voxel */
+        KERNEL_TRILINEAR,   /*!< trilinear interpolation */
+        KERNEL_LANCZOS      /*!< Lanczos-3 windowed sinc, widened when downsampling (antialiased, sharp; may overshoot) */
+    };
+
+
+    /*!
+    * \fn resampledDimensions
+    * \brief Dimensions of a grid resampled to a new spacing (at least 1 voxel along each axis)
+    * \param _dims : dimensions of the grid
+    * \param _spacing : spacing of the grid
+    * \param _newSpacing : target spacing (the actual one is adjusted, see VolumeResampler)
+    */
+    glm::ivec3 resampledDimensions(glm::ivec3 _dims, glm::vec3 _spacing, glm::vec3 _newSpacing);
+
+    /*!
+    * \fn resampledDimensions
+    * \brief Dimensions of the volume created by resample(), without creating it
+    * \param _src : volume
+    * \param _spacing : target spacing along each world axis
+    * \param _reorient : voxel axes permuted along the world axes
+    */
+    glm::ivec3 resampledDimensions(VolumeImg& _src, glm::vec3 _spacing, bool _reorient);
+
+    /*!
+    * \fn spacingForBudget
+    * \brief Smallest isotropic spacing for which a grid is resampled into at most a number of voxels
+    * \param _dims : dimensions of the grid
+    * \param _spacing : spacing of the grid
+    * \param _maxVoxels : voxel budget
+    */
+    float spacingForBudget(glm::ivec3 _dims, glm::vec3 _spacing, size_t _maxVoxels);
+
+    /*!
+    * \fn axisPermutation
+    * \brief Signed permutation of the voxel axes closest to an orientation
+    * \param _orientation : directions (columns) of the voxel axes in world coordinates
+    * \param _axes : for each world axis, the voxel axis along it
+    * \param _flips : for each world axis, true if the voxel axis points in the opposite direction
+    */
+    void axisPermutation(const glm::mat3& _orientation, glm::ivec3* _axes, glm::bvec3* _flips);
+
+
+    /*!
+    * \fn resample
+    * \brief Resample a voxel grid into another one of the same extent (multithreaded, see VolumeResampler)
+    * \param _src : voxels
+    * \param _dst : resampled voxels (their dimensions give the new grid)
+    * \param _kernel : interpolation kernel
+    */
+    template <typename VoxelType>
+    void resample(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, Kernel _kernel);
+
+    /*!
+    * \fn reorient
+    * \brief Permute and flip the axes of a voxel grid (multithreaded, by blocks of voxels so that both grids
+    * are accessed within cache-sized tiles)
+    * \param _src : voxels
+    * \param _dst : reoriented voxels, of dimensions _src.extent(_axes[a]) along each axis a
+    * \param _axes : for each axis of _dst, the axis of _src along it
+    * \param _flips : for each axis of _dst, true if the axis of _src is reversed
+    */
+    template <typename VoxelType>
+    void reorient(VolumeView<const VoxelType> _src, VolumeView<VoxelType> _dst, glm::ivec3 _axes, glm::bvec3 _flips);
+
+
+    /*!
+    * \fn resample
+    * \brief Create a volume resampled from another one (same voxel type)
+    * \param _src : volume
+    * \param _dst : new volume (dimensions, spacing, origin and orientation are set)
+    * \param _spacing : target spacing along each world axis
+    * \param _kernel : interpolation kernel
+    * \param _reorient : also permute and flip the voxel axes along the world axes (see axisPermutation())
+    * \return false if the source volume has no data in memory (e.g. out-of-core volume)
+    */
+    bool resample(VolumeImg& _src, VolumeImg* _dst, glm::vec3 _spacing, Kernel _kernel, bool _reorient);
+
+}
+
+#endif // VOLUMERESAMPLER_H
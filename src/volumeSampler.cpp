@@ -0,0 +1,359 @@
+/*********************************************************************************************************************
+ *
+ * volumeSampler.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include "volumeSampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "volumeImg.h"
+#include "parallel.h"
+#include "simd.h"
+
+
+namespace VolumeSampler
+{
+
+namespace
+{
+    // minimal number of points processed by a thread
+    const size_t minGrain = 1 << 12;
+
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "points are read as packed x, y, z floats");
+
+
+    /*!
+    * \struct Grid
+    * \brief Voxel grid and sampling parameters, shared by all points of a batch
+    */
+    template <typename VoxelType>
+    struct Grid
+    {
+        const VoxelType* data = nullptr;
+        size_t nx = 0, ny = 0;                      /*!< strides along y (nx) and z (nx * ny) */
+        glm::ivec3 maxIndex = glm::ivec3(0);        /*!< last voxel along each axis */
+        glm::vec3 maxCoord = glm::vec3(0.0f);       /*!< last voxel along each axis, as float */
+        glm::vec3 origin = glm::vec3(0.0f);
+        glm::vec3 invSpacing = glm::vec3(1.0f);
+        glm::vec3 low = glm::vec3(0.0f);            /*!< lowest voxel coordinates of points inside the grid */
+        glm::vec3 high = glm::vec3(0.0f);           /*!< highest voxel coordinates of points inside the grid */
+        Filter filter = FILTER_TRILINEAR;
+        float outside = 0.0f;
+    };
+
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                                  SCALAR                                                     |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+    template <typename VoxelType>
+    inline float fetchScalar(const Grid<VoxelType>& _g, int _i, int _j, int _k)
+    {
+        return float(_g.data[(size_t(_k) * _g.ny + size_t(_j)) * _g.nx + size_t(_i)]);
+    }
+
+    // uniform cubic B-spline weights of the 4 voxels around a fraction _t in [0 ; 1[
+    inline void bsplineWeights(float _t, float _w[4])
+    {
+        float t2 = _t * _t, t3 = t2 * _t;
+        float s = 1.0f - _t;
+        _w[0] = s * s * s * (1.0f / 6.0f);
+        _w[1] = (3.0f * t3 - 6.0f * t2 + 4.0f) * (1.0f / 6.0f);
+        _w[2] = (-3.0f * t3 + 3.0f * t2 + 3.0f * _t + 1.0f) * (1.0f / 6.0f);
+        _w[3] = t3 * (1.0f / 6.0f);
+    }
+
+    template <typename VoxelType>
+    float sampleScalar(const Grid<VoxelType>& _g, glm::vec3 _p)
+    {
+        glm::vec3 v = (_p - _g.origin) * _g.invSpacing;
+        // false for NaN coordinates
+        bool inside = v.x >= _g.low.x && v.x <= _g.high.x && v.y >= _g.low.y && v.y <= _g.high.y && v.z >= _g.low.z && v.z <= _g.high.z;
+
+        // clamp into the grid (NaN gives 0, as the vectorized version)
+        glm::vec3 c;
+        for (int a = 0; a < 3; a++)
+        {
+            c[a] = v[a] > 0.0f ? v[a] : 0.0f;
+            c[a] = c[a] < _g.maxCoord[a] ? c[a] : _g.maxCoord[a];
+        }
+
+        float val = 0.0f;
+        if (_g.filter == FILTER_NEAREST)
+        {
+            val = fetchScalar(_g, int(std::floor(c.x + 0.5f)), int(std::floor(c.y + 0.5f)), int(std::floor(c.z + 0.5f)));
+        }
+        else if (_g.filter == FILTER_TRILINEAR)
+        {
+            glm::vec3 fl = glm::floor(c);
+            glm::ivec3 i0 = glm::ivec3(fl);
+            glm::ivec3 i1 = glm::min(i0 + glm::ivec3(1), _g.maxIndex);
+            glm::vec3 f = c - fl;
+
+            float c00 = fetchScalar(_g, i0.x, i0.y, i0.z) + f.x * (fetchScalar(_g, i1.x, i0.y, i0.z) - fetchScalar(_g, i0.x, i0.y, i0.z));
+            float c10 = fetchScalar(_g, i0.x, i1.y, i0.z) + f.x * (fetchScalar(_g, i1.x, i1.y, i0.z) - fetchScalar(_g, i0.x, i1.y, i0.z));
+            float c01 = fetchScalar(_g, i0.x, i0.y, i1.z) + f.x * (fetchScalar(_g, i1.x, i0.y, i1.z) - fetchScalar(_g, i0.x, i0.y, i1.z));
+            float c11 = fetchScalar(_g, i0.x, i1.y, i1.z) + f.x * (fetchScalar(_g, i1.x, i1.y, i1.z) - fetchScalar(_g, i0.x, i1.y, i1.z));
+            float c0 = c00 + f.y * (c10 - c00);
+            float c1 = c01 + f.y * (c11 - c01);
+            val = c0 + f.z * (c1 - c0);
+        }
+        else
+        {
+            glm::vec3 fl = glm::floor(c);
+            glm::ivec3 i = glm::ivec3(fl);
+            float w[3][4];
+            int taps[3][4];
+            for (int a = 0; a < 3; a++)
+            {
+                bsplineWeights(c[a] - fl[a], w[a]);
+                for (int n = 0; n < 4; n++)
+                    taps[a][n] = std::max(0, std::min(i[a] - 1 + n, _g.maxIndex[a]));
+            }
+
+            for (int l = 0; l < 4; l++)
+                for (int m = 0; m < 4; m++)
+                {
+                    float row = 0.0f;
+                    for (int n = 0; n < 4; n++)
+                        row += w[0][n] * fetchScalar(_g, taps[0][n], taps[1][m], taps[2][l]);
+                    val += w[2][l] * w[1][m] * row;
+                }
+        }
+
+        return inside ? val : _g.outside;
+    }
+
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                                   AVX2                                                      |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+#if defined(SIMD_X86)
+
+    const size_t simdWidth = 4;
+
+    // Gather 4 voxels (64-bit indices) as floats
+    SIMD_TARGET_AVX2 inline __m128 gatherSimd(const float* _data, __m256i _idx)
+    {
+        return _mm256_i64gather_ps(_data, _idx, 4);
+    }
+
+    // Integer voxels: each lane loads the 32-bit word ending with its voxel (or starting at the first byte of the
+    // grid for the first voxels), so that no byte out of the grid is read, then shifts the voxel down
+    template <typename VoxelType>
+    SIMD_TARGET_AVX2 inline __m128 gatherSimd(const VoxelType* _data, __m256i _idx)
+    {
+        constexpr int size = int(sizeof(VoxelType));
+        __m256i bytes = size == 2 ? _mm256_slli_epi64(_idx, 1) : _idx;
+        __m256i offset = _mm256_sub_epi64(bytes, _mm256_set1_epi64x(4 - size));
+        offset = _mm256_andnot_si256(_mm256_cmpgt_epi64(_mm256_setzero_si256(), offset), offset);
+
+        __m256i shift64 = _mm256_slli_epi64(_mm256_sub_epi64(bytes, offset), 3);
+        __m128i shift = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(shift64, _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0)));
+
+        __m128i w = _mm256_i64gather_epi32(reinterpret_cast<const int*>(_data), offset, 1);
+        w = _mm_srlv_epi32(w, shift);
+        if constexpr (std::is_same_v<VoxelType, std::int16_t>)
+            w = _mm_srai_epi32(_mm_slli_epi32(w, 16), 16);
+        else
+            w = _mm_and_si128(w, _mm_set1_epi32(size == 1 ? 0xff : 0xffff));
+        return _mm_cvtepi32_ps(w);
+    }
+
+    // 64-bit indices of voxels (_i, _j, _k) (_k * ny + _j must fit in 32 bits)
+    SIMD_TARGET_AVX2 inline __m256i rowIndex(__m128i _j, __m128i _k, __m128i _ny, __m256i _nx)
+    {
+        __m128i row = _mm_add_epi32(_mm_mullo_epi32(_k, _ny), _j);
+        return _mm256_mul_epu32(_mm256_cvtepu32_epi64(row), _nx);
+    }
+    SIMD_TARGET_AVX2 inline __m256i voxelIndex(__m256i _row, __m128i _i)
+    {
+        return _mm256_add_epi64(_row, _mm256_cvtepu32_epi64(_i));
+    }
+
+    SIMD_TARGET_AVX2 inline __m128 lerpSimd(__m128 _a, __m128 _b, __m128 _t)
+    {
+        return _mm_add_ps(_a, _mm_mul_ps(_t, _mm_sub_ps(_b, _a)));
+    }
+
+    template <typename VoxelType>
+    SIMD_TARGET_AVX2 void sampleSimd(const Grid<VoxelType>& _g, const glm::vec3* _p, float* _out)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128i ny = _mm_set1_epi32(int(_g.ny));
+        const __m256i nx = _mm256_set1_epi64x(std::int64_t(_g.nx));
+
+        // transpose 4 points into voxel coordinates, clamped into the grid
+        const __m128i stride = _mm_setr_epi32(0, 3, 6, 9);
+        __m128 c[3];
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int a = 0; a < 3; a++)
+        {
+            __m128 v = _mm_i32gather_ps(&_p[0].x + a, stride, 4);
+            v = _mm_mul_ps(_mm_sub_ps(v, _mm_set1_ps(_g.origin[a])), _mm_set1_ps(_g.invSpacing[a]));
+            inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(v, _mm_set1_ps(_g.low[a])), _mm_cmple_ps(v, _mm_set1_ps(_g.high[a]))));
+            // max(NaN, 0) is 0
+            c[a] = _mm_min_ps(_mm_max_ps(v, zero), _mm_set1_ps(_g.maxCoord[a]));
+        }
+
+        __m128 val;
+        if (_g.filter == FILTER_NEAREST)
+        {
+            __m128i i = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(c[0], half)));
+            __m128i j = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(c[1], half)));
+            __m128i k = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(c[2], half)));
+            val = gatherSimd(_g.data, voxelIndex(rowIndex(j, k, ny, nx), i));
+        }
+        else if (_g.filter == FILTER_TRILINEAR)
+        {
+            __m128 f[3];
+            __m128i i0[3], i1[3];
+            for (int a = 0; a < 3; a++)
+            {
+                __m128 fl = _mm_floor_ps(c[a]);
+                f[a] = _mm_sub_ps(c[a], fl);
+                i0[a] = _mm_cvttps_epi32(fl);
+                i1[a] = _mm_min_epi32(_mm_add_epi32(i0[a], _mm_set1_epi32(1)), _mm_set1_epi32(_g.maxIndex[a]));
+            }
+
+            __m256i r00 = rowIndex(i0[1], i0[2], ny, nx), r10 = rowIndex(i1[1], i0[2], ny, nx);
+            __m256i r01 = rowIndex(i0[1], i1[2], ny, nx), r11 = rowIndex(i1[1], i1[2], ny, nx);
+            __m128 c00 = lerpSimd(gatherSimd(_g.data, voxelIndex(r00, i0[0])), gatherSimd(_g.data, voxelIndex(r00, i1[0])), f[0]);
+            __m128 c10 = lerpSimd(gatherSimd(_g.data, voxelIndex(r10, i0[0])), gatherSimd(_g.data, voxelIndex(r10, i1[0])), f[0]);
+            __m128 c01 = lerpSimd(gatherSimd(_g.data, voxelIndex(r01, i0[0])), gatherSimd(_g.data, voxelIndex(r01, i1[0])), f[0]);
+            __m128 c11 = lerpSimd(gatherSimd(_g.data, voxelIndex(r11, i0[0])), gatherSimd(_g.data, voxelIndex(r11, i1[0])), f[0]);
+            val = lerpSimd(lerpSimd(c00, c10, f[1]), lerpSimd(c01, c11, f[1]), f[2]);
+        }
+        else
+        {
+            const __m128 sixth = _mm_set1_ps(1.0f / 6.0f);
+            __m128 w[3][4];
+            __m128i taps[3][4];
+            for (int a = 0; a < 3; a++)
+            {
+                __m128 fl = _mm_floor_ps(c[a]);
+                __m128 t = _mm_sub_ps(c[a], fl), t2 = _mm_mul_ps(t, t), t3 = _mm_mul_ps(t2, t);
+                __m128 s = _mm_sub_ps(_mm_set1_ps(1.0f), t);
+                w[a][0] = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(s, s), s), sixth);
+                w[a][1] = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), t3), _mm_mul_ps(_mm_set1_ps(6.0f), t2)), _mm_set1_ps(4.0f)), sixth);
+                w[a][2] = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(-3.0f), t3), _mm_mul_ps(_mm_set1_ps(3.0f), t2)),
+                                                           _mm_mul_ps(_mm_set1_ps(3.0f), t)), _mm_set1_ps(1.0f)), sixth);
+                w[a][3] = _mm_mul_ps(t3, sixth);
+
+                __m128i i = _mm_cvttps_epi32(fl);
+                for (int n = 0; n < 4; n++)
+                    taps[a][n] = _mm_max_epi32(_mm_setzero_si128(), _mm_min_epi32(_mm_add_epi32(i, _mm_set1_epi32(n - 1)), _mm_set1_epi32(_g.maxIndex[a])));
+            }
+
+            val = zero;
+            for (int l = 0; l < 4; l++)
+                for (int m = 0; m < 4; m++)
+                {
+                    __m256i r = rowIndex(taps[1][m], taps[2][l], ny, nx);
+                    __m128 row = zero;
+                    for (int n = 0; n < 4; n++)
+                        row = _mm_add_ps(row, _mm_mul_ps(w[0][n], gatherSimd(_g.data, voxelIndex(r, taps[0][n]))));
+                    val = _mm_add_ps(val, _mm_mul_ps(_mm_mul_ps(w[2][l], w[1][m]), row));
+                }
+        }
+
+        _mm_storeu_ps(_out, _mm_blendv_ps(_mm_set1_ps(_g.outside), val, inside));
+    }
+
+#endif
+
+} // namespace
+
+
+const char* simdName()
+{
+#if defined(SIMD_X86)
+    if (Simd::hasAVX2())
+        return "AVX2";
+#endif
+    return "scalar";
+}
+
+
+template <typename VoxelType>
+void sample(VolumeView<const VoxelType> _vol, glm::vec3 _origin, glm::vec3 _spacing,
+            const glm::vec3* _points, size_t _nbPoints, Filter _filter, float* _values, float _outside)
+{
+    if (_nbPoints == 0)
+        return;
+    if (_vol.empty())
+    {
+        std::fill(_values, _values + _nbPoints, _outside);
+        return;
+    }
+
+    Grid<VoxelType> g;
+    g.data = _vol.data();
+    g.nx = _vol.extent(0);
+    g.ny = _vol.extent(1);
+    g.maxIndex = _vol.getDimensions() - glm::ivec3(1);
+    g.maxCoord = glm::vec3(g.maxIndex);
+    g.origin = _origin;
+    for (int a = 0; a < 3; a++)
+        g.invSpacing[a] = _spacing[a] != 0.0f ? 1.0f / _spacing[a] : 0.0f;
+    g.low = glm::vec3(_filter == FILTER_NEAREST ? -0.5f : 0.0f);
+    g.high = g.maxCoord - g.low;
+    g.filter = _filter;
+    g.outside = _outside;
+
+#if defined(SIMD_X86)
+    // row indices are computed in 32 bits, and integer voxels are gathered as 32-bit words
+    bool useSimd = Simd::hasAVX2() && g.ny * _vol.extent(2) <= size_t(0xffffffffu) && _vol.size() * sizeof(VoxelType) >= 4;
+#endif
+
+    Parallel::parallelFor(0, _nbPoints, [&](size_t _first, size_t _last)
+    {
+        size_t p = _first;
+#if defined(SIMD_X86)
+        if (useSimd)
+        {
+            for (; p + simdWidth <= _last; p += simdWidth)
+                sampleSimd(g, _points + p, _values + p);
+        }
+#endif
+        for (; p < _last; p++)
+            _values[p] = sampleScalar(g, _points[p]);
+    }, minGrain);
+}
+
+template void sample<std::uint8_t>(VolumeView<const std::uint8_t>, glm::vec3, glm::vec3, const glm::vec3*, size_t, Filter, float*, float);
+template void sample<std::uint16_t>(VolumeView<const std::uint16_t>, glm::vec3, glm::vec3, const glm::vec3*, size_t, Filter, float*, float);
+template void sample<std::int16_t>(VolumeView<const std::int16_t>, glm::vec3, glm::vec3, const glm::vec3*, size_t, Filter, float*, float);
+template void sample<float>(VolumeView<const float>, glm::vec3, glm::vec3, const glm::vec3*, size_t, Filter, float*, float);
+
+
+void sample(VolumeImg& _vol, const glm::vec3* _points, size_t _nbPoints, Filter _filter, float* _values, float _outside)
+{
+    size_t nbVoxels = _vol.getNbVoxels();
+    bool sampled = false;
+    _vol.visit([&](auto& _typedVol)
+    {
+        // no data (e.g. out-of-core volume)
+        if (nbVoxels == 0 || _typedVol.getStorage().size() != nbVoxels)
+            return;
+
+        sample(_typedVol, _points, _nbPoints, _filter, _values, _outside);
+        sampled = true;
+    });
+
+    if (!sampled)
+        std::fill(_values, _values + _nbPoints, _outside);
+}
+
+} // namespace VolumeSampler
@@ -0,0 +1,94 @@
+/*********************************************************************************************************************
+ *
+ * volumeSampler.h
+ *
+ * Batched CPU sampling of volumes at arbitrary points (nearest, trilinear, tricubic B-spline)
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef VOLUMESAMPLER_H
+#define VOLUMESAMPLER_H
+
+
+#include <cstdint>
+#include <cstddef>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "volumeView.h"
+#include "volumeBase.h"
+
+
+class VolumeImg;
+
+
+/*!
+* \namespace VolumeSampler
+* \brief Interpolated values of a volume at arrays of points, for CPU-side resampling, picking, profiles, etc.
+* Points are in world coordinates: voxel (i, j, k) is centered on origin + (i, j, k) * spacing.
+* Points are processed in parallel, 4 at a time with AVX2 gathers when the CPU supports them (64-bit indices, so any volume size is supported),
+* without any branch on the position of the points: coordinates are clamped into the grid, and points out of it get
+* a given value. Volumes whose y * z dimensions exceed 2^32 fall back to the scalar path.
+* Interpolation is done in native units (as float), whatever the voxel type.
+*/
+namespace VolumeSampler
+{
+
+    /*! Interpolation filter */
+    enum Filter
+    {
+        FILTER_NEAREST,     /*!< nearest voxel, points within half a voxel of the grid are inside */
+        FILTER_TRILINEAR,   /*!< trilinear interpolation, points between the first and last voxel centers are inside */
+        FILTER_TRICUBIC     /*!< cubic B-spline (4x4x4 voxels, smooths the data), inside as trilinear, border voxels repeated */
+    };
+
+
+    /*!
+    * \fn simdName
+    * \brief Name of the instruction set the sampling kernels use on this CPU ("AVX2" or "scalar")
+    */
+    const char* simdName();
+
+
+    /*!
+    * \fn sample
+    * \brief Sample a voxel grid at an array of points
+    * \param _vol : voxels
+    * \param _origin : world coordinates of the center of voxel (0, 0, 0)
+    * \param _spacing : distance between voxel centers along each axis
+    * \param _points : points, in world coordinates
+    * \param _nbPoints : number of points
+    * \param _filter : interpolation filter
+    * \param _values : output values (one per point)
+    * \param _outside : value of points out of the grid
+    */
+    template <typename VoxelType>
+    void sample(VolumeView<const VoxelType> _vol, glm::vec3 _origin, glm::vec3 _spacing,
+                const glm::vec3* _points, size_t _nbPoints, Filter _filter, float* _values, float _outside = 0.0f);
+
+    /*!
+    * \fn sample
+    * \brief Sample a volume at an array of points (see above)
+    */
+    template <typename VoxelType>
+    void sample(VolumeBase<VoxelType>& _vol, const glm::vec3* _points, size_t _nbPoints, Filter _filter, float* _values, float _outside = 0.0f)
+    {
+        const VolumeBase<VoxelType>& constVol = _vol;
+        sample(constVol.view(), _vol.getOrigin(), _vol.getSpacing(), _points, _nbPoints, _filter, _values, _outside);
+    }
+
+    /*!
+    * \fn sample
+    * \brief Sample a volume at an array of points, whatever its voxel type (see above)
+    * Volumes without data in memory (e.g. out-of-core volumes) give _outside everywhere.
+    */
+    void sample(VolumeImg& _vol, const glm::vec3* _points, size_t _nbPoints, Filter _filter, float* _values, float _outside = 0.0f);
+
+}
+
+#endif // VOLUMESAMPLER_H
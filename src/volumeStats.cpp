@@ -0,0 +1,470 @@
+/*********************************************************************************************************************
+ *
+ * volumeStats.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include "volumeStats.h"
+
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "volumeImg.h"
+#include "parallel.h"
+#include "simd.h"
+
+
+namespace VolumeStats
+{
+
+namespace
+{
+    // minimal number of rows of the box processed by a thread
+    const size_t minRowsPerRange = 16;
+
+    // number of bins of float volumes for BINS_NATIVE
+    const int nbFloatBins = 4096;
+
+
+    /*!
+    * \struct Box
+    * \brief Box of voxels, clamped to the grid, processed row by row
+    */
+    struct Box
+    {
+        size_t x0, y0, z0;      /*!< first voxel */
+        size_t nx, ny, nz;      /*!< number of voxels along each axis */
+
+        inline size_t nbRows() const { return ny * nz; }
+        inline size_t nbVoxels() const { return nx * ny * nz; }
+
+        /*! \fn row : first voxel of the box in its row _r (in [0 ; nbRows()[) */
+        template <typename VoxelType>
+        inline const VoxelType* row(const VolumeView<const VoxelType>& _vol, size_t _r) const
+        {
+            return _vol.row(y0 + _r % ny, z0 + _r / ny) + x0;
+        }
+    };
+
+    Box clampBox(glm::ivec3 _dimensions, glm::ivec3 _boxMin, glm::ivec3 _boxMax)
+    {
+        glm::ivec3 first = glm::clamp(_boxMin, glm::ivec3(0), _dimensions);
+        glm::ivec3 last = glm::clamp(_boxMax, first, _dimensions);
+        return { size_t(first.x), size_t(first.y), size_t(first.z),
+                 size_t(last.x - first.x), size_t(last.y - first.y), size_t(last.z - first.z) };
+    }
+
+
+    /*!
+    * \fn countValues
+    * \brief Number of voxels of each value of an integer voxel type (index 0 for the lowest value of the type)
+    * Each thread counts in its own table, tables are merged at the end.
+    */
+    template <typename VoxelType>
+    std::vector<std::uint64_t> countValues(const VolumeView<const VoxelType>& _vol, const Box& _box)
+    {
+        constexpr size_t nbValues = size_t(1) << (8 * sizeof(VoxelType));
+        constexpr std::int64_t offset = -std::int64_t(std::numeric_limits<VoxelType>::lowest());
+
+        std::vector<std::uint64_t> counts(nbValues, 0);
+        std::mutex countsMutex;
+
+        Parallel::parallelFor(0, _box.nbRows(), [&](size_t _first, size_t _last)
+        {
+            std::vector<std::uint64_t> local;
+            if constexpr (nbValues == 256)
+            {
+                // 4 interleaved tables, so that runs of the same value (e.g. background) do not serialize increments
+                local.assign(4 * nbValues, 0);
+                std::uint64_t* t0 = local.data();
+                std::uint64_t* t1 = t0 + nbValues;
+                std::uint64_t* t2 = t1 + nbValues;
+                std::uint64_t* t3 = t2 + nbValues;
+                for (size_t r = _first; r < _last; r++)
+                {
+                    const VoxelType* row = _box.row(_vol, r);
+                    size_t x = 0;
+                    for (; x + 4 <= _box.nx; x += 4)
+                    {
+                        t0[row[x]]++;
+                        t1[row[x + 1]]++;
+                        t2[row[x + 2]]++;
+                        t3[row[x + 3]]++;
+                    }
+                    for (; x < _box.nx; x++)
+                        t0[row[x]]++;
+                }
+                for (size_t v = 0; v < nbValues; v++)
+                    t0[v] += t1[v] + t2[v] + t3[v];
+            }
+            else
+            {
+                local.assign(nbValues, 0);
+                for (size_t r = _first; r < _last; r++)
+                {
+                    const VoxelType* row = _box.row(_vol, r);
+                    for (size_t x = 0; x < _box.nx; x++)
+                        local[size_t(std::int64_t(row[x]) + offset)]++;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(countsMutex);
+            for (size_t v = 0; v < nbValues; v++)
+                counts[v] += local[v];
+        }, minRowsPerRange);
+
+        return counts;
+    }
+
+
+    /*!
+    * \fn integerStats
+    * \brief Statistics of integer voxels, from the number of voxels of each value
+    */
+    template <typename VoxelType>
+    Stats integerStats(const VolumeView<const VoxelType>& _vol, const Box& _box, int _nbBins)
+    {
+        Stats stats;
+        std::vector<std::uint64_t> counts = countValues(_vol, _box);
+        const double lowest = double(std::numeric_limits<VoxelType>::lowest());
+
+        // range
+        size_t vMin = 0, vMax = counts.size() - 1;
+        while (vMin < counts.size() && counts[vMin] == 0)
+            vMin++;
+        if (vMin == counts.size())
+            return stats;
+        while (counts[vMax] == 0)
+            vMax--;
+        stats.range = glm::vec2(float(lowest + double(vMin)), float(lowest + double(vMax)));
+
+        // mean and variance (exact)
+        double sum = 0.0;
+        for (size_t v = vMin; v <= vMax; v++)
+        {
+            stats.count += counts[v];
+            sum += double(counts[v]) * double(v - vMin);
+        }
+        double meanOffset = sum / double(stats.count);
+        double sumSq = 0.0;
+        for (size_t v = vMin; v <= vMax; v++)
+        {
+            double d = double(v - vMin) - meanOffset;
+            sumSq += double(counts[v]) * d * d;
+        }
+        stats.mean = double(stats.range.x) + meanOffset;
+        stats.variance = sumSq / double(stats.count);
+
+        // bins of whole values
+        size_t nbValues = vMax - vMin + 1;
+        size_t nbBins = _nbBins <= 0 ? nbValues : std::min(size_t(_nbBins), nbValues);
+        stats.binRange = glm::vec2(stats.range.x, stats.range.y + 1.0f);
+        stats.histogram.assign(nbBins, 0);
+        for (size_t v = vMin; v <= vMax; v++)
+            stats.histogram[(v - vMin) * nbBins / nbValues] += counts[v];
+
+        return stats;
+    }
+
+
+#if defined(SIMD_X86)
+    /*!
+    * \fn accumulateRowAVX2
+    * \brief AVX2 version of accumulateRow(), 8 voxels at a time, on float row sums
+    * \return number of voxels processed (the remaining ones are left to the scalar loop)
+    */
+    SIMD_TARGET_AVX2 size_t accumulateRowAVX2(const float* _row, size_t _nx, float _shift, float* _min, float* _max,
+                                              float* _rowSum, float* _rowSumSq, std::uint64_t* _count)
+    {
+        size_t x = 0;
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 shift = _mm256_set1_ps(_shift);
+        __m256 vMin = _mm256_set1_ps(*_min), vMax = _mm256_set1_ps(*_max);
+        __m256 vSum = zero, vSumSq = zero;
+        __m256i vCount = _mm256_setzero_si256();
+        for (; x + 8 <= _nx; x += 8)
+        {
+            __m256 v = _mm256_loadu_ps(_row + x);
+            // v - v is 0 for finite values only
+            __m256 finite = _mm256_cmp_ps(_mm256_sub_ps(v, v), zero, _CMP_EQ_OQ);
+            vMin = _mm256_min_ps(vMin, _mm256_blendv_ps(vMin, v, finite));
+            vMax = _mm256_max_ps(vMax, _mm256_blendv_ps(vMax, v, finite));
+            __m256 d = _mm256_and_ps(_mm256_sub_ps(v, shift), finite);
+            vSum = _mm256_add_ps(vSum, d);
+            vSumSq = _mm256_add_ps(vSumSq, _mm256_mul_ps(d, d));
+            vCount = _mm256_sub_epi32(vCount, _mm256_castps_si256(finite));
+        }
+
+        alignas(32) float lanes[4][8];
+        alignas(32) std::uint32_t counts[8];
+        _mm256_store_ps(lanes[0], vMin);
+        _mm256_store_ps(lanes[1], vMax);
+        _mm256_store_ps(lanes[2], vSum);
+        _mm256_store_ps(lanes[3], vSumSq);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(counts), vCount);
+        for (int l = 0; l < 8; l++)
+        {
+            *_min = std::min(*_min, lanes[0][l]);
+            *_max = std::max(*_max, lanes[1][l]);
+            *_rowSum += lanes[2][l];
+            *_rowSumSq += lanes[3][l];
+            *_count += counts[l];
+        }
+        return x;
+    }
+#endif
+
+
+    /*!
+    * \fn accumulateRow
+    * \brief Extend range, sums (relative to _shift) and count of finite values with a row of float voxels
+    * Row sums are in float (8 lanes on AVX2), added to the double totals.
+    */
+    void accumulateRow(const float* _row, size_t _nx, float _shift, float* _min, float* _max, double* _sum, double* _sumSq, std::uint64_t* _count)
+    {
+        size_t x = 0;
+        float rowSum = 0.0f, rowSumSq = 0.0f;
+#if defined(SIMD_X86)
+        if (Simd::hasAVX2())
+            x = accumulateRowAVX2(_row, _nx, _shift, _min, _max, &rowSum, &rowSumSq, _count);
+#endif
+
+        for (; x < _nx; x++)
+        {
+            if (!std::isfinite(_row[x]))
+                continue;
+            *_min = std::min(*_min, _row[x]);
+            *_max = std::max(*_max, _row[x]);
+            float d = _row[x] - _shift;
+            rowSum += d;
+            rowSumSq += d * d;
+            (*_count)++;
+        }
+
+        *_sum += double(rowSum);
+        *_sumSq += double(rowSumSq);
+    }
+
+
+    /*!
+    * \fn floatStats
+    * \brief Statistics of float voxels: range, mean and variance in a first pass, then histogram over the range
+    * Non-finite values are ignored.
+    */
+    Stats floatStats(const VolumeView<const float>& _vol, const Box& _box, int _nbBins)
+    {
+        Stats stats;
+        std::mutex statsMutex;
+
+        // sums are computed relative to a voxel of the box, to limit cancellation in the variance
+        const double shift = std::isfinite(*_box.row(_vol, 0)) ? double(*_box.row(_vol, 0)) : 0.0;
+        float minVal = std::numeric_limits<float>::max();
+        float maxVal = std::numeric_limits<float>::lowest();
+        double sum = 0.0, sumSq = 0.0;
+
+        Parallel::parallelFor(0, _box.nbRows(), [&](size_t _first, size_t _last)
+        {
+            float localMin = std::numeric_limits<float>::max();
+            float localMax = std::numeric_limits<float>::lowest();
+            double localSum = 0.0, localSumSq = 0.0;
+            std::uint64_t localCount = 0;
+            for (size_t r = _first; r < _last; r++)
+            {
+                const float* row = _box.row(_vol, r);
+                accumulateRow(row, _box.nx, float(shift), &localMin, &localMax, &localSum, &localSumSq, &localCount);
+            }
+
+            std::lock_guard<std::mutex> lock(statsMutex);
+            minVal = std::min(minVal, localMin);
+            maxVal = std::max(maxVal, localMax);
+            sum += localSum;
+            sumSq += localSumSq;
+            stats.count += localCount;
+        }, minRowsPerRange);
+
+        if (stats.count == 0)
+            return stats;
+
+        double meanOffset = sum / double(stats.count);
+        stats.range = glm::vec2(minVal, maxVal);
+        stats.mean = shift + meanOffset;
+        stats.variance = std::max(0.0, sumSq / double(stats.count) - meanOffset * meanOffset);
+
+        // histogram
+        int nbBins = _nbBins <= 0 ? nbFloatBins : _nbBins;
+        stats.binRange = stats.range;
+        stats.histogram.assign(nbBins, 0);
+        float scale = maxVal > minVal ? float(nbBins) / (maxVal - minVal) : 0.0f;
+
+        Parallel::parallelFor(0, _box.nbRows(), [&](size_t _first, size_t _last)
+        {
+            // 4 interleaved tables (see countValues()), with an extra bin for non-finite values
+            const size_t tableSize = size_t(nbBins) + 1;
+            std::vector<std::uint64_t> local(4 * tableSize, 0);
+            auto binOf = [&](float _v)
+            {
+                return (_v >= minVal && _v <= maxVal) ? std::min(int((_v - minVal) * scale), nbBins - 1) : nbBins;
+            };
+            for (size_t r = _first; r < _last; r++)
+            {
+                const float* row = _box.row(_vol, r);
+                size_t x = 0;
+                for (; x + 4 <= _box.nx; x += 4)
+                {
+                    local[binOf(row[x])]++;
+                    local[tableSize + binOf(row[x + 1])]++;
+                    local[2 * tableSize + binOf(row[x + 2])]++;
+                    local[3 * tableSize + binOf(row[x + 3])]++;
+                }
+                for (; x < _box.nx; x++)
+                    local[binOf(row[x])]++;
+            }
+
+            std::lock_guard<std::mutex> lock(statsMutex);
+            for (int b = 0; b < nbBins; b++)
+                stats.histogram[b] += local[b] + local[tableSize + b] + local[2 * tableSize + b] + local[3 * tableSize + b];
+        }, minRowsPerRange);
+
+        return stats;
+    }
+
+} // namespace
+
+
+float Stats::percentile(float _percent) const
+{
+    if (empty() || histogram.empty())
+        return range.x;
+
+    double target = double(std::clamp(_percent, 0.0f, 100.0f)) * 0.01 * double(count);
+    double cumul = 0.0;
+    float width = binWidth();
+    for (size_t b = 0; b < histogram.size(); b++)
+    {
+        double binCount = double(histogram[b]);
+        if (binCount > 0.0 && cumul + binCount >= target)
+        {
+            // voxels evenly spread in their bin
+            float value = binRange.x + width * (float(b) + float((target - cumul) / binCount));
+            return std::clamp(value, range.x, range.y);
+        }
+        cumul += binCount;
+    }
+    return range.y;
+}
+
+
+float Stats::fractionBelow(float _value) const
+{
+    if (empty() || histogram.empty() || _value <= binRange.x)
+        return 0.0f;
+
+    float width = binWidth();
+    if (width <= 0.0f)
+        return _value > range.x ? 1.0f : 0.0f;
+
+    float pos = (_value - binRange.x) / width;
+    size_t bin = std::min(size_t(pos), histogram.size());
+    double cumul = 0.0;
+    for (size_t b = 0; b < bin; b++)
+        cumul += double(histogram[b]);
+    if (bin < histogram.size())
+        cumul += double(histogram[bin]) * double(pos - float(bin));
+    return float(cumul / double(count));
+}
+
+
+template <typename VoxelType>
+Stats compute(VolumeView<const VoxelType> _vol, glm::ivec3 _boxMin, glm::ivec3 _boxMax, int _nbBins)
+{
+    Box box = clampBox(_vol.getDimensions(), _boxMin, _boxMax);
+    if (_vol.empty() || box.nbVoxels() == 0)
+        return Stats();
+
+    if constexpr (std::is_same_v<VoxelType, float>)
+        return floatStats(_vol, box, _nbBins);
+    else
+        return integerStats(_vol, box, _nbBins);
+}
+
+template Stats compute<std::uint8_t>(VolumeView<const std::uint8_t>, glm::ivec3, glm::ivec3, int);
+template Stats compute<std::uint16_t>(VolumeView<const std::uint16_t>, glm::ivec3, glm::ivec3, int);
+template Stats compute<std::int16_t>(VolumeView<const std::int16_t>, glm::ivec3, glm::ivec3, int);
+template Stats compute<float>(VolumeView<const float>, glm::ivec3, glm::ivec3, int);
+
+
+Stats compute(VolumeImg& _vol, glm::ivec3 _boxMin, glm::ivec3 _boxMax, int _nbBins)
+{
+    size_t nbVoxels = _vol.getNbVoxels();
+    Stats stats;
+    _vol.visit([&](auto& _typedVol)
+    {
+        // no data (e.g. out-of-core volume)
+        if (nbVoxels == 0 || _typedVol.getStorage().size() != nbVoxels)
+            return;
+
+        stats = compute(std::as_const(_typedVol).view(), _boxMin, _boxMax, _nbBins);
+    });
+    return stats;
+}
+
+
+Stats compute(VolumeImg& _vol, int _nbBins)
+{
+    return compute(_vol, glm::ivec3(0), _vol.getDimensions(), _nbBins);
+}
+
+
+glm::vec2 autoWindow(const Stats& _stats, float _lowPercent, float _highPercent)
+{
+    glm::vec2 window(_stats.percentile(_lowPercent), _stats.percentile(_highPercent));
+    if (window.y - window.x < _stats.binWidth() || window.y <= window.x)
+        window.y = window.x + (_stats.binWidth() > 0.0f ? _stats.binWidth() : 1.0f);
+    return window;
+}
+
+
+float otsuThreshold(const Stats& _stats)
+{
+    if (_stats.empty() || _stats.histogram.empty())
+        return _stats.range.x;
+
+    // maximize the variance between the classes [0 ; t] and ]t ; nbBins[ (bin indices as values)
+    double sumAll = 0.0;
+    for (size_t b = 0; b < _stats.histogram.size(); b++)
+        sumAll += double(b) * double(_stats.histogram[b]);
+
+    double weightLow = 0.0, sumLow = 0.0, bestVariance = -1.0;
+    size_t bestBin = 0;
+    for (size_t b = 0; b < _stats.histogram.size(); b++)
+    {
+        weightLow += double(_stats.histogram[b]);
+        sumLow += double(b) * double(_stats.histogram[b]);
+        double weightHigh = double(_stats.count) - weightLow;
+        if (weightLow == 0.0)
+            continue;
+        if (weightHigh <= 0.0)
+            break;
+
+        double meanDiff = sumLow / weightLow - (sumAll - sumLow) / weightHigh;
+        double variance = weightLow * weightHigh * meanDiff * meanDiff;
+        if (variance > bestVariance)
+        {
+            bestVariance = variance;
+            bestBin = b;
+        }
+    }
+
+    return std::min(_stats.binRange.x + _stats.binWidth() * float(bestBin + 1), _stats.range.y);
+}
+
+} // namespace VolumeStats
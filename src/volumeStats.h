@@ -0,0 +1,126 @@
+/*********************************************************************************************************************
+ *
+ * volumeStats.h
+ *
+ * Histogram and statistics of voxel values (range, mean, variance, percentiles)
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef VOLUMESTATS_H
+#define VOLUMESTATS_H
+
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "volumeView.h"
+
+
+class VolumeImg;
+
+
+/*!
+* \namespace VolumeStats
+* \brief Statistics of the voxel values of a volume, or of a box of it, in native units.
+* Computed in a single multithreaded pass for 8b and 16b voxels (each thread counts every value of the voxel type,
+* counts are merged and then gathered in bins), in two passes for float voxels (range, then bins).
+* Mean and variance are exact for integer voxels, percentiles are interpolated within bins.
+*/
+namespace VolumeStats
+{
+
+    /*! Number of bins of the histogram */
+    enum Bins
+    {
+        BINS_NATIVE = 0,    /*!< one bin per value for integer voxels (4096 bins for float voxels) */
+        BINS_256 = 256,
+        BINS_4096 = 4096
+    };
+
+
+    /*!
+    * \struct Stats
+    * \brief Statistics of a set of voxels
+    * Bins evenly split binRange: for integer voxels, a bin gathers whole values, and binRange is [min ; max + 1[
+    * (so there are never more bins than values); for float voxels, binRange is [min ; max].
+    */
+    struct Stats
+    {
+        std::uint64_t count = 0;                        /*!< number of voxels (non-finite float values excluded) */
+        glm::vec2 range = glm::vec2(0.0f);              /*!< min and max values */
+        double mean = 0.0;                              /*!< mean value */
+        double variance = 0.0;                          /*!< variance of values */
+        glm::vec2 binRange = glm::vec2(0.0f, 1.0f);     /*!< values covered by the bins */
+        std::vector<std::uint64_t> histogram;           /*!< number of voxels per bin */
+
+        inline bool empty() const { return count == 0; }
+        /*! \fn binWidth : range of values of a bin */
+        inline float binWidth() const { return histogram.empty() ? 0.0f : (binRange.y - binRange.x) / float(histogram.size()); }
+
+        /*!
+        * \fn percentile
+        * \brief Value below which a given percentage of the voxels lie
+        * \param _percent : percentage, in [0 ; 100]
+        */
+        float percentile(float _percent) const;
+
+        /*!
+        * \fn fractionBelow
+        * \brief Fraction of the voxels whose value is below a given value, in [0 ; 1] (inverse of percentile())
+        */
+        float fractionBelow(float _value) const;
+    };
+
+
+    /*!
+    * \fn compute
+    * \brief Statistics of a box of voxels (multithreaded)
+    * \param _vol : voxels
+    * \param _boxMin : first voxel of the box (clamped to the grid)
+    * \param _boxMax : voxel after the last one of the box, along each axis (clamped to the grid)
+    * \param _nbBins : number of bins (see Bins, any positive number is accepted)
+    */
+    template <typename VoxelType>
+    Stats compute(VolumeView<const VoxelType> _vol, glm::ivec3 _boxMin, glm::ivec3 _boxMax, int _nbBins = BINS_256);
+
+    /*!
+    * \fn compute
+    * \brief Statistics of a box of a volume, whatever its voxel type (see above)
+    * Volumes without data in memory (e.g. out-of-core volumes) give empty statistics.
+    */
+    Stats compute(VolumeImg& _vol, glm::ivec3 _boxMin, glm::ivec3 _boxMax, int _nbBins = BINS_256);
+
+    /*!
+    * \fn compute
+    * \brief Statistics of a whole volume (see above)
+    */
+    Stats compute(VolumeImg& _vol, int _nbBins = BINS_256);
+
+
+    /*!
+    * \fn autoWindow
+    * \brief Window [low ; high] between two percentiles, discarding outliers (at least one bin wide)
+    * \param _stats : statistics of the volume
+    * \param _lowPercent : percentile of the low bound
+    * \param _highPercent : percentile of the high bound
+    */
+    glm::vec2 autoWindow(const Stats& _stats, float _lowPercent = 0.5f, float _highPercent = 99.5f);
+
+    /*!
+    * \fn otsuThreshold
+    * \brief Threshold best separating the histogram into two classes (Otsu's method), e.g. background and object
+    * \return threshold (native units): upper bound of the last bin of the low class
+    */
+    float otsuThreshold(const Stats& _stats);
+
+}
+
+#endif // VOLUMESTATS_H
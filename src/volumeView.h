@@ -0,0 +1,131 @@
+/*********************************************************************************************************************
+ *
+ * volumeView.h
+ *
+ * Non-owning 3D view of a voxel array, with unchecked 64-bit indexing for hot loops
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef VOLUMEVIEW_H
+#define VOLUMEVIEW_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+
+/*!
+* \class VolumeView
+* \brief mdspan-like view of a voxel grid in linear layout (x fastest, then y, then z)
+* Indices are computed in size_t, so that grids of more than 2^31 voxels (e.g. 2048^3) do not wrap.
+* Accessors do not check bounds and never log: they are meant to be inlined in CPU kernels, whose bounds
+* are checked once at the API boundary (see VolumeBase::getValue3ui() for checked access).
+* A view is a pointer and strides: it is cheap to copy, and must not outlive the storage it points to.
+* Use VolumeView<const T> for read-only access.
+*/
+template <typename VoxelType>
+class VolumeView
+{
+    public:
+
+        using value_type = std::remove_const_t<VoxelType>;
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                        CONSTRUCTORS / DESTRUCTORS                                           |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        VolumeView() {}
+
+        VolumeView(VoxelType* _data, glm::ivec3 _dimensions)
+            : m_data(_data)
+            , m_extentX(size_t(std::max(_dimensions.x, 0)))
+            , m_extentY(size_t(std::max(_dimensions.y, 0)))
+            , m_extentZ(size_t(std::max(_dimensions.z, 0)))
+            , m_strideZ(m_extentX * m_extentY)
+        {}
+
+        /*! read-only view of a mutable view */
+        template <typename T, typename = std::enable_if_t<std::is_same_v<const T, VoxelType>>>
+        VolumeView(const VolumeView<T>& _other) : VolumeView(_other.data(), _other.getDimensions()) {}
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                  ACCESS                                                     |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*! \fn index : index in array of voxel (_i, _j, _k) */
+        inline size_t index(size_t _i, size_t _j, size_t _k) const { return _k * m_strideZ + _j * m_extentX + _i; }
+
+        inline VoxelType& operator()(size_t _i, size_t _j, size_t _k) const { return m_data[index(_i, _j, _k)]; }
+        inline VoxelType& operator[](size_t _id) const { return m_data[_id]; }
+
+        /*! \fn row : first voxel of row (_j, _k) (voxels along x are contiguous) */
+        inline VoxelType* row(size_t _j, size_t _k) const { return m_data + _k * m_strideZ + _j * m_extentX; }
+        /*! \fn slice : first voxel of slice _k */
+        inline VoxelType* slice(size_t _k) const { return m_data + _k * m_strideZ; }
+
+        /*! \fn isInData : true if voxel (_i, _j, _k) is in the grid (signed, so that neighbors of border voxels can be tested) */
+        inline bool isInData(std::int64_t _i, std::int64_t _j, std::int64_t _k) const
+        {
+            return std::uint64_t(_i) < m_extentX && std::uint64_t(_j) < m_extentY && std::uint64_t(_k) < m_extentZ;
+        }
+
+        /*! \fn valueBound : value of voxel (_i, _j, _k), or 0 out of the grid */
+        inline value_type valueBound(std::int64_t _i, std::int64_t _j, std::int64_t _k) const
+        {
+            return isInData(_i, _j, _k) ? m_data[index(size_t(_i), size_t(_j), size_t(_k))] : value_type(0);
+        }
+
+        /*! \fn valueClamped : value of voxel (_i, _j, _k), coordinates clamped to the grid (i.e. border voxels repeated) */
+        inline value_type valueClamped(std::int64_t _i, std::int64_t _j, std::int64_t _k) const
+        {
+            return m_data[index(clamp(_i, m_extentX), clamp(_j, m_extentY), clamp(_k, m_extentZ))];
+        }
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                GETTERS                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        inline VoxelType* data() const { return m_data; }
+        inline glm::ivec3 getDimensions() const { return glm::ivec3(int(m_extentX), int(m_extentY), int(m_extentZ)); }
+        /*! \fn extent : number of voxels along axis _axis (0: x, 1: y, 2: z) */
+        inline size_t extent(int _axis) const { return _axis == 0 ? m_extentX : (_axis == 1 ? m_extentY : m_extentZ); }
+        /*! \fn stride : distance in array between two neighbor voxels along axis _axis */
+        inline size_t stride(int _axis) const { return _axis == 0 ? 1 : (_axis == 1 ? m_extentX : m_strideZ); }
+        /*! \fn size : number of voxels */
+        inline size_t size() const { return m_strideZ * m_extentZ; }
+        inline bool empty() const { return m_data == nullptr || size() == 0; }
+
+
+    protected:
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                ATTRIBUTES                                                   |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        VoxelType* m_data = nullptr;    /*!< first voxel */
+        size_t m_extentX = 0;           /*!< number of voxels along x (i.e. stride along y) */
+        size_t m_extentY = 0;           /*!< number of voxels along y */
+        size_t m_extentZ = 0;           /*!< number of voxels along z */
+        size_t m_strideZ = 0;           /*!< number of voxels of a slice (i.e. stride along z) */
+
+
+        static inline size_t clamp(std::int64_t _v, size_t _extent)
+        {
+            return _v < 0 ? 0 : (std::uint64_t(_v) >= _extent ? _extent - 1 : size_t(_v));
+        }
+
+};
+
+#endif // VOLUMEVIEW_H
@@ -0,0 +1,438 @@
+/*********************************************************************************************************************
+ *
+ * voxelConvert.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#include "voxelConvert.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+#include "parallel.h"
+#include "simd.h"
+
+
+namespace VoxelConvert
+{
+
+namespace
+{
+    // minimal number of voxels processed by a thread
+    const size_t minGrain = 1 << 16;
+
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                                  SCALAR                                                     |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+    inline uint16_t bswap16(uint16_t _v) { return uint16_t((_v >> 8) | (_v << 8)); }
+    inline uint32_t bswap32(uint32_t _v) { return (_v >> 24) | ((_v >> 8) & 0xff00u) | ((_v << 8) & 0xff0000u) | (_v << 24); }
+
+    // Load one voxel as float, byte swapped if needed
+    inline float loadScalar(const int16_t* _p, bool _swap)
+    {
+        uint16_t u;
+        std::memcpy(&u, _p, sizeof(u));
+        return float(int16_t(_swap ? bswap16(u) : u));
+    }
+    inline float loadScalar(const uint16_t* _p, bool _swap)
+    {
+        return float(_swap ? bswap16(*_p) : *_p);
+    }
+    inline float loadScalar(const uint32_t* _p, bool _swap)
+    {
+        return float(_swap ? bswap32(*_p) : *_p);
+    }
+    inline float loadScalar(const float* _p, bool _swap)
+    {
+        uint32_t u;
+        std::memcpy(&u, _p, sizeof(u));
+        if (_swap)
+            u = bswap32(u);
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                                   AVX2                                                      |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+#if defined(SIMD_X86)
+
+    namespace Avx2
+    {
+        const size_t simdWidth = 8;
+
+        SIMD_TARGET_AVX2 inline __m128i swapMask16() { return _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14); }
+        SIMD_TARGET_AVX2 inline __m256i swapMask32() { return _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                                              3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12); }
+
+        // exact uint32 -> float conversion (AVX2 only converts signed values)
+        SIMD_TARGET_AVX2 inline __m256 uint32ToFloat(__m256i _u)
+        {
+            __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(_u, 16));
+            __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(_u, _mm256_set1_epi32(0xffff)));
+            return _mm256_add_ps(_mm256_mul_ps(hi, _mm256_set1_ps(65536.0f)), lo);
+        }
+
+        // Load 8 voxels as floats, byte swapped if needed
+        SIMD_TARGET_AVX2 inline __m256 loadSimd(const int16_t* _p, bool _swap)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p));
+            if (_swap)
+                v = _mm_shuffle_epi8(v, swapMask16());
+            return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+        }
+        SIMD_TARGET_AVX2 inline __m256 loadSimd(const uint16_t* _p, bool _swap)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p));
+            if (_swap)
+                v = _mm_shuffle_epi8(v, swapMask16());
+            return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(v));
+        }
+        SIMD_TARGET_AVX2 inline __m256 loadSimd(const uint32_t* _p, bool _swap)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_p));
+            if (_swap)
+                v = _mm256_shuffle_epi8(v, swapMask32());
+            return uint32ToFloat(v);
+        }
+        SIMD_TARGET_AVX2 inline __m256 loadSimd(const float* _p, bool _swap)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_p));
+            if (_swap)
+                v = _mm256_shuffle_epi8(v, swapMask32());
+            return _mm256_castsi256_ps(v);
+        }
+
+        SIMD_TARGET_AVX2 inline void minMaxSimd(__m256 _v, __m256* _min, __m256* _max)
+        {
+            // NaN values (first operand) are ignored
+            *_min = _mm256_min_ps(_v, *_min);
+            *_max = _mm256_max_ps(_v, *_max);
+        }
+
+        SIMD_TARGET_AVX2 inline void reduceMinMax(__m256 _min, __m256 _max, float* _rMin, float* _rMax)
+        {
+            alignas(32) float mins[8], maxs[8];
+            _mm256_store_ps(mins, _min);
+            _mm256_store_ps(maxs, _max);
+            for (int k = 0; k < 8; k++)
+            {
+                *_rMin = std::min(*_rMin, mins[k]);
+                *_rMax = std::max(*_rMax, maxs[k]);
+            }
+        }
+
+        SIMD_TARGET_AVX2 inline void swapSimd(uint16_t* _p)
+        {
+            __m256i mask = _mm256_broadcastsi128_si256(swapMask16());
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i*>(_p));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_p), _mm256_shuffle_epi8(v, mask));
+        }
+        SIMD_TARGET_AVX2 inline void swapSimd(uint32_t* _p)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i*>(_p));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(_p), _mm256_shuffle_epi8(v, swapMask32()));
+        }
+
+        // number of elements per swapSimd() call
+        template <typename T> constexpr size_t swapWidth() { return 32 / sizeof(T); }
+
+        typedef __m256 SimdFloat;
+        SIMD_TARGET_AVX2 inline SimdFloat simdSet(float _v) { return _mm256_set1_ps(_v); }
+
+
+        template <typename T>
+        SIMD_TARGET_AVX2 void swapRange(T* _data, size_t _nbElem)
+        {
+            size_t i = 0;
+            for (; i + swapWidth<T>() <= _nbElem; i += swapWidth<T>())
+                swapSimd(_data + i);
+            for (; i < _nbElem; i++)
+            {
+                if constexpr (sizeof(T) == 2)
+                    _data[i] = bswap16(_data[i]);
+                else
+                    _data[i] = bswap32(_data[i]);
+            }
+        }
+
+        template <typename T>
+        SIMD_TARGET_AVX2 void valueRangeRange(const T* _src, size_t _nbElem, bool _swap, float* _min, float* _max)
+        {
+            size_t i = 0;
+            SimdFloat vMin = simdSet(*_min), vMax = simdSet(*_max);
+            for (; i + simdWidth <= _nbElem; i += simdWidth)
+                minMaxSimd(loadSimd(_src + i, _swap), &vMin, &vMax);
+            reduceMinMax(vMin, vMax, _min, _max);
+            for (; i < _nbElem; i++)
+            {
+                float v = loadScalar(_src + i, _swap);
+                if (v < *_min)
+                    *_min = v;
+                if (v > *_max)
+                    *_max = v;
+            }
+        }
+    } // namespace Avx2
+
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                                   SSE4                                                      |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+    namespace Sse4
+    {
+        const size_t simdWidth = 8;
+
+        // 8 voxels, as 2 x 4 floats
+        struct SimdFloat8 { __m128 lo, hi; };
+
+        SIMD_TARGET_SSE4 inline __m128i swapMask16() { return _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14); }
+        SIMD_TARGET_SSE4 inline __m128i swapMask32() { return _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12); }
+
+        // exact uint32 -> float conversion (SSE only converts signed values)
+        SIMD_TARGET_SSE4 inline __m128 uint32ToFloat(__m128i _u)
+        {
+            __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(_u, 16));
+            __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(_u, _mm_set1_epi32(0xffff)));
+            return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo);
+        }
+
+        // Load 8 voxels as floats, byte swapped if needed
+        SIMD_TARGET_SSE4 inline SimdFloat8 loadSimd(const int16_t* _p, bool _swap)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p));
+            if (_swap)
+                v = _mm_shuffle_epi8(v, swapMask16());
+            return { _mm_cvtepi32_ps(_mm_cvtepi16_epi32(v)), _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(v, 8))) };
+        }
+        SIMD_TARGET_SSE4 inline SimdFloat8 loadSimd(const uint16_t* _p, bool _swap)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p));
+            if (_swap)
+                v = _mm_shuffle_epi8(v, swapMask16());
+            return { _mm_cvtepi32_ps(_mm_cvtepu16_epi32(v)), _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(v, 8))) };
+        }
+        SIMD_TARGET_SSE4 inline SimdFloat8 loadSimd(const uint32_t* _p, bool _swap)
+        {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p + 4));
+            if (_swap)
+            {
+                lo = _mm_shuffle_epi8(lo, swapMask32());
+                hi = _mm_shuffle_epi8(hi, swapMask32());
+            }
+            return { uint32ToFloat(lo), uint32ToFloat(hi) };
+        }
+        SIMD_TARGET_SSE4 inline SimdFloat8 loadSimd(const float* _p, bool _swap)
+        {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p + 4));
+            if (_swap)
+            {
+                lo = _mm_shuffle_epi8(lo, swapMask32());
+                hi = _mm_shuffle_epi8(hi, swapMask32());
+            }
+            return { _mm_castsi128_ps(lo), _mm_castsi128_ps(hi) };
+        }
+
+        SIMD_TARGET_SSE4 inline void minMaxSimd(SimdFloat8 _v, __m128* _min, __m128* _max)
+        {
+            // NaN values (first operand) are ignored
+            *_min = _mm_min_ps(_v.hi, _mm_min_ps(_v.lo, *_min));
+            *_max = _mm_max_ps(_v.hi, _mm_max_ps(_v.lo, *_max));
+        }
+
+        SIMD_TARGET_SSE4 inline void reduceMinMax(__m128 _min, __m128 _max, float* _rMin, float* _rMax)
+        {
+            alignas(16) float mins[4], maxs[4];
+            _mm_store_ps(mins, _min);
+            _mm_store_ps(maxs, _max);
+            for (int k = 0; k < 4; k++)
+            {
+                *_rMin = std::min(*_rMin, mins[k]);
+                *_rMax = std::max(*_rMax, maxs[k]);
+            }
+        }
+
+        SIMD_TARGET_SSE4 inline void swapSimd(uint16_t* _p)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i*>(_p));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(_p), _mm_shuffle_epi8(v, swapMask16()));
+        }
+        SIMD_TARGET_SSE4 inline void swapSimd(uint32_t* _p)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i*>(_p));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(_p), _mm_shuffle_epi8(v, swapMask32()));
+        }
+
+        // number of elements per swapSimd() call
+        template <typename T> constexpr size_t swapWidth() { return 16 / sizeof(T); }
+
+        typedef __m128 SimdFloat;
+        SIMD_TARGET_SSE4 inline SimdFloat simdSet(float _v) { return _mm_set1_ps(_v); }
+
+        template <typename T>
+        SIMD_TARGET_SSE4 void swapRange(T* _data, size_t _nbElem)
+        {
+            size_t i = 0;
+            for (; i + swapWidth<T>() <= _nbElem; i += swapWidth<T>())
+                swapSimd(_data + i);
+            for (; i < _nbElem; i++)
+            {
+                if constexpr (sizeof(T) == 2)
+                    _data[i] = bswap16(_data[i]);
+                else
+                    _data[i] = bswap32(_data[i]);
+            }
+        }
+
+        template <typename T>
+        SIMD_TARGET_SSE4 void valueRangeRange(const T* _src, size_t _nbElem, bool _swap, float* _min, float* _max)
+        {
+            size_t i = 0;
+            SimdFloat vMin = simdSet(*_min), vMax = simdSet(*_max);
+            for (; i + simdWidth <= _nbElem; i += simdWidth)
+                minMaxSimd(loadSimd(_src + i, _swap), &vMin, &vMax);
+            reduceMinMax(vMin, vMax, _min, _max);
+            for (; i < _nbElem; i++)
+            {
+                float v = loadScalar(_src + i, _swap);
+                if (v < *_min)
+                    *_min = v;
+                if (v > *_max)
+                    *_max = v;
+            }
+        }
+    } // namespace Sse4
+
+#endif
+
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                              RANGE KERNELS                                                  |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+    template <typename T>
+    void swapRange(T* _data, size_t _nbElem)
+    {
+#if defined(SIMD_X86)
+        if (Simd::hasAVX2())
+            return Avx2::swapRange(_data, _nbElem);
+        if (Simd::hasSSE4())
+            return Sse4::swapRange(_data, _nbElem);
+#endif
+        for (size_t i = 0; i < _nbElem; i++)
+        {
+            if constexpr (sizeof(T) == 2)
+                _data[i] = bswap16(_data[i]);
+            else
+                _data[i] = bswap32(_data[i]);
+        }
+    }
+
+    template <typename T>
+    void valueRangeRange(const T* _src, size_t _nbElem, bool _swap, float* _min, float* _max)
+    {
+#if defined(SIMD_X86)
+        if (Simd::hasAVX2())
+            return Avx2::valueRangeRange(_src, _nbElem, _swap, _min, _max);
+        if (Simd::hasSSE4())
+            return Sse4::valueRangeRange(_src, _nbElem, _swap, _min, _max);
+#endif
+        for (size_t i = 0; i < _nbElem; i++)
+        {
+            float v = loadScalar(_src + i, _swap);
+            if (v < *_min)
+                *_min = v;
+            if (v > *_max)
+                *_max = v;
+        }
+    }
+
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                             THREADED KERNELS                                                |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+    template <typename T>
+    void valueRangeParallel(const T* _src, size_t _nbElem, bool _swap, float* _min, float* _max)
+    {
+        float rMin = std::numeric_limits<float>::max();
+        float rMax = std::numeric_limits<float>::lowest();
+        std::mutex mutex;
+        Parallel::parallelFor(0, _nbElem, [&](size_t _first, size_t _last) {
+            float tMin = std::numeric_limits<float>::max();
+            float tMax = std::numeric_limits<float>::lowest();
+            valueRangeRange(_src + _first, _last - _first, _swap, &tMin, &tMax);
+            std::lock_guard<std::mutex> lock(mutex);
+            rMin = std::min(rMin, tMin);
+            rMax = std::max(rMax, tMax);
+        }, minGrain);
+
+        // empty or all-NaN data
+        if (rMin > rMax)
+            rMin = rMax = 0.0f;
+
+        *_min = rMin;
+        *_max = rMax;
+    }
+
+} // anonymous namespace
+
+
+const char* simdName()
+{
+#if defined(SIMD_X86)
+    if (Simd::hasAVX2())
+        return "AVX2";
+    if (Simd::hasSSE4())
+        return "SSE4";
+#endif
+    return "scalar";
+}
+
+
+void swapBytes(uint16_t* _data, size_t _nbElem)
+{
+    Parallel::parallelFor(0, _nbElem, [&](size_t _first, size_t _last) { swapRange(_data + _first, _last - _first); }, minGrain);
+}
+
+void swapBytes(uint32_t* _data, size_t _nbElem)
+{
+    Parallel::parallelFor(0, _nbElem, [&](size_t _first, size_t _last) { swapRange(_data + _first, _last - _first); }, minGrain);
+}
+
+
+void valueRange(const int16_t* _src, size_t _nbElem, bool _swap, float* _min, float* _max)
+{
+    valueRangeParallel(_src, _nbElem, _swap, _min, _max);
+}
+
+void valueRange(const uint16_t* _src, size_t _nbElem, bool _swap, float* _min, float* _max)
+{
+    valueRangeParallel(_src, _nbElem, _swap, _min, _max);
+}
+
+void valueRange(const uint32_t* _src, size_t _nbElem, bool _swap, float* _min, float* _max)
+{
+    valueRangeParallel(_src, _nbElem, _swap, _min, _max);
+}
+
+void valueRange(const float* _src, size_t _nbElem, bool _swap, float* _min, float* _max)
+{
+    valueRangeParallel(_src, _nbElem, _swap, _min, _max);
+}
+
+} // namespace VoxelConvert
@@ -0,0 +1,67 @@
+/*********************************************************************************************************************
+ *
+ * voxelConvert.h
+ *
+ * Vectorized (SSE4 / AVX2) and multithreaded voxel conversion kernels (byte swap, value range)
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef VOXELCONVERT_H
+#define VOXELCONVERT_H
+
+
+#include <cstdint>
+#include <cstddef>
+
+
+namespace VoxelConvert
+{
+
+    /*!
+    * \fn simdName
+    * \brief Name of the instruction set the kernels use on this CPU ("AVX2", "SSE4" or "scalar")
+    */
+    const char* simdName();
+
+
+    /*!
+    * \fn swapBytes
+    * \brief Swap byte order of 2-byte or 4-byte elements, in place
+    * \param _data : first element
+    * \param _nbElem : number of elements
+    */
+    void swapBytes(uint16_t* _data, size_t _nbElem);
+    void swapBytes(uint32_t* _data, size_t _nbElem);
+
+    template <typename T>
+    void swapBytes(T* _data, size_t _nbElem)
+    {
+        static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4, "VoxelConvert::swapBytes(): unsupported element size");
+        if constexpr (sizeof(T) == 2)
+            swapBytes(reinterpret_cast<uint16_t*>(_data), _nbElem);
+        else if constexpr (sizeof(T) == 4)
+            swapBytes(reinterpret_cast<uint32_t*>(_data), _nbElem);
+    }
+
+
+    /*!
+    * \fn valueRange
+    * \brief Min and max values of source voxels (NaN values are ignored)
+    * \param _src : source voxels
+    * \param _nbElem : number of voxels
+    * \param _swap : true if source voxels must be byte swapped
+    * \param _min : returned min value
+    * \param _max : returned max value
+    */
+    void valueRange(const int16_t* _src, size_t _nbElem, bool _swap, float* _min, float* _max);
+    void valueRange(const uint16_t* _src, size_t _nbElem, bool _swap, float* _min, float* _max);
+    void valueRange(const uint32_t* _src, size_t _nbElem, bool _swap, float* _min, float* _max);
+    void valueRange(const float* _src, size_t _nbElem, bool _swap, float* _min, float* _max);
+
+} // namespace VoxelConvert
+
+#endif // VOXELCONVERT_H
@@ -0,0 +1,173 @@
+/*********************************************************************************************************************
+ *
+ * voxelStorage.h
+ *
+ * Voxel array, either owned or mapped from a file
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef VOXELSTORAGE_H
+#define VOXELSTORAGE_H
+
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+
+#include "mappedFile.h"
+
+
+/*!
+* \class VoxelStorage
+* \brief Contiguous array of voxels with a std::vector-like interface
+* Data is either owned (std::vector) or a view into a memory-mapped file, so that a volume
+* can expose the data section of a file without any intermediate copy.
+* Any operation changing the size of a mapped array first copies it into owned memory.
+*/
+template <typename VoxelType>
+class VoxelStorage
+{
+    public:
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                        CONSTRUCTORS / DESTRUCTORS                                           |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        VoxelStorage() {}
+
+        // copies always own their data (a mapping is private to its volume)
+        VoxelStorage(const VoxelStorage& _other) { *this = _other; }
+
+        VoxelStorage& operator=(const VoxelStorage& _other)
+        {
+            if (this != &_other)
+            {
+                m_mapping.reset();
+                m_owned.assign(_other.m_ptr, _other.m_ptr + _other.m_size);
+                syncOwned();
+            }
+            return *this;
+        }
+
+        VoxelStorage(VoxelStorage&& _other) noexcept { *this = std::move(_other); }
+
+        VoxelStorage& operator=(VoxelStorage&& _other) noexcept
+        {
+            if (this != &_other)
+            {
+                m_owned = std::move(_other.m_owned);
+                m_mapping = std::move(_other.m_mapping);
+                m_ptr = _other.m_ptr;
+                m_size = _other.m_size;
+                _other.syncOwned();
+            }
+            return *this;
+        }
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                  ACCESS                                                     |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        inline VoxelType& operator[](size_t _id) { return m_ptr[_id]; }
+        inline const VoxelType& operator[](size_t _id) const { return m_ptr[_id]; }
+
+        inline VoxelType* data() { return m_ptr; }
+        inline const VoxelType* data() const { return m_ptr; }
+
+        inline size_t size() const { return m_size; }
+        inline bool empty() const { return m_size == 0; }
+
+        inline VoxelType* begin() { return m_ptr; }
+        inline VoxelType* end() { return m_ptr + m_size; }
+        inline const VoxelType* begin() const { return m_ptr; }
+        inline const VoxelType* end() const { return m_ptr + m_size; }
+
+        /*! \fn isMapped : true if data is a view into a mapped file */
+        inline bool isMapped() const { return m_mapping != nullptr; }
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                  MODIFIERS                                                  |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        void assign(size_t _nbElem, VoxelType _val)
+        {
+            m_mapping.reset();
+            m_owned.assign(_nbElem, _val);
+            syncOwned();
+        }
+
+        void resize(size_t _nbElem)
+        {
+            if (isMapped())
+            {
+                // detach from mapping, keeping the mapped values
+                std::vector<VoxelType> owned(_nbElem);
+                std::memcpy(owned.data(), m_ptr, std::min(_nbElem, m_size) * sizeof(VoxelType));
+                m_mapping.reset();
+                m_owned = std::move(owned);
+            }
+            else
+            {
+                m_owned.resize(_nbElem);
+            }
+            syncOwned();
+        }
+
+        void clear()
+        {
+            m_mapping.reset();
+            m_owned.clear();
+            m_owned.shrink_to_fit();
+            syncOwned();
+        }
+
+        /*!
+        * \fn adoptMapping
+        * \brief Use a region of a mapped file as voxel array (no copy)
+        * \param _file : mapped file (kept alive as long as the storage uses it)
+        * \param _offset : offset in bytes of first voxel in the file (must be aligned on sizeof(VoxelType))
+        * \param _nbElem : number of voxels
+        * \return false if region is out of file or misaligned
+        */
+        bool adoptMapping(std::shared_ptr<MappedFile> _file, size_t _offset, size_t _nbElem)
+        {
+            if (_file == nullptr || !_file->isOpen()
+                || _offset > _file->size() || _nbElem > (_file->size() - _offset) / sizeof(VoxelType)
+                || _offset % alignof(VoxelType) != 0)
+            {
+                return false;
+            }
+
+            m_owned.clear();
+            m_owned.shrink_to_fit();
+            m_mapping = _file;
+            m_ptr = reinterpret_cast<VoxelType*>(_file->data() + _offset);
+            m_size = _nbElem;
+            return true;
+        }
+
+
+    protected:
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                ATTRIBUTES                                                   |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        std::vector<VoxelType> m_owned;             /*!< owned voxel data (empty when mapped) */
+        std::shared_ptr<MappedFile> m_mapping;      /*!< mapped file providing the voxel data (null when owned) */
+        VoxelType* m_ptr = nullptr;                 /*!< first voxel */
+        size_t m_size = 0;                          /*!< number of voxels */
+
+
+        inline void syncOwned() { m_ptr = m_owned.data(); m_size = m_owned.size(); }
+
+};
+
+#endif // VOXELSTORAGE_H
@@ -0,0 +1,629 @@
+/*********************************************************************************************************************
+ *
+ * vvolFile.cpp
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+#define NOMINMAX // avoid min*max macros to interfer with std::min/max
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+
+#include "vvolFile.h"
+#include "parallel.h"
+#include "GLtools.h"
+
+
+namespace
+{
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                                FILE LAYOUT                                                  |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+    const char VVOL_MAGIC[8] = { 'V', 'V', 'O', 'L', '0', '0', '0', '1' };
+
+    struct VVolHeader
+    {
+        char magic[8];
+        std::int32_t dimensions[3];
+        float origin[3];
+        float spacing[3];
+        std::uint32_t dataType;
+        std::uint32_t brickSize;
+        std::uint32_t nbBricks;
+        std::uint32_t histogramBins;
+        float valueRange[2];
+        std::uint32_t reserved;
+    };
+    static_assert(sizeof(VVolHeader) == 72, "unexpected padding in VVolHeader");
+    static_assert(sizeof(VVolFile::BrickInfo) == 32, "unexpected padding in VVolFile::BrickInfo");
+
+    size_t sizeOfDataType(std::uint32_t _dataType)
+    {
+        switch (_dataType)
+        {
+            case VVolFile::TYPE_UINT8:   return 1;
+            case VVolFile::TYPE_UINT16:
+            case VVolFile::TYPE_INT16:   return 2;
+            case VVolFile::TYPE_FLOAT32: return 4;
+            default:                     return 0;
+        }
+    }
+
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                                   CODEC                                                     |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+    // Voxels are handled as unsigned integers of their size (UInt = uint8_t, uint16_t, or uint32_t, float
+    // bit patterns included): prediction and residuals use wrap-around arithmetic, which is exactly
+    // invertible, so that the codec is lossless for any datatype.
+
+    // 3D Lorenzo predictor of voxel (x,y,z) from its 7 already decoded neighbors (0 outside brick)
+    template <typename UInt>
+    inline UInt predict(const UInt* _p, int _x, int _y, int _z, size_t _rowStride, size_t _sliceStride)
+    {
+        std::uint32_t a = (_x > 0) ? _p[-1] : 0;
+        std::uint32_t b = (_y > 0) ? _p[-(std::ptrdiff_t)_rowStride] : 0;
+        std::uint32_t c = (_z > 0) ? _p[-(std::ptrdiff_t)_sliceStride] : 0;
+        std::uint32_t ab = (_x > 0 && _y > 0) ? _p[-1 - (std::ptrdiff_t)_rowStride] : 0;
+        std::uint32_t ac = (_x > 0 && _z > 0) ? _p[-1 - (std::ptrdiff_t)_sliceStride] : 0;
+        std::uint32_t bc = (_y > 0 && _z > 0) ? _p[-(std::ptrdiff_t)_rowStride - (std::ptrdiff_t)_sliceStride] : 0;
+        std::uint32_t abc = (_x > 0 && _y > 0 && _z > 0) ? _p[-1 - (std::ptrdiff_t)_rowStride - (std::ptrdiff_t)_sliceStride] : 0;
+        return UInt(a + b + c - ab - ac - bc + abc);
+    }
+
+    inline void putVarint(std::uint32_t _val, std::vector<std::uint8_t>* _out)
+    {
+        while (_val >= 0x80)
+        {
+            _out->push_back(std::uint8_t(_val | 0x80));
+            _val >>= 7;
+        }
+        _out->push_back(std::uint8_t(_val));
+    }
+
+    inline bool getVarint(const std::uint8_t** _src, const std::uint8_t* _end, std::uint32_t* _val)
+    {
+        std::uint32_t val = 0;
+        for (int shift = 0; shift < 35 && *_src < _end; shift += 7)
+        {
+            std::uint8_t byte = *(*_src)++;
+            val |= std::uint32_t(byte & 0x7f) << shift;
+            if (byte < 0x80)
+            {
+                *_val = val;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Encode a brick of _size voxels read with given strides, returns false if it does not shrink
+    template <typename UInt>
+    bool encodeBrick(const UInt* _src, glm::ivec3 _size, size_t _rowStride, size_t _sliceStride, std::vector<std::uint8_t>* _out)
+    {
+        using SInt = std::make_signed_t<UInt>;
+        size_t rawSize = size_t(_size.x) * size_t(_size.y) * size_t(_size.z) * sizeof(UInt);
+        _out->clear();
+        _out->reserve(rawSize / 2);
+
+        std::uint32_t zeroRun = 0;
+        for (int z = 0; z < _size.z; z++)
+        {
+            for (int y = 0; y < _size.y; y++)
+            {
+                const UInt* p = _src + z * _sliceStride + y * _rowStride;
+                for (int x = 0; x < _size.x; x++, p++)
+                {
+                    UInt residual = UInt(*p - predict(p, x, y, z, _rowStride, _sliceStride));
+                    std::int32_t s = SInt(residual);
+                    std::uint32_t zigzag = (std::uint32_t(s) << 1) ^ std::uint32_t(s >> 31);
+
+                    if (zigzag == 0)
+                    {
+                        zeroRun++;
+                        continue;
+                    }
+                    if (zeroRun > 0)
+                    {
+                        // run of zero residuals: 0 followed by run length
+                        putVarint(0, _out);
+                        putVarint(zeroRun, _out);
+                        zeroRun = 0;
+                    }
+                    putVarint(zigzag, _out);
+                }
+            }
+            if (_out->size() >= rawSize)
+                return false;
+        }
+        if (zeroRun > 0)
+        {
+            putVarint(0, _out);
+            putVarint(zeroRun, _out);
+        }
+        return _out->size() < rawSize;
+    }
+
+    // Decode a brick of _size voxels written with given strides
+    template <typename UInt>
+    bool decodeBrickLorenzo(const std::uint8_t* _src, size_t _srcSize, UInt* _dst, glm::ivec3 _size, size_t _rowStride, size_t _sliceStride)
+    {
+        const std::uint8_t* end = _src + _srcSize;
+        std::uint32_t zeroRun = 0;
+        for (int z = 0; z < _size.z; z++)
+        {
+            for (int y = 0; y < _size.y; y++)
+            {
+                UInt* p = _dst + z * _sliceStride + y * _rowStride;
+                for (int x = 0; x < _size.x; x++, p++)
+                {
+                    std::uint32_t zigzag = 0;
+                    if (zeroRun > 0)
+                        zeroRun--;
+                    else
+                    {
+                        if (!getVarint(&_src, end, &zigzag))
+                            return false;
+                        if (zigzag == 0)
+                        {
+                            if (!getVarint(&_src, end, &zeroRun) || zeroRun == 0)
+                                return false;
+                            zeroRun--;
+                        }
+                    }
+                    std::int32_t s = std::int32_t(zigzag >> 1) ^ -std::int32_t(zigzag & 1);
+                    *p = UInt(predict(p, x, y, z, _rowStride, _sliceStride) + UInt(std::uint32_t(s)));
+                }
+            }
+        }
+        return true;
+    }
+
+    // Copy a raw brick with given strides
+    template <typename UInt>
+    void copyBrick(const UInt* _src, glm::ivec3 _size, size_t _srcRowStride, size_t _srcSliceStride,
+                   UInt* _dst, size_t _dstRowStride, size_t _dstSliceStride)
+    {
+        for (int z = 0; z < _size.z; z++)
+            for (int y = 0; y < _size.y; y++)
+                std::memcpy(_dst + z * _dstSliceStride + y * _dstRowStride, _src + z * _srcSliceStride + y * _srcRowStride, _size.x * sizeof(UInt));
+    }
+
+    // Reverse the byte order of a voxel
+    template <typename UInt>
+    inline UInt byteSwap(UInt _v)
+    {
+        if constexpr (sizeof(UInt) == 2)
+            return UInt((_v >> 8) | (_v << 8));
+        else if constexpr (sizeof(UInt) == 4)
+            return (_v >> 24) | ((_v >> 8) & 0xff00u) | ((_v << 8) & 0xff0000u) | (_v << 24);
+        else
+            return _v;
+    }
+
+    // Value of a voxel, byte swapped if needed
+    template <typename VoxelType, typename UInt>
+    inline float voxelValue(const VoxelType* _p, bool _swap)
+    {
+        UInt u;
+        std::memcpy(&u, _p, sizeof(UInt));
+        if (_swap)
+            u = byteSwap(u);
+        VoxelType v;
+        std::memcpy(&v, &u, sizeof(VoxelType));
+        return float(v);
+    }
+
+
+    /*------------------------------------------------------------------------------------------------------------+
+    |                                                 STATISTICS                                                  |
+    +-------------------------------------------------------------------------------------------------------------*/
+
+    // Min and max values of a brick (NaN ignored)
+    template <typename VoxelType>
+    void brickRange(const VoxelType* _src, glm::ivec3 _size, size_t _rowStride, size_t _sliceStride, float* _min, float* _max)
+    {
+        float minVal = std::numeric_limits<float>::max();
+        float maxVal = std::numeric_limits<float>::lowest();
+        for (int z = 0; z < _size.z; z++)
+        {
+            for (int y = 0; y < _size.y; y++)
+            {
+                const VoxelType* p = _src + z * _sliceStride + y * _rowStride;
+                for (int x = 0; x < _size.x; x++)
+                {
+                    float v = float(p[x]);
+                    if (v < minVal)
+                        minVal = v;
+                    if (v > maxVal)
+                        maxVal = v;
+                }
+            }
+        }
+        *_min = minVal;
+        *_max = maxVal;
+    }
+
+    // Add voxels (byte swapped if needed) to a histogram over [_min ; _max]
+    template <typename VoxelType, typename UInt>
+    void histogram(const VoxelType* _src, size_t _nbElem, bool _swap, float _min, float _max, std::vector<std::uint64_t>* _hist)
+    {
+        float scale = (_max > _min) ? float(VVolFile::HISTOGRAM_BINS) / (_max - _min) : 0.0f;
+        std::mutex mutex;
+        Parallel::parallelFor(0, _nbElem, [&](size_t _first, size_t _last)
+        {
+            std::vector<std::uint64_t> hist(VVolFile::HISTOGRAM_BINS, 0);
+            for (size_t i = _first; i < _last; i++)
+            {
+                float v = voxelValue<VoxelType, UInt>(_src + i, _swap);
+                if (v == v) // skip NaN
+                    hist[std::min(VVolFile::HISTOGRAM_BINS - 1, std::max(0, int((v - _min) * scale)))]++;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int b = 0; b < VVolFile::HISTOGRAM_BINS; b++)
+                (*_hist)[b] += hist[b];
+        }, 1 << 16);
+    }
+
+    // Call _func with a null pointer of the voxel type, and of the unsigned integer type of same size
+    template <typename Func>
+    bool dispatchType(std::uint32_t _dataType, Func&& _func)
+    {
+        switch (_dataType)
+        {
+            case VVolFile::TYPE_UINT8:   _func((std::uint8_t*)nullptr, (std::uint8_t*)nullptr); return true;
+            case VVolFile::TYPE_UINT16:  _func((std::uint16_t*)nullptr, (std::uint16_t*)nullptr); return true;
+            case VVolFile::TYPE_INT16:   _func((std::int16_t*)nullptr, (std::uint16_t*)nullptr); return true;
+            case VVolFile::TYPE_FLOAT32: _func((float*)nullptr, (std::uint32_t*)nullptr); return true;
+            default:                     return false;
+        }
+    }
+
+} // anonymous namespace
+
+
+
+std::string VVolFile::getDatatype() const
+{
+    switch (m_dataType)
+    {
+        case TYPE_UINT8:  return "uint8";
+        case TYPE_UINT16: return "uint16";
+        case TYPE_INT16:  return "int16";
+        default:          return "float32";
+    }
+}
+
+
+bool VVolFile::open(const std::string& _filename)
+{
+    if (std::endian::native != std::endian::little)
+    {
+        errorLog() << "VVolFile::open(): .vvol files are only supported on little endian hosts";
+        return false;
+    }
+
+    m_file = std::make_shared<MappedFile>();
+    if (!m_file->open(_filename))
+        return false;
+
+    VVolHeader header;
+    if (m_file->size() < sizeof(VVolHeader))
+    {
+        errorLog() << "VVolFile::open(): " << _filename << " is not a .vvol file";
+        return false;
+    }
+    std::memcpy(&header, m_file->data(), sizeof(VVolHeader));
+    if (std::memcmp(header.magic, VVOL_MAGIC, sizeof(VVOL_MAGIC)) != 0 || sizeOfDataType(header.dataType) == 0
+        || header.brickSize == 0 || header.brickSize > std::uint32_t(std::numeric_limits<std::int32_t>::max())
+        || header.dimensions[0] <= 0 || header.dimensions[1] <= 0 || header.dimensions[2] <= 0
+        || header.histogramBins != HISTOGRAM_BINS)
+    {
+        errorLog() << "VVolFile::open(): " << _filename << " is not a valid .vvol file";
+        return false;
+    }
+
+    m_dimensions = glm::ivec3(header.dimensions[0], header.dimensions[1], header.dimensions[2]);
+    m_origin = glm::vec3(header.origin[0], header.origin[1], header.origin[2]);
+    m_spacing = glm::vec3(header.spacing[0], header.spacing[1], header.spacing[2]);
+    m_dataType = DataType(header.dataType);
+    m_brickSize = int(header.brickSize);
+    for (int a = 0; a < 3; a++)
+        m_nbBricks[a] = int((std::int64_t(m_dimensions[a]) + m_brickSize - 1) / m_brickSize);
+    m_valueRange = glm::vec2(header.valueRange[0], header.valueRange[1]);
+
+    // (the brick count of the header is 32-bit: counts beyond it are rejected before their product can wrap,
+    // and sizes are compared by subtraction from the file size)
+    size_t nbBricksXY = size_t(m_nbBricks.x) * size_t(m_nbBricks.y);
+    size_t nbBricks = nbBricksXY <= header.nbBricks ? nbBricksXY * size_t(m_nbBricks.z) : std::numeric_limits<size_t>::max();
+    size_t fileSize = m_file->size();
+    size_t histogramSize = HISTOGRAM_BINS * sizeof(std::uint64_t);
+    if (header.nbBricks != nbBricks || fileSize - sizeof(VVolHeader) < histogramSize
+        || nbBricks > (fileSize - sizeof(VVolHeader) - histogramSize) / sizeof(BrickInfo))
+    {
+        errorLog() << "VVolFile::open(): invalid brick table in " << _filename;
+        return false;
+    }
+
+    const std::uint8_t* table = m_file->data() + sizeof(VVolHeader);
+    m_bricks.resize(nbBricks);
+    std::memcpy(m_bricks.data(), table, nbBricks * sizeof(BrickInfo));
+    m_histogram.resize(HISTOGRAM_BINS);
+    std::memcpy(m_histogram.data(), table + nbBricks * sizeof(BrickInfo), HISTOGRAM_BINS * sizeof(std::uint64_t));
+
+    size_t voxelSize = sizeOfDataType(m_dataType);
+    for (size_t b = 0; b < nbBricks; b++)
+    {
+        glm::ivec3 bMin, bSize;
+        brickBox(int(b), &bMin, &bSize);
+        const BrickInfo& brick = m_bricks[b];
+        if (brick.offset > fileSize || brick.size > fileSize - brick.offset
+            || (brick.codec == CODEC_RAW && brick.size != size_t(bSize.x) * size_t(bSize.y) * size_t(bSize.z) * voxelSize)
+            || brick.codec > CODEC_LORENZO)
+        {
+            errorLog() << "VVolFile::open(): invalid brick " << b << " in " << _filename;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void VVolFile::brickBox(int _id, glm::ivec3* _min, glm::ivec3* _size) const
+{
+    glm::ivec3 brick(_id % m_nbBricks.x, (_id / m_nbBricks.x) % m_nbBricks.y, _id / (m_nbBricks.x * m_nbBricks.y));
+    *_min = brick * m_brickSize;
+    *_size = glm::min(glm::ivec3(m_brickSize), m_dimensions - *_min);
+}
+
+
+bool VVolFile::decodeBrick(int _id, void* _dst, size_t _rowStride, size_t _sliceStride) const
+{
+    glm::ivec3 bMin, bSize;
+    brickBox(_id, &bMin, &bSize);
+    const BrickInfo& brick = m_bricks[_id];
+    const std::uint8_t* src = m_file->data() + brick.offset;
+
+    bool decoded = false;
+    dispatchType(m_dataType, [&](auto*, auto* _uint)
+    {
+        using UInt = std::remove_pointer_t<decltype(_uint)>;
+        UInt* dst = static_cast<UInt*>(_dst);
+        if (brick.codec == CODEC_RAW)
+        {
+            copyBrick(reinterpret_cast<const UInt*>(src), bSize, size_t(bSize.x), size_t(bSize.x) * size_t(bSize.y),
+                      dst, _rowStride, _sliceStride);
+            decoded = true;
+        }
+        else
+            decoded = decodeBrickLorenzo(src, size_t(brick.size), dst, bSize, _rowStride, _sliceStride);
+    });
+
+    if (!decoded)
+        errorLog() << "VVolFile::decodeBrick(): corrupted brick " << _id;
+    return decoded;
+}
+
+
+bool VVolFile::readBrick(int _id, void* _dst) const
+{
+    if (_id < 0 || _id >= int(m_bricks.size()))
+        return false;
+
+    glm::ivec3 bMin, bSize;
+    brickBox(_id, &bMin, &bSize);
+    return decodeBrick(_id, _dst, size_t(bSize.x), size_t(bSize.x) * size_t(bSize.y));
+}
+
+
+bool VVolFile::readVolume(void* _dst, const std::function<bool()>& _cancelled) const
+{
+    size_t voxelSize = sizeOfDataType(m_dataType);
+    size_t rowStride = size_t(m_dimensions.x);
+    size_t sliceStride = size_t(m_dimensions.x) * size_t(m_dimensions.y);
+
+    // bricks are independent: decode them in parallel, each straight at its place in the volume
+    std::atomic<bool> ok = true;
+    Parallel::parallelFor(0, m_bricks.size(), [&](size_t _first, size_t _last)
+    {
+        for (size_t b = _first; b < _last && ok; b++)
+        {
+            if (_cancelled && _cancelled())
+            {
+                ok = false;
+                break;
+            }
+            glm::ivec3 bMin, bSize;
+            brickBox(int(b), &bMin, &bSize);
+            size_t offset = size_t(bMin.x) + size_t(bMin.y) * rowStride + size_t(bMin.z) * sliceStride;
+            if (!decodeBrick(int(b), static_cast<std::uint8_t*>(_dst) + offset * voxelSize, rowStride, sliceStride))
+                ok = false;
+        }
+    });
+
+    return ok;
+}
+
+
+bool VVolFile::write(const std::string& _filename, const void* _data, DataType _dataType,
+                     glm::ivec3 _dimensions, glm::vec3 _origin, glm::vec3 _spacing, int _brickSize,
+                     bool _swapBytes, const std::function<bool()>& _cancelled)
+{
+    if (std::endian::native != std::endian::little)
+    {
+        errorLog() << "VVolFile::write(): .vvol files are only supported on little endian hosts";
+        return false;
+    }
+    if (sizeOfDataType(_dataType) == 0 || _brickSize <= 0)
+        return false;
+
+    VVolFile layout;
+    layout.m_dimensions = _dimensions;
+    layout.m_brickSize = _brickSize;
+    layout.m_nbBricks = (_dimensions + glm::ivec3(_brickSize - 1)) / _brickSize;
+    size_t nbBricks = size_t(layout.m_nbBricks.x) * size_t(layout.m_nbBricks.y) * size_t(layout.m_nbBricks.z);
+    size_t rowStride = size_t(_dimensions.x);
+    size_t sliceStride = size_t(_dimensions.x) * size_t(_dimensions.y);
+    size_t nbVoxels = sliceStride * size_t(_dimensions.z);
+    size_t layerSize = size_t(layout.m_nbBricks.x) * size_t(layout.m_nbBricks.y);
+
+    // written to a temporary file, renamed once complete: a failed or cancelled write leaves no partial file
+    std::string tmpFilename = _filename + ".tmp";
+    std::ofstream file(tmpFilename, std::ios::binary);
+    if (!file)
+    {
+        errorLog() << "VVolFile::write(): could not open " << tmpFilename;
+        return false;
+    }
+
+    // payloads are compressed and written one layer of bricks (along Z) at a time, so that memory use
+    // does not depend on the volume size (e.g. when converting a mapped volume larger than RAM);
+    // header, brick table and histogram are written last, once known
+    std::vector<BrickInfo> bricks(nbBricks);
+    glm::vec2 range(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+    std::vector<std::uint64_t> hist(HISTOGRAM_BINS, 0);
+    std::uint64_t offset = sizeof(VVolHeader) + nbBricks * sizeof(BrickInfo) + HISTOGRAM_BINS * sizeof(std::uint64_t);
+    file.seekp(std::streamoff(offset));
+    bool cancelled = false;
+
+    dispatchType(_dataType, [&](auto* _type, auto* _uint)
+    {
+        using VoxelType = std::remove_pointer_t<decltype(_type)>;
+        using UInt = std::remove_pointer_t<decltype(_uint)>;
+        const VoxelType* data = static_cast<const VoxelType*>(_data);
+
+        std::vector<std::vector<std::uint8_t>> payloads(layerSize);
+        for (size_t layer = 0; layer < nbBricks && !cancelled; layer += layerSize)
+        {
+            cancelled = _cancelled && _cancelled();
+            if (cancelled)
+                break;
+
+            // compress bricks of the layer and compute their min/max in parallel
+            Parallel::parallelFor(layer, layer + layerSize, [&](size_t _first, size_t _last)
+            {
+                std::vector<UInt> swapped;
+                for (size_t b = _first; b < _last; b++)
+                {
+                    glm::ivec3 bMin, bSize;
+                    layout.brickBox(int(b), &bMin, &bSize);
+                    const UInt* src = reinterpret_cast<const UInt*>(data + size_t(bMin.x) + size_t(bMin.y) * rowStride + size_t(bMin.z) * sliceStride);
+                    size_t srcRowStride = rowStride, srcSliceStride = sliceStride;
+                    std::vector<std::uint8_t>& payload = payloads[b - layer];
+
+                    // source data in the other byte order (e.g. mapped file): brick swapped into a copy,
+                    // so that the source is only read (mapped pages are not made private)
+                    if (_swapBytes)
+                    {
+                        srcRowStride = size_t(bSize.x);
+                        srcSliceStride = size_t(bSize.x) * size_t(bSize.y);
+                        swapped.resize(srcSliceStride * size_t(bSize.z));
+                        copyBrick(src, bSize, rowStride, sliceStride, swapped.data(), srcRowStride, srcSliceStride);
+                        for (UInt& v : swapped)
+                            v = byteSwap(v);
+                        src = swapped.data();
+                    }
+
+                    BrickInfo& brick = bricks[b];
+                    std::memset(&brick, 0, sizeof(BrickInfo));
+                    brickRange(reinterpret_cast<const VoxelType*>(src), bSize, srcRowStride, srcSliceStride, &brick.minVal, &brick.maxVal);
+
+                    brick.codec = CODEC_LORENZO;
+                    if (!encodeBrick(src, bSize, srcRowStride, srcSliceStride, &payload))
+                    {
+                        // incompressible brick: store it raw
+                        brick.codec = CODEC_RAW;
+                        payload.resize(size_t(bSize.x) * size_t(bSize.y) * size_t(bSize.z) * sizeof(UInt));
+                        copyBrick(src, bSize, srcRowStride, srcSliceStride,
+                                  reinterpret_cast<UInt*>(payload.data()), size_t(bSize.x), size_t(bSize.x) * size_t(bSize.y));
+                    }
+                    brick.size = payload.size();
+                }
+            });
+
+            for (size_t b = layer; b < layer + layerSize; b++)
+            {
+                bricks[b].offset = offset;
+                offset += bricks[b].size;
+                file.write(reinterpret_cast<const char*>(payloads[b - layer].data()), payloads[b - layer].size());
+                range.x = std::min(range.x, bricks[b].minVal);
+                range.y = std::max(range.y, bricks[b].maxVal);
+            }
+        }
+        if (range.y < range.x)
+            range = glm::vec2(0.0f);
+
+        // histogram over the whole range, layer by layer too
+        for (int z = 0; z < _dimensions.z && !cancelled; z += _brickSize)
+        {
+            cancelled = _cancelled && _cancelled();
+            size_t nbSlices = size_t(std::min(_brickSize, _dimensions.z - z));
+            if (!cancelled)
+                histogram<VoxelType, UInt>(data + size_t(z) * sliceStride, nbSlices * sliceStride, _swapBytes, range.x, range.y, &hist);
+        }
+    });
+
+    VVolHeader header;
+    std::memset(&header, 0, sizeof(VVolHeader));
+    std::memcpy(header.magic, VVOL_MAGIC, sizeof(VVOL_MAGIC));
+    for (int i = 0; i < 3; i++)
+    {
+        header.dimensions[i] = _dimensions[i];
+        header.origin[i] = _origin[i];
+        header.spacing[i] = _spacing[i];
+    }
+    header.dataType = _dataType;
+    header.brickSize = std::uint32_t(_brickSize);
+    header.nbBricks = std::uint32_t(nbBricks);
+    header.histogramBins = HISTOGRAM_BINS;
+    header.valueRange[0] = range.x;
+    header.valueRange[1] = range.y;
+
+    if (!cancelled)
+    {
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(VVolHeader));
+        file.write(reinterpret_cast<const char*>(bricks.data()), nbBricks * sizeof(BrickInfo));
+        file.write(reinterpret_cast<const char*>(hist.data()), HISTOGRAM_BINS * sizeof(std::uint64_t));
+    }
+    file.close();
+
+    std::error_code error;
+    if (cancelled || !file)
+    {
+        if (cancelled)
+            std::cout << "[INFO] VVolFile::write(): writing of " << _filename << " cancelled" << std::endl;
+        else
+            errorLog() << "VVolFile::write(): could not write " << tmpFilename;
+        std::filesystem::remove(tmpFilename, error);
+        return false;
+    }
+
+    std::filesystem::rename(tmpFilename, _filename, error);
+    if (error)
+    {
+        errorLog() << "VVolFile::write(): could not write " << _filename;
+        std::filesystem::remove(tmpFilename, error);
+        return false;
+    }
+
+    std::cout << "[INFO] VVolFile::write(): " << _filename << ": " << nbBricks << " bricks, "
+              << nbVoxels * sizeOfDataType(_dataType) / 1024 << " KB -> " << offset / 1024 << " KB" << std::endl;
+    return true;
+}
@@ -0,0 +1,183 @@
+/*********************************************************************************************************************
+ *
+ * vvolFile.h
+ *
+ * Native volume container (.vvol): independently compressed bricks, per-brick min/max and histogram
+ *
+ * Vol_viewer
+ * Ludovic Blache
+ *
+ *********************************************************************************************************************/
+
+
+#ifndef VVOLFILE_H
+#define VVOLFILE_H
+
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "mappedFile.h"
+
+
+/*!
+* \class VVolFile
+* \brief Reader / writer of .vvol files
+* A .vvol file stores a volume (uint8, uint16, int16 or float32 voxels) as bricks of brickSize^3 voxels
+* (smaller on the borders), in X, then Y, then Z order. Each brick is compressed independently, with a lossless
+* codec: 3D Lorenzo prediction of each voxel from its already decoded neighbors, zigzag + varint coding of the
+* residuals, and run-length coding of zero residuals (uniform areas such as air). A brick that would not shrink
+* is stored raw. All values are little endian. Layout:
+*
+*   Header          magic "VVOL0001", dimensions, origin, spacing, datatype, brick size, value range
+*   BrickInfo[]     offset and size of the payload, codec, min and max value of each brick
+*   uint64[]        histogram of all voxels (HISTOGRAM_BINS bins over the value range)
+*   payloads        compressed bricks
+*
+* Bricks are decoded straight from the mapped file, either all in parallel into a volume (readVolume()), or one
+* at a time (readBrick()) e.g. for sub-region lookups, using per-brick min/max to skip bricks.
+*/
+class VVolFile
+{
+    public:
+
+        /*! Voxel types (stored as uint32) */
+        enum DataType : std::uint32_t { TYPE_UINT8 = 0, TYPE_UINT16 = 1, TYPE_INT16 = 2, TYPE_FLOAT32 = 3 };
+
+        /*! Codecs of a brick payload (stored as uint32) */
+        enum Codec : std::uint32_t { CODEC_RAW = 0, CODEC_LORENZO = 1 };
+
+        /*! Entry of the brick table */
+        struct BrickInfo
+        {
+            std::uint64_t offset;   /*!< offset of payload in file (bytes) */
+            std::uint64_t size;     /*!< size of payload (bytes) */
+            float minVal;           /*!< min value in brick */
+            float maxVal;           /*!< max value in brick */
+            std::uint32_t codec;    /*!< codec of payload (see Codec) */
+            std::uint32_t reserved;
+        };
+
+        static const int HISTOGRAM_BINS = 256;      /*!< number of bins of the histogram */
+        static const int DEFAULT_BRICK_SIZE = 32;   /*!< default brick size (voxels) */
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                        CONSTRUCTORS / DESTRUCTORS                                           |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        VVolFile() {}
+
+        virtual ~VVolFile() {}
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                GETTERS                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        inline glm::ivec3 getDimensions() const { return m_dimensions; }
+        inline glm::vec3 getOrigin() const { return m_origin; }
+        inline glm::vec3 getSpacing() const { return m_spacing; }
+        inline DataType getDataType() const { return m_dataType; }
+        /*! \fn getDatatype : datatype name, as used by VolumeBase ("uint8", "uint16", "int16", or "float32") */
+        std::string getDatatype() const;
+        inline int getBrickSize() const { return m_brickSize; }
+        /*! \fn getNbBricks : number of bricks along each axis */
+        inline glm::ivec3 getNbBricks() const { return m_nbBricks; }
+        inline const std::vector<BrickInfo>& getBrickInfos() const { return m_bricks; }
+        inline glm::vec2 getValueRange() const { return m_valueRange; }
+        inline const std::vector<std::uint64_t>& getHistogram() const { return m_histogram; }
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                   MISC                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*!
+        * \fn open
+        * \brief Map a .vvol file and read its header, brick table and histogram
+        * \param _filename : name of file to open
+        * \return true if the file is a valid .vvol file, false otherwise
+        */
+        bool open(const std::string& _filename);
+
+        /*!
+        * \fn brickBox
+        * \brief Voxel box covered by a brick
+        * \param _id : brick index (X, then Y, then Z order)
+        * \param _min : first voxel of the brick
+        * \param _size : number of voxels of the brick along each axis
+        */
+        void brickBox(int _id, glm::ivec3* _min, glm::ivec3* _size) const;
+
+        /*!
+        * \fn readBrick
+        * \brief Decode a single brick into a dense array
+        * \param _id : brick index (X, then Y, then Z order)
+        * \param _dst : array of _size.x * _size.y * _size.z voxels (see brickBox()), of file datatype
+        * \return true if decoding succeeded, false otherwise
+        */
+        bool readBrick(int _id, void* _dst) const;
+
+        /*!
+        * \fn readVolume
+        * \brief Decode all bricks (in parallel) straight into a volume array
+        * \param _dst : array of dimensions.x * dimensions.y * dimensions.z voxels, of file datatype
+        * \param _cancelled : if set, called between bricks: decoding stops (and fails) when it returns true
+        * \return true if decoding succeeded, false otherwise
+        */
+        bool readVolume(void* _dst, const std::function<bool()>& _cancelled = nullptr) const;
+
+        /*!
+        * \fn write
+        * \brief Compress (in parallel) and write a volume into a .vvol file
+        * \param _filename : name of file to write
+        * \param _data : voxels, X, then Y, then Z order
+        * \param _dataType : voxel type of _data
+        * \param _dimensions, _origin, _spacing : volume attributes
+        * \param _brickSize : brick size (voxels)
+        * \param _swapBytes : if true, _data are in the other byte order (swapped brick by brick, _data are not modified)
+        * \param _cancelled : if set, called between layers of bricks: writing stops (and fails) when it returns true
+        * \return true if writing succeeded, false otherwise (no file is then left)
+        */
+        static bool write(const std::string& _filename, const void* _data, DataType _dataType,
+                          glm::ivec3 _dimensions, glm::vec3 _origin, glm::vec3 _spacing, int _brickSize = DEFAULT_BRICK_SIZE,
+                          bool _swapBytes = false, const std::function<bool()>& _cancelled = nullptr);
+
+
+    protected:
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                ATTRIBUTES                                                   |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        std::shared_ptr<MappedFile> m_file;                 /*!< mapped file */
+        glm::ivec3 m_dimensions = glm::ivec3(0);            /*!< volume dimensions */
+        glm::vec3 m_origin = glm::vec3(0.0f);               /*!< volume origin */
+        glm::vec3 m_spacing = glm::vec3(1.0f);              /*!< voxel spacing */
+        DataType m_dataType = TYPE_UINT8;                   /*!< voxel type */
+        int m_brickSize = DEFAULT_BRICK_SIZE;               /*!< brick size (voxels) */
+        glm::ivec3 m_nbBricks = glm::ivec3(0);              /*!< number of bricks along each axis */
+        glm::vec2 m_valueRange = glm::vec2(0.0f);           /*!< min and max values of volume */
+        std::vector<BrickInfo> m_bricks;                    /*!< brick table */
+        std::vector<std::uint64_t> m_histogram;             /*!< histogram of all voxels */
+
+
+        /*------------------------------------------------------------------------------------------------------------+
+        |                                                   MISC                                                      |
+        +-------------------------------------------------------------------------------------------------------------*/
+
+        /*!
+        * \fn decodeBrick
+        * \brief Decode a brick into an array with given row and slice strides (in voxels)
+        */
+        bool decodeBrick(int _id, void* _dst, size_t _rowStride, size_t _sliceStride) const;
+
+};
+
+#endif // VVOLFILE_H